@@ -0,0 +1,102 @@
+#include "BarnesHut3D.h"
+#include <cmath>
+
+BarnesHut3D::BarnesHut3D(TaskScheduler& scheduler) : scheduler(scheduler), octree(scheduler) {}
+
+void BarnesHut3D::Build(const std::vector<glm::vec3>& positions, uint32_t leafCapacity) {
+    octree.Build(positions, leafCapacity);
+    const std::vector<Octree::Node>& nodes = octree.GetNodes();
+    const std::vector<glm::vec3>& points = octree.GetSortedPoints();
+    nodeMasses.resize(nodes.size());
+
+    // Nodes are stored level by level, so each level is one contiguous range
+    levelStarts.clear();
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        if (n == 0 || nodes[n].level != nodes[n - 1].level) levelStarts.push_back(n);
+    }
+    levelStarts.push_back(nodes.size());
+
+    // Deepest level first, so every inner node finds its children done
+    for (size_t level = levelStarts.size() - 1; level > 0; --level) {
+        scheduler.ParallelFor(levelStarts[level - 1], levelStarts[level], 64, [&](size_t begin, size_t end) {
+            for (size_t n = begin; n < end; ++n) {
+                const Octree::Node& node = nodes[n];
+                glm::vec3 weighted(0.0f);
+                if (node.childCount == 0) {
+                    for (uint32_t i = node.firstPoint; i < node.firstPoint + node.pointCount; ++i) weighted += points[i];
+                }
+                else {
+                    for (uint32_t c = node.firstChild; c < node.firstChild + node.childCount; ++c) weighted += glm::vec3(nodeMasses[c]) * nodeMasses[c].w;
+                }
+                float mass = static_cast<float>(node.pointCount);
+                nodeMasses[n] = glm::vec4(weighted / mass, mass);
+            }
+        });
+    }
+}
+
+size_t BarnesHut3D::ComputeAccelerations(float strength, float softening, float theta, std::vector<glm::vec3>& accelerations) const {
+    const std::vector<Octree::Node>& nodes = octree.GetNodes();
+    const std::vector<glm::vec3>& points = octree.GetSortedPoints();
+    const std::vector<uint32_t>& indices = octree.GetPointIndices();
+    accelerations.resize(points.size());
+    if (nodes.empty()) return 0;
+
+    float sqrSoftening = softening * softening;
+    float sqrTheta = theta * theta;
+    return scheduler.ParallelReduce(size_t(0), points.size(), ParticleGrain, size_t(0),
+        [&](size_t begin, size_t end) {
+            size_t interactions = 0;
+            uint32_t stack[Octree::StackSize];
+            for (size_t s = begin; s < end; ++s) {
+                const glm::vec3 point = points[s];
+                glm::vec3 accel(0.0f);
+                int stackSize = 0;
+                stack[stackSize++] = 0;
+                while (stackSize > 0) {
+                    uint32_t n = stack[--stackSize];
+                    const Octree::Node& node = nodes[n];
+                    glm::vec3 offset = glm::vec3(nodeMasses[n]) - point;
+                    float sqrDst = glm::dot(offset, offset);
+                    // A node around the point is always opened, however far its centre of mass is
+                    bool inside = glm::all(glm::greaterThanEqual(point, node.boundsMin)) && glm::all(glm::lessThanEqual(point, node.boundsMin + node.size));
+                    if (!inside && node.size * node.size < sqrTheta * sqrDst) {
+                        float denominator = sqrDst + sqrSoftening;
+                        accel += offset * (nodeMasses[n].w / (denominator * std::sqrt(denominator)));
+                        ++interactions;
+                    }
+                    else if (node.childCount == 0) {
+                        // The point itself adds nothing: its offset is zero
+                        for (uint32_t i = node.firstPoint; i < node.firstPoint + node.pointCount; ++i) {
+                            glm::vec3 pairOffset = points[i] - point;
+                            float denominator = glm::dot(pairOffset, pairOffset) + sqrSoftening;
+                            accel += pairOffset / (denominator * std::sqrt(denominator));
+                        }
+                        interactions += node.pointCount;
+                    }
+                    else {
+                        for (uint32_t c = node.childCount; c > 0; --c) stack[stackSize++] = node.firstChild + c - 1;
+                    }
+                }
+                accelerations[indices[s]] = strength * accel;
+            }
+            return interactions;
+        },
+        [](size_t a, size_t b) { return a + b; });
+}
+
+void BarnesHut3D::ComputeDirect(const std::vector<glm::vec3>& positions, float strength, float softening, std::vector<glm::vec3>& accelerations) const {
+    float sqrSoftening = softening * softening;
+    accelerations.resize(positions.size());
+    scheduler.ParallelFor(0, positions.size(), ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec3 accel(0.0f);
+            for (const glm::vec3& other : positions) {
+                glm::vec3 offset = other - positions[i];
+                float denominator = glm::dot(offset, offset) + sqrSoftening;
+                accel += offset / (denominator * std::sqrt(denominator));
+            }
+            accelerations[i] = strength * accel;
+        }
+    });
+}
@@ -0,0 +1,43 @@
+#ifndef BARNES_HUT_3D_H
+#define BARNES_HUT_3D_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Octree.h"
+#include "TaskScheduler.h"
+
+// Long-range attraction between all particles in O(N log N), for self-gravitating blobs and
+// cohesion over distances the SPH kernels do not reach. Every particle has unit mass and pulls on
+// every other with strength * r / (|r|^2 + softening^2)^1.5.
+// Build sorts the points into an Octree and stores the centre of mass of every node, leaves
+// first. Each particle then walks the tree on its own: a node seen under an angle below theta
+// (node size / distance to its centre of mass) acts as one mass, otherwise it is opened.
+// Particles are walked in Morton order, so neighbouring walks visit the same nodes.
+class BarnesHut3D {
+public:
+    explicit BarnesHut3D(TaskScheduler& scheduler = TaskScheduler::Instance());
+
+    void Build(const std::vector<glm::vec3>& positions, uint32_t leafCapacity = DefaultLeafCapacity);
+    // Acceleration of every point given to Build. Returns the number of point and node
+    // interactions evaluated; theta = 0 opens every node and gives the direct sum.
+    size_t ComputeAccelerations(float strength, float softening, float theta, std::vector<glm::vec3>& accelerations) const;
+    // Reference O(N^2) sum over all pairs, to measure the error of ComputeAccelerations.
+    void ComputeDirect(const std::vector<glm::vec3>& positions, float strength, float softening, std::vector<glm::vec3>& accelerations) const;
+
+    const Octree& GetOctree() const { return octree; }
+
+    static const uint32_t DefaultLeafCapacity = 8;
+    static const size_t ParticleGrain = 256;
+
+private:
+    TaskScheduler& scheduler;
+    Octree octree;
+    // Centre of mass of every node in xyz and its mass, the point count, in w
+    std::vector<glm::vec4> nodeMasses;
+    std::vector<size_t> levelStarts;
+};
+
+#endif // BARNES_HUT_3D_H
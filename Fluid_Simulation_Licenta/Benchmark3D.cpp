@@ -0,0 +1,1005 @@
+#include "Benchmark3D.h"
+#include "BarnesHut3D.h"
+#include "BoundarySDF3D.h"
+#include "FluidSolverAPIC3D.h"
+#include "FluidSolverCPU3D.h"
+#include "MultigridPoisson3D.h"
+#include "Octree.h"
+#include "Philox.h"
+#include "Profiler.h"
+#include "RadixSort.h"
+#include "TaskScheduler.h"
+#include "TriangleMesh3D.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <sstream>
+
+#ifdef FLUID_HEADLESS_GL
+#include "FluidSolverGPU3D.h"
+#include "GPUSort.h"
+#include "HeadlessGLContext.h"
+#include "MultigridPoissonGPU3D.h"
+#endif
+
+namespace {
+    // Compulsory traffic per particle: every column a phase reads or writes, counted once.
+    // Neighbour reads that hit the cache again are not included.
+    const std::map<std::string, double> BytesPerParticle = {
+        { "hash", sizeof(glm::vec3) + 2 * sizeof(uint32_t) },
+        { "fill", 3 * sizeof(uint32_t) },
+        { "fill_incremental", 3 * sizeof(uint32_t) },
+        { "fill_deterministic", 5 * sizeof(uint32_t) },
+        { "density", sizeof(glm::vec3) + sizeof(glm::vec2) },
+        { "pressure", sizeof(glm::vec3) + sizeof(glm::vec2) + 2 * sizeof(glm::vec3) },
+        { "pressure_dfsph", 2 * sizeof(glm::vec3) + 6 * sizeof(float) },
+        { "pressure_pbf", 4 * sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(float) },
+        { "viscosity", 3 * sizeof(glm::vec3) },
+        { "integration", 3 * sizeof(glm::vec3) },
+        { "collision", 4 * sizeof(glm::vec3) },
+        { "readback", 4 * sizeof(glm::vec3) },
+        { "step", 13 * sizeof(glm::vec3) + 2 * sizeof(glm::vec2) },
+    };
+
+    // Compulsory traffic per cell of a V-cycle: four sweeps of 4 floats, the residual (4), the
+    // restriction (2) and the prolongation (4) on the finest level, plus a seventh for the coarser ones
+    const double VCycleBytesPerCell = 30.0 * sizeof(float);
+
+    // The Poisson solves run until the largest residual has fallen by this much. Plain V-cycles in
+    // single precision level off not far below it, where the recomputed residual is round-off.
+    const float PoissonTolerance = 1e-4f;
+    const int MaxPoissonCycles = 100;
+    // The GL multigrid is checked against the CPU one after this many cycles from zero. Both run
+    // the same red-black sweeps, so only the float rounding of their sums may differ.
+    const int PoissonCompareCycles = 4;
+    const float PoissonCompareTolerance = 1e-3f;
+
+    // Key and value read plus written once per pass
+    const double SortBytesPerPass = 4.0 * sizeof(uint32_t);
+
+    // The all-pairs GPU shader is O(n^2); above this it would run for hours
+    const size_t MaxAllPairsParticles = 100000;
+
+    template <typename Func>
+    std::vector<double> Measure(size_t repetitions, Func&& func) {
+        std::vector<double> milliseconds;
+        milliseconds.reserve(repetitions);
+        for (size_t i = 0; i < repetitions; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            func();
+            milliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        return milliseconds;
+    }
+
+    std::vector<std::string> SplitList(const std::string& text) {
+        std::vector<std::string> items;
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            if (!item.empty()) items.push_back(item);
+        }
+        return items;
+    }
+
+    std::string JsonEscape(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') escaped += '\\';
+            if (static_cast<unsigned char>(c) < 0x20) continue;
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    // Same compare-exchange network as shaders/BitonicMergeSort.comp, one ParallelFor per step.
+    void BitonicSortPairs(TaskScheduler& scheduler, std::vector<uint32_t>& keys, std::vector<uint32_t>& values) {
+        size_t count = keys.size();
+        size_t size = 1;
+        while (size < count) size <<= 1;
+        keys.resize(size, 0xFFFFFFFFu);
+        values.resize(size, 0xFFFFFFFFu);
+
+        for (size_t k = 2; k <= size; k <<= 1) {
+            for (size_t j = k >> 1; j > 0; j >>= 1) {
+                scheduler.ParallelFor(0, size, 16384, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; ++i) {
+                        size_t partner = i ^ j;
+                        if (partner <= i) continue;
+                        bool ascending = (i & k) == 0;
+                        bool outOfOrder = keys[i] > keys[partner] || (keys[i] == keys[partner] && values[i] > values[partner]);
+                        if (outOfOrder == ascending) {
+                            std::swap(keys[i], keys[partner]);
+                            std::swap(values[i], values[partner]);
+                        }
+                    }
+                });
+            }
+        }
+
+        keys.resize(count);
+        values.resize(count);
+    }
+
+    // The pointer octree the linear one replaced: one heap node per split, points kept in every
+    // node that filled up before splitting, queries return a new vector per node.
+    class PointerOctree {
+    public:
+        PointerOctree(const glm::vec3& centre, float halfSize, size_t capacity)
+            : centre(centre), halfSize(halfSize), capacity(capacity), divided(false) {}
+
+        bool Insert(const glm::vec3& point) {
+            if (glm::any(glm::greaterThan(glm::abs(point - centre), glm::vec3(halfSize)))) return false;
+            if (points.size() < capacity) {
+                points.push_back(point);
+                return true;
+            }
+            if (!divided) Subdivide();
+            for (int i = 0; i < 8; ++i) {
+                if (children[i]->Insert(point)) return true;
+            }
+            return false;
+        }
+
+        std::vector<glm::vec3> QueryRange(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const {
+            std::vector<glm::vec3> found;
+            if (glm::any(glm::greaterThan(centre - halfSize, boundsMax)) || glm::any(glm::lessThan(centre + halfSize, boundsMin))) return found;
+            for (const glm::vec3& point : points) {
+                if (glm::all(glm::greaterThanEqual(point, boundsMin)) && glm::all(glm::lessThanEqual(point, boundsMax))) found.push_back(point);
+            }
+            if (divided) {
+                for (int i = 0; i < 8; ++i) {
+                    std::vector<glm::vec3> childPoints = children[i]->QueryRange(boundsMin, boundsMax);
+                    found.insert(found.end(), childPoints.begin(), childPoints.end());
+                }
+            }
+            return found;
+        }
+
+    private:
+        void Subdivide() {
+            float half = halfSize * 0.5f;
+            for (int i = 0; i < 8; ++i) {
+                glm::vec3 offset((i & 1) ? half : -half, (i & 2) ? half : -half, (i & 4) ? half : -half);
+                children[i].reset(new PointerOctree(centre + offset, half, capacity));
+            }
+            divided = true;
+        }
+
+        glm::vec3 centre;
+        float halfSize;
+        size_t capacity;
+        bool divided;
+        std::vector<glm::vec3> points;
+        std::unique_ptr<PointerOctree> children[8];
+    };
+
+    // A cube of size^3 unit cells: a sphere from the boundary field is wall, the top eighth is air and
+    // outside the cube is wall. The right-hand side is noise on the cells solved for, which every
+    // frequency of the error has to be smoothed out of.
+    void BuildPoissonDomain(int size, std::vector<uint8_t>& types, std::vector<float>& rhs) {
+        const uint32_t PoissonKey = 0x706F6973u;
+        glm::ivec3 dims(size);
+        float extent = static_cast<float>(size);
+        Obstacle3D sphere;
+        sphere.shape = Obstacle3D::Shape::Sphere;
+        sphere.centre = glm::vec3(0.5f, 0.4f, 0.5f) * extent;
+        sphere.size = glm::vec3(0.4f * extent);
+
+        BoundarySDF3D boundary;
+        boundary.SetResolution(size);
+        boundary.Bake(glm::vec3(0.0f), glm::vec3(extent), std::vector<Obstacle3D>(1, sphere));
+        MultigridPoisson3D::ClassifyFromSDF(boundary, glm::vec3(0.0f), 1.0f, dims, MultigridPoisson3D::Neumann, types);
+
+        int airStart = size - size / 8;
+        rhs.assign(types.size(), 0.0f);
+        for (int z = 0; z < size; ++z) {
+            for (int y = 0; y < size; ++y) {
+                for (int x = 0; x < size; ++x) {
+                    size_t index = (static_cast<size_t>(z) * size + y) * size + x;
+                    if (types[index] != MultigridPoisson3D::Interior) continue;
+                    if (y >= airStart) {
+                        types[index] = MultigridPoisson3D::Dirichlet;
+                        continue;
+                    }
+                    Philox4x32 random = Philox4x32::Generate(static_cast<uint32_t>(index), 0, 0, 0, 0, PoissonKey);
+                    rhs[index] = Philox4x32::ToUnitFloat(random.v[0]) - 0.5f;
+                }
+            }
+        }
+    }
+
+    std::string PoissonNote(const MultigridPoisson3D::SolveStats& stats, const std::string& unit) {
+        std::ostringstream note;
+        note << stats.iterations << " " << unit << " to " << PoissonTolerance << ", residual " << stats.error
+            << ", convergence factor " << std::pow(static_cast<double>(std::max(stats.error, 1e-30f)), 1.0 / std::max(stats.iterations, 1));
+        return note.str();
+    }
+
+    size_t BitonicStepCount(size_t count) {
+        size_t stages = 0;
+        while ((size_t(1) << stages) < count) ++stages;
+        return stages * (stages + 1) / 2;
+    }
+}
+
+void BenchmarkSuite3D::PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+        << "  --sizes N,N,...          particle counts for the phase benchmarks (default: 10000,100000,1000000,4000000)\n"
+        << "  --scenes A,B,...         scenes for the full-step benchmarks, 'none' to skip\n"
+        << "  --backends cpu,gl        backends to run (gl needs FLUID_HEADLESS_GL)\n"
+        << "  --bake-triangles N,N,... triangles of the meshes for the boundary bake benchmark, 'none' to skip (default: 1000000)\n"
+        << "  --bake-resolution N      cells along the box for the boundary bake (default: 256)\n"
+        << "  --octree-points N,N,...  points for the octree build and query benchmark, 'none' to skip (default: 1000000)\n"
+        << "  --long-range N,N,...     particles for the Barnes-Hut vs direct sum benchmark, 'none' to skip (default: 20000)\n"
+        << "  --theta T,T,...          Barnes-Hut opening angles to compare (default: 0.3,0.5,0.8)\n"
+        << "  --poisson N,N,...        cells per side of the multigrid Poisson benchmark, 'none' to skip (default: 128,256)\n"
+        << "  --repetitions N          timed repetitions per phase (default: 5)\n"
+        << "  --scene-steps N          steps per scene run (default: 50)\n"
+        << "  --threads N              CPU worker threads, 0 = all hardware threads\n"
+        << "  --pin                    pin CPU workers to cores\n"
+        << "  --output FILE            JSON report (default: benchmark.json)\n"
+        << "  --label TEXT             free text stored in the report, e.g. the commit id\n"
+        << "  --shader-dir DIR         directory of the compute shaders (default: shaders/)" << std::endl;
+}
+
+bool BenchmarkSuite3D::ParseArguments(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto nextValue = [&](std::string& value) {
+            if (i + 1 >= argc) {
+                std::cerr << "BenchmarkSuite3D Error: Missing value for " << arg << std::endl;
+                return false;
+            }
+            value = argv[++i];
+            return true;
+        };
+
+        std::string value;
+        if (arg == "--help" || arg == "-h") {
+            PrintUsage(argv[0]);
+            return false;
+        }
+        else if (arg == "--pin") options.pinThreads = true;
+        else if (arg == "--output") { if (!nextValue(options.outputFile)) return false; }
+        else if (arg == "--label") { if (!nextValue(options.label)) return false; }
+        else if (arg == "--shader-dir") { if (!nextValue(options.shaderDirectory)) return false; }
+        else if (arg == "--backends") { if (!nextValue(value)) return false; options.backends = SplitList(value); }
+        else if (arg == "--scenes") {
+            if (!nextValue(value)) return false;
+            options.scenes = value == "none" ? std::vector<std::string>() : SplitList(value);
+        }
+        else if (arg == "--bake-triangles") {
+            if (!nextValue(value)) return false;
+            options.bakeTriangles.clear();
+            if (value != "none") {
+                for (const std::string& item : SplitList(value)) options.bakeTriangles.push_back(std::strtoull(item.c_str(), nullptr, 10));
+            }
+        }
+        else if (arg == "--bake-resolution") { if (!nextValue(value)) return false; options.bakeResolution = std::max(2, std::atoi(value.c_str())); }
+        else if (arg == "--octree-points") {
+            if (!nextValue(value)) return false;
+            options.octreePoints.clear();
+            if (value != "none") {
+                for (const std::string& item : SplitList(value)) options.octreePoints.push_back(std::strtoull(item.c_str(), nullptr, 10));
+            }
+        }
+        else if (arg == "--long-range") {
+            if (!nextValue(value)) return false;
+            options.longRangeParticles.clear();
+            if (value != "none") {
+                for (const std::string& item : SplitList(value)) options.longRangeParticles.push_back(std::strtoull(item.c_str(), nullptr, 10));
+            }
+        }
+        else if (arg == "--poisson") {
+            if (!nextValue(value)) return false;
+            options.poissonSizes.clear();
+            if (value != "none") {
+                for (const std::string& item : SplitList(value)) options.poissonSizes.push_back(std::max(2, std::atoi(item.c_str())));
+            }
+        }
+        else if (arg == "--theta") {
+            if (!nextValue(value)) return false;
+            options.barnesHutThetas.clear();
+            for (const std::string& item : SplitList(value)) options.barnesHutThetas.push_back(static_cast<float>(std::atof(item.c_str())));
+        }
+        else if (arg == "--sizes") {
+            if (!nextValue(value)) return false;
+            options.sizes.clear();
+            for (const std::string& item : SplitList(value)) options.sizes.push_back(std::strtoull(item.c_str(), nullptr, 10));
+        }
+        else if (arg == "--repetitions") { if (!nextValue(value)) return false; options.repetitions = std::max<size_t>(1, std::strtoull(value.c_str(), nullptr, 10)); }
+        else if (arg == "--scene-steps") { if (!nextValue(value)) return false; options.sceneSteps = std::max<size_t>(1, std::strtoull(value.c_str(), nullptr, 10)); }
+        else if (arg == "--threads") { if (!nextValue(value)) return false; options.threads = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10)); }
+        else {
+            std::cerr << "BenchmarkSuite3D Error: Unknown argument '" << arg << "'" << std::endl;
+            PrintUsage(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+BenchmarkSuite3D::BenchmarkSuite3D(const Options& options) : options(options) {}
+
+Scene3D BenchmarkSuite3D::ScaleScene(const Scene3D& scene, size_t particleCount) {
+    // Grow the spawn block and the box together so the particle spacing stays the same
+    Scene3D scaled = scene;
+    float factor = std::cbrt(static_cast<float>(particleCount) / static_cast<float>(scene.GetSpawnCount()));
+    SceneLoader3D::SetParticleCount(scaled, static_cast<int>(particleCount));
+    for (FluidBlock3D& block : scaled.fluidBlocks) {
+        block.centre *= factor;
+        block.size *= factor;
+    }
+    for (Obstacle3D& obstacle : scaled.obstacles) {
+        obstacle.centre *= factor;
+        obstacle.size *= factor;
+    }
+    scaled.params.boundingBoxMin *= factor;
+    scaled.params.boundingBoxMax *= factor;
+    return scaled;
+}
+
+void BenchmarkSuite3D::AddResult(Result result, const std::vector<double>& milliseconds) {
+    result.repetitions = milliseconds.size();
+    if (!milliseconds.empty()) {
+        result.meanMilliseconds = std::accumulate(milliseconds.begin(), milliseconds.end(), 0.0) / milliseconds.size();
+        result.minMilliseconds = *std::min_element(milliseconds.begin(), milliseconds.end());
+        result.maxMilliseconds = *std::max_element(milliseconds.begin(), milliseconds.end());
+    }
+    if (result.meanMilliseconds > 0.0) {
+        double seconds = result.meanMilliseconds / 1000.0;
+        result.particleStepsPerSecond = result.particles / seconds;
+        result.bytesPerSecond = result.bytesPerStep / seconds;
+    }
+
+    std::cout << result.kind << " " << result.backend << " " << result.phase;
+    if (!result.scene.empty()) std::cout << " [" << result.scene << "]";
+    std::cout << " n=" << result.particles << ": " << result.meanMilliseconds << " ms";
+    if (!result.note.empty()) std::cout << " (" << result.note << ")";
+    std::cout << std::endl;
+
+    results.push_back(result);
+}
+
+void BenchmarkSuite3D::RunCpuPhases(size_t particleCount) {
+    Scene3D base;
+    SceneLoader3D::Load("default", base);
+    Scene3D scene = ScaleScene(base, particleCount);
+    FluidParams3D params = scene.params;
+
+    ParticleData3D particleData;
+    SceneLoader3D::Spawn(scene, particleData);
+
+    FluidSolverCPU3D solver;
+    for (size_t i = 0; i < options.warmupSteps; ++i) solver.Step(particleData, params);
+    solver.EnsureParticleStorage(particleData);
+
+    size_t count = particleData.positions.size();
+    Profiler& profiler = Profiler::Instance();
+
+    auto phaseResult = [&](const std::string& phase) {
+        Result result;
+        result.kind = "phase";
+        result.backend = "cpu";
+        result.phase = phase;
+        result.particles = count;
+        auto bytes = BytesPerParticle.find(phase);
+        if (bytes != BytesPerParticle.end()) result.bytesPerStep = bytes->second * count;
+        return result;
+    };
+
+    // The grid build is timed as a whole; its hash / offsets / fill parts come from the profiler.
+    // The state does not change between builds, so the fill re-sorts from scratch here.
+    FluidParams3D fullSortParams = params;
+    fullSortParams.rebinThreshold = 0.0f;
+    fullSortParams.deterministic = false;
+    FluidParams3D deterministicParams = fullSortParams;
+    deterministicParams.deterministic = true;
+    std::vector<double> hashMs, offsetsMs, fillMs, deterministicFillMs;
+    Measure(options.repetitions, [&]() {
+        solver.BuildNeighborGrid(particleData, fullSortParams);
+        std::map<std::string, Profiler::Entry> timings = profiler.GetTimings();
+        hashMs.push_back(timings["CPU/Neighbor Hash"].last);
+        offsetsMs.push_back(timings["CPU/Neighbor Offsets"].last);
+        fillMs.push_back(timings["CPU/Neighbor Fill (slot order)"].last);
+    });
+    Measure(options.repetitions, [&]() {
+        solver.BuildNeighborGrid(particleData, deterministicParams);
+        deterministicFillMs.push_back(profiler.GetTimings()["CPU/Neighbor Fill (deterministic)"].last);
+    });
+    AddResult(phaseResult("hash"), hashMs);
+
+    Result offsets = phaseResult("offsets");
+    // Key and start per occupied cell, its 27 neighbour entries, and the block grid written once
+    const SparseBlockGrid3D& cellGrid = solver.GetCellGrid();
+    offsets.bytesPerStep = (2.0 + 27.0) * sizeof(uint32_t) * solver.GetCellCount() + cellGrid.GetMemoryBytes();
+    offsets.note = std::to_string(solver.GetCellCount()) + " occupied cells in " + std::to_string(cellGrid.GetBlockCount()) + " blocks";
+    AddResult(offsets, offsetsMs);
+    AddResult(phaseResult("fill"), fillMs);
+    Result deterministicFill = phaseResult("fill_deterministic");
+    deterministicFill.note = "slots in particle id order before the sort";
+    AddResult(deterministicFill, deterministicFillMs);
+
+    // The fill of real steps, where only the particles that changed cell are re-sorted
+    std::vector<double> incrementalMs;
+    double movedFraction = 0.0;
+    size_t incrementalSteps = 0;
+    for (size_t i = 0; i < options.repetitions; ++i) {
+        solver.Step(particleData, params);
+        std::map<std::string, Profiler::Entry> timings = profiler.GetTimings();
+        std::map<std::string, Profiler::Entry> counters = profiler.GetCounters();
+        incrementalMs.push_back(timings[params.deterministic ? "CPU/Neighbor Fill (deterministic)" : "CPU/Neighbor Fill (slot order)"].last);
+        movedFraction += counters["CPU/Rebin Moved Fraction"].last;
+        incrementalSteps += counters["CPU/Rebin Incremental"].last > 0.0 ? 1 : 0;
+    }
+    Result incremental = phaseResult("fill_incremental");
+    std::ostringstream incrementalNote;
+    incrementalNote << std::fixed << std::setprecision(1) << 100.0 * movedFraction / std::max<size_t>(options.repetitions, 1)
+        << "% moved per step, " << incrementalSteps << "/" << options.repetitions << " steps merged";
+    incremental.note = incrementalNote.str();
+    AddResult(incremental, incrementalMs);
+
+    // Sorting the (cell, slot) pairs of the current state
+    const std::vector<uint32_t>& cells = solver.GetParticleCells();
+    uint32_t keyBits = solver.GetCellKeyBits();
+    std::vector<uint32_t> keys, values;
+    auto resetPairs = [&]() {
+        keys = cells;
+        values.resize(count);
+        std::iota(values.begin(), values.end(), 0u);
+    };
+    auto sortResult = [&](const std::string& phase, double passes) {
+        Result result = phaseResult(phase);
+        result.bytesPerStep = SortBytesPerPass * passes * count;
+        return result;
+    };
+    auto measureSort = [&](const std::function<void()>& sort) {
+        std::vector<double> milliseconds;
+        for (size_t i = 0; i < options.repetitions; ++i) {
+            resetPairs();
+            std::vector<double> single = Measure(1, sort);
+            milliseconds.push_back(single.front());
+        }
+        return milliseconds;
+    };
+
+    RadixSort radixSort;
+    AddResult(sortResult("sort_radix", std::ceil(keyBits / static_cast<double>(RadixSort::DigitBits))),
+        measureSort([&]() { radixSort.Sort(keys, values, keyBits); }));
+    AddResult(sortResult("sort_bitonic", static_cast<double>(BitonicStepCount(count))),
+        measureSort([&]() { BitonicSortPairs(TaskScheduler::Instance(), keys, values); }));
+
+    std::vector<uint64_t> packed(count);
+    double comparisonPasses = std::ceil(std::log2(static_cast<double>(std::max<size_t>(count, 2))));
+    AddResult(sortResult("sort_std", comparisonPasses), measureSort([&]() {
+        for (size_t i = 0; i < count; ++i) packed[i] = (uint64_t(keys[i]) << 32) | values[i];
+        std::sort(packed.begin(), packed.end());
+    }));
+
+    solver.BuildNeighborGrid(particleData, params);
+    AddResult(phaseResult("density"), Measure(options.repetitions, [&]() { solver.CalculateDensities(particleData, params); }));
+    // The explicit kernels give densities at or below zero here, where the pressure forces return
+    // early; a copy with their magnitudes times the full neighbour loop instead
+    ParticleData3D pressureData = particleData;
+    for (glm::vec2& density : pressureData.densities) density = glm::abs(density);
+    Result pressureResult = phaseResult("pressure");
+    pressureResult.note = "on the density magnitudes";
+    AddResult(pressureResult, Measure(options.repetitions, [&]() { solver.CalculatePressureForces(pressureData, params); }));
+    AddResult(phaseResult("viscosity"), Measure(options.repetitions, [&]() { solver.CalculateViscosity(particleData, params); }));
+
+    // What replaces density and pressure with the DFSPH pressure solver
+    FluidParams3D implicitParams = params;
+    implicitParams.pressureSolver = PressureSolver3D::DFSPH;
+    double densityIterations = 0.0, divergenceIterations = 0.0;
+    std::vector<double> implicitMs = Measure(options.repetitions, [&]() {
+        solver.CalculateDensityFactors(particleData, implicitParams);
+        solver.SolveDivergence(particleData, implicitParams);
+        solver.SolveDensity(particleData, implicitParams);
+        densityIterations += solver.GetLastPressureSolve().densityIterations;
+        divergenceIterations += solver.GetLastPressureSolve().divergenceIterations;
+    });
+    Result implicitResult = phaseResult("pressure_dfsph");
+    std::ostringstream iterationsNote;
+    double measured = static_cast<double>(std::max<size_t>(options.repetitions, 1));
+    iterationsNote << std::fixed << std::setprecision(1) << densityIterations / measured << " density and "
+        << divergenceIterations / measured << " divergence iterations";
+    implicitResult.note = iterationsNote.str();
+    AddResult(implicitResult, implicitMs);
+    solver.UpdateBoundary(params);
+
+    // What replaces density, pressure and viscosity with PBF, on a copy so the later phases see the same particles
+    FluidParams3D constraintParams = params;
+    constraintParams.pressureSolver = PressureSolver3D::PBF;
+    ParticleData3D constraintData = particleData;
+    std::vector<double> constraintMs = Measure(options.repetitions, [&]() {
+        solver.GatherNeighborLists(constraintData, constraintParams);
+        solver.SolveDensityConstraints(constraintData, constraintParams);
+        solver.UpdateConstraintVelocities(constraintData, constraintParams);
+    });
+    Result constraintResult = phaseResult("pressure_pbf");
+    constraintResult.note = std::to_string(constraintParams.pbfIterations) + " iterations, includes XSPH";
+    AddResult(constraintResult, constraintMs);
+
+    // A whole step of the APIC grid backend, which replaces every phase above, on a copy as well
+    ParticleData3D gridData = particleData;
+    FluidSolverAPIC3D gridSolver;
+    gridSolver.Reserve(count);
+    double gridIterations = 0.0;
+    std::vector<double> gridMs = Measure(options.repetitions, [&]() {
+        gridSolver.Step(gridData, params);
+        gridIterations += gridSolver.GetLastPressureSolve().iterations;
+    });
+    Result gridResult = phaseResult("step_apic");
+    std::ostringstream gridNote;
+    const glm::ivec3& gridDims = gridSolver.GetDimensions();
+    gridNote << std::fixed << std::setprecision(1) << gridDims.x << "x" << gridDims.y << "x" << gridDims.z << " cells, "
+        << gridIterations / measured << " CG iterations per substep";
+    gridResult.note = gridNote.str();
+    AddResult(gridResult, gridMs);
+    AddResult(phaseResult("integration"), Measure(options.repetitions, [&]() { solver.IntegratePositions(particleData, params); }));
+    Result collisionResult = phaseResult("collision");
+    collisionResult.note = "includes integration";
+    AddResult(collisionResult, Measure(options.repetitions, [&]() {
+        solver.IntegratePositions(particleData, params);
+        solver.ResolveCollisions(particleData, params);
+    }));
+
+    // On the CPU backend "readback" is the copy of the columns the renderer uploads
+    std::vector<glm::vec3> renderPositions(count), renderVelocities(count);
+    AddResult(phaseResult("readback"), Measure(options.repetitions, [&]() {
+        TaskScheduler::Instance().ParallelFor(0, count, FluidSolverCPU3D::ParticleGrain, [&](size_t begin, size_t end) {
+            std::copy(particleData.positions.begin() + begin, particleData.positions.begin() + end, renderPositions.begin() + begin);
+            std::copy(particleData.velocities.begin() + begin, particleData.velocities.begin() + end, renderVelocities.begin() + begin);
+        });
+    }));
+}
+
+void BenchmarkSuite3D::RunBoundaryBake(size_t triangleCount) {
+    // A closed torus tessellated into about triangleCount triangles, filling most of the box
+    size_t tubeSegments = std::max<size_t>(3, static_cast<size_t>(std::sqrt(triangleCount / 8.0)));
+    size_t ringSegments = std::max<size_t>(3, triangleCount / (2 * tubeSegments));
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::uvec3> triangles;
+    vertices.reserve(ringSegments * tubeSegments);
+    triangles.reserve(ringSegments * tubeSegments * 2);
+    for (size_t i = 0; i < ringSegments; ++i) {
+        for (size_t j = 0; j < tubeSegments; ++j) {
+            float ring = 6.28318530718f * i / ringSegments;
+            float tube = 6.28318530718f * j / tubeSegments;
+            float radius = 1.0f + 0.4f * std::cos(tube);
+            vertices.push_back(glm::vec3(radius * std::cos(ring), 0.4f * std::sin(tube), -radius * std::sin(ring)));
+        }
+    }
+    for (size_t i = 0; i < ringSegments; ++i) {
+        for (size_t j = 0; j < tubeSegments; ++j) {
+            uint32_t a = static_cast<uint32_t>(i * tubeSegments + j);
+            uint32_t b = static_cast<uint32_t>(((i + 1) % ringSegments) * tubeSegments + j);
+            uint32_t c = static_cast<uint32_t>(((i + 1) % ringSegments) * tubeSegments + (j + 1) % tubeSegments);
+            uint32_t d = static_cast<uint32_t>(i * tubeSegments + (j + 1) % tubeSegments);
+            triangles.push_back(glm::uvec3(a, b, c));
+            triangles.push_back(glm::uvec3(a, c, d));
+        }
+    }
+
+    Obstacle3D obstacle;
+    obstacle.shape = Obstacle3D::Shape::Mesh;
+    obstacle.centre = glm::vec3(32.0f);
+    obstacle.size = glm::vec3(56.0f, 16.0f, 56.0f);
+    obstacle.mesh = std::make_shared<TriangleMesh3D>(std::move(vertices), std::move(triangles));
+    std::vector<Obstacle3D> obstacles(1, obstacle);
+
+    Result result;
+    result.kind = "bake";
+    result.backend = "cpu";
+    result.particles = obstacle.mesh->GetTriangles().size();
+
+    result.phase = "bvh_build";
+    result.note = "triangles, includes placement and pseudonormals";
+    AddResult(result, Measure(options.repetitions, [&]() { MeshDistance3D distance(*obstacle.mesh, obstacle.centre, obstacle.size); }));
+
+    BoundarySDF3D field;
+    field.SetResolution(options.bakeResolution);
+    result.phase = "boundary_bake";
+    result.note = "triangles into " + std::to_string(options.bakeResolution) + "^3 cells, includes the bvh build";
+    AddResult(result, Measure(options.repetitions, [&]() { field.Bake(glm::vec3(0.0f), glm::vec3(64.0f), obstacles); }));
+}
+
+void BenchmarkSuite3D::RunOctree(size_t pointCount) {
+    // Uniform points in a 64^3 box, queried with boxes about the size of a smoothing kernel
+    const size_t queryCount = 100000;
+    const float queryHalfSize = 1.0f;
+    const uint32_t OctreeKey = 0x6F637472u;
+    std::vector<glm::vec3> points(pointCount);
+    for (size_t i = 0; i < pointCount; ++i) {
+        Philox4x32 random = Philox4x32::Generate(static_cast<uint32_t>(i), 0, 0, 0, 0, OctreeKey);
+        points[i] = 64.0f * glm::vec3(Philox4x32::ToUnitFloat(random.v[0]), Philox4x32::ToUnitFloat(random.v[1]), Philox4x32::ToUnitFloat(random.v[2]));
+    }
+    std::vector<glm::vec3> queries(points.begin(), points.begin() + std::min(queryCount, pointCount));
+
+    TaskScheduler& scheduler = TaskScheduler::Instance();
+    Result result;
+    result.kind = "octree";
+    result.backend = "cpu";
+    result.particles = pointCount;
+
+    std::unique_ptr<PointerOctree> pointerTree;
+    result.phase = "pointer_build";
+    result.note = "one insert per point, 16 points per node";
+    AddResult(result, Measure(options.repetitions, [&]() {
+        pointerTree.reset(new PointerOctree(glm::vec3(32.0f), 32.0f, Octree::DefaultLeafCapacity));
+        for (const glm::vec3& point : points) pointerTree->Insert(point);
+    }));
+
+    std::vector<size_t> pointerHits(queries.size());
+    result.phase = "pointer_query";
+    result.note = std::to_string(queries.size()) + " range queries of side 2 on the thread pool";
+    AddResult(result, Measure(options.repetitions, [&]() {
+        scheduler.ParallelFor(0, queries.size(), 256, [&](size_t begin, size_t end) {
+            for (size_t q = begin; q < end; ++q) pointerHits[q] = pointerTree->QueryRange(queries[q] - queryHalfSize, queries[q] + queryHalfSize).size();
+        });
+    }));
+    pointerTree.reset();
+
+    Octree octree(scheduler);
+    result.phase = "linear_build";
+    result.note = "morton encode, radix sort and level-by-level node build, 16 points per leaf";
+    AddResult(result, Measure(options.repetitions, [&]() { octree.Build(points); }));
+
+    std::vector<size_t> linearHits(queries.size());
+    result.phase = "linear_query";
+    result.note = std::to_string(queries.size()) + " range queries of side 2 on the thread pool";
+    AddResult(result, Measure(options.repetitions, [&]() {
+        scheduler.ParallelFor(0, queries.size(), 256, [&](size_t begin, size_t end) {
+            for (size_t q = begin; q < end; ++q) {
+                size_t hits = 0;
+                octree.QueryRange(queries[q] - queryHalfSize, queries[q] + queryHalfSize, [&](uint32_t, const glm::vec3&) { ++hits; });
+                linearHits[q] = hits;
+            }
+        });
+    }));
+
+    if (pointerHits != linearHits) std::cerr << "BenchmarkSuite3D::RunOctree Error: The linear and pointer octrees disagree on the query results" << std::endl;
+}
+
+void BenchmarkSuite3D::RunLongRange(size_t particleCount) {
+    // A ball of uniform density, the start of a self-gravitating blob
+    const uint32_t LongRangeKey = 0x62687574u;
+    std::vector<glm::vec3> positions;
+    positions.reserve(particleCount);
+    for (uint32_t i = 0; positions.size() < particleCount; ++i) {
+        Philox4x32 random = Philox4x32::Generate(i, 0, 0, 0, 0, LongRangeKey);
+        glm::vec3 point = 2.0f * glm::vec3(Philox4x32::ToUnitFloat(random.v[0]), Philox4x32::ToUnitFloat(random.v[1]), Philox4x32::ToUnitFloat(random.v[2])) - 1.0f;
+        if (glm::dot(point, point) <= 1.0f) positions.push_back(32.0f + 16.0f * point);
+    }
+    const float strength = 1.0f;
+    const float softening = 0.5f;
+
+    Result result;
+    result.kind = "long_range";
+    result.backend = "cpu";
+    result.particles = particleCount;
+
+    BarnesHut3D barnesHut;
+    std::vector<glm::vec3> direct;
+    result.phase = "direct_sum";
+    result.note = "all pairs";
+    AddResult(result, Measure(options.repetitions, [&]() { barnesHut.ComputeDirect(positions, strength, softening, direct); }));
+    double directSqrSum = 0.0;
+    for (const glm::vec3& accel : direct) directSqrSum += glm::dot(accel, accel);
+
+    std::vector<glm::vec3> approximate;
+    for (float theta : options.barnesHutThetas) {
+        size_t interactions = 0;
+        std::vector<double> milliseconds = Measure(options.repetitions, [&]() {
+            barnesHut.Build(positions);
+            interactions = barnesHut.ComputeAccelerations(strength, softening, theta, approximate);
+        });
+
+        // Relative RMS error over all particles, and the worst single particle
+        double errorSqrSum = 0.0;
+        double maxError = 0.0;
+        for (size_t i = 0; i < particleCount; ++i) {
+            glm::vec3 difference = approximate[i] - direct[i];
+            errorSqrSum += glm::dot(difference, difference);
+            maxError = std::max(maxError, static_cast<double>(glm::length(difference) / std::max(glm::length(direct[i]), 1e-12f)));
+        }
+        std::ostringstream note;
+        note << "theta " << theta << ", includes the tree build, relative rms error " << std::sqrt(errorSqrSum / std::max(directSqrSum, 1e-30))
+            << ", max " << maxError << ", " << static_cast<double>(interactions) / particleCount << " interactions per particle";
+        result.phase = "barnes_hut";
+        result.note = note.str();
+        AddResult(result, milliseconds);
+    }
+}
+
+void BenchmarkSuite3D::RunPoisson(int size) {
+    glm::ivec3 dims(size);
+    std::vector<uint8_t> types;
+    std::vector<float> rhs;
+    BuildPoissonDomain(size, types, rhs);
+
+    Result result;
+    result.kind = "poisson";
+    result.backend = "cpu";
+    result.particles = types.size();
+
+    MultigridPoisson3D poisson;
+    result.phase = "configure";
+    result.note = "cells, coarse types, diagonals and wall weights of every level";
+    AddResult(result, Measure(options.repetitions, [&]() { poisson.Configure(dims, types); }));
+
+    std::vector<float> solution;
+    MultigridPoisson3D::SolveStats stats;
+    std::vector<double> milliseconds = Measure(options.repetitions, [&]() {
+        solution.clear();
+        stats = poisson.Solve(rhs, solution, PoissonTolerance, MaxPoissonCycles);
+    });
+
+    // A cycle's share of the solve, which also checks the residual after every cycle
+    std::vector<double> cycleMilliseconds;
+    for (double ms : milliseconds) cycleMilliseconds.push_back(ms / std::max(stats.iterations, 1));
+    std::ostringstream note;
+    note << poisson.GetLevelCount() << " levels, " << poisson.GetInteriorCount() << " cells solved for, convergence factor "
+        << std::pow(static_cast<double>(std::max(stats.error, 1e-30f)), 1.0 / std::max(stats.iterations, 1));
+    result.phase = "vcycle";
+    result.note = note.str();
+    result.bytesPerStep = VCycleBytesPerCell * result.particles;
+    AddResult(result, cycleMilliseconds);
+
+    result.phase = "solve_vcycle";
+    result.note = PoissonNote(stats, "cycles");
+    result.bytesPerStep = VCycleBytesPerCell * result.particles * stats.iterations;
+    AddResult(result, milliseconds);
+
+    milliseconds = Measure(options.repetitions, [&]() { stats = poisson.SolvePCG(rhs, solution, PoissonTolerance, MaxPoissonCycles); });
+    result.phase = "solve_pcg";
+    result.note = PoissonNote(stats, "iterations") + ", each preconditioned by one cycle";
+    result.bytesPerStep = 0.0;
+    AddResult(result, milliseconds);
+}
+
+void BenchmarkSuite3D::RunCpuScene(const std::string& sceneName) {
+    Scene3D scene;
+    if (!SceneLoader3D::Load(sceneName, scene)) return;
+
+    ParticleData3D particleData;
+    SceneLoader3D::Spawn(scene, particleData);
+
+    FluidSolverCPU3D solver;
+    solver.SetObstacles(scene.obstacles);
+    for (size_t i = 0; i < options.warmupSteps; ++i) solver.Step(particleData, scene.params);
+
+    Result result;
+    result.kind = "scene";
+    result.backend = "cpu";
+    result.phase = "step";
+    result.scene = sceneName;
+    result.particles = particleData.positions.size();
+    result.bytesPerStep = BytesPerParticle.at("step") * result.particles;
+    AddResult(result, Measure(options.sceneSteps, [&]() { solver.Step(particleData, scene.params); }));
+}
+
+#ifdef FLUID_HEADLESS_GL
+void BenchmarkSuite3D::RunGlPhases(size_t particleCount) {
+    Scene3D base;
+    SceneLoader3D::Load("default", base);
+    Scene3D scene = ScaleScene(base, particleCount);
+
+    ParticleData3D particleData;
+    SceneLoader3D::Spawn(scene, particleData);
+    size_t count = particleData.positions.size();
+
+    Result result;
+    result.kind = "phase";
+    result.backend = "gl";
+    result.particles = count;
+
+    FluidSolverGPU3D solver(options.shaderDirectory + "FluidSimulator_3D.comp", particleData);
+
+    result.phase = "step";
+    result.bytesPerStep = BytesPerParticle.at("step") * count;
+    if (count <= MaxAllPairsParticles) {
+        AddResult(result, Measure(options.repetitions, [&]() { solver.Step(scene.params); }));
+    }
+    else {
+        result.note = "skipped: all-pairs shader is O(n^2)";
+        AddResult(result, {});
+    }
+
+    result.phase = "readback";
+    result.note.clear();
+    result.bytesPerStep = BytesPerParticle.at("readback") * count;
+    AddResult(result, Measure(options.repetitions, [&]() { solver.Download(particleData); }));
+
+    // Bitonic sort of random hash keys, the way the hashed shader uses GPUSort
+    std::vector<glm::uvec3> entries(count);
+    for (size_t i = 0; i < count; ++i) {
+        glm::uint key = static_cast<glm::uint>((i * 2654435761u) % count);
+        entries[i] = glm::uvec3(static_cast<glm::uint>(i), key, key);
+    }
+    std::vector<glm::uint> offsets(count, 0);
+
+    GPUSort sorter;
+    result.phase = "sort_bitonic";
+    result.bytesPerStep = 2.0 * sizeof(glm::uvec3) * BitonicStepCount(count) * count;
+    std::vector<double> milliseconds;
+    for (size_t i = 0; i < options.repetitions; ++i) {
+        sorter.SetBuffers(entries, offsets);
+        milliseconds.push_back(Measure(1, [&]() { sorter.Sort(); }).front());
+    }
+    AddResult(result, milliseconds);
+
+    // Re-sorting after about 5% of the keys changed, alternating with the original keys
+    std::vector<glm::uvec3> changed = entries;
+    for (size_t i = 0; i < count; i += 20) changed[i].y = changed[i].z = (changed[i].z + 1) % static_cast<glm::uint>(count);
+    sorter.SetRebinThreshold(0.25f);
+    sorter.UpdateBuffers(entries, offsets);
+    sorter.Sort();
+    result.phase = "sort_incremental";
+    result.bytesPerStep = 2.0 * sizeof(glm::uvec3) * (4.0 + BitonicStepCount(count / 20)) * count;
+    milliseconds.clear();
+    size_t merged = 0;
+    for (size_t i = 0; i < options.repetitions; ++i) {
+        sorter.UpdateBuffers(i % 2 == 0 ? changed : entries, offsets);
+        milliseconds.push_back(Measure(1, [&]() { sorter.Sort(); }).front());
+        merged += sorter.WasLastSortIncremental() ? 1 : 0;
+    }
+    result.note = std::to_string(merged) + "/" + std::to_string(options.repetitions) + " sorts merged";
+    AddResult(result, milliseconds);
+}
+
+void BenchmarkSuite3D::RunGlScene(const std::string& sceneName) {
+    Scene3D scene;
+    if (!SceneLoader3D::Load(sceneName, scene)) return;
+
+    ParticleData3D particleData;
+    SceneLoader3D::Spawn(scene, particleData);
+
+    Result result;
+    result.kind = "scene";
+    result.backend = "gl";
+    result.phase = "step";
+    result.scene = sceneName;
+    result.particles = particleData.positions.size();
+    result.bytesPerStep = BytesPerParticle.at("step") * result.particles;
+
+    if (result.particles > MaxAllPairsParticles) {
+        result.note = "skipped: all-pairs shader is O(n^2)";
+        AddResult(result, {});
+        return;
+    }
+
+    FluidSolverGPU3D solver(options.shaderDirectory + "FluidSimulator_3D.comp", particleData);
+    AddResult(result, Measure(options.sceneSteps, [&]() { solver.Step(scene.params); }));
+}
+
+void BenchmarkSuite3D::RunGlPoisson(int size) {
+    glm::ivec3 dims(size);
+    std::vector<uint8_t> types;
+    std::vector<float> rhs;
+    BuildPoissonDomain(size, types, rhs);
+
+    Result result;
+    result.kind = "poisson";
+    result.backend = "gl";
+    result.particles = types.size();
+
+    MultigridPoissonGPU3D poisson(options.shaderDirectory + "MultigridPoisson_3D.comp");
+    result.phase = "configure";
+    result.note = "cells, levels built on the host and uploaded";
+    AddResult(result, Measure(options.repetitions, [&]() { poisson.Configure(dims, types); glFinish(); }));
+
+    // V-cycles alone, without the residual readback
+    poisson.Upload(rhs, std::vector<float>());
+    result.phase = "vcycle";
+    result.note = std::to_string(poisson.GetLevelCount()) + " levels";
+    result.bytesPerStep = VCycleBytesPerCell * result.particles;
+    AddResult(result, Measure(options.repetitions, [&]() { poisson.VCycles(1); glFinish(); }));
+
+    std::vector<float> solution;
+    MultigridPoisson3D::SolveStats stats;
+    std::vector<double> milliseconds = Measure(options.repetitions, [&]() {
+        solution.clear();
+        stats = poisson.Solve(rhs, solution, PoissonTolerance, MaxPoissonCycles);
+    });
+    result.phase = "solve_vcycle";
+    result.note = PoissonNote(stats, "cycles") + ", includes the upload, one residual readback per cycle and the download";
+    result.bytesPerStep = VCycleBytesPerCell * result.particles * stats.iterations;
+    AddResult(result, milliseconds);
+
+    // The same cycles on the CPU solver that the shader mirrors
+    MultigridPoisson3D reference;
+    reference.Configure(dims, types);
+    std::vector<float> referenceSolution;
+    MultigridPoisson3D::SolveStats referenceStats = reference.Solve(rhs, referenceSolution, 0.0f, PoissonCompareCycles);
+    solution.clear();
+    stats = poisson.Solve(rhs, solution, 0.0f, PoissonCompareCycles);
+    float largest = 0.0f;
+    float difference = 0.0f;
+    for (size_t i = 0; i < referenceSolution.size() && i < solution.size(); ++i) {
+        largest = std::max(largest, std::abs(referenceSolution[i]));
+        difference = std::max(difference, std::abs(solution[i] - referenceSolution[i]));
+    }
+    float relativeDifference = difference / std::max(largest, 1e-30f);
+    std::ostringstream note;
+    note << PoissonCompareCycles << " cycles from zero: residual " << stats.error << " on gl and " << referenceStats.error
+        << " on cpu, solutions differ by up to " << relativeDifference << " of the largest value";
+    if (solution.size() != referenceSolution.size() || relativeDifference > PoissonCompareTolerance) {
+        std::cerr << "BenchmarkSuite3D::RunGlPoisson Error: The GL and CPU multigrid solutions differ by " << relativeDifference << std::endl;
+    }
+    result.phase = "compare_cpu";
+    result.note = note.str();
+    result.bytesPerStep = 0.0;
+    AddResult(result, {});
+}
+#endif
+
+int BenchmarkSuite3D::Run() {
+    TaskScheduler::Instance().Configure(options.threads, options.pinThreads);
+    results.clear();
+
+    bool runCpu = std::find(options.backends.begin(), options.backends.end(), "cpu") != options.backends.end();
+    bool runGl = std::find(options.backends.begin(), options.backends.end(), "gl") != options.backends.end();
+
+    if (runCpu) {
+        for (size_t size : options.sizes) RunCpuPhases(size);
+        for (const std::string& scene : options.scenes) RunCpuScene(scene);
+        for (size_t triangles : options.bakeTriangles) RunBoundaryBake(triangles);
+        // An empty octree or blob has nothing to time, and its per-point figures would divide by zero
+        for (size_t points : options.octreePoints) if (points > 0) RunOctree(points);
+        for (size_t particles : options.longRangeParticles) if (particles > 0) RunLongRange(particles);
+        for (int size : options.poissonSizes) RunPoisson(size);
+    }
+
+    if (runGl) {
+#ifdef FLUID_HEADLESS_GL
+        HeadlessGLContext context;
+        if (!context.Create()) return 1;
+        for (size_t size : options.sizes) RunGlPhases(size);
+        for (const std::string& scene : options.scenes) RunGlScene(scene);
+        for (int size : options.poissonSizes) RunGlPoisson(size);
+#else
+        std::cerr << "BenchmarkSuite3D Error: Built without FLUID_HEADLESS_GL, skipping the gl backend" << std::endl;
+#endif
+    }
+
+    return WriteJson() ? 0 : 1;
+}
+
+bool BenchmarkSuite3D::WriteJson() const {
+    std::ofstream file(options.outputFile);
+    if (!file.is_open()) {
+        std::cerr << "BenchmarkSuite3D Error: Cannot write " << options.outputFile << std::endl;
+        return false;
+    }
+
+    file << "{\n";
+    file << "  \"label\": \"" << JsonEscape(options.label) << "\",\n";
+    file << "  \"timestamp\": " << static_cast<long long>(std::time(nullptr)) << ",\n";
+    file << "  \"threads\": " << TaskScheduler::Instance().GetThreadCount() << ",\n";
+    file << "  \"hardware_threads\": " << TaskScheduler::HardwareThreads() << ",\n";
+    file << "  \"bytes_model\": \"compulsory column traffic per step\",\n";
+    file << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        file << "    { \"kind\": \"" << r.kind << "\", \"backend\": \"" << r.backend << "\", \"phase\": \"" << r.phase << "\""
+            << ", \"scene\": \"" << JsonEscape(r.scene) << "\", \"particles\": " << r.particles
+            << ", \"repetitions\": " << r.repetitions
+            << ", \"mean_ms\": " << r.meanMilliseconds << ", \"min_ms\": " << r.minMilliseconds << ", \"max_ms\": " << r.maxMilliseconds
+            << ", \"particle_steps_per_second\": " << r.particleStepsPerSecond
+            << ", \"bytes_per_step\": " << r.bytesPerStep << ", \"bytes_per_second\": " << r.bytesPerSecond
+            << ", \"note\": \"" << JsonEscape(r.note) << "\" }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    file << "  ]\n}\n";
+
+    std::cout << "Wrote " << results.size() << " results to " << options.outputFile << std::endl;
+    return true;
+}
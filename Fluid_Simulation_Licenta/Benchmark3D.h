@@ -0,0 +1,87 @@
+#ifndef BENCHMARK_3D_H
+#define BENCHMARK_3D_H
+
+#include <string>
+#include <vector>
+
+#include "ParticleData.h"
+#include "Scene3D.h"
+
+// Micro benchmarks of every SPH phase at fixed particle counts plus full-step
+// runs of the standard scenes, written as JSON so results can be compared
+// between commits.
+class BenchmarkSuite3D {
+public:
+    struct Options {
+        std::vector<size_t> sizes = { 10000, 100000, 1000000, 4000000 };
+        std::vector<std::string> scenes = SceneLoader3D::GetPresetNames();
+        std::vector<std::string> backends = { "cpu" };
+        // Triangle counts of the closed meshes baked into the boundary field
+        std::vector<size_t> bakeTriangles = { 1000000 };
+        int bakeResolution = 256;
+        // Point counts for the octree build and query benchmark
+        std::vector<size_t> octreePoints = { 1000000 };
+        // Particle counts for the long-range force benchmark; the direct sum it is checked against is O(N^2)
+        std::vector<size_t> longRangeParticles = { 20000 };
+        std::vector<float> barnesHutThetas = { 0.3f, 0.5f, 0.8f };
+        // Cells per side of the cubes the multigrid Poisson solver is timed on
+        std::vector<int> poissonSizes = { 128, 256 };
+        size_t repetitions = 5;
+        size_t warmupSteps = 2;
+        size_t sceneSteps = 50;
+        unsigned int threads = 0;
+        bool pinThreads = false;
+        std::string outputFile = "benchmark.json";
+        std::string label;
+        std::string shaderDirectory = "shaders/";
+    };
+
+    struct Result {
+        std::string kind;
+        std::string backend;
+        std::string phase;
+        std::string scene;
+        size_t particles = 0;
+        size_t repetitions = 0;
+        double meanMilliseconds = 0.0;
+        double minMilliseconds = 0.0;
+        double maxMilliseconds = 0.0;
+        double particleStepsPerSecond = 0.0;
+        double bytesPerStep = 0.0;
+        double bytesPerSecond = 0.0;
+        std::string note;
+    };
+
+    static bool ParseArguments(int argc, char** argv, Options& options);
+    static void PrintUsage(const char* program);
+
+    explicit BenchmarkSuite3D(const Options& options);
+
+    // Runs every configured benchmark and writes the JSON report. Returns the process exit code.
+    int Run();
+
+    const std::vector<Result>& GetResults() const { return results; }
+
+private:
+    static Scene3D ScaleScene(const Scene3D& scene, size_t particleCount);
+
+    void RunCpuPhases(size_t particleCount);
+    void RunCpuScene(const std::string& sceneName);
+    void RunBoundaryBake(size_t triangleCount);
+    void RunOctree(size_t pointCount);
+    void RunLongRange(size_t particleCount);
+    void RunPoisson(int size);
+#ifdef FLUID_HEADLESS_GL
+    void RunGlPhases(size_t particleCount);
+    void RunGlScene(const std::string& sceneName);
+    void RunGlPoisson(int size);
+#endif
+
+    void AddResult(Result result, const std::vector<double>& milliseconds);
+    bool WriteJson() const;
+
+    Options options;
+    std::vector<Result> results;
+};
+
+#endif // BENCHMARK_3D_H
@@ -0,0 +1,12 @@
+#include "Benchmark3D.h"
+
+// Entry point of the benchmark suite; see BenchmarkSuite3D::PrintUsage for the options.
+int main(int argc, char** argv) {
+    BenchmarkSuite3D::Options options;
+    if (!BenchmarkSuite3D::ParseArguments(argc, argv, options)) {
+        return 1;
+    }
+
+    BenchmarkSuite3D suite(options);
+    return suite.Run();
+}
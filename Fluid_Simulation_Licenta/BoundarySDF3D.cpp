@@ -0,0 +1,244 @@
+#include "BoundarySDF3D.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+#include "Profiler.h"
+#include "TriangleMesh3D.h"
+
+BoundarySDF3D::BoundarySDF3D(TaskScheduler& scheduler)
+    : scheduler(scheduler), resolution(DefaultResolution), dimensions(0), origin(0.0f), spacing(1.0f), version(0),
+    bakedResolution(0), bakedMin(0.0f), bakedMax(0.0f) {}
+
+float BoundarySDF3D::BoxDistance(const glm::vec3& point, const glm::vec3& centre, const glm::vec3& halfSize) {
+    glm::vec3 q = glm::abs(point - centre) - halfSize;
+    return glm::length(glm::max(q, glm::vec3(0.0f))) + std::min(std::max(q.x, std::max(q.y, q.z)), 0.0f);
+}
+
+bool BoundarySDF3D::Matches(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const std::vector<Obstacle3D>& obstacles) const {
+    if (!IsBaked() || bakedResolution != resolution || bakedMin != boundsMin || bakedMax != boundsMax) return false;
+    if (bakedObstacles.size() != obstacles.size()) return false;
+    for (size_t i = 0; i < obstacles.size(); ++i) {
+        const Obstacle3D& a = bakedObstacles[i];
+        const Obstacle3D& b = obstacles[i];
+        if (a.shape != b.shape || a.centre != b.centre || a.size != b.size || a.mesh != b.mesh) return false;
+    }
+    return true;
+}
+
+bool BoundarySDF3D::Update(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const std::vector<Obstacle3D>& obstacles) {
+    if (Matches(boundsMin, boundsMax, obstacles)) return false;
+    Bake(boundsMin, boundsMax, obstacles);
+    return true;
+}
+
+void BoundarySDF3D::Bake(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const std::vector<Obstacle3D>& obstacles) {
+    ScopedTimer timer("CPU/Boundary Bake");
+    bakedResolution = resolution;
+    bakedMin = boundsMin;
+    bakedMax = boundsMax;
+    bakedObstacles = obstacles;
+
+    glm::vec3 lower = glm::min(boundsMin, boundsMax);
+    glm::vec3 upper = glm::max(boundsMin, boundsMax);
+    glm::vec3 boxCentre = (lower + upper) * 0.5f;
+    glm::vec3 boxHalf = (upper - lower) * 0.5f;
+    float longest = std::max(upper.x - lower.x, std::max(upper.y - lower.y, upper.z - lower.z));
+    spacing = longest > 0.0f ? longest / static_cast<float>(resolution) : 1.0f;
+    for (int axis = 0; axis < 3; ++axis) {
+        dimensions[axis] = static_cast<int>(std::ceil((upper[axis] - lower[axis]) / spacing)) + 2 * Padding;
+    }
+    origin = boxCentre - glm::vec3(dimensions) * (spacing * 0.5f);
+
+    // Meshes are placed (and their hierarchies built) once per bake
+    std::vector<std::unique_ptr<MeshDistance3D>> meshes(obstacles.size());
+    for (size_t i = 0; i < obstacles.size(); ++i) {
+        if (obstacles[i].shape == Obstacle3D::Shape::Mesh && obstacles[i].mesh) {
+            meshes[i].reset(new MeshDistance3D(*obstacles[i].mesh, obstacles[i].centre, obstacles[i].size, scheduler));
+        }
+    }
+
+    size_t cellCount = static_cast<size_t>(dimensions.x) * dimensions.y * dimensions.z;
+    std::vector<float> distances(cellCount);
+    scheduler.ParallelFor(0, static_cast<size_t>(dimensions.z), 1, [&](size_t zBegin, size_t zEnd) {
+        for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+            for (int y = 0; y < dimensions.y; ++y) {
+                for (int x = 0; x < dimensions.x; ++x) {
+                    glm::vec3 point = origin + (glm::vec3(x, y, z) + 0.5f) * spacing;
+                    // The union of the solids is the minimum of the distances on the fluid side
+                    float distance = -BoxDistance(point, boxCentre, boxHalf);
+                    for (const Obstacle3D& obstacle : obstacles) {
+                        if (obstacle.shape == Obstacle3D::Shape::Box) {
+                            distance = std::min(distance, BoxDistance(point, obstacle.centre, obstacle.size * 0.5f));
+                        }
+                        else if (obstacle.shape == Obstacle3D::Shape::Sphere) {
+                            distance = std::min(distance, glm::length(point - obstacle.centre) - obstacle.size.x * 0.5f);
+                        }
+                    }
+                    distances[CellIndex(x, y, z)] = distance;
+                }
+            }
+        }
+    });
+    for (const std::unique_ptr<MeshDistance3D>& mesh : meshes) {
+        if (mesh) BakeMesh(*mesh, distances);
+    }
+
+    // Normals from central differences, one-sided at the edges of the grid
+    cells.resize(cellCount);
+    scheduler.ParallelFor(0, static_cast<size_t>(dimensions.z), 1, [&](size_t zBegin, size_t zEnd) {
+        for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+            for (int y = 0; y < dimensions.y; ++y) {
+                for (int x = 0; x < dimensions.x; ++x) {
+                    glm::ivec3 cell(x, y, z);
+                    glm::vec3 gradient(0.0f);
+                    for (int axis = 0; axis < 3; ++axis) {
+                        glm::ivec3 below = cell;
+                        glm::ivec3 above = cell;
+                        below[axis] = std::max(cell[axis] - 1, 0);
+                        above[axis] = std::min(cell[axis] + 1, dimensions[axis] - 1);
+                        float span = static_cast<float>(above[axis] - below[axis]) * spacing;
+                        if (span > 0.0f) {
+                            gradient[axis] = (distances[CellIndex(above.x, above.y, above.z)] - distances[CellIndex(below.x, below.y, below.z)]) / span;
+                        }
+                    }
+                    float length = glm::length(gradient);
+                    glm::vec3 normal = length > 0.0f ? gradient / length : glm::vec3(0.0f);
+                    cells[CellIndex(x, y, z)] = glm::vec4(normal, distances[CellIndex(x, y, z)]);
+                }
+            }
+        }
+    });
+    ++version;
+}
+
+void BoundarySDF3D::BakeMesh(const MeshDistance3D& mesh, std::vector<float>& distances) {
+    size_t cellCount = distances.size();
+    std::vector<float> meshDistances(cellCount, std::numeric_limits<float>::max());
+    std::vector<uint32_t> closest(cellCount, MeshDistance3D::NoHint);
+    std::vector<uint8_t> exact(cellCount, 0);
+    auto cellCentre = [&](int x, int y, int z) { return origin + (glm::vec3(x, y, z) + 0.5f) * spacing; };
+
+    // Within the band around the surface every cell gets its exact distance from a bounded search,
+    // which skips every node farther than the band however curved the surface is
+    float band = static_cast<float>(BandCells) * spacing;
+    glm::ivec3 lower = glm::max(glm::ivec3(glm::floor((mesh.GetBoundsMin() - band - origin) / spacing)), glm::ivec3(0));
+    glm::ivec3 upper = glm::min(glm::ivec3(glm::ceil((mesh.GetBoundsMax() + band - origin) / spacing)), dimensions - 1);
+    if (glm::all(glm::lessThanEqual(lower, upper))) {
+        scheduler.ParallelFor(static_cast<size_t>(lower.z), static_cast<size_t>(upper.z) + 1, 1, [&](size_t zBegin, size_t zEnd) {
+            uint32_t hint = MeshDistance3D::NoHint;
+            for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+                for (int y = lower.y; y <= upper.y; ++y) {
+                    for (int x = lower.x; x <= upper.x; ++x) {
+                        size_t cell = CellIndex(x, y, z);
+                        if (!mesh.SignedDistanceWithin(cellCentre(x, y, z), band, hint, meshDistances[cell])) continue;
+                        closest[cell] = hint;
+                        exact[cell] = 1;
+                    }
+                }
+            }
+        });
+    }
+
+    // Farther cells inherit a neighbour's closest triangle when it is nearer than their own, sweeping
+    // every axis both ways. The sign travels with it: only band cells sit next to the surface.
+    auto relax = [&](size_t cell, size_t previous, const glm::vec3& point) {
+        uint32_t triangle = closest[previous];
+        if (exact[cell] || triangle == MeshDistance3D::NoHint || triangle == closest[cell]) return;
+        float distance = mesh.DistanceToTriangle(point, triangle);
+        if (closest[cell] != MeshDistance3D::NoHint && distance >= std::abs(meshDistances[cell])) return;
+        closest[cell] = triangle;
+        meshDistances[cell] = meshDistances[previous] < 0.0f ? -distance : distance;
+    };
+    for (int round = 0; round < SweepRounds; ++round) {
+        for (int axis = 0; axis < 3; ++axis) {
+            for (int step = 1; step >= -1; step -= 2) {
+                int first = step > 0 ? 1 : dimensions[axis] - 2;
+                int count = dimensions[axis] - 1;
+                if (axis == 0) {
+                    // Rows along x, each walked on its own
+                    size_t rows = static_cast<size_t>(dimensions.y) * dimensions.z;
+                    scheduler.ParallelFor(0, rows, 64, [&](size_t begin, size_t end) {
+                        for (size_t row = begin; row < end; ++row) {
+                            int y = static_cast<int>(row % dimensions.y);
+                            int z = static_cast<int>(row / dimensions.y);
+                            for (int i = 0, x = first; i < count; ++i, x += step) {
+                                relax(CellIndex(x, y, z), CellIndex(x - step, y, z), cellCentre(x, y, z));
+                            }
+                        }
+                    });
+                }
+                else {
+                    // Whole x rows advance together, so the inner loop stays contiguous
+                    int other = axis == 1 ? 2 : 1;
+                    scheduler.ParallelFor(0, static_cast<size_t>(dimensions[other]), 1, [&](size_t begin, size_t end) {
+                        for (int o = static_cast<int>(begin); o < static_cast<int>(end); ++o) {
+                            for (int i = 0, a = first; i < count; ++i, a += step) {
+                                glm::ivec3 cell(0);
+                                cell[axis] = a;
+                                cell[other] = o;
+                                glm::ivec3 previous = cell;
+                                previous[axis] -= step;
+                                for (int x = 0; x < dimensions.x; ++x) {
+                                    relax(CellIndex(x, cell.y, cell.z), CellIndex(x, previous.y, previous.z), cellCentre(x, cell.y, cell.z));
+                                }
+                            }
+                        }
+                    });
+                }
+            }
+        }
+    }
+
+    scheduler.ParallelFor(0, static_cast<size_t>(dimensions.z), 1, [&](size_t zBegin, size_t zEnd) {
+        uint32_t hint = MeshDistance3D::NoHint;
+        for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+            for (int y = 0; y < dimensions.y; ++y) {
+                for (int x = 0; x < dimensions.x; ++x) {
+                    size_t cell = CellIndex(x, y, z);
+                    // Only reached when no band cell lies on the grid, e.g. a mesh outside the box
+                    if (closest[cell] == MeshDistance3D::NoHint) {
+                        mesh.SignedDistanceWithin(cellCentre(x, y, z), std::numeric_limits<float>::max(), hint, meshDistances[cell]);
+                    }
+                    distances[cell] = std::min(distances[cell], meshDistances[cell]);
+                }
+            }
+        }
+    });
+}
+
+glm::vec4 BoundarySDF3D::Sample(const glm::vec3& position) const {
+    if (!IsBaked()) return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    glm::vec3 first = origin + 0.5f * spacing;
+    glm::vec3 last = origin + (glm::vec3(dimensions) - 0.5f) * spacing;
+    glm::vec3 clamped = glm::clamp(position, first, last);
+
+    glm::vec3 grid = (clamped - first) / spacing;
+    glm::ivec3 base = glm::min(glm::ivec3(glm::floor(grid)), dimensions - 2);
+    base = glm::max(base, glm::ivec3(0));
+    glm::vec3 t = glm::clamp(grid - glm::vec3(base), 0.0f, 1.0f);
+
+    auto at = [&](int dx, int dy, int dz) { return cells[CellIndex(base.x + dx, base.y + dy, base.z + dz)]; };
+    glm::vec4 x00 = glm::mix(at(0, 0, 0), at(1, 0, 0), t.x);
+    glm::vec4 x10 = glm::mix(at(0, 1, 0), at(1, 1, 0), t.x);
+    glm::vec4 x01 = glm::mix(at(0, 0, 1), at(1, 0, 1), t.x);
+    glm::vec4 x11 = glm::mix(at(0, 1, 1), at(1, 1, 1), t.x);
+    glm::vec4 sample = glm::mix(glm::mix(x00, x10, t.y), glm::mix(x01, x11, t.y), t.z);
+
+    sample.w -= glm::length(position - clamped);
+    return sample;
+}
+
+void BoundarySDF3D::ResolveContact(const glm::vec4& sample, glm::vec3& position, glm::vec3& velocity, float damping) {
+    if (sample.w >= 0.0f) return;
+    glm::vec3 normal(sample);
+    float length = glm::length(normal);
+    if (length <= 0.0f) return;
+    normal /= length;
+
+    position -= normal * sample.w;
+    float normalSpeed = glm::dot(velocity, normal);
+    if (normalSpeed < 0.0f) velocity -= (1.0f + damping) * normalSpeed * normal;
+}
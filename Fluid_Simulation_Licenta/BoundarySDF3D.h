@@ -0,0 +1,78 @@
+#ifndef BOUNDARY_SDF_3D_H
+#define BOUNDARY_SDF_3D_H
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "FluidParams3D.h"
+#include "TaskScheduler.h"
+
+class MeshDistance3D;
+
+// Signed distance to the solid boundary, baked onto a grid over the container: the inside of the
+// bounding box is fluid and every obstacle is solid, so the distance is positive in the fluid.
+// Each cell stores the distance and its normalized gradient, so a particle's collision response is
+// one trilinear lookup however many obstacles or triangles the scene has.
+// Samples sit at cell centres, origin + (i + 0.5) * spacing, which is the texel layout of a GL 3D
+// texture; BoundaryTexture3D's filtered lookup in the shaders returns the same values.
+class BoundarySDF3D {
+public:
+    explicit BoundarySDF3D(TaskScheduler& scheduler = TaskScheduler::Instance());
+
+    // Bakes when the box or the obstacles differ from the last bake. Returns true if it baked.
+    bool Update(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const std::vector<Obstacle3D>& obstacles);
+    void Bake(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const std::vector<Obstacle3D>& obstacles);
+
+    // xyz: unit normal pointing into the fluid, w: signed distance. Past the edge of the grid the
+    // distance keeps falling with the distance to the grid, so escaped particles are still pulled back.
+    glm::vec4 Sample(const glm::vec3& position) const;
+    // Moves a particle that ended up in the solid back onto the surface and reflects the velocity
+    // component into the solid, scaled by damping. The shaders apply the same rule.
+    static void ResolveContact(const glm::vec4& sample, glm::vec3& position, glm::vec3& velocity, float damping);
+    // Exact signed distance to a box, negative inside.
+    static float BoxDistance(const glm::vec3& point, const glm::vec3& centre, const glm::vec3& halfSize);
+
+    bool IsBaked() const { return !cells.empty(); }
+    const std::vector<glm::vec4>& GetCells() const { return cells; }
+    const glm::ivec3& GetDimensions() const { return dimensions; }
+    const glm::vec3& GetOrigin() const { return origin; }
+    float GetSpacing() const { return spacing; }
+    // Incremented by every bake, so GPU copies know when to upload again.
+    size_t GetVersion() const { return version; }
+
+    // Cells along the longest side of the box; takes effect at the next bake.
+    void SetResolution(int cellsPerAxis) { resolution = cellsPerAxis > 1 ? cellsPerAxis : 2; }
+    int GetResolution() const { return resolution; }
+
+    static const int DefaultResolution = 64;
+    // Cells outside the box on every side, so the walls get a smooth field on both sides
+    static const int Padding = 2;
+    // Width in cells of the band around mesh surfaces that is searched exactly; farther cells
+    // take the closest triangle of a neighbour, SweepRounds times along every axis
+    static const int BandCells = 3;
+    static const int SweepRounds = 2;
+
+private:
+    // Takes the minimum of distances and the mesh's signed distance at every cell.
+    void BakeMesh(const MeshDistance3D& mesh, std::vector<float>& distances);
+    bool Matches(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const std::vector<Obstacle3D>& obstacles) const;
+    size_t CellIndex(int x, int y, int z) const {
+        return (static_cast<size_t>(z) * dimensions.y + y) * dimensions.x + x;
+    }
+
+    TaskScheduler& scheduler;
+    int resolution;
+    std::vector<glm::vec4> cells;
+    glm::ivec3 dimensions;
+    glm::vec3 origin;
+    float spacing;
+    size_t version;
+
+    int bakedResolution;
+    glm::vec3 bakedMin;
+    glm::vec3 bakedMax;
+    std::vector<Obstacle3D> bakedObstacles;
+};
+
+#endif // BOUNDARY_SDF_3D_H
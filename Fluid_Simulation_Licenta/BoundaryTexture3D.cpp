@@ -0,0 +1,49 @@
+#include "BoundaryTexture3D.h"
+
+BoundaryTexture3D::BoundaryTexture3D(TaskScheduler& scheduler)
+    : field(scheduler), texture(0), uploadedVersion(0) {}
+
+BoundaryTexture3D::~BoundaryTexture3D() {
+    glDeleteTextures(1, &texture);
+}
+
+void BoundaryTexture3D::Update(const FluidParams3D& params) {
+    field.SetResolution(params.boundaryResolution);
+    field.Update(params.boundingBoxMin, params.boundingBoxMax, obstacles);
+    if (field.GetVersion() != uploadedVersion) Upload();
+}
+
+void BoundaryTexture3D::Upload() {
+    if (texture == 0) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_3D, texture);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    }
+    const glm::ivec3& dimensions = field.GetDimensions();
+    glBindTexture(GL_TEXTURE_3D, texture);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, dimensions.x, dimensions.y, dimensions.z, 0, GL_RGBA, GL_FLOAT, field.GetCells().data());
+    glBindTexture(GL_TEXTURE_3D, 0);
+    CheckGLError("BoundaryTexture3D::Upload");
+    uploadedVersion = field.GetVersion();
+}
+
+void BoundaryTexture3D::Bind(ComputeShader* computeShader) const {
+    glActiveTexture(GL_TEXTURE0 + TextureUnit);
+    glBindTexture(GL_TEXTURE_3D, texture);
+    glActiveTexture(GL_TEXTURE0);
+    computeShader->setInt("boundarySdf", TextureUnit);
+    computeShader->setVec3("boundarySdfOrigin", field.GetOrigin());
+    computeShader->setVec3("boundarySdfExtent", glm::vec3(field.GetDimensions()) * field.GetSpacing());
+    computeShader->setFloat("boundarySdfSpacing", field.GetSpacing());
+}
+
+void BoundaryTexture3D::CheckGLError(const std::string& operation) {
+    GLenum err;
+    while ((err = glGetError()) != GL_NO_ERROR) {
+        std::cerr << "OpenGL error during " << operation << ": " << std::hex << err << std::dec << std::endl;
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef BOUNDARY_TEXTURE_3D_H
+#define BOUNDARY_TEXTURE_3D_H
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+
+#include "BoundarySDF3D.h"
+#include "ComputeShader.h"
+#include "FluidParams3D.h"
+
+// GPU copy of a BoundarySDF3D: an RGBA32F 3D texture with linear filtering, so the boundary
+// lookup in shaders/boundarySdf_3D.glsl is one hardware trilinear fetch. The field is baked on
+// the host and uploaded again only after a rebake.
+class BoundaryTexture3D {
+public:
+    explicit BoundaryTexture3D(TaskScheduler& scheduler = TaskScheduler::Instance());
+    ~BoundaryTexture3D();
+
+    void SetObstacles(const std::vector<Obstacle3D>& obstacles) { this->obstacles = obstacles; }
+    // Rebakes and uploads after the box or the obstacles changed.
+    void Update(const FluidParams3D& params);
+    // Binds the texture to TextureUnit and sets the uniforms boundarySdf_3D.glsl reads.
+    void Bind(ComputeShader* computeShader) const;
+    const BoundarySDF3D& GetField() const { return field; }
+
+    static const int TextureUnit = 1;
+
+private:
+    void Upload();
+    void CheckGLError(const std::string& operation);
+
+    BoundarySDF3D field;
+    std::vector<Obstacle3D> obstacles;
+    GLuint texture;
+    size_t uploadedVersion;
+};
+
+#endif // BOUNDARY_TEXTURE_3D_H
@@ -0,0 +1,452 @@
+#include "Checkpoint3D.h"
+#include "TaskScheduler.h"
+#include <cstring>
+#include <iostream>
+
+namespace {
+    const size_t HeaderSize = 16;
+    const size_t ChunkHeaderSize = 16;
+    const size_t MetaSize = 32;
+    // Large enough that the page faults of a mapped column are spread over the workers
+    const size_t CopyGrain = size_t(4) << 20;
+
+    // PARM is a list of { u32 field, u32 bits } records so fields can be added or
+    // dropped without breaking older files. Never renumber these.
+    enum ParamField : uint32_t {
+        DeltaTime = 1,
+        Gravity = 2,
+        CollisionDamping = 3,
+        SmoothingRadius = 4,
+        TargetDensity = 5,
+        PressureMultiplier = 6,
+        NearPressureMultiplier = 7,
+        ViscosityStrength = 8,
+        ParticleRadius = 9,
+        MaxVelocity = 10,
+        ReorderInterval = 11,
+        Deterministic = 12,
+        BoundingBoxMinX = 13,
+        BoundingBoxMinY = 14,
+        BoundingBoxMinZ = 15,
+        BoundingBoxMaxX = 16,
+        BoundingBoxMaxY = 17,
+        BoundingBoxMaxZ = 18,
+        InteractionInputStrength = 19,
+        InteractionInputRadius = 20,
+        BoundaryResolution = 21,
+        LongRangeStrength = 22,
+        LongRangeSoftening = 23,
+        BarnesHutTheta = 24,
+        RebinThreshold = 25,
+        PressureSolver = 26,
+        DensityTolerance = 27,
+        DivergenceTolerance = 28,
+        MaxPressureIterations = 29,
+        PbfIterations = 30,
+        PbfRelaxation = 31,
+        PbfTensileStrength = 32,
+        XsphViscosity = 33,
+        GridCellSize = 34,
+        GridPressureTolerance = 35,
+    };
+
+    template <typename T>
+    void Append(std::vector<unsigned char>& buffer, const T& value) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+    }
+
+    template <typename T>
+    T Load(const unsigned char* data) {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    uint32_t FloatBits(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    float BitsFloat(uint32_t bits) {
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    size_t PaddingFor(uint64_t offset) {
+        return static_cast<size_t>((Checkpoint3D::ChunkAlignment - offset % Checkpoint3D::ChunkAlignment) % Checkpoint3D::ChunkAlignment);
+    }
+
+    template <typename T>
+    void CopyColumn(const unsigned char* source, std::vector<T>& destination, size_t count) {
+        destination.resize(count);
+        if (!source) {
+            std::fill(destination.begin(), destination.end(), T(0));
+            return;
+        }
+        unsigned char* target = reinterpret_cast<unsigned char*>(destination.data());
+        size_t bytes = count * sizeof(T);
+        TaskScheduler::Instance().ParallelFor(0, bytes, CopyGrain, [&](size_t begin, size_t end) {
+            std::memcpy(target + begin, source + begin, end - begin);
+        });
+    }
+}
+
+bool Checkpoint3D::IsLittleEndianHost() {
+    const uint32_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+CheckpointWriter::CheckpointWriter() : chunkCount(0), chunkRemaining(0), inChunk(false), failed(false) {}
+
+CheckpointWriter::~CheckpointWriter() {
+    if (file.is_open()) {
+        std::cerr << "CheckpointWriter Error: " << path << " was not closed and is incomplete" << std::endl;
+    }
+}
+
+bool CheckpointWriter::Open(const std::string& path, const Checkpoint3D::State& state) {
+    if (!Checkpoint3D::IsLittleEndianHost()) {
+        std::cerr << "CheckpointWriter::Open Error: Checkpoints are little-endian and this host is not" << std::endl;
+        return false;
+    }
+
+    this->path = path;
+    this->state = state;
+    chunkCount = 0;
+    inChunk = false;
+    failed = false;
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "CheckpointWriter::Open Error: Cannot write " << path << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> header;
+    Append(header, Checkpoint3D::Magic);
+    Append(header, Checkpoint3D::Version);
+    Append(header, uint64_t(0));
+    if (!Write(header.data(), header.size())) return false;
+
+    std::vector<unsigned char> meta;
+    Append(meta, state.particleCount);
+    Append(meta, state.stepCount);
+    Append(meta, state.simulationTime);
+    Append(meta, state.simulationType);
+    Append(meta, uint32_t(0));
+
+    const FluidParams3D& p = state.params;
+    std::vector<unsigned char> params;
+    auto field = [&](ParamField id, uint32_t bits) {
+        Append(params, uint32_t(id));
+        Append(params, bits);
+    };
+    field(DeltaTime, FloatBits(p.deltaTime));
+    field(Gravity, FloatBits(p.gravity));
+    field(CollisionDamping, FloatBits(p.collisionDamping));
+    field(SmoothingRadius, FloatBits(p.smoothingRadius));
+    field(TargetDensity, FloatBits(p.targetDensity));
+    field(PressureMultiplier, FloatBits(p.pressureMultiplier));
+    field(NearPressureMultiplier, FloatBits(p.nearPressureMultiplier));
+    field(ViscosityStrength, FloatBits(p.viscosityStrength));
+    field(ParticleRadius, FloatBits(p.particleRadius));
+    field(MaxVelocity, FloatBits(p.maxVelocity));
+    field(ReorderInterval, static_cast<uint32_t>(p.reorderInterval));
+    field(Deterministic, p.deterministic ? 1u : 0u);
+    field(BoundaryResolution, static_cast<uint32_t>(p.boundaryResolution));
+    field(LongRangeStrength, FloatBits(p.longRangeStrength));
+    field(LongRangeSoftening, FloatBits(p.longRangeSoftening));
+    field(BarnesHutTheta, FloatBits(p.barnesHutTheta));
+    field(RebinThreshold, FloatBits(p.rebinThreshold));
+    field(PressureSolver, static_cast<uint32_t>(p.pressureSolver));
+    field(DensityTolerance, FloatBits(p.densityTolerance));
+    field(DivergenceTolerance, FloatBits(p.divergenceTolerance));
+    field(MaxPressureIterations, static_cast<uint32_t>(p.maxPressureIterations));
+    field(PbfIterations, static_cast<uint32_t>(p.pbfIterations));
+    field(PbfRelaxation, FloatBits(p.pbfRelaxation));
+    field(PbfTensileStrength, FloatBits(p.pbfTensileStrength));
+    field(XsphViscosity, FloatBits(p.xsphViscosity));
+    field(GridCellSize, FloatBits(p.gridCellSize));
+    field(GridPressureTolerance, FloatBits(p.gridPressureTolerance));
+    field(BoundingBoxMinX, FloatBits(p.boundingBoxMin.x));
+    field(BoundingBoxMinY, FloatBits(p.boundingBoxMin.y));
+    field(BoundingBoxMinZ, FloatBits(p.boundingBoxMin.z));
+    field(BoundingBoxMaxX, FloatBits(p.boundingBoxMax.x));
+    field(BoundingBoxMaxY, FloatBits(p.boundingBoxMax.y));
+    field(BoundingBoxMaxZ, FloatBits(p.boundingBoxMax.z));
+    field(InteractionInputStrength, FloatBits(p.interactionInputStrength));
+    field(InteractionInputRadius, FloatBits(p.interactionInputRadius));
+
+    return WriteChunk(Checkpoint3D::Meta, 0, meta.data(), meta.size())
+        && WriteChunk(Checkpoint3D::Params, 2 * sizeof(uint32_t), params.data(), params.size());
+}
+
+bool CheckpointWriter::BeginChunk(uint32_t tag, uint32_t elementSize, uint64_t payloadSize) {
+    if (inChunk) {
+        std::cerr << "CheckpointWriter::BeginChunk Error: Previous chunk was not ended" << std::endl;
+        failed = true;
+        return false;
+    }
+    if (!Pad()) return false;
+
+    std::vector<unsigned char> header;
+    Append(header, tag);
+    Append(header, elementSize);
+    Append(header, payloadSize);
+    // The payload, not the chunk header, has to land on the alignment boundary
+    if (!Write(header.data(), header.size())) return false;
+
+    inChunk = true;
+    chunkRemaining = payloadSize;
+    chunkCount++;
+    return true;
+}
+
+bool CheckpointWriter::Write(const void* data, size_t bytes) {
+    if (failed) return false;
+    if (inChunk) {
+        if (bytes > chunkRemaining) {
+            std::cerr << "CheckpointWriter::Write Error: Chunk payload is larger than announced" << std::endl;
+            failed = true;
+            return false;
+        }
+        chunkRemaining -= bytes;
+    }
+    file.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+    if (!file) {
+        std::cerr << "CheckpointWriter::Write Error: Write to " << path << " failed" << std::endl;
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool CheckpointWriter::EndChunk() {
+    if (!inChunk || chunkRemaining != 0) {
+        std::cerr << "CheckpointWriter::EndChunk Error: Chunk payload is " << chunkRemaining << " bytes short" << std::endl;
+        failed = true;
+        return false;
+    }
+    inChunk = false;
+    return true;
+}
+
+bool CheckpointWriter::WriteChunk(uint32_t tag, uint32_t elementSize, const void* data, uint64_t payloadSize) {
+    return BeginChunk(tag, elementSize, payloadSize) && Write(data, static_cast<size_t>(payloadSize)) && EndChunk();
+}
+
+bool CheckpointWriter::WriteParticleData(const ParticleData3D& particleData) {
+    size_t count = static_cast<size_t>(state.particleCount);
+    if (particleData.positions.size() != count || particleData.velocities.size() != count
+        || particleData.predictedPositions.size() != count || particleData.densities.size() != count) {
+        std::cerr << "CheckpointWriter::WriteParticleData Error: Columns do not hold " << count << " particles" << std::endl;
+        failed = true;
+        return false;
+    }
+
+    return WriteChunk(Checkpoint3D::Positions, sizeof(glm::vec3), particleData.positions.data(), count * sizeof(glm::vec3))
+        && WriteChunk(Checkpoint3D::Velocities, sizeof(glm::vec3), particleData.velocities.data(), count * sizeof(glm::vec3))
+        && WriteChunk(Checkpoint3D::PredictedPositions, sizeof(glm::vec3), particleData.predictedPositions.data(), count * sizeof(glm::vec3))
+        && WriteChunk(Checkpoint3D::Densities, sizeof(glm::vec2), particleData.densities.data(), count * sizeof(glm::vec2));
+}
+
+bool CheckpointWriter::Pad() {
+    static const unsigned char zeros[Checkpoint3D::ChunkAlignment] = {};
+    // Pad so that the payload after the next chunk header is aligned
+    uint64_t offset = static_cast<uint64_t>(file.tellp()) + ChunkHeaderSize;
+    size_t padding = PaddingFor(offset);
+    return padding == 0 || Write(zeros, padding);
+}
+
+bool CheckpointWriter::Close() {
+    if (!file.is_open()) return false;
+    if (inChunk) {
+        std::cerr << "CheckpointWriter::Close Error: Last chunk was not ended" << std::endl;
+        failed = true;
+    }
+    if (!failed) {
+        file.seekp(8);
+        file.write(reinterpret_cast<const char*>(&chunkCount), sizeof(chunkCount));
+    }
+    file.close();
+    if (failed || file.fail()) {
+        std::cerr << "CheckpointWriter::Close Error: " << path << " is incomplete" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool CheckpointReader::Open(const std::string& path) {
+    Close();
+    this->path = path;
+
+    if (!Checkpoint3D::IsLittleEndianHost()) {
+        std::cerr << "CheckpointReader::Open Error: Checkpoints are little-endian and this host is not" << std::endl;
+        return false;
+    }
+    if (!mapping.Open(path)) return false;
+
+    const unsigned char* data = mapping.GetData();
+    size_t size = mapping.GetSize();
+    if (size < HeaderSize || Load<uint32_t>(data) != Checkpoint3D::Magic) {
+        std::cerr << "CheckpointReader::Open Error: " << path << " is not a checkpoint" << std::endl;
+        Close();
+        return false;
+    }
+
+    version = Load<uint32_t>(data + 4);
+    if (version == 0 || version > Checkpoint3D::Version) {
+        std::cerr << "CheckpointReader::Open Error: " << path << " has version " << version
+            << ", this build reads up to " << Checkpoint3D::Version << std::endl;
+        Close();
+        return false;
+    }
+
+    uint64_t chunkCount = Load<uint64_t>(data + 8);
+    size_t offset = HeaderSize;
+    for (uint64_t i = 0; i < chunkCount; ++i) {
+        offset += PaddingFor(offset + ChunkHeaderSize);
+        if (offset + ChunkHeaderSize > size) break;
+
+        Chunk chunk;
+        chunk.tag = Load<uint32_t>(data + offset);
+        chunk.elementSize = Load<uint32_t>(data + offset + 4);
+        chunk.size = Load<uint64_t>(data + offset + 8);
+        offset += ChunkHeaderSize;
+        if (chunk.size > size - offset) {
+            std::cerr << "CheckpointReader::Open Error: " << path << " is truncated" << std::endl;
+            Close();
+            return false;
+        }
+        chunk.data = data + offset;
+        chunks.push_back(chunk);
+        offset += static_cast<size_t>(chunk.size);
+    }
+
+    const Chunk* meta = FindChunk(Checkpoint3D::Meta);
+    if (chunks.size() != chunkCount || !meta || !ParseMeta(*meta)) {
+        std::cerr << "CheckpointReader::Open Error: " << path << " is truncated or has no META chunk" << std::endl;
+        Close();
+        return false;
+    }
+    if (const Chunk* params = FindChunk(Checkpoint3D::Params)) ParseParams(*params);
+    return true;
+}
+
+void CheckpointReader::Close() {
+    mapping.Close();
+    chunks.clear();
+    state = Checkpoint3D::State();
+    version = 0;
+}
+
+bool CheckpointReader::ParseMeta(const Chunk& chunk) {
+    if (chunk.size < MetaSize) return false;
+    state.particleCount = Load<uint64_t>(chunk.data);
+    state.stepCount = Load<uint64_t>(chunk.data + 8);
+    state.simulationTime = Load<double>(chunk.data + 16);
+    state.simulationType = Load<uint32_t>(chunk.data + 24);
+    return true;
+}
+
+void CheckpointReader::ParseParams(const Chunk& chunk) {
+    FluidParams3D& p = state.params;
+    for (uint64_t offset = 0; offset + 8 <= chunk.size; offset += 8) {
+        uint32_t id = Load<uint32_t>(chunk.data + offset);
+        uint32_t bits = Load<uint32_t>(chunk.data + offset + 4);
+        float value = BitsFloat(bits);
+        switch (id) {
+        case DeltaTime: p.deltaTime = value; break;
+        case Gravity: p.gravity = value; break;
+        case CollisionDamping: p.collisionDamping = value; break;
+        case SmoothingRadius: p.smoothingRadius = value; break;
+        case TargetDensity: p.targetDensity = value; break;
+        case PressureMultiplier: p.pressureMultiplier = value; break;
+        case NearPressureMultiplier: p.nearPressureMultiplier = value; break;
+        case ViscosityStrength: p.viscosityStrength = value; break;
+        case ParticleRadius: p.particleRadius = value; break;
+        case MaxVelocity: p.maxVelocity = value; break;
+        case ReorderInterval: p.reorderInterval = static_cast<int>(bits); break;
+        case Deterministic: p.deterministic = bits != 0; break;
+        case BoundaryResolution: p.boundaryResolution = static_cast<int>(bits); break;
+        case LongRangeStrength: p.longRangeStrength = value; break;
+        case LongRangeSoftening: p.longRangeSoftening = value; break;
+        case BarnesHutTheta: p.barnesHutTheta = value; break;
+        case RebinThreshold: p.rebinThreshold = value; break;
+        case PressureSolver: p.pressureSolver = bits <= 2 ? static_cast<PressureSolver3D>(bits) : PressureSolver3D::Explicit; break;
+        case DensityTolerance: p.densityTolerance = value; break;
+        case DivergenceTolerance: p.divergenceTolerance = value; break;
+        case MaxPressureIterations: p.maxPressureIterations = static_cast<int>(bits); break;
+        case PbfIterations: p.pbfIterations = static_cast<int>(bits); break;
+        case PbfRelaxation: p.pbfRelaxation = value; break;
+        case PbfTensileStrength: p.pbfTensileStrength = value; break;
+        case XsphViscosity: p.xsphViscosity = value; break;
+        case GridCellSize: p.gridCellSize = value; break;
+        case GridPressureTolerance: p.gridPressureTolerance = value; break;
+        case BoundingBoxMinX: p.boundingBoxMin.x = value; break;
+        case BoundingBoxMinY: p.boundingBoxMin.y = value; break;
+        case BoundingBoxMinZ: p.boundingBoxMin.z = value; break;
+        case BoundingBoxMaxX: p.boundingBoxMax.x = value; break;
+        case BoundingBoxMaxY: p.boundingBoxMax.y = value; break;
+        case BoundingBoxMaxZ: p.boundingBoxMax.z = value; break;
+        case InteractionInputStrength: p.interactionInputStrength = value; break;
+        case InteractionInputRadius: p.interactionInputRadius = value; break;
+        default: break;
+        }
+    }
+}
+
+const CheckpointReader::Chunk* CheckpointReader::FindChunk(uint32_t tag) const {
+    for (const Chunk& chunk : chunks) {
+        if (chunk.tag == tag) return &chunk;
+    }
+    return nullptr;
+}
+
+const unsigned char* CheckpointReader::GetColumn(uint32_t tag, size_t elementSize) const {
+    const Chunk* chunk = FindChunk(tag);
+    if (!chunk) return nullptr;
+    if (chunk->elementSize != elementSize || chunk->size != state.particleCount * elementSize) {
+        std::cerr << "CheckpointReader::GetColumn Error: Chunk size in " << path << " does not match "
+            << state.particleCount << " particles" << std::endl;
+        return nullptr;
+    }
+    return chunk->data;
+}
+
+bool CheckpointReader::ReadParticleData(ParticleData3D& particleData) const {
+    const unsigned char* positions = GetColumn(Checkpoint3D::Positions, sizeof(glm::vec3));
+    if (!positions) {
+        std::cerr << "CheckpointReader::ReadParticleData Error: " << path << " has no positions" << std::endl;
+        return false;
+    }
+
+    size_t count = static_cast<size_t>(state.particleCount);
+    CopyColumn(positions, particleData.positions, count);
+    CopyColumn(GetColumn(Checkpoint3D::Velocities, sizeof(glm::vec3)), particleData.velocities, count);
+    const unsigned char* predicted = GetColumn(Checkpoint3D::PredictedPositions, sizeof(glm::vec3));
+    CopyColumn(predicted ? predicted : positions, particleData.predictedPositions, count);
+    CopyColumn(GetColumn(Checkpoint3D::Densities, sizeof(glm::vec2)), particleData.densities, count);
+    particleData.spatialIndices.assign(count, glm::uvec3(0));
+    particleData.spatialOffsets.assign(count, 0);
+    return true;
+}
+
+std::vector<uint32_t> CheckpointReader::ReadParticleIds() const {
+    std::vector<uint32_t> ids;
+    const unsigned char* column = GetColumn(Checkpoint3D::ParticleIds, sizeof(uint32_t));
+    if (column) CopyColumn(column, ids, static_cast<size_t>(state.particleCount));
+    return ids;
+}
+
+std::vector<glm::mat3> CheckpointReader::ReadAffine() const {
+    std::vector<glm::mat3> affine;
+    const unsigned char* column = GetColumn(Checkpoint3D::Affine, sizeof(glm::mat3));
+    if (column) CopyColumn(column, affine, static_cast<size_t>(state.particleCount));
+    return affine;
+}
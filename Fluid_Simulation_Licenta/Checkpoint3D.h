@@ -0,0 +1,123 @@
+#ifndef CHECKPOINT_3D_H
+#define CHECKPOINT_3D_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "FluidParams3D.h"
+#include "MemoryMappedFile.h"
+#include "ParticleData.h"
+
+// Binary checkpoint of the 3D particle state.
+// Everything is little-endian. The file is a 16-byte header (magic "FSCP", u32 version,
+// u64 chunk count) followed by chunks of { u32 tag, u32 element size, u64 payload size,
+// payload }. Payloads start on a ChunkAlignment boundary so a mapped file can be handed
+// to glBufferData or a vector as is. Readers skip chunks with unknown tags, so new
+// chunks can be added without a version bump; the version only changes when the
+// meaning of an existing chunk does.
+namespace Checkpoint3D {
+    const uint32_t Magic = 0x50435346; // "FSCP"
+    const uint32_t Version = 1;
+    const size_t ChunkAlignment = 64;
+
+    constexpr uint32_t MakeTag(char a, char b, char c, char d) {
+        return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+    }
+
+    enum ChunkTag : uint32_t {
+        Meta = MakeTag('M', 'E', 'T', 'A'),
+        Params = MakeTag('P', 'A', 'R', 'M'),
+        Positions = MakeTag('P', 'O', 'S', 'I'),
+        Velocities = MakeTag('V', 'E', 'L', 'O'),
+        PredictedPositions = MakeTag('P', 'R', 'E', 'D'),
+        Densities = MakeTag('D', 'E', 'N', 'S'),
+        ParticleIds = MakeTag('P', 'I', 'D', 'S'),
+        // glm::mat3 per particle, the grid backend's APIC affine matrices
+        Affine = MakeTag('A', 'F', 'F', 'N'),
+    };
+
+    // Everything in a checkpoint except the particle columns.
+    struct State {
+        uint64_t particleCount = 0;
+        uint64_t stepCount = 0;
+        double simulationTime = 0.0;
+        uint32_t simulationType = 0;
+        FluidParams3D params;
+    };
+
+    bool IsLittleEndianHost();
+}
+
+// Writes a checkpoint front to back. Columns can be written in one call, or streamed
+// in pieces between BeginChunk and EndChunk when they come from a GPU staging buffer.
+class CheckpointWriter {
+public:
+    CheckpointWriter();
+    ~CheckpointWriter();
+
+    // Creates the file and writes the header, META and PARM chunks.
+    bool Open(const std::string& path, const Checkpoint3D::State& state);
+    bool BeginChunk(uint32_t tag, uint32_t elementSize, uint64_t payloadSize);
+    bool Write(const void* data, size_t bytes);
+    bool EndChunk();
+    bool WriteChunk(uint32_t tag, uint32_t elementSize, const void* data, uint64_t payloadSize);
+    // Writes the columns that live on the host.
+    bool WriteParticleData(const ParticleData3D& particleData);
+    // Patches the chunk count into the header. The file is only valid after this returns true.
+    bool Close();
+
+    const Checkpoint3D::State& GetState() const { return state; }
+
+private:
+    bool Pad();
+
+    std::ofstream file;
+    std::string path;
+    Checkpoint3D::State state;
+    uint64_t chunkCount;
+    uint64_t chunkRemaining;
+    bool inChunk;
+    bool failed;
+};
+
+// Maps a checkpoint and gives direct pointers into it; nothing is copied until
+// the caller copies a column into its own storage.
+class CheckpointReader {
+public:
+    struct Chunk {
+        uint32_t tag = 0;
+        uint32_t elementSize = 0;
+        uint64_t size = 0;
+        const unsigned char* data = nullptr;
+    };
+
+    bool Open(const std::string& path);
+    void Close();
+
+    const Checkpoint3D::State& GetState() const { return state; }
+    uint32_t GetVersion() const { return version; }
+    // Returns nullptr when the chunk is missing.
+    const Chunk* FindChunk(uint32_t tag) const;
+    // A particle column chunk, checked to hold particleCount elements of elementSize bytes.
+    const unsigned char* GetColumn(uint32_t tag, size_t elementSize) const;
+    // Copies the columns into host vectors. Missing optional columns are zero filled.
+    bool ReadParticleData(ParticleData3D& particleData) const;
+    // The spawn ids of the CPU solver, or an empty vector when the checkpoint has none.
+    std::vector<uint32_t> ReadParticleIds() const;
+    // The grid backend's affine matrices, or an empty vector when the checkpoint has none.
+    std::vector<glm::mat3> ReadAffine() const;
+
+private:
+    bool ParseMeta(const Chunk& chunk);
+    void ParseParams(const Chunk& chunk);
+
+    MemoryMappedFile mapping;
+    std::string path;
+    uint32_t version = 0;
+    Checkpoint3D::State state;
+    std::vector<Chunk> chunks;
+};
+
+#endif // CHECKPOINT_3D_H
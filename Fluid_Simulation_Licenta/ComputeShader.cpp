@@ -69,6 +69,11 @@ void ComputeShader::setVec2(const std::string& name, float x, float y) const {
     CheckGLError("ComputeShader::setVec2");
 }
 
+void ComputeShader::setIVec3(const std::string& name, const glm::ivec3& value) const {
+    glUniform3iv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    CheckGLError("ComputeShader::setIVec3");
+}
+
 void ComputeShader::setVec3(const std::string& name, const glm::vec3& value) const {
     glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
     CheckGLError("ComputeShader::setVec3");
@@ -129,6 +134,26 @@ void ComputeShader::DispatchComputeShader(GLuint particleCount, int numThreads)
 }
 
 
+void ComputeShader::DispatchComputeIndirect(GLuint indirectBuffer, GLintptr offset) const {
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, indirectBuffer);
+    glDispatchComputeIndirect(offset);
+    CheckGLError("ComputeShader::DispatchComputeIndirect - DispatchComputeIndirect");
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+    // Later passes may read the results as storage, as indirect arguments or through a readback
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    CheckGLError("ComputeShader::DispatchComputeIndirect - MemoryBarrier");
+}
+
+void ComputeShader::DispatchGroups(GLuint numGroups) const {
+    if (numGroups == 0) return;
+    glDispatchCompute(numGroups, 1, 1);
+    CheckGLError("ComputeShader::DispatchGroups - DispatchCompute");
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    CheckGLError("ComputeShader::DispatchGroups - MemoryBarrier");
+}
+
 void ComputeShader::QueryMaxWorkGroupAndComputeUnits(GLint* maxWorkGroupCount, GLint* maxWorkGroupSize, GLint& maxComputeWorkGroupInvocations) const {
     glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &maxWorkGroupCount[0]);
     glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 1, &maxWorkGroupCount[1]);
@@ -22,6 +22,7 @@ public:
     void setUInt(const std::string& name, unsigned int value) const;
     void setFloat(const std::string& name, float value) const;
     void setBVec2(const std::string& name, const glm::bvec2& value) const;
+    void setIVec3(const std::string& name, const glm::ivec3& value) const;
     void setVec2(const std::string& name, const glm::vec2& value) const;
     void setVec2(const std::string& name, float x, float y) const;
     void setVec3(const std::string& name, const glm::vec3& value) const;
@@ -33,6 +34,10 @@ public:
     void setMat4(const std::string& name, const glm::mat4& mat) const;
 
     void DispatchComputeShader(GLuint particleCount, int = 64) const;
+    // Takes the group counts from indirectBuffer at offset, so a count written by an earlier pass
+    // sizes the launch without a readback. Neither this nor DispatchGroups waits for the GPU.
+    void DispatchComputeIndirect(GLuint indirectBuffer, GLintptr offset = 0) const;
+    void DispatchGroups(GLuint numGroups) const;
 
 private:
     ShaderPreprocessor preprocessor;
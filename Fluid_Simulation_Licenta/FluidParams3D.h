@@ -0,0 +1,84 @@
+#ifndef FLUID_PARAMS_3D_H
+#define FLUID_PARAMS_3D_H
+
+#include <memory>
+#include <glm/glm.hpp>
+
+class TriangleMesh3D;
+
+// Solid that particles are pushed out of. Every shape fills the box given by centre and size:
+// a sphere's diameter is size.x, and a mesh is scaled uniformly to fit and centred on centre.
+struct Obstacle3D {
+    enum class Shape { Box, Sphere, Mesh };
+
+    Shape shape = Shape::Box;
+    glm::vec3 centre = glm::vec3(0.0f);
+    glm::vec3 size = glm::vec3(1.0f);
+    // Closed triangle mesh in model space, for Shape::Mesh
+    std::shared_ptr<const TriangleMesh3D> mesh;
+};
+
+// How the CPU backend turns density into pressure. Explicit is the equation of state of the shaders:
+// pressure grows with the density error, so stiff settings need small steps. DFSPH solves for the
+// pressures that keep the velocity field divergence-free and the density at rest, iterating until
+// the errors fall below a tolerance, so the step is only limited by how far particles move.
+// PBF (position-based fluids) projects the predicted positions onto the rest density with a fixed
+// number of constraint iterations; it stays stable at 1/60 s steps at the cost of some compression.
+enum class PressureSolver3D { Explicit, DFSPH, PBF };
+
+// Snapshot of the 3D solver settings. ShaderManager3D owns the values that are
+// edited through ImGui; the CPU backend only ever sees this plain struct.
+struct FluidParams3D {
+    float deltaTime = 0.0007f;
+    float gravity = 9.81f;
+    float collisionDamping = 0.5f;
+    float smoothingRadius = 1.0f;
+    float targetDensity = 1.0f;
+    float pressureMultiplier = 1.0f;
+    float nearPressureMultiplier = 1.0f;
+    float viscosityStrength = 1.0f;
+    float particleRadius = 1.0f;
+    float maxVelocity = 50.0f;
+    // CPU backend: sort particles by Morton cell every this many steps, 0 disables it
+    int reorderInterval = 16;
+    // Neighbour sorts re-sort only the particles whose cell changed and merge them back in while at
+    // most this fraction of them did; above it, or at 0, the sort starts from scratch
+    float rebinThreshold = 0.25f;
+    PressureSolver3D pressureSolver = PressureSolver3D::Explicit;
+    // DFSPH stops iterating once the average density error, and the average density change over the
+    // step, are below these fractions of the rest density, or after maxPressureIterations
+    float densityTolerance = 0.001f;
+    float divergenceTolerance = 0.001f;
+    int maxPressureIterations = 100;
+    // PBF: constraint iterations per step, the relaxation added to every constraint's gradient sum,
+    // the strength of the artificial pressure against clustering, and the XSPH velocity blend
+    int pbfIterations = 4;
+    float pbfRelaxation = 0.01f;
+    float pbfTensileStrength = 0.1f;
+    float xsphViscosity = 0.05f;
+    // Grid backend: edge of a MAC grid cell, 0 = twice the particle spacing (4 * particleRadius), and
+    // the pressure solve stops once its largest residual is this fraction of the largest divergence,
+    // or after maxPressureIterations
+    float gridCellSize = 0.0f;
+    float gridPressureTolerance = 1e-4f;
+    // CPU backend: fixed neighbour order and reductions, bitwise identical for any thread count
+    bool deterministic = false;
+    // Cells along the longest side of the box in the baked boundary field
+    int boundaryResolution = 64;
+    // CPU backend: Barnes-Hut attraction between all particles, 0 disables it
+    float longRangeStrength = 0.0f;
+    // Keeps the attraction finite at short range: pairs pull like point masses this far apart
+    float longRangeSoftening = 1.0f;
+    // Opening angle: a tree node acts as one mass once its size over its distance is below this
+    float barnesHutTheta = 0.5f;
+
+    glm::vec3 boundingBoxMin = glm::vec3(0.0f);
+    glm::vec3 boundingBoxMax = glm::vec3(32.0f);
+
+    glm::vec3 interactionInputPoint = glm::vec3(0.0f);
+    float interactionInputStrength = 1.0f;
+    float interactionInputRadius = 1.0f;
+    glm::bvec2 isXButtonDown = glm::bvec2(false, false);
+};
+
+#endif // FLUID_PARAMS_3D_H
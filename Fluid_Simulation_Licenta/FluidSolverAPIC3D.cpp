@@ -0,0 +1,533 @@
+#include "FluidSolverAPIC3D.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Quadratic B-spline weights of the three nodes from base along one axis, for a particle at
+    // fraction = g - base in [0.5, 1.5)
+    inline glm::vec3 SplineWeights(float fraction) {
+        float a = 1.5f - fraction;
+        float b = fraction - 1.0f;
+        float c = fraction - 0.5f;
+        return glm::vec3(0.5f * a * a, 0.75f - b * b, 0.5f * c * c);
+    }
+
+    // Z slices per task, so that a task covers about CellGrain cells
+    inline size_t SliceGrain(const glm::ivec3& dims, size_t cellGrain) {
+        size_t slice = static_cast<size_t>(dims.x) * dims.y;
+        return std::max<size_t>(1, cellGrain / std::max<size_t>(slice, 1));
+    }
+}
+
+FluidSolverAPIC3D::FluidSolverAPIC3D(TaskScheduler& scheduler)
+    : scheduler(scheduler), radixSort(scheduler), origin(0.0f), dims(0), cellSize(0.0f), solidVersion(0), fluidCellCount(0),
+    poisson(scheduler), boundary(scheduler) {}
+
+FluidSolverAPIC3D::~FluidSolverAPIC3D() {}
+
+void FluidSolverAPIC3D::Step(ParticleData3D& particleData, const FluidParams3D& params) {
+    if (particleData.positions.empty()) return;
+    ScopedTimer stepTimer("APIC/Step");
+
+    size_t count = particleData.positions.size();
+    particleData.velocities.resize(count);
+    particleData.predictedPositions.resize(count);
+    particleData.densities.resize(count);
+    affine.resize(count, glm::mat3(0.0f));
+    trackedPositions.resize(count, glm::vec3(0.0f));
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            if (particleData.positions[i] != trackedPositions[i]) affine[i] = glm::mat3(0.0f);
+        }
+    });
+
+    UpdateGrid(params);
+
+    // CFL: no particle crosses more than one cell in a substep
+    float travel = GetMaxVelocity(particleData) * params.deltaTime / cellSize;
+    int substeps = glm::clamp(static_cast<int>(std::ceil(travel)), 1, MaxSubsteps);
+    float deltaTime = params.deltaTime / substeps;
+
+    for (int substep = 0; substep < substeps; ++substep) {
+        {
+            ScopedTimer timer("APIC/External Forces");
+            ApplyExternalForces(particleData, params, deltaTime);
+        }
+        {
+            ScopedTimer timer("APIC/Binning");
+            BinParticles(particleData);
+        }
+        {
+            ScopedTimer timer("APIC/Transfer to Grid");
+            TransferToGrid(particleData);
+        }
+        {
+            ScopedTimer timer("APIC/Pressure Solve");
+            SolvePressure(params);
+        }
+        {
+            ScopedTimer timer("APIC/Extrapolation");
+            ExtrapolateVelocities();
+        }
+        {
+            ScopedTimer timer("APIC/Transfer to Particles");
+            TransferToParticles(particleData, params, deltaTime);
+        }
+    }
+    lastPressureSolve.substeps = substeps;
+
+    Profiler& profiler = Profiler::Instance();
+    profiler.SetCounter("APIC/Substeps", substeps);
+    profiler.SetCounter("APIC/Fluid Cells", static_cast<double>(fluidCellCount));
+    profiler.SetCounter("APIC/CG Iterations", lastPressureSolve.iterations);
+    profiler.SetCounter("APIC/Relative Residual", lastPressureSolve.error);
+}
+
+void FluidSolverAPIC3D::Reserve(size_t capacity) {
+    sortedCells.reserve(capacity);
+    sortedParticles.reserve(capacity);
+    affine.reserve(capacity);
+    trackedPositions.reserve(capacity);
+}
+
+glm::ivec3 FluidSolverAPIC3D::FaceDims(int axis) const {
+    glm::ivec3 faceDims = dims;
+    faceDims[axis] += 1;
+    return faceDims;
+}
+
+void FluidSolverAPIC3D::UpdateGrid(const FluidParams3D& params) {
+    boundary.SetResolution(params.boundaryResolution);
+    boundary.Update(params.boundingBoxMin, params.boundingBoxMax, obstacles);
+
+    // Twice the particle spacing by default, about eight particles to a cell
+    float size = params.gridCellSize > 0.0f ? params.gridCellSize : 4.0f * params.particleRadius;
+    glm::vec3 extent = glm::max(params.boundingBoxMax - params.boundingBoxMin, glm::vec3(size));
+    glm::ivec3 newDims = glm::max(glm::ivec3(glm::ceil(extent / size - 1e-4f)), glm::ivec3(1));
+
+    if (newDims != dims || size != cellSize || params.boundingBoxMin != origin) {
+        dims = newDims;
+        cellSize = size;
+        origin = params.boundingBoxMin;
+        size_t cellCount = static_cast<size_t>(dims.x) * dims.y * dims.z;
+        cellTypes.assign(cellCount, Air);
+        for (int axis = 0; axis < 3; ++axis) {
+            glm::ivec3 faceDims = FaceDims(axis);
+            size_t faceCount = static_cast<size_t>(faceDims.x) * faceDims.y * faceDims.z;
+            faceVelocities[axis].assign(faceCount, 0.0f);
+            faceWeights[axis].assign(faceCount, 0.0f);
+            faceValid[axis].assign(faceCount, 0);
+        }
+        pressure.assign(cellCount, 0.0f);
+        divergence.assign(cellCount, 0.0f);
+        // Forces the walls to be marked again below
+        solidVersion = boundary.GetVersion() + 1;
+    }
+
+    if (solidVersion == boundary.GetVersion()) return;
+    MultigridPoisson3D::ClassifyFromSDF(boundary, origin, cellSize, dims, MultigridPoisson3D::Neumann, solidCells, scheduler);
+    solidVersion = boundary.GetVersion();
+}
+
+void FluidSolverAPIC3D::ApplyExternalForces(ParticleData3D& particleData, const FluidParams3D& params, float deltaTime) {
+    scheduler.ParallelFor(0, particleData.positions.size(), ParticleGrain, [&](size_t begin, size_t end) {
+        glm::vec3 gravityAccel(0.0f, -params.gravity, 0.0f);
+        float sqrInputRadius = params.interactionInputRadius * params.interactionInputRadius;
+
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec3 pos = particleData.positions[i];
+            glm::vec3 velocity = particleData.velocities[i];
+            glm::vec3 accel = gravityAccel;
+
+            // Input interactions modify gravity proportional to the distance from the interaction point
+            if (params.interactionInputStrength != 0.0f) {
+                glm::vec3 inputPointOffset = params.interactionInputPoint - pos;
+                if (params.isXButtonDown[1]) inputPointOffset = -inputPointOffset;
+
+                float sqrDst = glm::dot(inputPointOffset, inputPointOffset);
+                if (sqrDst < sqrInputRadius && sqrDst > 0.0f) {
+                    float dst = std::sqrt(sqrDst);
+                    float centreT = 1.0f - dst / params.interactionInputRadius;
+                    glm::vec3 dirToCentre = inputPointOffset / dst;
+
+                    float gravityWeight = 1.0f - (centreT * glm::clamp(params.interactionInputStrength / 10.0f, 0.0f, 1.0f));
+                    accel = gravityAccel * gravityWeight + dirToCentre * centreT * params.interactionInputStrength;
+                    accel -= velocity * centreT;
+                }
+            }
+            particleData.velocities[i] = velocity + accel * deltaTime;
+        }
+    });
+}
+
+void FluidSolverAPIC3D::BinParticles(const ParticleData3D& particleData) {
+    size_t count = particleData.positions.size();
+    sortedCells.resize(count);
+    sortedParticles.resize(count);
+    glm::vec3 upper = glm::vec3(dims) - 1e-3f;
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec3 g = glm::clamp((particleData.positions[i] - origin) / cellSize, glm::vec3(0.0f), upper);
+            glm::ivec3 cell = glm::ivec3(g);
+            sortedCells[i] = static_cast<uint32_t>(CellIndex(cell.x, cell.y, cell.z));
+            sortedParticles[i] = static_cast<uint32_t>(i);
+        }
+    });
+
+    size_t cellCount = static_cast<size_t>(dims.x) * dims.y * dims.z;
+    uint32_t keyBits = 1;
+    while (keyBits < 32 && (size_t(1) << keyBits) < cellCount) keyBits++;
+    radixSort.Sort(sortedCells, sortedParticles, keyBits);
+
+    size_t slabCount = (static_cast<size_t>(dims.z) + SlabCells - 1) / SlabCells;
+    size_t slabCells = static_cast<size_t>(dims.x) * dims.y * SlabCells;
+    slabStart.resize(slabCount + 1);
+    for (size_t slab = 0; slab <= slabCount; ++slab) {
+        uint32_t firstCell = static_cast<uint32_t>(std::min(slab * slabCells, cellCount));
+        slabStart[slab] = std::lower_bound(sortedCells.begin(), sortedCells.end(), firstCell) - sortedCells.begin();
+    }
+
+    // Slabs hold disjoint cells, so each can mark its own
+    std::vector<uint8_t>& types = cellTypes;
+    scheduler.ParallelFor(0, slabCount, 1, [&](size_t slabBegin, size_t slabEnd) {
+        for (size_t cell = slabBegin * slabCells; cell < std::min(slabEnd * slabCells, cellCount); ++cell) {
+            types[cell] = solidCells[cell] == Solid ? Solid : Air;
+        }
+        for (size_t slot = slabStart[slabBegin]; slot < slabStart[slabEnd]; ++slot) {
+            uint32_t cell = sortedCells[slot];
+            if (types[cell] == Air) types[cell] = Fluid;
+        }
+    });
+    fluidCellCount = scheduler.ParallelReduce(size_t(0), cellCount, CellGrain, size_t(0),
+        [&](size_t begin, size_t end) {
+            size_t fluid = 0;
+            for (size_t cell = begin; cell < end; ++cell) fluid += types[cell] == Fluid;
+            return fluid;
+        },
+        [](size_t a, size_t b) { return a + b; });
+}
+
+void FluidSolverAPIC3D::TransferToGrid(const ParticleData3D& particleData) {
+    for (int axis = 0; axis < 3; ++axis) {
+        std::fill(faceVelocities[axis].begin(), faceVelocities[axis].end(), 0.0f);
+        std::fill(faceWeights[axis].begin(), faceWeights[axis].end(), 0.0f);
+    }
+
+    glm::vec3 upper = glm::vec3(dims) - 1e-3f;
+    size_t slabCount = slabStart.size() - 1;
+    for (size_t colour = 0; colour < 2; ++colour) {
+        size_t colourSlabs = (slabCount + 1 - colour) / 2;
+        scheduler.ParallelFor(0, colourSlabs, 1, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                size_t slab = 2 * k + colour;
+                for (size_t slot = slabStart[slab]; slot < slabStart[slab + 1]; ++slot) {
+                    uint32_t i = sortedParticles[slot];
+                    glm::vec3 x = glm::clamp((particleData.positions[i] - origin) / cellSize, glm::vec3(0.0f), upper);
+                    const glm::vec3& velocity = particleData.velocities[i];
+                    const glm::mat3& c = affine[i];
+
+                    for (int axis = 0; axis < 3; ++axis) {
+                        // Face (i, j, k) of this axis sits at i along the axis and at the cell centres across it.
+                        // Nodes past the edge of the grid stand for the edge face, so the weights always sum to one
+                        glm::vec3 g = x - 0.5f;
+                        g[axis] += 0.5f;
+                        glm::ivec3 base = glm::ivec3(glm::floor(g - 0.5f));
+                        glm::vec3 fraction = g - glm::vec3(base);
+                        glm::vec3 w[3] = { SplineWeights(fraction.x), SplineWeights(fraction.y), SplineWeights(fraction.z) };
+                        glm::ivec3 faceDims = FaceDims(axis);
+                        std::vector<float>& momentum = faceVelocities[axis];
+                        std::vector<float>& weights = faceWeights[axis];
+
+                        for (int dz = 0; dz < 3; ++dz) {
+                            int fz = glm::clamp(base.z + dz, 0, faceDims.z - 1);
+                            for (int dy = 0; dy < 3; ++dy) {
+                                int fy = glm::clamp(base.y + dy, 0, faceDims.y - 1);
+                                for (int dx = 0; dx < 3; ++dx) {
+                                    int fx = glm::clamp(base.x + dx, 0, faceDims.x - 1);
+                                    float weight = w[0][dx] * w[1][dy] * w[2][dz];
+                                    glm::vec3 offset = (glm::vec3(base + glm::ivec3(dx, dy, dz)) - g) * cellSize;
+                                    size_t face = (static_cast<size_t>(fz) * faceDims.y + fy) * faceDims.x + fx;
+                                    momentum[face] += weight * (velocity[axis] + glm::dot(c[axis], offset));
+                                    weights[face] += weight;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    for (int axis = 0; axis < 3; ++axis) {
+        std::vector<float>& velocities = faceVelocities[axis];
+        const std::vector<float>& weights = faceWeights[axis];
+        scheduler.ParallelFor(0, velocities.size(), CellGrain, [&](size_t begin, size_t end) {
+            for (size_t face = begin; face < end; ++face) {
+                velocities[face] = weights[face] > 0.0f ? velocities[face] / weights[face] : 0.0f;
+            }
+        });
+    }
+}
+
+void FluidSolverAPIC3D::ClearSolidFaces() {
+    const std::vector<uint8_t>& types = cellTypes;
+    for (int axis = 0; axis < 3; ++axis) {
+        glm::ivec3 faceDims = FaceDims(axis);
+        size_t stride = axis == 0 ? 1 : axis == 1 ? static_cast<size_t>(dims.x) : static_cast<size_t>(dims.x) * dims.y;
+        std::vector<float>& velocities = faceVelocities[axis];
+        scheduler.ParallelFor(0, faceDims.z, SliceGrain(faceDims, CellGrain), [&](size_t zBegin, size_t zEnd) {
+            for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+                for (int y = 0; y < faceDims.y; ++y) {
+                    for (int x = 0; x < faceDims.x; ++x) {
+                        glm::ivec3 face(x, y, z);
+                        size_t index = (static_cast<size_t>(z) * faceDims.y + y) * faceDims.x + x;
+                        if (face[axis] == 0 || face[axis] == dims[axis]) {
+                            velocities[index] = 0.0f;
+                            continue;
+                        }
+                        size_t right = CellIndex(x, y, z);
+                        if (types[right] == Solid || types[right - stride] == Solid) velocities[index] = 0.0f;
+                    }
+                }
+            }
+        });
+    }
+}
+
+void FluidSolverAPIC3D::SolvePressure(const FluidParams3D& params) {
+    ClearSolidFaces();
+    lastPressureSolve.iterations = 0;
+    lastPressureSolve.error = 0.0f;
+    if (fluidCellCount == 0) return;
+
+    // Right-hand side: minus the divergence of every fluid cell, in velocity units; the pressure is
+    // solved scaled by dt / (density * cellSize), so a face subtracts the plain pressure difference
+    const std::vector<float>& u = faceVelocities[0];
+    const std::vector<float>& v = faceVelocities[1];
+    const std::vector<float>& w = faceVelocities[2];
+    scheduler.ParallelFor(0, dims.z, SliceGrain(dims, CellGrain), [&](size_t zBegin, size_t zEnd) {
+        for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+            for (int y = 0; y < dims.y; ++y) {
+                for (int x = 0; x < dims.x; ++x) {
+                    size_t index = CellIndex(x, y, z);
+                    if (cellTypes[index] != Fluid) {
+                        divergence[index] = 0.0f;
+                        continue;
+                    }
+                    size_t uFace = (static_cast<size_t>(z) * dims.y + y) * (dims.x + 1) + x;
+                    size_t vFace = (static_cast<size_t>(z) * (dims.y + 1) + y) * dims.x + x;
+                    size_t wFace = index;
+                    divergence[index] = -((u[uFace + 1] - u[uFace]) + (v[vFace + dims.x] - v[vFace])
+                        + (w[wFace + static_cast<size_t>(dims.x) * dims.y] - w[wFace]));
+                }
+            }
+        }
+    });
+
+    // Outside the box is wall, like the box's own faces
+    poisson.Configure(dims, cellTypes, MultigridPoisson3D::Neumann);
+    MultigridPoisson3D::SolveStats solve = poisson.SolvePCG(divergence, pressure, params.gridPressureTolerance, params.maxPressureIterations);
+    lastPressureSolve.iterations = solve.iterations;
+    lastPressureSolve.error = solve.error;
+
+    // Every face next to fluid and away from walls takes the pressure difference across it; air is at zero
+    for (int axis = 0; axis < 3; ++axis) {
+        glm::ivec3 faceDims = FaceDims(axis);
+        size_t stride = axis == 0 ? 1 : axis == 1 ? static_cast<size_t>(dims.x) : static_cast<size_t>(dims.x) * dims.y;
+        std::vector<float>& velocities = faceVelocities[axis];
+        scheduler.ParallelFor(0, faceDims.z, SliceGrain(faceDims, CellGrain), [&](size_t zBegin, size_t zEnd) {
+            for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+                for (int y = 0; y < faceDims.y; ++y) {
+                    for (int x = 0; x < faceDims.x; ++x) {
+                        glm::ivec3 face(x, y, z);
+                        if (face[axis] == 0 || face[axis] == dims[axis]) continue;
+                        size_t right = CellIndex(x, y, z);
+                        size_t left = right - stride;
+                        uint8_t rightType = cellTypes[right], leftType = cellTypes[left];
+                        if (rightType == Solid || leftType == Solid) continue;
+                        if (rightType != Fluid && leftType != Fluid) continue;
+                        size_t index = (static_cast<size_t>(z) * faceDims.y + y) * faceDims.x + x;
+                        velocities[index] -= pressure[right] - pressure[left];
+                    }
+                }
+            }
+        });
+    }
+}
+
+void FluidSolverAPIC3D::ExtrapolateVelocities() {
+    const std::vector<uint8_t>& types = cellTypes;
+    for (int axis = 0; axis < 3; ++axis) {
+        glm::ivec3 faceDims = FaceDims(axis);
+        size_t stride = axis == 0 ? 1 : axis == 1 ? static_cast<size_t>(dims.x) : static_cast<size_t>(dims.x) * dims.y;
+        size_t faceStrideY = static_cast<size_t>(faceDims.x);
+        size_t faceStrideZ = static_cast<size_t>(faceDims.x) * faceDims.y;
+        std::vector<float>& velocities = faceVelocities[axis];
+        std::vector<uint8_t>& valid = faceValid[axis];
+        size_t grain = SliceGrain(faceDims, CellGrain);
+
+        // Faces next to a fluid cell are known, including the walls' zero faces
+        scheduler.ParallelFor(0, faceDims.z, grain, [&](size_t zBegin, size_t zEnd) {
+            for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+                for (int y = 0; y < faceDims.y; ++y) {
+                    for (int x = 0; x < faceDims.x; ++x) {
+                        glm::ivec3 face(x, y, z);
+                        size_t index = (static_cast<size_t>(z) * faceDims.y + y) * faceDims.x + x;
+                        // One past the last cell for the far border face, whose left cell is still right - stride
+                        size_t right = CellIndex(x, y, z);
+                        bool fluid = (face[axis] < dims[axis] && types[right] == Fluid) || (face[axis] > 0 && types[right - stride] == Fluid);
+                        valid[index] = fluid ? 1 : 0;
+                    }
+                }
+            }
+        });
+
+        // Each layer averages the known neighbours of the faces next to them; it reads only faces that
+        // were known before it, so it can write in place
+        validScratch.resize(valid.size());
+        for (int layer = 0; layer < ExtrapolationLayers; ++layer) {
+            scheduler.ParallelFor(0, faceDims.z, grain, [&](size_t zBegin, size_t zEnd) {
+                for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+                    for (int y = 0; y < faceDims.y; ++y) {
+                        for (int x = 0; x < faceDims.x; ++x) {
+                            size_t index = (static_cast<size_t>(z) * faceDims.y + y) * faceDims.x + x;
+                            validScratch[index] = valid[index];
+                            if (valid[index]) continue;
+                            float sum = 0.0f;
+                            int known = 0;
+                            auto visit = [&](bool inside, size_t neighbour) {
+                                if (!inside || !valid[neighbour]) return;
+                                sum += velocities[neighbour];
+                                known++;
+                            };
+                            visit(x > 0, index - 1);
+                            visit(x + 1 < faceDims.x, index + 1);
+                            visit(y > 0, index - faceStrideY);
+                            visit(y + 1 < faceDims.y, index + faceStrideY);
+                            visit(z > 0, index - faceStrideZ);
+                            visit(z + 1 < faceDims.z, index + faceStrideZ);
+                            if (known == 0) continue;
+                            velocities[index] = sum / known;
+                            validScratch[index] = 1;
+                        }
+                    }
+                }
+            });
+            valid.swap(validScratch);
+        }
+    }
+    // The extrapolated faces may point into walls
+    ClearSolidFaces();
+}
+
+void FluidSolverAPIC3D::TransferToParticles(ParticleData3D& particleData, const FluidParams3D& params, float deltaTime) {
+    glm::vec3 upper = glm::vec3(dims) - 1e-3f;
+    float affineScale = 4.0f / cellSize;
+    scheduler.ParallelFor(0, particleData.positions.size(), ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec3 pos = particleData.positions[i];
+            glm::vec3 x = glm::clamp((pos - origin) / cellSize, glm::vec3(0.0f), upper);
+            glm::vec3 velocity(0.0f);
+            glm::mat3 c(0.0f);
+
+            for (int axis = 0; axis < 3; ++axis) {
+                glm::vec3 g = x - 0.5f;
+                g[axis] += 0.5f;
+                glm::ivec3 base = glm::ivec3(glm::floor(g - 0.5f));
+                glm::vec3 fraction = g - glm::vec3(base);
+                glm::vec3 w[3] = { SplineWeights(fraction.x), SplineWeights(fraction.y), SplineWeights(fraction.z) };
+                glm::ivec3 faceDims = FaceDims(axis);
+                const std::vector<float>& velocities = faceVelocities[axis];
+
+                float component = 0.0f;
+                glm::vec3 gradient(0.0f);
+                for (int dz = 0; dz < 3; ++dz) {
+                    int fz = glm::clamp(base.z + dz, 0, faceDims.z - 1);
+                    for (int dy = 0; dy < 3; ++dy) {
+                        int fy = glm::clamp(base.y + dy, 0, faceDims.y - 1);
+                        for (int dx = 0; dx < 3; ++dx) {
+                            int fx = glm::clamp(base.x + dx, 0, faceDims.x - 1);
+                            float weighted = w[0][dx] * w[1][dy] * w[2][dz] * velocities[(static_cast<size_t>(fz) * faceDims.y + fy) * faceDims.x + fx];
+                            component += weighted;
+                            gradient += weighted * (glm::vec3(base + glm::ivec3(dx, dy, dz)) - g);
+                        }
+                    }
+                }
+                velocity[axis] = component;
+                // The quadratic B-spline's inertia tensor is dx^2 / 4
+                c[axis] = gradient * affineScale;
+            }
+
+            float speed = glm::length(velocity);
+            if (speed > params.maxVelocity) velocity *= params.maxVelocity / speed;
+            pos += velocity * deltaTime;
+            BoundarySDF3D::ResolveContact(boundary.Sample(pos), pos, velocity, params.collisionDamping);
+
+            particleData.positions[i] = pos;
+            particleData.velocities[i] = velocity;
+            particleData.predictedPositions[i] = pos;
+            affine[i] = c;
+            trackedPositions[i] = pos;
+        }
+    });
+}
+
+void FluidSolverAPIC3D::GetAffine(const ParticleData3D& particleData, std::vector<glm::mat3>& output) const {
+    size_t count = particleData.positions.size();
+    output.resize(count);
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            bool tracked = i < affine.size() && particleData.positions[i] == trackedPositions[i];
+            output[i] = tracked ? affine[i] : glm::mat3(0.0f);
+        }
+    });
+}
+
+void FluidSolverAPIC3D::RestoreState(const std::vector<glm::mat3>& restoredAffine, const ParticleData3D& particleData) {
+    if (restoredAffine.size() != particleData.positions.size()) {
+        affine.clear();
+        trackedPositions.clear();
+        return;
+    }
+    affine.assign(restoredAffine.begin(), restoredAffine.end());
+    trackedPositions.assign(particleData.positions.begin(), particleData.positions.end());
+}
+
+float FluidSolverAPIC3D::GetMaxVelocity(const ParticleData3D& particleData) const {
+    const std::vector<glm::vec3>& velocities = particleData.velocities;
+    return scheduler.ParallelReduce(size_t(0), velocities.size(), ParticleGrain, 0.0f,
+        [&](size_t begin, size_t end) {
+            float maxSpeed = 0.0f;
+            for (size_t i = begin; i < end; ++i) {
+                maxSpeed = std::max(maxSpeed, glm::length(velocities[i]));
+            }
+            return maxSpeed;
+        },
+        [](float a, float b) { return std::max(a, b); });
+}
+
+uint64_t FluidSolverAPIC3D::ComputeStateHash(const ParticleData3D& particleData) const {
+    const uint64_t fnvOffset = 1469598103934665603ull;
+    const uint64_t fnvPrime = 1099511628211ull;
+
+    auto hashBytes = [&](uint64_t hash, const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * fnvPrime;
+        }
+        return hash;
+    };
+
+    // FNV-1a over the raw bits of each chunk, chunk hashes folded in a fixed tree
+    return scheduler.ParallelReduce(size_t(0), particleData.positions.size(), ParticleGrain, fnvOffset,
+        [&](size_t begin, size_t end) {
+            uint64_t hash = fnvOffset;
+            for (size_t i = begin; i < end; ++i) {
+                hash = hashBytes(hash, &particleData.positions[i], sizeof(glm::vec3));
+                hash = hashBytes(hash, &particleData.velocities[i], sizeof(glm::vec3));
+            }
+            return hash;
+        },
+        [&](uint64_t a, uint64_t b) { return hashBytes(a, &b, sizeof(uint64_t)); });
+}
@@ -0,0 +1,129 @@
+#ifndef FLUID_SOLVER_APIC_3D_H
+#define FLUID_SOLVER_APIC_3D_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "BoundarySDF3D.h"
+#include "FluidParams3D.h"
+#include "MultigridPoisson3D.h"
+#include "ParticleData.h"
+#include "RadixSort.h"
+#include "TaskScheduler.h"
+
+// Hybrid particle-grid backend for large particle counts: the particles only carry the fluid,
+// and the pressure is solved on a MAC grid over the bounding box, so no step sums over neighbours.
+// A substep applies the external forces to the particles, splats their velocities onto the faces
+// with quadratic B-spline weights (APIC, Jiang et al.), makes the face velocities divergence-free,
+// extends them into the air, and reads each particle's velocity and its affine part back.
+// The splat bins the particles by cell with a radix sort and scatters z slabs of cells in two
+// colours, so no two threads write the same face and no atomics are needed.
+// The pressure solve is MultigridPoisson3D's conjugate gradients preconditioned by one multigrid
+// V-cycle. Cells holding particles are fluid, cells whose centre is inside the boundary field's
+// solid are walls (Neumann), and the rest is air at zero pressure (Dirichlet).
+// Every reduction is a fixed tree and every scatter has a fixed order, so the result does not
+// depend on the thread count.
+class FluidSolverAPIC3D {
+public:
+    explicit FluidSolverAPIC3D(TaskScheduler& scheduler = TaskScheduler::Instance());
+    ~FluidSolverAPIC3D();
+
+    // Advances by params.deltaTime in as many substeps as keep particles within one cell per substep.
+    void Step(ParticleData3D& particleData, const FluidParams3D& params);
+    void Reserve(size_t capacity);
+    // Solids baked into the boundary field with the box; their cells become walls of the grid.
+    void SetObstacles(const std::vector<Obstacle3D>& obstacles) { this->obstacles = obstacles; }
+    const BoundarySDF3D& GetBoundary() const { return boundary; }
+
+    // Phases of one substep, in order. Public so they can be timed on their own.
+    // Sizes the grid for the box and marks the cells inside solids.
+    void UpdateGrid(const FluidParams3D& params);
+    void ApplyExternalForces(ParticleData3D& particleData, const FluidParams3D& params, float deltaTime);
+    // Sorts the particles by cell and marks the cells that hold any as fluid.
+    void BinParticles(const ParticleData3D& particleData);
+    void TransferToGrid(const ParticleData3D& particleData);
+    // Subtracts the pressure gradient that makes every fluid cell divergence-free.
+    void SolvePressure(const FluidParams3D& params);
+    // Copies the face velocities next to the fluid into ExtrapolationLayers layers of air faces.
+    void ExtrapolateVelocities();
+    // Interpolates the velocities and affine matrices back, then moves the particles and resolves collisions.
+    void TransferToParticles(ParticleData3D& particleData, const FluidParams3D& params, float deltaTime);
+
+    // Conjugate gradient iterations of the last substep and its largest remaining divergence, as a
+    // fraction of the largest before the solve, and the substeps of the last step.
+    struct PressureSolveStats {
+        int iterations = 0;
+        float error = 0.0f;
+        int substeps = 0;
+    };
+    const PressureSolveStats& GetLastPressureSolve() const { return lastPressureSolve; }
+
+    float GetMaxVelocity(const ParticleData3D& particleData) const;
+    // The affine matrix the next step starts each particle from, zero for slots the last step did not leave.
+    void GetAffine(const ParticleData3D& particleData, std::vector<glm::mat3>& output) const;
+    // Continues from a checkpoint's affine matrices; an empty vector starts every particle from zero.
+    void RestoreState(const std::vector<glm::mat3>& restoredAffine, const ParticleData3D& particleData);
+    // 64-bit FNV-1a hash of positions and velocities, used to compare runs.
+    uint64_t ComputeStateHash(const ParticleData3D& particleData) const;
+    float GetCellSize() const { return cellSize; }
+    const glm::ivec3& GetDimensions() const { return dims; }
+    size_t GetFluidCellCount() const { return fluidCellCount; }
+    int GetLevelCount() const { return poisson.GetLevelCount(); }
+
+    static const size_t ParticleGrain = 1024;
+    static const size_t CellGrain = 4096;
+    // A particle writes faces from one cell below to two cells above its own, so slabs this thick
+    // and one slab apart never write the same face
+    static const int SlabCells = 3;
+    static const int ExtrapolationLayers = 2;
+    static const int MaxSubsteps = 8;
+
+private:
+    enum CellType : uint8_t { Fluid = MultigridPoisson3D::Interior, Air = MultigridPoisson3D::Dirichlet, Solid = MultigridPoisson3D::Neumann };
+
+    size_t CellIndex(int x, int y, int z) const { return (static_cast<size_t>(z) * dims.y + y) * dims.x + x; }
+    glm::ivec3 FaceDims(int axis) const;
+    // Zeroes the faces on the box and between a wall cell and any other cell.
+    void ClearSolidFaces();
+
+    TaskScheduler& scheduler;
+    RadixSort radixSort;
+
+    glm::vec3 origin;
+    glm::ivec3 dims;
+    float cellSize;
+    size_t solidVersion;
+    // Solid or Fluid by the boundary field alone, and the types of the substep
+    std::vector<uint8_t> solidCells;
+    std::vector<uint8_t> cellTypes;
+    size_t fluidCellCount;
+
+    // Face velocities of each axis: (dims.x + 1) * dims.y * dims.z for x and so on
+    std::vector<float> faceVelocities[3];
+    std::vector<float> faceWeights[3];
+    std::vector<uint8_t> faceValid[3];
+    std::vector<uint8_t> validScratch;
+
+    // Cell of every particle, sorted, and the particles in that order
+    std::vector<uint32_t> sortedCells;
+    std::vector<uint32_t> sortedParticles;
+    // First sorted particle of every z slab of SlabCells cells, plus the end
+    std::vector<size_t> slabStart;
+
+    // Affine velocity of every particle: column c is the gradient of velocity component c.
+    // Positions as the last step left them; a slot that no longer matches (emitters, sinks,
+    // loaded checkpoints) starts again from a zero affine part
+    std::vector<glm::mat3> affine;
+    std::vector<glm::vec3> trackedPositions;
+
+    MultigridPoisson3D poisson;
+    std::vector<float> divergence;
+    std::vector<float> pressure;
+    PressureSolveStats lastPressureSolve;
+
+    std::vector<Obstacle3D> obstacles;
+    BoundarySDF3D boundary;
+};
+
+#endif // FLUID_SOLVER_APIC_3D_H
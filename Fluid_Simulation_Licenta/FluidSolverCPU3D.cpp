@@ -0,0 +1,1186 @@
+#include "FluidSolverCPU3D.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+    struct ProbeCount {
+        uint64_t lookups = 0;
+        uint64_t probes = 0;
+    };
+    const float PredictionFactor = 1.0f / 120.0f;
+    // Neighbour reads further away than these many bytes are counted as likely cache / page misses
+    const size_t CacheLineBytes = 64;
+    const size_t PageBytes = 4096;
+    // DFSPH: particles with fewer neighbours are at a free surface, where the divergence is not corrected
+    const uint32_t MinDivergenceNeighbors = 20;
+    // DFSPH: below this the factor is left at 0, for isolated particles
+    const float MinFactorDenominator = 1e-6f;
+    // PBF: artificial pressure reaches pbfTensileStrength at this fraction of the smoothing radius
+    const float TensileDistance = 0.2f;
+
+    // Volume of a particle at rest: the particles of a resting fluid are one diameter apart
+    float RestVolume(const FluidParams3D& params) {
+        float spacing = 2.0f * params.particleRadius;
+        return spacing * spacing * spacing;
+    }
+}
+
+FluidSolverCPU3D::FluidSolverCPU3D(TaskScheduler& scheduler)
+    : scheduler(scheduler), radixSort(scheduler), stepCount(0), lastStateHash(0), gridOrigin(0.0f), gridDims(1), cellSize(1.0f), cellGrid(scheduler), rebinCount(0),
+    longRange(scheduler), boundary(scheduler) {}
+
+FluidSolverCPU3D::~FluidSolverCPU3D() {}
+
+void FluidSolverCPU3D::Step(ParticleData3D& particleData, const FluidParams3D& params) {
+    if (particleData.positions.empty()) return;
+    EnsureParticleStorage(particleData);
+
+    TaskGraph graph;
+    TaskGraph::NodeId longRangeForces = graph.AddNode("Long-Range Forces", [&]() { CalculateLongRangeForces(particleData, params); });
+    TaskGraph::NodeId forces = graph.AddNode("External Forces", [&]() { ApplyExternalForces(particleData, params); });
+    TaskGraph::NodeId neighbors = graph.AddNode("Neighbor Build", [&]() { BuildNeighborGrid(particleData, params); });
+    TaskGraph::NodeId reorder = graph.AddNode("Reorder", [&]() { ReorderParticles(particleData, params); });
+    TaskGraph::NodeId boundary = graph.AddNode("Boundary Update", [&]() { UpdateBoundary(params); });
+    TaskGraph::NodeId integrate = graph.AddNode("Integrate", [&]() { UpdatePositions(particleData, params); });
+
+    graph.AddDependency(longRangeForces, forces);
+    graph.AddDependency(forces, neighbors);
+    graph.AddDependency(neighbors, reorder);
+    graph.AddDependency(boundary, integrate);
+
+    if (params.pressureSolver == PressureSolver3D::DFSPH) {
+        // Viscosity goes between the solves, so the density solve sees every other velocity change
+        TaskGraph::NodeId factors = graph.AddNode("Density Factors", [&]() { CalculateDensityFactors(particleData, params); });
+        TaskGraph::NodeId divergence = graph.AddNode("Divergence Solve", [&]() { SolveDivergence(particleData, params); });
+        TaskGraph::NodeId viscosity = graph.AddNode("Viscosity", [&]() { CalculateViscosity(particleData, params); });
+        TaskGraph::NodeId densitySolve = graph.AddNode("Density Solve", [&]() { SolveDensity(particleData, params); });
+        graph.AddDependency(reorder, factors);
+        graph.AddDependency(factors, divergence);
+        graph.AddDependency(divergence, viscosity);
+        graph.AddDependency(viscosity, densitySolve);
+        graph.AddDependency(densitySolve, integrate);
+    }
+    else if (params.pressureSolver == PressureSolver3D::PBF) {
+        TaskGraph::NodeId lists = graph.AddNode("Neighbor Lists", [&]() { GatherNeighborLists(particleData, params); });
+        TaskGraph::NodeId constraints = graph.AddNode("Density Constraints", [&]() { SolveDensityConstraints(particleData, params); });
+        TaskGraph::NodeId velocities = graph.AddNode("XSPH Viscosity", [&]() { UpdateConstraintVelocities(particleData, params); });
+        graph.AddDependency(reorder, lists);
+        graph.AddDependency(lists, constraints);
+        graph.AddDependency(boundary, constraints);
+        graph.AddDependency(constraints, velocities);
+        graph.AddDependency(velocities, integrate);
+    }
+    else {
+        TaskGraph::NodeId density = graph.AddNode("Density", [&]() { CalculateDensities(particleData, params); });
+        TaskGraph::NodeId pressure = graph.AddNode("Pressure", [&]() { CalculatePressureForces(particleData, params); });
+        TaskGraph::NodeId viscosity = graph.AddNode("Viscosity", [&]() { CalculateViscosity(particleData, params); });
+        graph.AddDependency(reorder, density);
+        graph.AddDependency(density, pressure);
+        graph.AddDependency(pressure, viscosity);
+        graph.AddDependency(viscosity, integrate);
+    }
+
+    {
+        ScopedTimer timer("CPU/Step");
+        graph.Run(scheduler);
+    }
+
+    if (params.deterministic) {
+        ScopedTimer timer("CPU/State Hash");
+        lastStateHash = ComputeStateHash(particleData);
+    }
+
+    Profiler& profiler = Profiler::Instance();
+    for (TaskGraph::NodeId id = 0; id < graph.GetNodeCount(); ++id) {
+        profiler.AddTiming("CPU/" + graph.GetNodeName(id), graph.GetNodeMilliseconds(id));
+    }
+    stepCount++;
+}
+
+void FluidSolverCPU3D::RestoreState(const std::vector<uint32_t>& ids, size_t steps) {
+    particleIds = ids;
+    stepCount = steps;
+    rebinCount = 0;
+    lastStateHash = 0;
+    // The warm starts belong to the slots of the previous run
+    densityStiffness.clear();
+    divergenceStiffness.clear();
+}
+
+void FluidSolverCPU3D::CompactSlots(const std::vector<uint32_t>& destinations) {
+    size_t count = destinations.size();
+    if (densityStiffness.size() != count || divergenceStiffness.size() != count) {
+        densityStiffness.clear();
+        divergenceStiffness.clear();
+        return;
+    }
+
+    // Survivors keep their order, so each one lands at or below its old slot
+    size_t newCount = count - static_cast<size_t>(std::count(destinations.begin(), destinations.end(), UINT32_MAX));
+    auto compact = [&](std::vector<float>& column) {
+        floatScratch.resize(count);
+        scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+            for (size_t slot = begin; slot < end; ++slot) {
+                if (destinations[slot] != UINT32_MAX) floatScratch[destinations[slot]] = column[slot];
+            }
+        });
+        floatScratch.resize(newCount);
+        column.swap(floatScratch);
+    };
+    compact(densityStiffness);
+    compact(divergenceStiffness);
+}
+
+void FluidSolverCPU3D::EnsureParticleStorage(ParticleData3D& particleData) {
+    size_t count = particleData.positions.size();
+    particleData.velocities.resize(count);
+    particleData.predictedPositions.resize(count);
+    particleData.densities.resize(count);
+    velocityScratch.resize(count);
+    positionScratch.resize(count);
+    densityScratch.resize(count);
+    idScratch.resize(count);
+    cellScratch.resize(count);
+    particleCells.resize(count);
+    particleCoords.resize(count);
+    rebinCoords.resize(count);
+    rebinIds.resize(count);
+    cellEntries.resize(count);
+
+    if (particleIds.size() != count) {
+        particleIds.resize(count);
+        for (size_t i = 0; i < count; ++i) particleIds[i] = static_cast<uint32_t>(i);
+    }
+}
+
+void FluidSolverCPU3D::Reserve(size_t capacity) {
+    // Reordering swaps columns with their scratch twins, so both sides need the capacity
+    velocityScratch.reserve(capacity);
+    positionScratch.reserve(capacity);
+    densityScratch.reserve(capacity);
+    idScratch.reserve(capacity);
+    cellScratch.reserve(capacity);
+    particleCells.reserve(capacity);
+    particleCoords.reserve(capacity);
+    rebinCoords.reserve(capacity);
+    rebinIds.reserve(capacity);
+    slotMoved.reserve(capacity);
+    movedSlots.reserve(capacity);
+    movedKeys.reserve(capacity);
+    keptEntries.reserve(capacity);
+    movedEntries.reserve(capacity);
+    cellEntries.reserve(capacity);
+    particleIds.reserve(capacity);
+    sortOrder.reserve(capacity);
+    neighborStart.reserve(capacity + 1);
+    restDensityRatios.reserve(capacity);
+    densityFactors.reserve(capacity);
+    stiffnessStep.reserve(capacity);
+    densityStiffness.reserve(capacity);
+    divergenceStiffness.reserve(capacity);
+    floatScratch.reserve(capacity);
+    lambdas.reserve(capacity);
+}
+
+void FluidSolverCPU3D::CalculateLongRangeForces(const ParticleData3D& particleData, const FluidParams3D& params) {
+    if (params.longRangeStrength == 0.0f) {
+        longRangeAccelerations.clear();
+        return;
+    }
+    longRange.Build(particleData.positions);
+    size_t interactions = longRange.ComputeAccelerations(params.longRangeStrength, params.longRangeSoftening, params.barnesHutTheta, longRangeAccelerations);
+    Profiler::Instance().SetCounter("CPU/Long-Range Interactions per Particle", static_cast<double>(interactions) / particleData.positions.size());
+}
+
+void FluidSolverCPU3D::ApplyExternalForces(ParticleData3D& particleData, const FluidParams3D& params) {
+    bool longRangeActive = longRangeAccelerations.size() == particleData.positions.size();
+    // DFSPH works on the positions at the start of the step, so the grid is built over those.
+    // PBF predicts the whole step and then corrects the prediction
+    float predictionFactor = PredictionFactor;
+    if (params.pressureSolver == PressureSolver3D::DFSPH) predictionFactor = 0.0f;
+    else if (params.pressureSolver == PressureSolver3D::PBF) predictionFactor = params.deltaTime;
+    scheduler.ParallelFor(0, particleData.positions.size(), ParticleGrain, [&](size_t begin, size_t end) {
+        glm::vec3 gravityAccel(0.0f, -params.gravity, 0.0f);
+        float sqrInputRadius = params.interactionInputRadius * params.interactionInputRadius;
+
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec3 pos = particleData.positions[i];
+            glm::vec3 velocity = particleData.velocities[i];
+            glm::vec3 accel = gravityAccel;
+
+            // Input interactions modify gravity proportional to the distance from the interaction point
+            if (params.interactionInputStrength != 0.0f) {
+                glm::vec3 inputPointOffset = params.interactionInputPoint - pos;
+                if (params.isXButtonDown[1]) inputPointOffset = -inputPointOffset;
+
+                float sqrDst = glm::dot(inputPointOffset, inputPointOffset);
+                if (sqrDst < sqrInputRadius && sqrDst > 0.0f) {
+                    float dst = std::sqrt(sqrDst);
+                    float centreT = 1.0f - dst / params.interactionInputRadius;
+                    glm::vec3 dirToCentre = inputPointOffset / dst;
+
+                    float gravityWeight = 1.0f - (centreT * glm::clamp(params.interactionInputStrength / 10.0f, 0.0f, 1.0f));
+                    accel = gravityAccel * gravityWeight + dirToCentre * centreT * params.interactionInputStrength;
+                    accel -= velocity * centreT;
+                }
+            }
+            if (longRangeActive) accel += longRangeAccelerations[i];
+
+            velocity += accel * params.deltaTime;
+
+            // Clamp velocities to a maximum value to prevent numerical instabilities
+            float speed = glm::length(velocity);
+            if (speed > params.maxVelocity) {
+                velocity *= params.maxVelocity / speed;
+            }
+
+            particleData.velocities[i] = velocity;
+            particleData.predictedPositions[i] = pos + velocity * predictionFactor;
+        }
+    });
+}
+
+glm::ivec3 FluidSolverCPU3D::CellCoord(const glm::vec3& position) const {
+    glm::ivec3 cell = glm::ivec3(glm::floor((position - gridOrigin) / cellSize));
+    return glm::clamp(cell, glm::ivec3(0), gridDims - 1);
+}
+
+void FluidSolverCPU3D::BuildNeighborGrid(const ParticleData3D& particleData, const FluidParams3D& params) {
+    // Cells must cover both the smoothing radius and the particle-particle collision distance
+    cellSize = std::max(params.smoothingRadius, 2.0f * params.particleRadius);
+    glm::vec3 extent = glm::max(params.boundingBoxMax - params.boundingBoxMin, glm::vec3(0.0f));
+    glm::ivec3 dims = glm::ivec3(glm::ceil(extent / cellSize)) + 3;
+
+    // Only the block grid's coordinate range limits the box; past it the cells get coarser
+    const int maxAxisCells = SparseBlockGrid3D::MaxAxisCells;
+    int largestAxis = std::max(dims.x, std::max(dims.y, dims.z));
+    if (largestAxis > maxAxisCells) {
+        float largestExtent = std::max(extent.x, std::max(extent.y, extent.z));
+        cellSize = largestExtent / static_cast<float>(maxAxisCells - 4);
+        dims = glm::min(glm::ivec3(glm::ceil(extent / cellSize)) + 3, glm::ivec3(maxAxisCells));
+    }
+
+    gridDims = dims;
+    gridOrigin = params.boundingBoxMin - glm::vec3(cellSize);
+
+    size_t count = particleData.predictedPositions.size();
+    {
+        ScopedTimer timer("CPU/Neighbor Hash");
+        // Last build's cells stay behind for the incremental re-sort
+        particleCoords.swap(rebinCoords);
+        scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) particleCoords[i] = CellCoord(particleData.predictedPositions[i]);
+        });
+        cellGrid.Build(particleCoords);
+
+        // While the cells are at hand, flag the slots whose particle changed cell, or that the pool
+        // gave to another particle, and count them per chunk for the incremental re-sort
+        bool flagMoved = params.rebinThreshold > 0.0f && rebinCount == count;
+        size_t numChunks = (count + ParticleGrain - 1) / ParticleGrain;
+        if (flagMoved) {
+            slotMoved.resize(count);
+            movedSums.assign(numChunks + 1, 0);
+        }
+        scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+            uint32_t probes = 0;
+            size_t moved = 0;
+            for (size_t i = begin; i < end; ++i) {
+                particleCells[i] = cellGrid.FindKey(particleCoords[i], probes);
+                if (!flagMoved) continue;
+                slotMoved[i] = particleCoords[i] != rebinCoords[i] || particleIds[i] != rebinIds[i];
+                moved += slotMoved[i];
+            }
+            if (flagMoved) movedSums[begin / ParticleGrain + 1] = moved;
+        });
+        if (flagMoved) {
+            for (size_t chunk = 1; chunk <= numChunks; ++chunk) movedSums[chunk] += movedSums[chunk - 1];
+        }
+        else {
+            movedSums.clear();
+        }
+    }
+
+    {
+        // Sort the slots by cell, so every occupied cell owns one range of cellEntries. The id-ordered
+        // fill keeps its own timer, as it costs an extra pass over the slots.
+        ScopedTimer timer(params.deterministic ? "CPU/Neighbor Fill (deterministic)" : "CPU/Neighbor Fill (slot order)");
+        bool incremental = RebinIncrementally(count, params);
+        if (!incremental && params.deterministic) {
+            FillCellEntriesById(count);
+        }
+        else if (!incremental) {
+            scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    cellEntries[i] = static_cast<uint32_t>(i);
+                    cellScratch[i] = particleCells[i];
+                }
+            });
+            radixSort.Sort(cellScratch, cellEntries, GetCellKeyBits());
+        }
+        Profiler::Instance().SetCounter("CPU/Rebin Incremental", incremental ? 1.0 : 0.0);
+
+        // The next build continues from this order
+        std::copy(particleIds.begin(), particleIds.begin() + count, rebinIds.begin());
+        rebinCount = count;
+    }
+
+    ScopedTimer timer("CPU/Neighbor Offsets");
+    CompactCells(count);
+    LinkCells();
+}
+
+void FluidSolverCPU3D::FillCellEntriesById(size_t count) {
+    // List the slots in id order, then stable sort them by cell: every cell ends up
+    // holding its particles sorted by id, whatever order the threads ran in.
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t slot = begin; slot < end; ++slot) cellEntries[particleIds[slot]] = static_cast<uint32_t>(slot);
+    });
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) cellScratch[i] = particleCells[cellEntries[i]];
+    });
+
+    radixSort.Sort(cellScratch, cellEntries, GetCellKeyBits());
+}
+
+bool FluidSolverCPU3D::RebinIncrementally(size_t count, const FluidParams3D& params) {
+    // The hash pass flagged and counted the moved slots when last step's order was usable
+    if (movedSums.empty()) return false;
+    size_t numChunks = movedSums.size() - 1;
+    size_t movedCount = movedSums[numChunks];
+    Profiler::Instance().SetCounter("CPU/Rebin Moved Fraction", static_cast<double>(movedCount) / count);
+    if (movedCount > params.rebinThreshold * count) return false;
+
+    // Moved slots in slot order, then stable sorted into the order of the full sorts:
+    // by cell, then by id in deterministic mode and by slot otherwise
+    movedSlots.resize(movedCount);
+    movedKeys.resize(movedCount);
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        size_t next = movedSums[begin / ParticleGrain];
+        for (size_t i = begin; i < end; ++i) {
+            if (slotMoved[i]) movedSlots[next++] = static_cast<uint32_t>(i);
+        }
+    });
+    if (params.deterministic) {
+        for (size_t i = 0; i < movedCount; ++i) movedKeys[i] = particleIds[movedSlots[i]];
+        radixSort.Sort(movedKeys, movedSlots);
+    }
+    for (size_t i = 0; i < movedCount; ++i) movedKeys[i] = particleCells[movedSlots[i]];
+    radixSort.Sort(movedKeys, movedSlots, GetCellKeyBits());
+
+    bool byId = params.deterministic;
+    auto entry = [&](uint32_t slot) {
+        RebinEntry result;
+        result.order = (uint64_t(particleCells[slot]) << 32) | (byId ? particleIds[slot] : slot);
+        result.slot = slot;
+        return result;
+    };
+    movedEntries.resize(movedCount);
+    for (size_t i = 0; i < movedCount; ++i) movedEntries[i] = entry(movedSlots[i]);
+
+    // The slots that stayed keep their relative order from last step
+    chunkSums.assign(numChunks + 1, 0);
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        size_t kept = 0;
+        for (size_t i = begin; i < end; ++i) kept += !slotMoved[cellEntries[i]];
+        chunkSums[begin / ParticleGrain + 1] = kept;
+    });
+    for (size_t chunk = 1; chunk <= numChunks; ++chunk) {
+        chunkSums[chunk] += chunkSums[chunk - 1];
+    }
+    size_t keptCount = count - movedCount;
+    keptEntries.resize(keptCount);
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        size_t next = chunkSums[begin / ParticleGrain];
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t slot = cellEntries[i];
+            if (!slotMoved[slot]) keptEntries[next++] = entry(slot);
+        }
+    });
+
+    // Merge path: the kept entries among the first d of the merged order are found by binary
+    // search, so every chunk of the output merges its own part of the two lists
+    auto keptBefore = [&](size_t d) {
+        size_t low = d > movedCount ? d - movedCount : 0;
+        size_t high = std::min(d, keptCount);
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (keptEntries[middle].order < movedEntries[d - middle - 1].order) low = middle + 1;
+            else high = middle;
+        }
+        return low;
+    };
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        size_t kept = keptBefore(begin);
+        size_t keptEnd = keptBefore(end);
+        size_t moved = begin - kept;
+        size_t movedEnd = end - keptEnd;
+        for (size_t i = begin; i < end; ++i) {
+            bool takeKept = moved == movedEnd || (kept < keptEnd && keptEntries[kept].order < movedEntries[moved].order);
+            const RebinEntry& next = takeKept ? keptEntries[kept++] : movedEntries[moved++];
+            cellEntries[i] = next.slot;
+            cellScratch[i] = static_cast<uint32_t>(next.order >> 32);
+        }
+    });
+    return true;
+}
+
+void FluidSolverCPU3D::CompactCells(size_t count) {
+    // A cell starts wherever the sorted key changes; count the starts per chunk, scan, then write
+    size_t numChunks = (count + ParticleGrain - 1) / ParticleGrain;
+    chunkSums.assign(numChunks + 1, 0);
+
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        size_t starts = 0;
+        for (size_t i = begin; i < end; ++i) {
+            starts += i == 0 || cellScratch[i] != cellScratch[i - 1];
+        }
+        chunkSums[begin / ParticleGrain + 1] = starts;
+    });
+
+    for (size_t chunk = 1; chunk <= numChunks; ++chunk) {
+        chunkSums[chunk] += chunkSums[chunk - 1];
+    }
+
+    size_t numCells = chunkSums[numChunks];
+    cellKeys.resize(numCells);
+    cellStart.resize(numCells + 1);
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        size_t cell = chunkSums[begin / ParticleGrain];
+        for (size_t i = begin; i < end; ++i) {
+            if (i != 0 && cellScratch[i] == cellScratch[i - 1]) continue;
+            cellKeys[cell] = cellScratch[i];
+            cellStart[cell] = static_cast<uint32_t>(i);
+            ++cell;
+        }
+    });
+    cellStart[numCells] = static_cast<uint32_t>(count);
+}
+
+void FluidSolverCPU3D::LinkCells() {
+    size_t numCells = cellKeys.size();
+    // Keys are unique, so every cell writes its own value
+    scheduler.ParallelFor(0, numCells, CellGrain, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) cellGrid.SetValue(cellKeys[c], static_cast<uint32_t>(c));
+    });
+
+    cellNeighbors.resize(numCells * 27);
+    ProbeCount probeCount = scheduler.ParallelReduce(size_t(0), numCells, CellGrain, ProbeCount(),
+        [&](size_t begin, size_t end) {
+            ProbeCount chunk;
+            for (size_t c = begin; c < end; ++c) {
+                glm::ivec3 origin = cellGrid.CellFromKey(cellKeys[c]);
+                uint32_t* neighbours = cellNeighbors.data() + c * 27;
+                int n = 0;
+                for (int dz = -1; dz <= 1; ++dz) {
+                    for (int dy = -1; dy <= 1; ++dy) {
+                        for (int dx = -1; dx <= 1; ++dx) {
+                            glm::ivec3 cell = origin + glm::ivec3(dx, dy, dz);
+                            uint32_t found = EmptyCell;
+                            if (glm::all(glm::greaterThanEqual(cell, glm::ivec3(0))) && glm::all(glm::lessThan(cell, gridDims))) {
+                                uint32_t probes = 0;
+                                found = cellGrid.Find(cell, probes);
+                                chunk.lookups++;
+                                chunk.probes += probes;
+                            }
+                            neighbours[n++] = found;
+                        }
+                    }
+                }
+            }
+            return chunk;
+        },
+        [](const ProbeCount& a, const ProbeCount& b) {
+            ProbeCount combined;
+            combined.lookups = a.lookups + b.lookups;
+            combined.probes = a.probes + b.probes;
+            return combined;
+        });
+
+    Profiler& profiler = Profiler::Instance();
+    profiler.SetCounter("CPU/Hash Occupied Cells", static_cast<double>(numCells));
+    profiler.SetCounter("CPU/Grid Occupied Blocks", static_cast<double>(cellGrid.GetBlockCount()));
+    profiler.SetCounter("CPU/Grid Memory (MB)", static_cast<double>(cellGrid.GetMemoryBytes()) / (1024.0 * 1024.0));
+    if (cellGrid.GetTableSize() > 0) profiler.SetCounter("CPU/Hash Load Factor", static_cast<double>(cellGrid.GetBlockCount()) / cellGrid.GetTableSize());
+    // Buckets of the block table read per lookup
+    if (probeCount.lookups > 0) profiler.SetCounter("CPU/Hash Avg Bucket Length", static_cast<double>(probeCount.probes) / probeCount.lookups);
+}
+
+void FluidSolverCPU3D::ReorderParticles(ParticleData3D& particleData, const FluidParams3D& params) {
+    if (params.reorderInterval <= 0 || stepCount % static_cast<size_t>(params.reorderInterval) != 0) return;
+
+    size_t count = particleData.positions.size();
+    sortOrder.resize(count);
+
+    if (params.deterministic) {
+        // cellEntries is already ordered by (cell, id); use it as the permutation
+        // so the id order inside each cell survives the reorder.
+        scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                sortOrder[i] = cellEntries[i];
+                cellScratch[i] = particleCells[cellEntries[i]];
+            }
+        });
+        particleCells.swap(cellScratch);
+    }
+    else {
+        scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) sortOrder[i] = static_cast<uint32_t>(i);
+        });
+
+        // Stable, so particles keep their relative order inside a cell
+        radixSort.Sort(particleCells, sortOrder, GetCellKeyBits());
+    }
+
+    auto gather = [&](auto& column, auto& scratch) {
+        scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) scratch[i] = column[sortOrder[i]];
+        });
+        column.swap(scratch);
+    };
+
+    gather(particleData.positions, positionScratch);
+    gather(particleData.velocities, velocityScratch);
+    gather(particleData.predictedPositions, positionScratch);
+    gather(particleData.densities, densityScratch);
+    gather(particleIds, idScratch);
+    // Keep the incremental re-sort's view of each slot in step with the particles
+    gather(particleCoords, rebinCoords);
+    gather(rebinIds, idScratch);
+    if (densityStiffness.size() == count) {
+        floatScratch.resize(count);
+        gather(densityStiffness, floatScratch);
+        gather(divergenceStiffness, floatScratch);
+    }
+
+    // particleCells is now sorted, so every cell's entries are simply its own slot range
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) cellEntries[i] = static_cast<uint32_t>(i);
+    });
+}
+
+void FluidSolverCPU3D::UpdateBoundary(const FluidParams3D& params) {
+    // Only rebakes after the box, the resolution or the obstacles changed
+    boundary.SetResolution(params.boundaryResolution);
+    boundary.Update(params.boundingBoxMin, params.boundingBoxMax, obstacles);
+}
+
+void FluidSolverCPU3D::CalculateDensities(ParticleData3D& particleData, const FluidParams3D& params) {
+    SPHKernels kernels(params.smoothingRadius);
+    float sqrRadius = params.smoothingRadius * params.smoothingRadius;
+    const std::vector<glm::vec3>& predicted = particleData.predictedPositions;
+
+    // Locality proxies: how far apart in memory the particles read for each neighbour pair are
+    bool measureLocality = Profiler::Instance().isEnabled();
+    size_t numChunks = (predicted.size() + ParticleGrain - 1) / ParticleGrain;
+    std::vector<uint64_t> indexDistance(measureLocality ? numChunks : 0, 0);
+    std::vector<uint64_t> lineMisses(indexDistance.size(), 0);
+    std::vector<uint64_t> pageMisses(indexDistance.size(), 0);
+    std::vector<uint64_t> pairCount(indexDistance.size(), 0);
+    std::vector<uint64_t> checkCount(indexDistance.size(), 0);
+    const size_t lineStride = CacheLineBytes / sizeof(glm::vec3);
+    const size_t pageStride = PageBytes / sizeof(glm::vec3);
+
+    scheduler.ParallelFor(0, predicted.size(), ParticleGrain, [&](size_t begin, size_t end) {
+        uint64_t chunkDistance = 0;
+        uint64_t chunkLineMisses = 0;
+        uint64_t chunkPageMisses = 0;
+        uint64_t chunkPairs = 0;
+        uint64_t chunkChecks = 0;
+
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec3 pos = predicted[i];
+            float density = 0.0f;
+            float nearDensity = 0.0f;
+
+            ForEachNeighbor(pos, [&](uint32_t j) {
+                glm::vec3 offsetToNeighbour = predicted[j] - pos;
+                float sqrDst = glm::dot(offsetToNeighbour, offsetToNeighbour);
+                if (measureLocality) chunkChecks++;
+                if (sqrDst > sqrRadius) return;
+
+                if (measureLocality) {
+                    size_t distance = j > i ? j - i : i - j;
+                    chunkDistance += distance;
+                    chunkLineMisses += distance >= lineStride;
+                    chunkPageMisses += distance >= pageStride;
+                    chunkPairs++;
+                }
+
+                float dst = std::sqrt(sqrDst);
+                density += kernels.DensityKernel(dst);
+                nearDensity += kernels.NearDensityKernel(dst);
+            });
+
+            particleData.densities[i] = glm::vec2(density, nearDensity);
+        }
+
+        if (measureLocality) {
+            size_t chunk = begin / ParticleGrain;
+            indexDistance[chunk] = chunkDistance;
+            lineMisses[chunk] = chunkLineMisses;
+            pageMisses[chunk] = chunkPageMisses;
+            pairCount[chunk] = chunkPairs;
+            checkCount[chunk] = chunkChecks;
+        }
+    });
+
+    if (measureLocality) {
+        RecordLocalityMetrics(indexDistance, lineMisses, pageMisses, pairCount, checkCount);
+    }
+}
+
+void FluidSolverCPU3D::RecordLocalityMetrics(const std::vector<uint64_t>& indexDistance, const std::vector<uint64_t>& lineMisses,
+    const std::vector<uint64_t>& pageMisses, const std::vector<uint64_t>& pairCount, const std::vector<uint64_t>& checkCount) {
+    uint64_t totalDistance = 0, totalLineMisses = 0, totalPageMisses = 0, totalPairs = 0, totalChecks = 0;
+    for (size_t chunk = 0; chunk < pairCount.size(); ++chunk) {
+        totalDistance += indexDistance[chunk];
+        totalLineMisses += lineMisses[chunk];
+        totalPageMisses += pageMisses[chunk];
+        totalPairs += pairCount[chunk];
+        totalChecks += checkCount[chunk];
+    }
+    if (totalPairs == 0) return;
+
+    double pairs = static_cast<double>(totalPairs);
+    Profiler& profiler = Profiler::Instance();
+    // Candidates from the 27 cells that turned out to be beyond the smoothing radius
+    profiler.SetCounter("CPU/False Positive Neighbor Checks", static_cast<double>(totalChecks - totalPairs));
+    profiler.SetCounter("CPU/False Positive Neighbor Ratio", static_cast<double>(totalChecks - totalPairs) / totalChecks);
+    profiler.SetCounter("CPU/Avg Neighbor Index Distance", totalDistance / pairs);
+    profiler.SetCounter("CPU/Neighbor Cache Line Miss Proxy", totalLineMisses / pairs);
+    profiler.SetCounter("CPU/Neighbor Page Miss Proxy", totalPageMisses / pairs);
+}
+
+void FluidSolverCPU3D::CalculatePressureForces(ParticleData3D& particleData, const FluidParams3D& params) {
+    SPHKernels kernels(params.smoothingRadius);
+    float sqrRadius = params.smoothingRadius * params.smoothingRadius;
+    const std::vector<glm::vec3>& predicted = particleData.predictedPositions;
+    const std::vector<glm::vec2>& densities = particleData.densities;
+
+    auto pressureFromDensity = [&](float density) { return (density - params.targetDensity) * params.pressureMultiplier; };
+    auto nearPressureFromDensity = [&](float nearDensity) { return params.nearPressureMultiplier * nearDensity; };
+
+    scheduler.ParallelFor(0, predicted.size(), ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            float density = densities[i].x;
+            if (density <= 0.0f) continue;
+
+            float pressure = pressureFromDensity(density);
+            float nearPressure = nearPressureFromDensity(densities[i].y);
+            glm::vec3 pos = predicted[i];
+            glm::vec3 pressureForce(0.0f);
+
+            ForEachNeighbor(pos, [&](uint32_t j) {
+                if (j == i) return;
+
+                glm::vec3 offsetToNeighbour = predicted[j] - pos;
+                float sqrDst = glm::dot(offsetToNeighbour, offsetToNeighbour);
+                if (sqrDst > sqrRadius) return;
+
+                float dst = std::sqrt(sqrDst);
+                if (dst <= 0.0f) return;
+
+                float neighbourDensity = densities[j].x;
+                float neighbourNearDensity = densities[j].y;
+                if (neighbourDensity <= 0.0f || neighbourNearDensity <= 0.0f) return;
+
+                glm::vec3 dirToNeighbour = offsetToNeighbour / dst;
+                float sharedPressure = (pressure + pressureFromDensity(neighbourDensity)) * 0.5f;
+                float sharedNearPressure = (nearPressure + nearPressureFromDensity(neighbourNearDensity)) * 0.5f;
+
+                pressureForce += dirToNeighbour * kernels.DensityDerivative(dst) * sharedPressure / neighbourDensity;
+                pressureForce += dirToNeighbour * kernels.NearDensityDerivative(dst) * sharedNearPressure / neighbourNearDensity;
+            });
+
+            particleData.velocities[i] += pressureForce / density * params.deltaTime;
+        }
+    });
+}
+
+void FluidSolverCPU3D::CalculateViscosity(ParticleData3D& particleData, const FluidParams3D& params) {
+    SPHKernels kernels(params.smoothingRadius);
+    float sqrRadius = params.smoothingRadius * params.smoothingRadius;
+    const std::vector<glm::vec3>& predicted = particleData.predictedPositions;
+    const std::vector<glm::vec3>& velocities = particleData.velocities;
+
+    // Read the post-pressure velocities, write into scratch so every particle sees the same input
+    scheduler.ParallelFor(0, predicted.size(), ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec3 pos = predicted[i];
+            glm::vec3 velocity = velocities[i];
+            glm::vec3 viscosityForce(0.0f);
+
+            ForEachNeighbor(pos, [&](uint32_t j) {
+                if (j == i) return;
+
+                glm::vec3 offsetToNeighbour = predicted[j] - pos;
+                float sqrDst = glm::dot(offsetToNeighbour, offsetToNeighbour);
+                if (sqrDst > sqrRadius) return;
+
+                float dst = std::sqrt(sqrDst);
+                if (dst <= 0.0f) return;
+
+                viscosityForce += (velocities[j] - velocity) * kernels.ViscosityKernel(dst);
+            });
+
+            velocityScratch[i] = velocity + viscosityForce * params.viscosityStrength * params.deltaTime;
+        }
+    });
+
+    particleData.velocities.swap(velocityScratch);
+}
+
+template <typename Visit>
+void FluidSolverCPU3D::ListNeighbors(const std::vector<glm::vec3>& positions, const FluidParams3D& params, Visit&& visit) {
+    float sqrRadius = params.smoothingRadius * params.smoothingRadius;
+    size_t count = positions.size();
+
+    // Count the neighbours within the radius, scan, then list them; every iteration reads the lists
+    size_t numChunks = (count + ParticleGrain - 1) / ParticleGrain;
+    chunkSums.assign(numChunks + 1, 0);
+    neighborStart.resize(count + 1);
+
+    // The same locality proxies as CalculateDensities, which DFSPH and PBF do not run; the count
+    // pass sees every candidate, and a pair includes the particle itself like there
+    bool measureLocality = Profiler::Instance().isEnabled();
+    std::vector<uint64_t> indexDistance(measureLocality ? numChunks : 0, 0);
+    std::vector<uint64_t> lineMisses(indexDistance.size(), 0);
+    std::vector<uint64_t> pageMisses(indexDistance.size(), 0);
+    std::vector<uint64_t> pairCount(indexDistance.size(), 0);
+    std::vector<uint64_t> checkCount(indexDistance.size(), 0);
+    const size_t lineStride = CacheLineBytes / sizeof(glm::vec3);
+    const size_t pageStride = PageBytes / sizeof(glm::vec3);
+
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        size_t total = 0;
+        uint64_t chunkDistance = 0;
+        uint64_t chunkLineMisses = 0;
+        uint64_t chunkPageMisses = 0;
+        uint64_t chunkPairs = 0;
+        uint64_t chunkChecks = 0;
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec3 pos = positions[i];
+            uint32_t neighbours = 0;
+            ForEachNeighbor(pos, [&](uint32_t j) {
+                glm::vec3 offset = positions[j] - pos;
+                bool inside = glm::dot(offset, offset) <= sqrRadius;
+                neighbours += j != i && inside;
+                if (measureLocality) {
+                    chunkChecks++;
+                    if (!inside) return;
+                    size_t distance = j > i ? j - i : i - j;
+                    chunkDistance += distance;
+                    chunkLineMisses += distance >= lineStride;
+                    chunkPageMisses += distance >= pageStride;
+                    chunkPairs++;
+                }
+            });
+            neighborStart[i] = neighbours;
+            total += neighbours;
+        }
+        chunkSums[begin / ParticleGrain + 1] = total;
+
+        if (measureLocality) {
+            size_t chunk = begin / ParticleGrain;
+            indexDistance[chunk] = chunkDistance;
+            lineMisses[chunk] = chunkLineMisses;
+            pageMisses[chunk] = chunkPageMisses;
+            pairCount[chunk] = chunkPairs;
+            checkCount[chunk] = chunkChecks;
+        }
+    });
+    if (measureLocality) {
+        RecordLocalityMetrics(indexDistance, lineMisses, pageMisses, pairCount, checkCount);
+    }
+    for (size_t chunk = 1; chunk <= numChunks; ++chunk) {
+        chunkSums[chunk] += chunkSums[chunk - 1];
+    }
+    neighborList.resize(chunkSums[numChunks]);
+
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        size_t next = chunkSums[begin / ParticleGrain];
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec3 pos = positions[i];
+            size_t first = next;
+            neighborStart[i] = static_cast<uint32_t>(first);
+            ForEachNeighbor(pos, [&](uint32_t j) {
+                glm::vec3 offset = positions[j] - pos;
+                if (j != i && glm::dot(offset, offset) <= sqrRadius) neighborList[next++] = j;
+            });
+            visit(i, first, next);
+        }
+    });
+    neighborStart[count] = static_cast<uint32_t>(neighborList.size());
+}
+
+void FluidSolverCPU3D::CalculateDensityFactors(ParticleData3D& particleData, const FluidParams3D& params) {
+    SPHKernels kernels(params.smoothingRadius);
+    float restVolume = RestVolume(params);
+    const std::vector<glm::vec3>& positions = particleData.positions;
+    size_t count = positions.size();
+
+    restDensityRatios.resize(count);
+    densityFactors.resize(count);
+    stiffnessStep.resize(count);
+    densityStiffness.resize(count, 0.0f);
+    divergenceStiffness.resize(count, 0.0f);
+
+    ListNeighbors(positions, params, [&](size_t i, size_t first, size_t end) {
+        glm::vec3 pos = positions[i];
+        float density = kernels.SmoothingKernelPoly6(0.0f);
+        glm::vec3 gradientSum(0.0f);
+        float gradientSqrSum = 0.0f;
+        for (size_t n = first; n < end; ++n) {
+            glm::vec3 offset = pos - positions[neighborList[n]];
+            float dst = glm::length(offset);
+            density += kernels.SmoothingKernelPoly6(dst);
+            if (dst <= 0.0f) continue;
+            glm::vec3 gradient = offset * (kernels.SpikyPow3Slope(dst) / dst);
+            gradientSum += gradient;
+            gradientSqrSum += glm::dot(gradient, gradient);
+        }
+
+        float denominator = restVolume * (glm::dot(gradientSum, gradientSum) + gradientSqrSum);
+        restDensityRatios[i] = density * restVolume;
+        densityFactors[i] = denominator > MinFactorDenominator ? 1.0f / denominator : 0.0f;
+        particleData.densities[i] = glm::vec2(restDensityRatios[i] * params.targetDensity, 0.0f);
+    });
+}
+
+void FluidSolverCPU3D::ApplyStiffness(ParticleData3D& particleData, const FluidParams3D& params, const std::vector<float>& stiffness, float scale) {
+    SPHKernels kernels(params.smoothingRadius);
+    const std::vector<glm::vec3>& positions = particleData.positions;
+    std::vector<glm::vec3>& velocities = particleData.velocities;
+    float stepScale = params.deltaTime * scale;
+
+    // Every particle only writes its own velocity and reads stiffness, so the update is in place
+    scheduler.ParallelFor(0, positions.size(), ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec3 pos = positions[i];
+            glm::vec3 deltaVelocity(0.0f);
+            for (uint32_t n = neighborStart[i]; n < neighborStart[i + 1]; ++n) {
+                uint32_t j = neighborList[n];
+                glm::vec3 offset = pos - positions[j];
+                float dst = glm::length(offset);
+                if (dst <= 0.0f) continue;
+                deltaVelocity += offset * ((stiffness[i] + stiffness[j]) * kernels.SpikyPow3Slope(dst) / dst);
+            }
+            velocities[i] -= deltaVelocity * stepScale;
+        }
+    });
+}
+
+template <typename ComputeStiffness>
+int FluidSolverCPU3D::SolvePressure(ParticleData3D& particleData, const FluidParams3D& params, std::vector<float>& warmStart, int minIterations,
+    float tolerance, float& error, ComputeStiffness&& computeStiffness) {
+    size_t count = particleData.positions.size();
+    float sqrDeltaTime = params.deltaTime * params.deltaTime;
+
+    // Start from half of last step's stiffness; all of it overshoots where the fluid began to expand
+    ApplyStiffness(particleData, params, warmStart, 0.5f / sqrDeltaTime);
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) warmStart[i] *= 0.5f;
+    });
+
+    int iterations = 0;
+    error = 0.0f;
+    while (iterations < params.maxPressureIterations) {
+        double totalError = scheduler.ParallelReduce(size_t(0), count, ParticleGrain, 0.0,
+            [&](size_t begin, size_t end) {
+                double chunkError = computeStiffness(begin, end);
+                for (size_t i = begin; i < end; ++i) warmStart[i] += stiffnessStep[i] * sqrDeltaTime;
+                return chunkError;
+            },
+            [](double a, double b) { return a + b; });
+        error = static_cast<float>(totalError / count);
+        ApplyStiffness(particleData, params, stiffnessStep, 1.0f);
+        ++iterations;
+        if (iterations >= minIterations && error <= tolerance) break;
+    }
+    return iterations;
+}
+
+void FluidSolverCPU3D::SolveDivergence(ParticleData3D& particleData, const FluidParams3D& params) {
+    SPHKernels kernels(params.smoothingRadius);
+    float restVolume = RestVolume(params);
+    float deltaTime = params.deltaTime;
+    const std::vector<glm::vec3>& positions = particleData.positions;
+    const std::vector<glm::vec3>& velocities = particleData.velocities;
+
+    // The rate at which each particle's density grows; only compression is corrected
+    lastPressureSolve.divergenceIterations = SolvePressure(particleData, params, divergenceStiffness, 1, params.divergenceTolerance,
+        lastPressureSolve.divergenceError, [&](size_t begin, size_t end) {
+            double chunkError = 0.0;
+            for (size_t i = begin; i < end; ++i) {
+                float divergence = 0.0f;
+                if (neighborStart[i + 1] - neighborStart[i] >= MinDivergenceNeighbors) {
+                    glm::vec3 pos = positions[i];
+                    glm::vec3 velocity = velocities[i];
+                    for (uint32_t n = neighborStart[i]; n < neighborStart[i + 1]; ++n) {
+                        uint32_t j = neighborList[n];
+                        glm::vec3 offset = pos - positions[j];
+                        float dst = glm::length(offset);
+                        if (dst <= 0.0f) continue;
+                        divergence += glm::dot(velocity - velocities[j], offset) * (kernels.SpikyPow3Slope(dst) / dst);
+                    }
+                    divergence = std::max(divergence * restVolume, 0.0f);
+                }
+                stiffnessStep[i] = divergence * densityFactors[i] / deltaTime;
+                chunkError += divergence * deltaTime;
+            }
+            return chunkError;
+        });
+
+    Profiler& profiler = Profiler::Instance();
+    profiler.SetCounter("CPU/DFSPH Divergence Iterations", lastPressureSolve.divergenceIterations);
+    profiler.SetCounter("CPU/DFSPH Divergence Error (%)", 100.0 * lastPressureSolve.divergenceError);
+}
+
+void FluidSolverCPU3D::SolveDensity(ParticleData3D& particleData, const FluidParams3D& params) {
+    SPHKernels kernels(params.smoothingRadius);
+    float restVolume = RestVolume(params);
+    float deltaTime = params.deltaTime;
+    const std::vector<glm::vec3>& positions = particleData.positions;
+    const std::vector<glm::vec3>& velocities = particleData.velocities;
+
+    // The density each particle would have after moving with the current velocities; only
+    // compression is corrected
+    lastPressureSolve.densityIterations = SolvePressure(particleData, params, densityStiffness, 2, params.densityTolerance,
+        lastPressureSolve.densityError, [&](size_t begin, size_t end) {
+            double chunkError = 0.0;
+            for (size_t i = begin; i < end; ++i) {
+                glm::vec3 pos = positions[i];
+                glm::vec3 velocity = velocities[i];
+                float densityChange = 0.0f;
+                for (uint32_t n = neighborStart[i]; n < neighborStart[i + 1]; ++n) {
+                    uint32_t j = neighborList[n];
+                    glm::vec3 offset = pos - positions[j];
+                    float dst = glm::length(offset);
+                    if (dst <= 0.0f) continue;
+                    densityChange += glm::dot(velocity - velocities[j], offset) * (kernels.SpikyPow3Slope(dst) / dst);
+                }
+                float densityError = std::max(restDensityRatios[i] + deltaTime * restVolume * densityChange - 1.0f, 0.0f);
+                stiffnessStep[i] = densityError * densityFactors[i] / (deltaTime * deltaTime);
+                chunkError += densityError;
+            }
+            return chunkError;
+        });
+
+    Profiler& profiler = Profiler::Instance();
+    profiler.SetCounter("CPU/DFSPH Density Iterations", lastPressureSolve.densityIterations);
+    profiler.SetCounter("CPU/DFSPH Density Error (%)", 100.0 * lastPressureSolve.densityError);
+}
+
+void FluidSolverCPU3D::GatherNeighborLists(const ParticleData3D& particleData, const FluidParams3D& params) {
+    ListNeighbors(particleData.predictedPositions, params, [](size_t, size_t, size_t) {});
+}
+
+void FluidSolverCPU3D::SolveDensityConstraints(ParticleData3D& particleData, const FluidParams3D& params) {
+    SPHKernels kernels(params.smoothingRadius);
+    float restVolume = RestVolume(params);
+    float tensileReference = kernels.SmoothingKernelPoly6(TensileDistance * params.smoothingRadius);
+    std::vector<glm::vec3>& predicted = particleData.predictedPositions;
+    size_t count = predicted.size();
+    lambdas.resize(count);
+
+    float error = 0.0f;
+    for (int iteration = 0; iteration < params.pbfIterations; ++iteration) {
+        // Lambda pass: every constraint's violation over the squared length of its gradients.
+        // Only compression is corrected, so the free surface does not pull particles together
+        double totalError = scheduler.ParallelReduce(size_t(0), count, ParticleGrain, 0.0,
+            [&](size_t begin, size_t end) {
+                double chunkError = 0.0;
+                for (size_t i = begin; i < end; ++i) {
+                    glm::vec3 pos = predicted[i];
+                    float density = kernels.SmoothingKernelPoly6(0.0f);
+                    glm::vec3 gradientSum(0.0f);
+                    float gradientSqrSum = 0.0f;
+                    for (uint32_t n = neighborStart[i]; n < neighborStart[i + 1]; ++n) {
+                        glm::vec3 offset = pos - predicted[neighborList[n]];
+                        float dst = glm::length(offset);
+                        density += kernels.SmoothingKernelPoly6(dst);
+                        if (dst <= 0.0f) continue;
+                        glm::vec3 gradient = offset * (restVolume * kernels.SpikyPow3Slope(dst) / dst);
+                        gradientSum += gradient;
+                        gradientSqrSum += glm::dot(gradient, gradient);
+                    }
+
+                    float constraint = std::max(density * restVolume - 1.0f, 0.0f);
+                    lambdas[i] = -constraint / (glm::dot(gradientSum, gradientSum) + gradientSqrSum + params.pbfRelaxation);
+                    particleData.densities[i] = glm::vec2(density * restVolume * params.targetDensity, lambdas[i]);
+                    chunkError += constraint;
+                }
+                return chunkError;
+            },
+            [](double a, double b) { return a + b; });
+        error = static_cast<float>(totalError / count);
+
+        // Position pass, Jacobi style: every particle moves itself by its own and its neighbours' lambdas.
+        // The artificial pressure term pushes apart particles closer than TensileDistance
+        scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                glm::vec3 pos = predicted[i];
+                glm::vec3 correction(0.0f);
+                for (uint32_t n = neighborStart[i]; n < neighborStart[i + 1]; ++n) {
+                    uint32_t j = neighborList[n];
+                    glm::vec3 offset = pos - predicted[j];
+                    float dst = glm::length(offset);
+                    if (dst <= 0.0f) continue;
+                    float tensile = kernels.SmoothingKernelPoly6(dst) / tensileReference;
+                    tensile *= tensile;
+                    tensile *= -params.pbfTensileStrength * tensile;
+                    correction += offset * ((lambdas[i] + lambdas[j] + tensile) * kernels.SpikyPow3Slope(dst) / dst);
+                }
+                pos += correction * restVolume;
+
+                // The boundary is a constraint too; the velocity follows from the positions afterwards
+                glm::vec3 unusedVelocity(0.0f);
+                BoundarySDF3D::ResolveContact(boundary.Sample(pos), pos, unusedVelocity, 0.0f);
+                positionScratch[i] = pos;
+            }
+        });
+        predicted.swap(positionScratch);
+    }
+
+    lastPressureSolve = PressureSolveStats();
+    lastPressureSolve.densityIterations = params.pbfIterations;
+    lastPressureSolve.densityError = error;
+    Profiler& profiler = Profiler::Instance();
+    profiler.SetCounter("CPU/PBF Iterations", params.pbfIterations);
+    profiler.SetCounter("CPU/PBF Density Error (%)", 100.0 * error);
+}
+
+void FluidSolverCPU3D::UpdateConstraintVelocities(ParticleData3D& particleData, const FluidParams3D& params) {
+    SPHKernels kernels(params.smoothingRadius);
+    float xsphScale = params.xsphViscosity * RestVolume(params);
+    float inverseDeltaTime = 1.0f / params.deltaTime;
+    const std::vector<glm::vec3>& positions = particleData.positions;
+    const std::vector<glm::vec3>& predicted = particleData.predictedPositions;
+
+    // The velocity is the distance the solve moved each particle over the step. XSPH then blends it
+    // towards the neighbours' velocities, which are derived the same way on the fly
+    scheduler.ParallelFor(0, positions.size(), ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec3 pos = predicted[i];
+            glm::vec3 velocity = (pos - positions[i]) * inverseDeltaTime;
+            glm::vec3 blend(0.0f);
+            for (uint32_t n = neighborStart[i]; n < neighborStart[i + 1]; ++n) {
+                uint32_t j = neighborList[n];
+                glm::vec3 neighbourVelocity = (predicted[j] - positions[j]) * inverseDeltaTime;
+                blend += (neighbourVelocity - velocity) * kernels.SmoothingKernelPoly6(glm::length(pos - predicted[j]));
+            }
+            velocity += blend * xsphScale;
+
+            float speed = glm::length(velocity);
+            if (speed > params.maxVelocity) {
+                velocity *= params.maxVelocity / speed;
+            }
+            velocityScratch[i] = velocity;
+        }
+    });
+
+    particleData.velocities.swap(velocityScratch);
+}
+
+void FluidSolverCPU3D::UpdatePositions(ParticleData3D& particleData, const FluidParams3D& params) {
+    IntegratePositions(particleData, params);
+    ResolveCollisions(particleData, params);
+}
+
+void FluidSolverCPU3D::IntegratePositions(ParticleData3D& particleData, const FluidParams3D& params) {
+    const std::vector<glm::vec3>& positions = particleData.positions;
+    const std::vector<glm::vec3>& velocities = particleData.velocities;
+
+    scheduler.ParallelFor(0, positions.size(), ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            positionScratch[i] = positions[i] + velocities[i] * params.deltaTime;
+        }
+    });
+}
+
+void FluidSolverCPU3D::ResolveCollisions(ParticleData3D& particleData, const FluidParams3D& params) {
+    std::vector<glm::vec3>& positions = particleData.positions;
+    std::vector<glm::vec3>& velocities = particleData.velocities;
+    size_t count = positions.size();
+
+    // Particle-particle collisions are resolved Jacobi style: every particle only
+    // moves itself, using the symmetric half of each overlap, so no two threads write the same particle.
+    float collisionDistance = 2.0f * params.particleRadius;
+    float sqrCollisionDistance = collisionDistance * collisionDistance;
+
+    scheduler.ParallelFor(0, count, ParticleGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec3 pos = positionScratch[i];
+            glm::vec3 vel = velocities[i];
+            glm::vec3 correction(0.0f);
+            glm::vec3 impulse(0.0f);
+
+            ForEachNeighbor(pos, [&](uint32_t j) {
+                if (j == i) return;
+
+                glm::vec3 delta = pos - positionScratch[j];
+                float sqrDistance = glm::dot(delta, delta);
+                if (sqrDistance >= sqrCollisionDistance || sqrDistance <= 0.0f) return;
+
+                float distance = std::sqrt(sqrDistance);
+                glm::vec3 collisionNormal = delta / distance;
+                correction += collisionNormal * ((collisionDistance - distance) * 0.5f);
+
+                float collisionImpulse = glm::dot(vel - velocities[j], collisionNormal);
+                impulse += collisionImpulse * collisionNormal * params.collisionDamping;
+            });
+
+            pos += correction;
+            vel -= impulse;
+
+            // One lookup covers the walls and every obstacle
+            BoundarySDF3D::ResolveContact(boundary.Sample(pos), pos, vel, params.collisionDamping);
+
+            positions[i] = pos;
+            velocityScratch[i] = vel;
+        }
+    });
+
+    velocities.swap(velocityScratch);
+}
+
+float FluidSolverCPU3D::GetMaxVelocity(const ParticleData3D& particleData) const {
+    const std::vector<glm::vec3>& velocities = particleData.velocities;
+    return scheduler.ParallelReduce(size_t(0), velocities.size(), ParticleGrain, 0.0f,
+        [&](size_t begin, size_t end) {
+            float maxSpeed = 0.0f;
+            for (size_t i = begin; i < end; ++i) {
+                maxSpeed = std::max(maxSpeed, glm::length(velocities[i]));
+            }
+            return maxSpeed;
+        },
+        [](float a, float b) { return std::max(a, b); });
+}
+
+uint64_t FluidSolverCPU3D::ComputeStateHash(const ParticleData3D& particleData) const {
+    const uint64_t fnvOffset = 1469598103934665603ull;
+    const uint64_t fnvPrime = 1099511628211ull;
+
+    auto hashBytes = [&](uint64_t hash, const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * fnvPrime;
+        }
+        return hash;
+    };
+
+    // FNV-1a over the raw bits of each chunk, chunk hashes folded in a fixed tree
+    return scheduler.ParallelReduce(size_t(0), particleData.positions.size(), ParticleGrain, fnvOffset,
+        [&](size_t begin, size_t end) {
+            uint64_t hash = fnvOffset;
+            for (size_t i = begin; i < end; ++i) {
+                hash = hashBytes(hash, &particleIds[i], sizeof(uint32_t));
+                hash = hashBytes(hash, &particleData.positions[i], sizeof(glm::vec3));
+                hash = hashBytes(hash, &particleData.velocities[i], sizeof(glm::vec3));
+            }
+            return hash;
+        },
+        [&](uint64_t a, uint64_t b) { return hashBytes(a, &b, sizeof(uint64_t)); });
+}
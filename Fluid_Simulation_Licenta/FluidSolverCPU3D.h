@@ -0,0 +1,245 @@
+#ifndef FLUID_SOLVER_CPU_3D_H
+#define FLUID_SOLVER_CPU_3D_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "BarnesHut3D.h"
+#include "BoundarySDF3D.h"
+#include "FluidParams3D.h"
+#include "Morton.h"
+#include "ParticleData.h"
+#include "RadixSort.h"
+#include "SPHKernels.h"
+#include "SparseBlockGrid3D.h"
+#include "TaskScheduler.h"
+
+// Multithreaded CPU port of FluidSimulator_3D.comp.
+// Neighbours come from a uniform cell grid over the bounding box instead of the
+// all-pairs loop of the slow shader. Each phase is a ParallelFor over particles
+// or cells, and the phases of one step form a TaskGraph.
+// Cells are numbered in Morton order, and every reorderInterval steps the particle
+// columns are radix sorted by cell so that neighbours also sit close in memory.
+// The grid is sparse: cells live in the 8^3 blocks of a SparseBlockGrid3D, so only blocks
+// that hold particles take memory and any box keeps cells the size of the smoothing radius.
+// Only occupied cells get an entry, and each of them lists its 27 neighbours once per build.
+// Particles rarely change cell between steps, so the build keeps last step's sorted order, pulls
+// out the particles whose cell changed, sorts those alone and merges them back in.
+// With FluidParams3D::deterministic every cell lists its particles by id and all
+// reductions are fixed-shape trees, so the result is bitwise identical for any thread count.
+// With FluidParams3D::pressureSolver set to DFSPH, the explicit pressure pass is replaced by
+// a divergence-free solve and a density solve, both Jacobi iterations over per-particle
+// neighbour lists that are gathered once per step from the grid.
+// With PBF, the same lists are gathered around the predicted positions, which a fixed number of
+// Jacobi iterations then move towards rest density before the velocities are taken from them.
+// With FluidParams3D::longRangeStrength set, a Barnes-Hut pass adds attraction between all
+// particles to the external forces.
+class FluidSolverCPU3D {
+public:
+    explicit FluidSolverCPU3D(TaskScheduler& scheduler = TaskScheduler::Instance());
+    ~FluidSolverCPU3D();
+
+    void Step(ParticleData3D& particleData, const FluidParams3D& params);
+    // Sizes the solver's columns for particleData. Step calls it; call it before running phases on their own.
+    void EnsureParticleStorage(ParticleData3D& particleData);
+    // Reserves every per-particle column for capacity particles so later growth does not reallocate.
+    void Reserve(size_t capacity);
+    // Solids that ResolveCollisions pushes particles out of, baked into the boundary field with the box.
+    void SetObstacles(const std::vector<Obstacle3D>& obstacles) { this->obstacles = obstacles; }
+    const BoundarySDF3D& GetBoundary() const { return boundary; }
+    BoundarySDF3D& GetBoundary() { return boundary; }
+
+    // Individual phases, in step order. Public so they can be timed on their own.
+    // Barnes-Hut attraction into a column that ApplyExternalForces adds; does nothing while longRangeStrength is 0.
+    void CalculateLongRangeForces(const ParticleData3D& particleData, const FluidParams3D& params);
+    void ApplyExternalForces(ParticleData3D& particleData, const FluidParams3D& params);
+    void BuildNeighborGrid(const ParticleData3D& particleData, const FluidParams3D& params);
+    void ReorderParticles(ParticleData3D& particleData, const FluidParams3D& params);
+    void UpdateBoundary(const FluidParams3D& params);
+    void CalculateDensities(ParticleData3D& particleData, const FluidParams3D& params);
+    void CalculatePressureForces(ParticleData3D& particleData, const FluidParams3D& params);
+    void CalculateViscosity(ParticleData3D& particleData, const FluidParams3D& params);
+    // DFSPH: gathers every particle's neighbour list, then its density and factor.
+    void CalculateDensityFactors(ParticleData3D& particleData, const FluidParams3D& params);
+    // DFSPH: removes the velocity divergence that would compress the fluid.
+    void SolveDivergence(ParticleData3D& particleData, const FluidParams3D& params);
+    // DFSPH: corrects the velocities so that the positions after the step are at rest density.
+    void SolveDensity(ParticleData3D& particleData, const FluidParams3D& params);
+    // PBF: gathers every particle's neighbour list around its predicted position.
+    void GatherNeighborLists(const ParticleData3D& particleData, const FluidParams3D& params);
+    // PBF: pbfIterations passes of lambdas, then position corrections, on the predicted positions.
+    void SolveDensityConstraints(ParticleData3D& particleData, const FluidParams3D& params);
+    // PBF: velocities from the corrected predicted positions, blended with the neighbours' by XSPH.
+    void UpdateConstraintVelocities(ParticleData3D& particleData, const FluidParams3D& params);
+    void UpdatePositions(ParticleData3D& particleData, const FluidParams3D& params);
+    // The two halves of UpdatePositions: explicit Euler into scratch, then collisions and bounds.
+    void IntegratePositions(ParticleData3D& particleData, const FluidParams3D& params);
+    void ResolveCollisions(ParticleData3D& particleData, const FluidParams3D& params);
+
+    // Iterations and remaining average errors of the last DFSPH step, as fractions of the rest density.
+    // PBF fills in the density half: its iterations and the error that the last of them corrected.
+    struct PressureSolveStats {
+        int densityIterations = 0;
+        float densityError = 0.0f;
+        int divergenceIterations = 0;
+        float divergenceError = 0.0f;
+    };
+    const PressureSolveStats& GetLastPressureSolve() const { return lastPressureSolve; }
+
+    float GetMaxVelocity(const ParticleData3D& particleData) const;
+    // 64-bit FNV-1a hash of ids, positions and velocities, used to compare runs.
+    uint64_t ComputeStateHash(const ParticleData3D& particleData) const;
+    // Hash after the last step; only updated in deterministic mode.
+    uint64_t GetLastStateHash() const { return lastStateHash; }
+    // Occupied cells and the blocks holding them from the last neighbour build.
+    size_t GetCellCount() const { return cellKeys.size(); }
+    const SparseBlockGrid3D& GetCellGrid() const { return cellGrid; }
+    float GetCellSize() const { return cellSize; }
+    // Cell key of every slot from the last neighbour build, and the number of bits those keys use.
+    const std::vector<uint32_t>& GetParticleCells() const { return particleCells; }
+    uint32_t GetCellKeyBits() const { return cellGrid.GetKeyBits(); }
+    // Spawn index of the particle currently stored in each slot.
+    const std::vector<uint32_t>& GetParticleIds() const { return particleIds; }
+    // For ParticlePool3D, which keeps the ids in step when particles are added or removed.
+    std::vector<uint32_t>& GetParticleIds() { return particleIds; }
+    size_t GetStepCount() const { return stepCount; }
+    // Continues from a checkpoint: slot ids (empty = identity) and the step counter that drives reordering.
+    void RestoreState(const std::vector<uint32_t>& ids, size_t steps);
+    // Moves the per-slot state that outlives a step (the DFSPH warm starts) after ParticlePool3D::Compact.
+    void CompactSlots(const std::vector<uint32_t>& destinations);
+
+    static const size_t ParticleGrain = 1024;
+    static const size_t CellGrain = 4096;
+
+private:
+    glm::ivec3 CellCoord(const glm::vec3& position) const;
+    // Lists the occupied cells from the sorted keys in cellScratch.
+    void CompactCells(size_t count);
+    // Stores every occupied cell's entry in the block grid and looks up the 27 neighbours of each of them once.
+    void LinkCells();
+    void FillCellEntriesById(size_t count);
+    // Re-sorts last step's cellEntries by merging the slots whose cell changed back into the ones
+    // that did not. Returns false, leaving the sort to the caller, when there is no usable last
+    // order or more than params.rebinThreshold of the particles moved.
+    bool RebinIncrementally(size_t count, const FluidParams3D& params);
+    // Fills neighborStart and neighborList with the neighbours within the smoothing radius in
+    // positions; visit(i, first, end) runs once particle i's list is complete.
+    template <typename Visit>
+    void ListNeighbors(const std::vector<glm::vec3>& positions, const FluidParams3D& params, Visit&& visit);
+    // Runs pressure iterations until the average error is below tolerance. computeStiffness fills
+    // stiffnessStep for the particles in [begin, end) and returns their summed error.
+    template <typename ComputeStiffness>
+    int SolvePressure(ParticleData3D& particleData, const FluidParams3D& params, std::vector<float>& warmStart, int minIterations,
+        float tolerance, float& error, ComputeStiffness&& computeStiffness);
+    // Subtracts the pressure accelerations of stiffness over one step from the velocities.
+    void ApplyStiffness(ParticleData3D& particleData, const FluidParams3D& params, const std::vector<float>& stiffness, float scale);
+    void RecordLocalityMetrics(const std::vector<uint64_t>& indexDistance, const std::vector<uint64_t>& lineMisses,
+        const std::vector<uint64_t>& pageMisses, const std::vector<uint64_t>& pairCount, const std::vector<uint64_t>& checkCount);
+
+    template <typename Func>
+    void ForEachNeighbor(const glm::vec3& position, Func&& func) const {
+        glm::ivec3 origin = CellCoord(position);
+        uint32_t probes = 0;
+        uint32_t originCell = cellGrid.Find(origin, probes);
+        if (originCell != EmptyCell) {
+            const uint32_t* neighbours = cellNeighbors.data() + size_t(originCell) * 27;
+            for (int n = 0; n < 27; ++n) {
+                uint32_t cell = neighbours[n];
+                if (cell == EmptyCell) continue;
+                for (uint32_t slot = cellStart[cell]; slot < cellStart[cell + 1]; ++slot) {
+                    func(cellEntries[slot]);
+                }
+            }
+            return;
+        }
+
+        // A position whose own cell is empty, e.g. after integration: look the neighbours up one by one
+        glm::ivec3 lower = glm::max(origin - 1, glm::ivec3(0));
+        glm::ivec3 upper = glm::min(origin + 1, gridDims - 1);
+        for (int z = lower.z; z <= upper.z; ++z) {
+            for (int y = lower.y; y <= upper.y; ++y) {
+                for (int x = lower.x; x <= upper.x; ++x) {
+                    uint32_t cell = cellGrid.Find(glm::ivec3(x, y, z), probes);
+                    if (cell == EmptyCell) continue;
+                    for (uint32_t slot = cellStart[cell]; slot < cellStart[cell + 1]; ++slot) {
+                        func(cellEntries[slot]);
+                    }
+                }
+            }
+        }
+    }
+
+    static const uint32_t EmptyCell = SparseBlockGrid3D::Empty;
+
+    // A slot and its place in the neighbour order: cell key above, tie breaker below
+    struct RebinEntry {
+        uint64_t order;
+        uint32_t slot;
+    };
+
+    TaskScheduler& scheduler;
+    RadixSort radixSort;
+    size_t stepCount;
+    uint64_t lastStateHash;
+
+    glm::vec3 gridOrigin;
+    glm::ivec3 gridDims;
+    float cellSize;
+    // Maps a cell to its entry in cellKeys; blocks without particles are not stored
+    SparseBlockGrid3D cellGrid;
+    // Occupied cells in key order: their keys, and where their particles start in cellEntries
+    std::vector<uint32_t> cellKeys;
+    std::vector<uint32_t> cellStart;
+    // Entries of the 27 cells around every occupied cell, z-major, EmptyCell where there are none
+    std::vector<uint32_t> cellNeighbors;
+    std::vector<uint32_t> cellEntries;
+    std::vector<uint32_t> particleCells;
+    std::vector<glm::ivec3> particleCoords;
+    // Cell and id of every slot at the last build, permuted along by reorders; rebinCount is 0
+    // when cellEntries holds no order to continue from
+    std::vector<glm::ivec3> rebinCoords;
+    std::vector<uint32_t> rebinIds;
+    size_t rebinCount;
+    std::vector<uint8_t> slotMoved;
+    // Moved slots per chunk of slots, scanned; empty when the build has no order to continue from
+    std::vector<size_t> movedSums;
+    std::vector<uint32_t> movedSlots;
+    std::vector<uint32_t> movedKeys;
+    std::vector<RebinEntry> keptEntries;
+    std::vector<RebinEntry> movedEntries;
+    std::vector<uint32_t> particleIds;
+    std::vector<uint32_t> sortOrder;
+
+    std::vector<glm::vec3> velocityScratch;
+    std::vector<glm::vec3> positionScratch;
+    std::vector<glm::vec2> densityScratch;
+    std::vector<uint32_t> idScratch;
+    std::vector<uint32_t> cellScratch;
+    std::vector<size_t> chunkSums;
+
+    // DFSPH and PBF: neighbours within the smoothing radius of every slot, listed from neighborStart
+    std::vector<uint32_t> neighborStart;
+    std::vector<uint32_t> neighborList;
+    // Density over rest density, and the factor that turns a density error into a stiffness
+    std::vector<float> restDensityRatios;
+    std::vector<float> densityFactors;
+    std::vector<float> stiffnessStep;
+    // Stiffness of the last step times dt^2, the warm start of the next one; reordered with the particles
+    std::vector<float> densityStiffness;
+    std::vector<float> divergenceStiffness;
+    std::vector<float> floatScratch;
+    // PBF: scaling factor of every particle's density constraint in the current iteration
+    std::vector<float> lambdas;
+    PressureSolveStats lastPressureSolve;
+
+    BarnesHut3D longRange;
+    std::vector<glm::vec3> longRangeAccelerations;
+
+    std::vector<Obstacle3D> obstacles;
+    BoundarySDF3D boundary;
+};
+
+#endif // FLUID_SOLVER_CPU_3D_H
@@ -0,0 +1,65 @@
+#include "FluidSolverGPU3D.h"
+#include "SPHKernels.h"
+
+FluidSolverGPU3D::FluidSolverGPU3D(const std::string& shaderPath, const ParticleData3D& particleData, size_t capacity)
+    : shaderPath(shaderPath), computeShader(new ComputeShader(shaderPath)), particleBuffers(nullptr), boundary(new BoundaryTexture3D()),
+    positionBasedFluids(nullptr) {
+    computeShader->use();
+    particleBuffers = new ParticleBuffers3D(particleData.positions.size(), computeShader, capacity);
+    particleBuffers->UpdateData(particleData.positions, particleData.velocities, particleData.predictedPositions, particleData.densities);
+}
+
+FluidSolverGPU3D::~FluidSolverGPU3D() {
+    delete positionBasedFluids;
+    delete particleBuffers;
+    delete boundary;
+    delete computeShader;
+}
+
+void FluidSolverGPU3D::Step(const FluidParams3D& params) {
+    // Emitters and sinks change the count on the GPU between steps, so the launch is sized from the
+    // count buffer; an empty pool dispatches no groups.
+    boundary->Update(params);
+    if (params.pressureSolver == PressureSolver3D::PBF) {
+        if (!positionBasedFluids) {
+            size_t slash = shaderPath.find_last_of("/\\");
+            std::string directory = slash == std::string::npos ? std::string() : shaderPath.substr(0, slash + 1);
+            positionBasedFluids = new PositionBasedFluidsGPU3D(directory + "PositionBasedFluids_3D.comp");
+        }
+        positionBasedFluids->Step(*particleBuffers, *boundary, params);
+        return;
+    }
+    computeShader->use();
+    ApplyParams(computeShader, params);
+    boundary->Bind(computeShader);
+    particleBuffers->BindParticleBuffers();
+    computeShader->DispatchComputeIndirect(particleBuffers->GetCountBuffer());
+}
+
+void FluidSolverGPU3D::Download(ParticleData3D& particleData) {
+    particleBuffers->RetrieveData(particleData.positions, particleData.velocities, particleData.predictedPositions, particleData.densities);
+}
+
+void FluidSolverGPU3D::ApplyParams(ComputeShader* computeShader, const FluidParams3D& params) {
+    computeShader->setFloat("gravity", params.gravity);
+    computeShader->setFloat("deltaTime", params.deltaTime);
+    computeShader->setFloat("collisionDamping", params.collisionDamping);
+    computeShader->setFloat("smoothingRadius", params.smoothingRadius);
+    computeShader->setFloat("targetDensity", params.targetDensity);
+    computeShader->setFloat("pressureMultiplier", params.pressureMultiplier);
+    computeShader->setFloat("nearPressureMultiplier", params.nearPressureMultiplier);
+    computeShader->setFloat("viscosityStrength", params.viscosityStrength);
+    computeShader->setVec3("interactionInputPoint", params.interactionInputPoint);
+    computeShader->setFloat("interactionInputStrength", params.interactionInputStrength);
+    computeShader->setFloat("interactionInputRadius", params.interactionInputRadius);
+    computeShader->setBVec2("isXButtonDown", params.isXButtonDown);
+
+    SPHKernels kernels(params.smoothingRadius);
+    computeShader->setFloat("Poly6ScalingFactor", kernels.poly6ScalingFactor);
+    computeShader->setFloat("SpikyPow3ScalingFactor", kernels.spikyPow3ScalingFactor);
+    computeShader->setFloat("SpikyPow2ScalingFactor", kernels.spikyPow2ScalingFactor);
+    computeShader->setFloat("SpikyPow3DerivativeScalingFactor", kernels.spikyPow3DerivativeScalingFactor);
+    computeShader->setFloat("SpikyPow2DerivativeScalingFactor", kernels.spikyPow2DerivativeScalingFactor);
+
+    computeShader->setBool("debugEnabled", false);
+}
@@ -0,0 +1,45 @@
+#ifndef FLUID_SOLVER_GPU_3D_H
+#define FLUID_SOLVER_GPU_3D_H
+
+#include <string>
+
+#include "BoundaryTexture3D.h"
+#include "ComputeShader.h"
+#include "FluidParams3D.h"
+#include "ParticleBuffers3D.h"
+#include "ParticleData.h"
+#include "PositionBasedFluidsGPU3D.h"
+
+// Runs FluidSimulator_3D.comp on the current GL context without any window or
+// render buffers, for the headless runner. Needs a context with GL 4.3 compute.
+// With FluidParams3D::pressureSolver set to PBF, steps run PositionBasedFluids_3D.comp from the
+// same directory instead.
+class FluidSolverGPU3D {
+public:
+    // capacity (0 = the current count) sizes the SSBOs once for scenes that grow.
+    FluidSolverGPU3D(const std::string& shaderPath, const ParticleData3D& particleData, size_t capacity = 0);
+    ~FluidSolverGPU3D();
+
+    void Step(const FluidParams3D& params);
+    // Copies the particle state back from the SSBOs.
+    void Download(ParticleData3D& particleData);
+    ParticleBuffers3D* GetParticleBuffers() const { return particleBuffers; }
+    // Solids baked into the boundary field with the box.
+    void SetObstacles(const std::vector<Obstacle3D>& obstacles) { boundary->SetObstacles(obstacles); }
+
+    // Uploads params as the uniforms FluidSimulator_3D.comp expects. The particle count is not
+    // among them: the shaders read it from the buffers' count buffer.
+    static void ApplyParams(ComputeShader* computeShader, const FluidParams3D& params);
+
+    static const int NumThreads = 64;
+
+private:
+    std::string shaderPath;
+    ComputeShader* computeShader;
+    ParticleBuffers3D* particleBuffers;
+    BoundaryTexture3D* boundary;
+    // Created by the first PBF step
+    PositionBasedFluidsGPU3D* positionBasedFluids;
+};
+
+#endif // FLUID_SOLVER_GPU_3D_H
@@ -0,0 +1,21 @@
+#ifndef FRAME_DROP_WARNING_H
+#define FRAME_DROP_WARNING_H
+
+#include <cstdint>
+#include <iostream>
+
+// Shared by the background frame writers (TrajectoryRecorder, ParticleExporter3D), which drop a
+// frame when every staging buffer is still queued. Only the first drop and every Interval-th
+// after it are reported, so a slow disk does not flood the log.
+namespace FrameDropWarning {
+    const uint64_t Interval = 100;
+
+    // framesDropped already counts this frame
+    inline void Report(const char* writer, uint64_t step, uint64_t framesDropped) {
+        if (framesDropped % Interval != 1) return;
+        std::cerr << writer << " Warning: Writer is falling behind, dropped the frame of step " << step
+            << " (" << framesDropped << " dropped so far)" << std::endl;
+    }
+}
+
+#endif // FRAME_DROP_WARNING_H
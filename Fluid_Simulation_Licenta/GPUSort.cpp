@@ -1,17 +1,46 @@
 #include "GPUSort.h"
+#include "Profiler.h"
 
-GPUSort::GPUSort() : indexBuffer(0), offsetBuffer(0) {
+namespace {
+    const GLuint RebinThreads = 64;
+    enum RebinPass : GLuint { Flag = 0, ScanBlocks = 1, Scatter = 2, Merge = 3 };
+}
+
+GPUSort::GPUSort()
+    : indexBuffer(0), offsetBuffer(0), entryCount(0), freshBuffer(0), scanBuffer(0), keptBuffer(0), movedBuffer(0), rebinCountBuffer(0),
+    sortedCount(0), freshPending(false), rebinThreshold(0.0f), lastMovedCount(0), lastSortIncremental(false) {
     sortComputeShader = new ComputeShader("shaders/BitonicMergeSort.comp");
+    rebinComputeShader = new ComputeShader("shaders/RebinEntries.comp");
 }
 
 GPUSort::~GPUSort() {
     glDeleteBuffers(1, &indexBuffer);
     glDeleteBuffers(1, &offsetBuffer);
+    glDeleteBuffers(1, &freshBuffer);
+    glDeleteBuffers(1, &scanBuffer);
+    glDeleteBuffers(1, &keptBuffer);
+    glDeleteBuffers(1, &movedBuffer);
+    glDeleteBuffers(1, &rebinCountBuffer);
     delete sortComputeShader;
+    delete rebinComputeShader;
+}
+
+void GPUSort::EnsureBufferSize(GLuint& buffer, size_t bytes) {
+    if (!buffer) glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    GLint64 size = 0;
+    glGetBufferParameteri64v(GL_SHADER_STORAGE_BUFFER, GL_BUFFER_SIZE, &size);
+    if (size < static_cast<GLint64>(bytes)) {
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+    }
+    CheckGLError("GPUSort::EnsureBufferSize");
 }
 
 void GPUSort::SetBuffers(const std::vector<glm::uvec3>& spatialIndices, const std::vector<glm::uint>& spatialOffsets) {
     sortComputeShader->use();
+    entryCount = spatialIndices.size();
+    sortedCount = 0;
+    freshPending = false;
     if (!indexBuffer) {
         glGenBuffers(1, &indexBuffer);
         CheckGLError("GPUSort::SetBuffers - Gen indexBuffer");
@@ -37,12 +66,19 @@ void GPUSort::SetBuffers(const std::vector<glm::uvec3>& spatialIndices, const st
 
 void GPUSort::UpdateBuffers(const std::vector<glm::uvec3>& spatialIndices, const std::vector<glm::uint>& spatialOffsets) {
     sortComputeShader->use();
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
-    CheckGLError("GPUSort::UpdateBuffers - Bind indexBuffer (before update)");
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, spatialIndices.size() * sizeof(glm::uvec3), spatialIndices.data());
+    if (spatialIndices.size() != entryCount) sortedCount = 0;
+    entryCount = spatialIndices.size();
+    size_t indexBytes = spatialIndices.size() * sizeof(glm::uvec3);
+
+    // In incremental mode the sorted entries of the last step stay put and the new ones go aside
+    freshPending = rebinThreshold > 0.0f;
+    GLuint& target = freshPending ? freshBuffer : indexBuffer;
+    if (!freshPending) sortedCount = 0;
+    EnsureBufferSize(target, indexBytes);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, indexBytes, spatialIndices.data());
     CheckGLError("GPUSort::UpdateBuffers - Update indexBuffer");
 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, offsetBuffer);
+    EnsureBufferSize(offsetBuffer, spatialOffsets.size() * sizeof(glm::uint));
     CheckGLError("GPUSort::UpdateBuffers - Bind offsetBuffer (before update)");
     glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, spatialOffsets.size() * sizeof(glm::uint), spatialOffsets.data());
     CheckGLError("GPUSort::UpdateBuffers - Update offsetBuffer");
@@ -77,36 +113,139 @@ void GPUSort::RetrieveSpatialData(std::vector<glm::uvec3>& spatialIndices, std::
 
 
 void GPUSort::Sort() {
+    ScopedTimer timer("GPU/Sort");
+    lastSortIncremental = false;
+    if (freshPending) {
+        freshPending = false;
+        if (sortedCount == entryCount && entryCount > 0) {
+            lastSortIncremental = SortIncremental();
+            Profiler& profiler = Profiler::Instance();
+            profiler.SetCounter("GPU/Rebin Moved Fraction", static_cast<double>(lastMovedCount) / entryCount);
+            profiler.SetCounter("GPU/Rebin Incremental", lastSortIncremental ? 1.0 : 0.0);
+        }
+        else {
+            // Nothing sorted to continue from: start from this step's entries
+            EnsureBufferSize(indexBuffer, entryCount * sizeof(glm::uvec3));
+            CopyEntries(freshBuffer, indexBuffer, entryCount);
+        }
+    }
+    if (!lastSortIncremental) BitonicSort(indexBuffer, entryCount);
+    sortedCount = entryCount;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, indexBuffer);
+}
+
+bool GPUSort::SortIncremental() {
+    GLuint numEntries = static_cast<GLuint>(entryCount);
+    GLuint groups = (numEntries + RebinThreads - 1) / RebinThreads;
+    EnsureBufferSize(scanBuffer, (entryCount + groups) * sizeof(GLuint));
+    EnsureBufferSize(keptBuffer, entryCount * sizeof(glm::uvec3));
+    EnsureBufferSize(movedBuffer, entryCount * sizeof(glm::uvec3));
+    EnsureBufferSize(rebinCountBuffer, sizeof(GLuint));
+
+    rebinComputeShader->use();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, indexBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, freshBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, scanBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, keptBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, movedBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, rebinCountBuffer);
+    rebinComputeShader->setUInt("numEntries", numEntries);
+    rebinComputeShader->setUInt("pass", Flag);
+    rebinComputeShader->DispatchGroups(groups);
+    rebinComputeShader->setUInt("pass", ScanBlocks);
+    rebinComputeShader->DispatchGroups(1);
+
+    // The host needs the count to size the bitonic sort of the moved list
+    GLuint movedCount = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, rebinCountBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &movedCount);
+    CheckGLError("GPUSort::SortIncremental - Read moved count");
+    lastMovedCount = movedCount;
+    if (movedCount > rebinThreshold * numEntries) return false;
+    if (movedCount == 0) return true;
+
+    rebinComputeShader->setUInt("pass", Scatter);
+    rebinComputeShader->DispatchGroups(groups);
+
+    BitonicSort(movedBuffer, movedCount);
+
+    rebinComputeShader->use();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, indexBuffer);
+    rebinComputeShader->setUInt("pass", Merge);
+    rebinComputeShader->DispatchGroups(groups);
+    CheckGLError("GPUSort::SortIncremental - Merge");
+    return true;
+}
+
+void GPUSort::BitonicSort(GLuint buffer, size_t count) {
     sortComputeShader->use();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
 
-    int numEntries = 10000;  // Replace with actual number of entries
+    int numEntries = static_cast<int>(count);
+    if (numEntries < 2) return;
     int numStages = static_cast<int>(std::log2(NextPowerOfTwo(numEntries)));
-    sortComputeShader->setInt("numEntries", numEntries);
+    sortComputeShader->setUInt("numEntries", static_cast<unsigned int>(numEntries));
 
     for (int stageIndex = 0; stageIndex < numStages; ++stageIndex) {
         for (int stepIndex = 0; stepIndex < stageIndex + 1; ++stepIndex) {
             int groupWidth = 1 << (stageIndex - stepIndex);
             int groupHeight = 2 * groupWidth - 1;
-            sortComputeShader->setInt("groupWidth", groupWidth);
-            sortComputeShader->setInt("groupHeight", groupHeight);
-            sortComputeShader->setInt("stepIndex", stepIndex);
-            sortComputeShader->DispatchComputeShader((numEntries + 127) / 128, 128);
-            CheckGLError("GPUSort::Sort - DispatchComputeShader");
+            sortComputeShader->setUInt("groupWidth", groupWidth);
+            sortComputeShader->setUInt("groupHeight", groupHeight);
+            sortComputeShader->setUInt("stepIndex", stepIndex);
+            // One invocation per compare-exchange pair
+            sortComputeShader->DispatchComputeShader(static_cast<GLuint>(NextPowerOfTwo(numEntries) / 2), 128);
+            CheckGLError("GPUSort::BitonicSort - DispatchComputeShader");
         }
     }
 }
 
 void GPUSort::SortAndCalculateOffsets() {
-    sortComputeShader->use();
-    sortComputeShader->setInt("stepIndex", 0); 
     Sort();
 
     sortComputeShader->use();
-    sortComputeShader->setInt("stepIndex", -1);  // -1 -> offset calculation kernel
-    sortComputeShader->DispatchComputeShader((indexBuffer + 127) / 128, 128);
+    EnsureBufferSize(offsetBuffer, entryCount * sizeof(glm::uint));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, offsetBuffer);
+    sortComputeShader->setUInt("numEntries", static_cast<unsigned int>(entryCount));
+    sortComputeShader->setUInt("stepIndex", 0xFFFFFFFFu);  // uint(-1) -> offset calculation kernel
+    sortComputeShader->DispatchComputeShader(static_cast<GLuint>(entryCount), 128);
     CheckGLError("GPUSort::SortAndCalculateOffsets - DispatchComputeShader");
 }
 
+void GPUSort::SortAndCalculateOffsets(GLuint entriesBuffer, GLuint offsetsBuffer, size_t count) {
+    if (count == 0) return;
+    if (rebinThreshold > 0.0f) {
+        // Last step's order stays in indexBuffer; this step's entries go aside like UpdateBuffers puts them
+        if (count != entryCount) sortedCount = 0;
+        entryCount = count;
+        EnsureBufferSize(freshBuffer, count * sizeof(glm::uvec3));
+        CopyEntries(entriesBuffer, freshBuffer, count);
+        freshPending = true;
+        Sort();
+        CopyEntries(indexBuffer, entriesBuffer, count);
+        sortComputeShader->use();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, entriesBuffer);
+    }
+    else {
+        BitonicSort(entriesBuffer, count);
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, offsetsBuffer);
+    sortComputeShader->setUInt("numEntries", static_cast<unsigned int>(count));
+    sortComputeShader->setUInt("stepIndex", 0xFFFFFFFFu);
+    sortComputeShader->DispatchComputeShader(static_cast<GLuint>(count), 128);
+    CheckGLError("GPUSort::SortAndCalculateOffsets - External buffers");
+}
+
+void GPUSort::CopyEntries(GLuint source, GLuint destination, size_t count) {
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, source);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, count * sizeof(glm::uvec3));
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    CheckGLError("GPUSort::CopyEntries");
+}
+
 int GPUSort::NextPowerOfTwo(int value) {
     return static_cast<int>(std::pow(2, std::ceil(std::log2(value))));
 }
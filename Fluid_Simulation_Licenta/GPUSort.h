@@ -8,6 +8,11 @@
 #include <cmath>
 #include <glm/glm.hpp>
 
+// Bitonic sort of the (originalIndex, hash, key) spatial entries on the GPU.
+// With a rebin threshold set, the sorted entries stay on the GPU between steps: UpdateBuffers then
+// takes the new entries in particle order, and Sort re-sorts only the entries whose key changed
+// (shaders/RebinEntries.comp) and merges them back in. It sorts from scratch when the entry count
+// changed or more than the threshold fraction of the entries moved.
 class GPUSort {
 public:
     GPUSort();
@@ -18,13 +23,49 @@ public:
     void RetrieveSpatialData(std::vector<glm::uvec3>& spatialIndices, std::vector<glm::uint>& spatialOffsets);
     void Sort();
     void SortAndCalculateOffsets();
+    // Sorts count entries that live in another buffer in place and writes their offsets to
+    // offsetsBuffer. With a rebin threshold set it re-sorts incrementally through this sorter's own
+    // buffers, so the entries must come in particle order, as the hash passes write them. Entries
+    // with the EmptyKey of gridHash_3D.glsl sort last and get no offset, which lets callers pad count to their capacity.
+    void SortAndCalculateOffsets(GLuint entriesBuffer, GLuint offsetsBuffer, size_t count);
+    size_t GetEntryCount() const { return entryCount; }
+
+    // Fraction of changed entries up to which Sort merges instead of sorting everything; 0 disables it.
+    void SetRebinThreshold(float threshold) { rebinThreshold = threshold; }
+    float GetRebinThreshold() const { return rebinThreshold; }
+    // Entries whose key changed at the last incremental Sort, and whether that Sort merged them.
+    size_t GetLastMovedCount() const { return lastMovedCount; }
+    bool WasLastSortIncremental() const { return lastSortIncremental; }
 
 private:
     ComputeShader* sortComputeShader;
+    ComputeShader* rebinComputeShader;
 
     GLuint indexBuffer;
     GLuint offsetBuffer;
+    size_t entryCount;
+
+    // Incremental mode: this step's entries, the scan of the moved flags, the two lists and the moved count
+    GLuint freshBuffer;
+    GLuint scanBuffer;
+    GLuint keptBuffer;
+    GLuint movedBuffer;
+    GLuint rebinCountBuffer;
+    // Entries in indexBuffer that are sorted and can be re-sorted incrementally; 0 when there are none
+    size_t sortedCount;
+    bool freshPending;
+    float rebinThreshold;
+    size_t lastMovedCount;
+    bool lastSortIncremental;
 
+    // Sorts count entries of buffer with the compare-exchange network of BitonicMergeSort.comp.
+    void BitonicSort(GLuint buffer, size_t count);
+    // Refreshes, splits, sorts and merges; false if too many entries moved, leaving them refreshed but unsorted.
+    bool SortIncremental();
+    // Copies count entries between buffers on the GPU
+    void CopyEntries(GLuint source, GLuint destination, size_t count);
+    // Creates buffer or grows it to at least bytes; growing discards the contents.
+    void EnsureBufferSize(GLuint& buffer, size_t bytes);
     int NextPowerOfTwo(int value);
 
     void CheckGLError(const std::string& operation);
@@ -0,0 +1,75 @@
+#include "HeadlessGLContext.h"
+#include <GL/glew.h>
+#include <iostream>
+
+HeadlessGLContext::HeadlessGLContext() : display(EGL_NO_DISPLAY), surface(EGL_NO_SURFACE), context(EGL_NO_CONTEXT) {}
+
+HeadlessGLContext::~HeadlessGLContext() {
+    Destroy();
+}
+
+bool HeadlessGLContext::Create() {
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+        std::cerr << "HeadlessGLContext::Create Error: Failed to initialize EGL display" << std::endl;
+        return false;
+    }
+
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0) {
+        std::cerr << "HeadlessGLContext::Create Error: No EGL config with desktop OpenGL support" << std::endl;
+        return false;
+    }
+
+    // The compute path never presents anything, a 1x1 pbuffer is enough to make the context current
+    const EGLint surfaceAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+    surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+    if (surface == EGL_NO_SURFACE) {
+        std::cerr << "HeadlessGLContext::Create Error: Failed to create pbuffer surface" << std::endl;
+        return false;
+    }
+
+    eglBindAPI(EGL_OPENGL_API);
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context)) {
+        std::cerr << "HeadlessGLContext::Create Error: Failed to create OpenGL 4.3 context" << std::endl;
+        return false;
+    }
+
+    glewExperimental = GL_TRUE;
+    GLenum glewErr = glewInit();
+    // GLEW builds without EGL support still load the core entry points before failing on GLX
+    if (glewErr != GLEW_OK && glewErr != GLEW_ERROR_NO_GLX_DISPLAY) {
+        std::cerr << "HeadlessGLContext::Create Error: Failed to initialize GLEW: " << glewGetErrorString(glewErr) << std::endl;
+        return false;
+    }
+    glGetError();
+
+    std::cout << "Headless OpenGL version: " << glGetString(GL_VERSION) << std::endl;
+    return true;
+}
+
+void HeadlessGLContext::Destroy() {
+    if (display == EGL_NO_DISPLAY) return;
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+    if (surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+    eglTerminate(display);
+
+    display = EGL_NO_DISPLAY;
+    surface = EGL_NO_SURFACE;
+    context = EGL_NO_CONTEXT;
+}
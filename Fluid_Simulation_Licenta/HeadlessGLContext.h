@@ -0,0 +1,23 @@
+#ifndef HEADLESS_GL_CONTEXT_H
+#define HEADLESS_GL_CONTEXT_H
+
+#include <EGL/egl.h>
+
+// Offscreen OpenGL 4.3 core context through EGL, for machines without a display.
+// Only built when FLUID_HEADLESS_GL is defined.
+class HeadlessGLContext {
+public:
+    HeadlessGLContext();
+    ~HeadlessGLContext();
+
+    // Creates the context, makes it current and loads the GL functions through GLEW.
+    bool Create();
+    void Destroy();
+
+private:
+    EGLDisplay display;
+    EGLSurface surface;
+    EGLContext context;
+};
+
+#endif // HEADLESS_GL_CONTEXT_H
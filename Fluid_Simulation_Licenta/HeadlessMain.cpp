@@ -0,0 +1,12 @@
+#include "HeadlessRunner.h"
+
+// Entry point of the headless batch runner; see HeadlessRunner::PrintUsage for the options.
+int main(int argc, char** argv) {
+    HeadlessRunner::Options options;
+    if (!HeadlessRunner::ParseArguments(argc, argv, options)) {
+        return 1;
+    }
+
+    HeadlessRunner runner(options);
+    return runner.Run();
+}
@@ -0,0 +1,612 @@
+#include "HeadlessRunner.h"
+#include "Checkpoint3D.h"
+#include "Profiler.h"
+#include "SimulationType3D.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#ifdef FLUID_HEADLESS_GL
+#include "FluidSolverGPU3D.h"
+#include "HeadlessGLContext.h"
+#include "ParticlePoolGPU3D.h"
+#include "ParticleSpawnerGPU3D.h"
+#endif
+
+namespace {
+    bool ParsePressureSolver(const std::string& name, PressureSolver3D& solver) {
+        if (name == "explicit") solver = PressureSolver3D::Explicit;
+        else if (name == "dfsph") solver = PressureSolver3D::DFSPH;
+        else if (name == "pbf") solver = PressureSolver3D::PBF;
+        else return false;
+        return true;
+    }
+}
+
+void HeadlessRunner::PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+        << "  --scene NAME|FILE.json   built-in scene or scene file to load (default: default)\n"
+        << "  --steps N                number of simulation steps (default: 1000)\n"
+        << "  --backend cpu|gl|grid    CPU solver, offscreen OpenGL compute or the CPU APIC grid (default: the scene's backend)\n"
+        << "  --threads N              CPU worker threads, 0 = all hardware threads\n"
+        << "  --pin                    pin CPU workers to cores\n"
+        << "  --deterministic          bitwise reproducible CPU mode\n"
+        << "  --reorder-interval N     steps between Morton reorders, 0 = off\n"
+        << "  --pressure-solver NAME   explicit, dfsph (CPU only) or pbf (default: the scene's)\n"
+        << "  --dt SECONDS             override the scene time step\n"
+        << "  --particles N            override the scene particle count\n"
+        << "  --snapshot-every N       write a particle snapshot every N steps\n"
+        << "  --checkpoint-every N     write a binary checkpoint every N steps\n"
+        << "  --restore FILE           continue from a checkpoint instead of spawning the scene\n"
+        << "  --trajectory FILE        record a compressed trajectory of positions and velocities\n"
+        << "  --trajectory-every N     steps between trajectory frames (default: 10)\n"
+        << "  --export vtu|ply         write particle frames for ParaView into the output directory\n"
+        << "  --export-every N         steps between exported frames (default: 1)\n"
+        << "  --output DIR             directory for snapshots and checkpoints (default: .)\n"
+        << "  --stats FILE             write timing statistics as CSV\n"
+        << "  --shader FILE            compute shader for the gl backend\n"
+        << "  --gpu-spawn              gl backend: spawn the particles on the GPU\n"
+        << "  --quiet                  only print the summary\n"
+        << "Scenes:";
+    for (const std::string& name : SceneLoader3D::GetPresetNames()) std::cout << " " << name;
+    std::cout << std::endl;
+}
+
+bool HeadlessRunner::ParseArguments(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto nextValue = [&](std::string& value) {
+            if (i + 1 >= argc) {
+                std::cerr << "HeadlessRunner Error: Missing value for " << arg << std::endl;
+                return false;
+            }
+            value = argv[++i];
+            return true;
+        };
+
+        std::string value;
+        if (arg == "--help" || arg == "-h") {
+            PrintUsage(argv[0]);
+            return false;
+        }
+        else if (arg == "--pin") options.pinThreads = true;
+        else if (arg == "--deterministic") options.deterministic = true;
+        else if (arg == "--quiet") options.quiet = true;
+        else if (arg == "--gpu-spawn") options.gpuSpawn = true;
+        else if (arg == "--scene") { if (!nextValue(options.scene)) return false; }
+        else if (arg == "--output") { if (!nextValue(options.outputDirectory)) return false; }
+        else if (arg == "--stats") { if (!nextValue(options.statsFile)) return false; }
+        else if (arg == "--shader") { if (!nextValue(options.shaderPath)) return false; }
+        else if (arg == "--restore") { if (!nextValue(options.restoreFile)) return false; }
+        else if (arg == "--trajectory") { if (!nextValue(options.trajectoryFile)) return false; }
+        else if (arg == "--export") {
+            if (!nextValue(options.exportFormat)) return false;
+            if (options.exportFormat != "vtu" && options.exportFormat != "ply") {
+                std::cerr << "HeadlessRunner Error: Unknown export format '" << options.exportFormat << "'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--backend") {
+            if (!nextValue(value)) return false;
+            options.backendSet = true;
+            if (value == "cpu") options.backend = Backend::CPU;
+            else if (value == "gl") options.backend = Backend::GL;
+            else if (value == "grid") options.backend = Backend::Grid;
+            else {
+                std::cerr << "HeadlessRunner Error: Unknown backend '" << value << "'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--pressure-solver") {
+            if (!nextValue(options.pressureSolver)) return false;
+            PressureSolver3D solver;
+            if (!ParsePressureSolver(options.pressureSolver, solver)) {
+                std::cerr << "HeadlessRunner Error: Unknown pressure solver '" << options.pressureSolver << "'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--steps") { if (!nextValue(value)) return false; options.steps = std::strtoull(value.c_str(), nullptr, 10); }
+        else if (arg == "--threads") { if (!nextValue(value)) return false; options.threads = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10)); }
+        else if (arg == "--reorder-interval") { if (!nextValue(value)) return false; options.reorderInterval = std::atoi(value.c_str()); }
+        else if (arg == "--dt") { if (!nextValue(value)) return false; options.deltaTime = static_cast<float>(std::atof(value.c_str())); }
+        else if (arg == "--particles") { if (!nextValue(value)) return false; options.particleCount = std::atoi(value.c_str()); }
+        else if (arg == "--snapshot-every") { if (!nextValue(value)) return false; options.snapshotInterval = std::strtoull(value.c_str(), nullptr, 10); }
+        else if (arg == "--trajectory-every") { if (!nextValue(value)) return false; options.trajectoryInterval = std::max<size_t>(1, std::strtoull(value.c_str(), nullptr, 10)); }
+        else if (arg == "--export-every") { if (!nextValue(value)) return false; options.exportInterval = std::max<size_t>(1, std::strtoull(value.c_str(), nullptr, 10)); }
+        else if (arg == "--checkpoint-every") { if (!nextValue(value)) return false; options.checkpointInterval = std::strtoull(value.c_str(), nullptr, 10); }
+        else {
+            std::cerr << "HeadlessRunner Error: Unknown argument '" << arg << "'" << std::endl;
+            PrintUsage(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+HeadlessRunner::HeadlessRunner(const Options& options)
+    : options(options), cpuSolver(nullptr), gridSolver(nullptr), emitters(nullptr)
+#ifdef FLUID_HEADLESS_GL
+    , glContext(nullptr), gpuSolver(nullptr), gpuPool(nullptr)
+#endif
+    , firstStep(0), startTime(0.0), simulationTime(0.0)
+{}
+
+HeadlessRunner::~HeadlessRunner() {
+#ifdef FLUID_HEADLESS_GL
+    delete gpuPool;
+    delete gpuSolver;
+    delete glContext;
+#endif
+    delete emitters;
+    delete gridSolver;
+    delete cpuSolver;
+}
+
+bool HeadlessRunner::LoadScene() {
+    if (!SceneLoader3D::Load(options.scene, scene)) return false;
+
+    if (!options.restoreFile.empty()) {
+        CheckpointReader reader;
+        if (!reader.Open(options.restoreFile) || !reader.ReadParticleData(particleData)) return false;
+
+        const Checkpoint3D::State& state = reader.GetState();
+        scene.name = options.restoreFile;
+        scene.maxParticleCount = std::max(scene.maxParticleCount, static_cast<int>(state.particleCount));
+        scene.params = state.params;
+        firstStep = static_cast<size_t>(state.stepCount);
+        startTime = state.simulationTime;
+        restoredIds = reader.ReadParticleIds();
+        restoredAffine = reader.ReadAffine();
+
+        if (options.deltaTime > 0.0f) scene.params.deltaTime = options.deltaTime;
+        if (options.reorderInterval >= 0) scene.params.reorderInterval = options.reorderInterval;
+        if (options.deterministic) scene.params.deterministic = true;
+        if (!options.pressureSolver.empty()) ParsePressureSolver(options.pressureSolver, scene.params.pressureSolver);
+        return true;
+    }
+
+    if (options.particleCount > 0) SceneLoader3D::SetParticleCount(scene, options.particleCount);
+    if (options.deltaTime > 0.0f) scene.params.deltaTime = options.deltaTime;
+    if (options.reorderInterval >= 0) scene.params.reorderInterval = options.reorderInterval;
+    scene.params.deterministic = options.deterministic;
+    if (!options.pressureSolver.empty()) ParsePressureSolver(options.pressureSolver, scene.params.pressureSolver);
+
+    if (options.gpuSpawn) {
+        // Only sizes the host copy; InitBackend fills the SSBOs and downloads the result
+        particleData.positions.resize(static_cast<size_t>(scene.GetSpawnCount()));
+        particleData.velocities.resize(particleData.positions.size());
+        particleData.predictedPositions.resize(particleData.positions.size());
+        particleData.densities.resize(particleData.positions.size());
+        return true;
+    }
+    SceneLoader3D::Spawn(scene, particleData);
+    return true;
+}
+
+bool HeadlessRunner::InitBackend() {
+    TaskScheduler::Instance().Configure(options.threads, options.pinThreads);
+    size_t capacity = std::max(static_cast<size_t>(scene.GetMaxParticleCount()), particleData.positions.size());
+    if (!options.backendSet) {
+        if (scene.backend == SimulationType3D::CPU) options.backend = Backend::CPU;
+        else if (scene.backend == SimulationType3D::GRID) options.backend = Backend::Grid;
+        else options.backend = Backend::GL;
+    }
+
+    if (options.backend != Backend::GL && options.gpuSpawn) {
+        std::cerr << "HeadlessRunner Error: --gpu-spawn needs the gl backend" << std::endl;
+        return false;
+    }
+
+    if (!scene.emitters.empty() || !scene.sinks.empty()) {
+        emitters = new ParticleEmitters3D(scene);
+    }
+
+    if (options.backend == Backend::CPU) {
+        cpuSolver = new FluidSolverCPU3D();
+        cpuSolver->Reserve(capacity);
+        cpuSolver->SetObstacles(scene.obstacles);
+        cpuSolver->RestoreState(restoredIds, firstStep);
+        if (emitters) emitters->GetPool().Reserve(particleData, capacity);
+        return true;
+    }
+    if (options.backend == Backend::Grid) {
+        gridSolver = new FluidSolverAPIC3D();
+        gridSolver->Reserve(capacity);
+        gridSolver->SetObstacles(scene.obstacles);
+        if (!options.restoreFile.empty() && restoredAffine.empty()) {
+            std::cerr << "HeadlessRunner Warning: " << options.restoreFile << " has no affine matrices, so they start from zero" << std::endl;
+        }
+        gridSolver->RestoreState(restoredAffine, particleData);
+        if (emitters) emitters->GetPool().Reserve(particleData, capacity);
+        return true;
+    }
+
+#ifdef FLUID_HEADLESS_GL
+    glContext = new HeadlessGLContext();
+    if (!glContext->Create()) return false;
+    gpuSolver = new FluidSolverGPU3D(options.shaderPath, particleData, capacity);
+    gpuSolver->SetObstacles(scene.obstacles);
+    std::string shaderDirectory = options.shaderPath.substr(0, options.shaderPath.find_last_of("/\\") + 1);
+    if (options.gpuSpawn && options.restoreFile.empty()) {
+        ParticleSpawnerGPU3D spawner(shaderDirectory + "SpawnParticles_3D.comp");
+        spawner.SpawnScene(scene, *gpuSolver->GetParticleBuffers());
+        gpuSolver->Download(particleData);
+    }
+    if (emitters) {
+        gpuPool = new ParticlePoolGPU3D(shaderDirectory + "ParticleLifecycle_3D.comp");
+    }
+    return true;
+#else
+    std::cerr << "HeadlessRunner Error: Built without FLUID_HEADLESS_GL, the gl backend is not available" << std::endl;
+    return false;
+#endif
+}
+
+void HeadlessRunner::StepOnce() {
+    if (cpuSolver) {
+        if (emitters) {
+            emitters->Update(particleData, &cpuSolver->GetParticleIds(), simulationTime, scene.params.deltaTime);
+            if (emitters->GetLastRemovedCount() > 0) cpuSolver->CompactSlots(emitters->GetPool().GetLastDestinations());
+        }
+        cpuSolver->Step(particleData, scene.params);
+    }
+    else if (gridSolver) {
+        // The grid solver keeps no ids; its particles are only told apart by their slot
+        if (emitters) emitters->Update(particleData, nullptr, simulationTime, scene.params.deltaTime);
+        gridSolver->Step(particleData, scene.params);
+    }
+#ifdef FLUID_HEADLESS_GL
+    else if (gpuSolver) {
+        if (gpuPool) gpuPool->Update(*emitters, *gpuSolver->GetParticleBuffers(), simulationTime, scene.params.deltaTime);
+        gpuSolver->Step(scene.params);
+    }
+#endif
+    simulationTime += scene.params.deltaTime;
+}
+
+void HeadlessRunner::SyncParticleData() {
+#ifdef FLUID_HEADLESS_GL
+    if (gpuSolver) gpuSolver->Download(particleData);
+#endif
+}
+
+int HeadlessRunner::Run() {
+    if (!LoadScene()) return 1;
+    if (!InitBackend()) return 1;
+
+    if (options.snapshotInterval > 0 || options.checkpointInterval > 0) {
+        std::error_code error;
+        std::filesystem::create_directories(options.outputDirectory, error);
+        if (error) {
+            std::cerr << "HeadlessRunner Error: Cannot create " << options.outputDirectory << ": " << error.message() << std::endl;
+            return 1;
+        }
+    }
+
+    if (!options.quiet) {
+        std::cout << "Scene '" << scene.name << "': " << particleData.positions.size() << " particles, "
+            << options.steps << " steps on " << (options.backend == Backend::CPU ? "cpu" : options.backend == Backend::Grid ? "grid" : "gl")
+            << " with " << TaskScheduler::Instance().GetThreadCount() << " threads" << std::endl;
+    }
+
+    if (!options.trajectoryFile.empty()) {
+        // Batch runs want every frame, so the solver waits for the writer instead of dropping
+        TrajectoryRecorder::Options recorderOptions;
+        recorderOptions.frameInterval = options.trajectoryInterval;
+        recorderOptions.blockWhenFull = true;
+        if (!trajectoryRecorder.Start(options.trajectoryFile, recorderOptions)) return 1;
+    }
+    if (!options.exportFormat.empty()) {
+        ParticleExporter3D::Options exportOptions;
+        exportOptions.format = options.exportFormat == "ply" ? ParticleExporter3D::Format::PLY : ParticleExporter3D::Format::VTU;
+        exportOptions.directory = options.outputDirectory;
+        exportOptions.prefix = scene.name;
+        exportOptions.frameInterval = options.exportInterval;
+        exportOptions.blockWhenFull = true;
+        if (!exporter.Start(exportOptions)) return 1;
+    }
+
+    Profiler::Instance().Reset();
+    simulationTime = startTime;
+    stepMilliseconds.clear();
+    stepMilliseconds.reserve(options.steps);
+    pressureSolves.clear();
+    gridSolves.clear();
+
+    for (size_t step = 1; step <= options.steps; ++step) {
+        auto start = std::chrono::steady_clock::now();
+        StepOnce();
+        stepMilliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        if (cpuSolver && scene.params.pressureSolver != PressureSolver3D::Explicit) pressureSolves.push_back(cpuSolver->GetLastPressureSolve());
+        if (gridSolver) gridSolves.push_back(gridSolver->GetLastPressureSolve());
+
+        if (options.snapshotInterval > 0 && step % options.snapshotInterval == 0) {
+            SyncParticleData();
+            if (!WriteSnapshot(firstStep + step)) return 1;
+        }
+        if (options.checkpointInterval > 0 && step % options.checkpointInterval == 0) {
+            if (!WriteCheckpoint(firstStep + step)) return 1;
+        }
+        if (trajectoryRecorder.IsRecording() && (firstStep + step) % options.trajectoryInterval == 0) {
+            SyncParticleData();
+            trajectoryRecorder.SubmitFrame(firstStep + step, startTime + step * static_cast<double>(scene.params.deltaTime),
+                particleData.positions, particleData.velocities, scene.params.boundingBoxMin, scene.params.boundingBoxMax,
+                cpuSolver ? &cpuSolver->GetParticleIds() : nullptr);
+        }
+        if (exporter.IsRunning() && (firstStep + step) % options.exportInterval == 0) {
+            SyncParticleData();
+            exporter.SubmitFrame(firstStep + step, startTime + step * static_cast<double>(scene.params.deltaTime), particleData,
+                cpuSolver ? &cpuSolver->GetParticleIds() : nullptr);
+        }
+        if (!options.quiet && step % 100 == 0) {
+            std::cout << "Step " << step << "/" << options.steps << ": " << stepMilliseconds.back() << " ms" << std::endl;
+        }
+    }
+
+    SyncParticleData();
+    if (trajectoryRecorder.IsRecording()) {
+        if (!trajectoryRecorder.Stop()) return 1;
+        TrajectoryRecorder::Statistics trajectory = trajectoryRecorder.GetStatistics();
+        std::cout << "Trajectory: " << trajectory.framesWritten << " frames, " << trajectory.compressedBytes / (1024.0 * 1024.0)
+            << " MB, ratio " << trajectory.compressionRatio << ", " << trajectory.megabytesPerSecond << " MB/s" << std::endl;
+    }
+    if (exporter.IsRunning()) {
+        if (!exporter.Stop()) return 1;
+        ParticleExporter3D::Statistics exported = exporter.GetStatistics();
+        std::cout << "Export: " << exported.framesWritten << " frames, " << exported.bytesWritten / (1024.0 * 1024.0)
+            << " MB, " << exported.encodeMilliseconds << " ms encode, " << exported.writeMegabytesPerSecond << " MB/s" << std::endl;
+    }
+    if (emitters) PrintEmitterStatistics();
+    StepStatistics statistics = ComputeStatistics();
+    PrintStatistics(statistics);
+    if (!options.statsFile.empty() && !WriteStatistics(statistics)) return 1;
+    return 0;
+}
+
+HeadlessRunner::StepStatistics HeadlessRunner::ComputeStatistics() const {
+    StepStatistics statistics;
+    if (stepMilliseconds.empty()) return statistics;
+
+    std::vector<double> sorted = stepMilliseconds;
+    std::sort(sorted.begin(), sorted.end());
+    for (double value : sorted) statistics.totalMilliseconds += value;
+
+    statistics.meanMilliseconds = statistics.totalMilliseconds / sorted.size();
+    statistics.minMilliseconds = sorted.front();
+    statistics.maxMilliseconds = sorted.back();
+    statistics.medianMilliseconds = sorted[sorted.size() / 2];
+    statistics.p95Milliseconds = sorted[std::min(sorted.size() - 1, sorted.size() * 95 / 100)];
+    if (statistics.totalMilliseconds > 0.0) {
+        statistics.particleStepsPerSecond = static_cast<double>(particleData.positions.size()) * sorted.size() / (statistics.totalMilliseconds / 1000.0);
+    }
+    return statistics;
+}
+
+uint64_t HeadlessRunner::GetStateHash() const {
+    if (cpuSolver) return cpuSolver->ComputeStateHash(particleData);
+    return gridSolver ? gridSolver->ComputeStateHash(particleData) : 0;
+}
+
+void HeadlessRunner::PrintEmitterStatistics() const {
+    size_t emitted = 0, removed = 0, rejected = 0, growths = 0;
+    if (cpuSolver || gridSolver) {
+        const ParticlePool3D::Statistics& pool = emitters->GetPool().GetStatistics();
+        emitted = pool.emitted;
+        removed = pool.removed;
+        rejected = pool.rejected;
+        growths = pool.growths;
+    }
+#ifdef FLUID_HEADLESS_GL
+    else if (gpuPool) {
+        const ParticlePoolGPU3D::Statistics& pool = gpuPool->GetStatistics();
+        emitted = pool.emitted;
+        removed = pool.removed;
+        rejected = pool.rejected;
+    }
+#endif
+    std::cout << "Emitters: " << emitted << " emitted, " << removed << " removed by sinks, " << rejected
+        << " rejected at the limit, " << growths << " reallocations, " << particleData.positions.size() << " particles at the end" << std::endl;
+}
+
+void HeadlessRunner::PrintStatistics(const StepStatistics& statistics) const {
+    std::cout << std::fixed << std::setprecision(3)
+        << "Steps: " << stepMilliseconds.size() << ", total " << statistics.totalMilliseconds << " ms\n"
+        << "Step time (ms): mean " << statistics.meanMilliseconds << ", min " << statistics.minMilliseconds
+        << ", median " << statistics.medianMilliseconds << ", p95 " << statistics.p95Milliseconds
+        << ", max " << statistics.maxMilliseconds << "\n"
+        << "Throughput: " << std::setprecision(0) << statistics.particleStepsPerSecond << " particle-steps/s\n";
+
+    std::cout << std::setprecision(3);
+    for (const auto& timing : Profiler::Instance().GetTimings()) {
+        std::cout << "  " << timing.first << ": " << timing.second.average << " ms" << std::endl;
+    }
+    PrintPressureSolveStatistics();
+    if (cpuSolver || gridSolver) {
+        std::cout << "State hash: " << std::hex << std::setw(16) << std::setfill('0') << GetStateHash() << std::dec << std::setfill(' ') << std::endl;
+    }
+}
+
+HeadlessRunner::PressureSolveSummary HeadlessRunner::SummarizePressureSolves() const {
+    PressureSolveSummary summary;
+    if (pressureSolves.empty()) return summary;
+
+    for (const FluidSolverCPU3D::PressureSolveStats& solve : pressureSolves) {
+        summary.meanDensityIterations += solve.densityIterations;
+        summary.meanDivergenceIterations += solve.divergenceIterations;
+        summary.meanDensityError += solve.densityError;
+        summary.meanDivergenceError += solve.divergenceError;
+        summary.maxDensityIterations = std::max(summary.maxDensityIterations, solve.densityIterations);
+        summary.maxDivergenceIterations = std::max(summary.maxDivergenceIterations, solve.divergenceIterations);
+        summary.maxDensityError = std::max(summary.maxDensityError, static_cast<double>(solve.densityError));
+    }
+    double steps = static_cast<double>(pressureSolves.size());
+    summary.meanDensityIterations /= steps;
+    summary.meanDivergenceIterations /= steps;
+    summary.meanDensityError /= steps;
+    summary.meanDivergenceError /= steps;
+    return summary;
+}
+
+HeadlessRunner::GridSolveSummary HeadlessRunner::SummarizeGridSolves() const {
+    GridSolveSummary summary;
+    if (gridSolves.empty()) return summary;
+
+    for (const FluidSolverAPIC3D::PressureSolveStats& solve : gridSolves) {
+        summary.meanIterations += solve.iterations;
+        summary.meanError += solve.error;
+        summary.meanSubsteps += solve.substeps;
+        summary.maxIterations = std::max(summary.maxIterations, solve.iterations);
+        summary.maxError = std::max(summary.maxError, static_cast<double>(solve.error));
+    }
+    double steps = static_cast<double>(gridSolves.size());
+    summary.meanIterations /= steps;
+    summary.meanError /= steps;
+    summary.meanSubsteps /= steps;
+    return summary;
+}
+
+void HeadlessRunner::PrintPressureSolveStatistics() const {
+    if (!gridSolves.empty()) {
+        GridSolveSummary summary = SummarizeGridSolves();
+        std::cout << std::setprecision(3)
+            << "Grid pressure solve: " << summary.meanIterations << " CG iterations per substep (max " << summary.maxIterations
+            << "), residual " << 100.0 * summary.meanError << "% of the initial divergence (max " << 100.0 * summary.maxError << "%), "
+            << summary.meanSubsteps << " substeps per step, " << gridSolver->GetDimensions().x << "x" << gridSolver->GetDimensions().y
+            << "x" << gridSolver->GetDimensions().z << " cells" << std::endl;
+    }
+    if (pressureSolves.empty()) return;
+
+    PressureSolveSummary summary = SummarizePressureSolves();
+    if (scene.params.pressureSolver == PressureSolver3D::PBF) {
+        // PBF runs a fixed number of iterations; the error is what the last of them corrected
+        std::cout << std::setprecision(3)
+            << "PBF constraint solve: " << summary.meanDensityIterations << " iterations per step, error "
+            << 100.0 * summary.meanDensityError << "% (max " << 100.0 * summary.maxDensityError << "%)" << std::endl;
+        return;
+    }
+    std::cout << std::setprecision(3)
+        << "DFSPH density solve: " << summary.meanDensityIterations << " iterations per step (max " << summary.maxDensityIterations << "), error "
+        << 100.0 * summary.meanDensityError << "% (max " << 100.0 * summary.maxDensityError << "%)\n"
+        << "DFSPH divergence solve: " << summary.meanDivergenceIterations << " iterations per step (max " << summary.maxDivergenceIterations
+        << "), error " << 100.0 * summary.meanDivergenceError << "%" << std::endl;
+}
+
+bool HeadlessRunner::WriteStatistics(const StepStatistics& statistics) const {
+    std::ofstream file(options.statsFile);
+    if (!file.is_open()) {
+        std::cerr << "HeadlessRunner Error: Cannot write " << options.statsFile << std::endl;
+        return false;
+    }
+
+    file << "name,value\n";
+    file << "particles," << particleData.positions.size() << "\n";
+    file << "steps," << stepMilliseconds.size() << "\n";
+    file << "threads," << TaskScheduler::Instance().GetThreadCount() << "\n";
+    file << "total_ms," << statistics.totalMilliseconds << "\n";
+    file << "mean_ms," << statistics.meanMilliseconds << "\n";
+    file << "min_ms," << statistics.minMilliseconds << "\n";
+    file << "median_ms," << statistics.medianMilliseconds << "\n";
+    file << "p95_ms," << statistics.p95Milliseconds << "\n";
+    file << "max_ms," << statistics.maxMilliseconds << "\n";
+    file << "particle_steps_per_second," << statistics.particleStepsPerSecond << "\n";
+    for (const auto& timing : Profiler::Instance().GetTimings()) {
+        file << timing.first << "," << timing.second.average << "\n";
+    }
+    if (!gridSolves.empty()) {
+        GridSolveSummary summary = SummarizeGridSolves();
+        file << "grid_cg_iterations_mean," << summary.meanIterations << "\n";
+        file << "grid_cg_iterations_max," << summary.maxIterations << "\n";
+        file << "grid_residual_mean," << summary.meanError << "\n";
+        file << "grid_residual_max," << summary.maxError << "\n";
+        file << "grid_substeps_mean," << summary.meanSubsteps << "\n";
+    }
+    if (!pressureSolves.empty()) {
+        PressureSolveSummary summary = SummarizePressureSolves();
+        if (scene.params.pressureSolver == PressureSolver3D::PBF) {
+            file << "pbf_iterations," << summary.meanDensityIterations << "\n";
+            file << "pbf_density_error_mean," << summary.meanDensityError << "\n";
+            file << "pbf_density_error_max," << summary.maxDensityError << "\n";
+        }
+        else {
+            file << "dfsph_density_iterations_mean," << summary.meanDensityIterations << "\n";
+            file << "dfsph_density_iterations_max," << summary.maxDensityIterations << "\n";
+            file << "dfsph_density_error_mean," << summary.meanDensityError << "\n";
+            file << "dfsph_density_error_max," << summary.maxDensityError << "\n";
+            file << "dfsph_divergence_iterations_mean," << summary.meanDivergenceIterations << "\n";
+            file << "dfsph_divergence_error_mean," << summary.meanDivergenceError << "\n";
+        }
+    }
+    return true;
+}
+
+bool HeadlessRunner::WriteSnapshot(size_t step) {
+    std::ostringstream name;
+    name << "snapshot_" << std::setw(6) << std::setfill('0') << step << ".csv";
+    std::filesystem::path path = std::filesystem::path(options.outputDirectory) / name.str();
+
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "HeadlessRunner Error: Cannot write " << path.string() << std::endl;
+        return false;
+    }
+
+    const std::vector<uint32_t>* ids = cpuSolver ? &cpuSolver->GetParticleIds() : nullptr;
+    file << "id,x,y,z,vx,vy,vz\n";
+    file << std::setprecision(9);
+    for (size_t i = 0; i < particleData.positions.size(); ++i) {
+        const glm::vec3& p = particleData.positions[i];
+        const glm::vec3& v = particleData.velocities[i];
+        size_t id = ids && i < ids->size() ? (*ids)[i] : i;
+        file << id << "," << p.x << "," << p.y << "," << p.z << "," << v.x << "," << v.y << "," << v.z << "\n";
+    }
+    return true;
+}
+
+bool HeadlessRunner::WriteCheckpoint(size_t step) {
+    std::ostringstream name;
+    name << "checkpoint_" << std::setw(6) << std::setfill('0') << step << ".fsc";
+    std::filesystem::path path = std::filesystem::path(options.outputDirectory) / name.str();
+
+    Checkpoint3D::State state;
+    state.particleCount = particleData.positions.size();
+#ifdef FLUID_HEADLESS_GL
+    // GPU emitters and sinks change the count in the SSBOs; the host copy is only as fresh as the last sync
+    if (gpuSolver) state.particleCount = gpuSolver->GetParticleBuffers()->GetParticleCount();
+#endif
+    state.stepCount = step;
+    state.simulationTime = startTime + static_cast<double>(step - firstStep) * scene.params.deltaTime;
+    SimulationType3D type = SimulationType3D::SLOW;
+    if (options.backend == Backend::CPU) type = SimulationType3D::CPU;
+    else if (options.backend == Backend::Grid) type = SimulationType3D::GRID;
+    state.simulationType = static_cast<uint32_t>(type);
+    state.params = scene.params;
+
+    CheckpointWriter writer;
+    if (!writer.Open(path.string(), state)) return false;
+
+    bool written = false;
+    if (cpuSolver) {
+        const std::vector<uint32_t>& ids = cpuSolver->GetParticleIds();
+        written = writer.WriteParticleData(particleData)
+            && writer.WriteChunk(Checkpoint3D::ParticleIds, sizeof(uint32_t), ids.data(), ids.size() * sizeof(uint32_t));
+    }
+    else if (gridSolver) {
+        std::vector<glm::mat3> affine;
+        gridSolver->GetAffine(particleData, affine);
+        written = writer.WriteParticleData(particleData)
+            && writer.WriteChunk(Checkpoint3D::Affine, sizeof(glm::mat3), affine.data(), affine.size() * sizeof(glm::mat3));
+    }
+#ifdef FLUID_HEADLESS_GL
+    else if (gpuSolver) {
+        written = gpuSolver->GetParticleBuffers()->WriteCheckpointColumns(writer);
+    }
+#endif
+    return writer.Close() && written;
+}
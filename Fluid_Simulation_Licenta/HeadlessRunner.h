@@ -0,0 +1,144 @@
+#ifndef HEADLESS_RUNNER_H
+#define HEADLESS_RUNNER_H
+
+#include <string>
+#include <vector>
+
+#include "FluidSolverAPIC3D.h"
+#include "FluidSolverCPU3D.h"
+#include "ParticleEmitters3D.h"
+#include "ParticleExporter3D.h"
+#include "ParticleData.h"
+#include "Scene3D.h"
+#include "TrajectoryRecorder.h"
+
+#ifdef FLUID_HEADLESS_GL
+class HeadlessGLContext;
+class FluidSolverGPU3D;
+class ParticlePoolGPU3D;
+#endif
+
+// Runs a 3D scene for a fixed number of steps without GLUT or ImGui and reports
+// per-step timings. Used for long batch runs and benchmarks on servers.
+class HeadlessRunner {
+public:
+    enum class Backend { CPU, GL, Grid };
+
+    struct Options {
+        std::string scene = "default";
+        size_t steps = 1000;
+        Backend backend = Backend::CPU;
+        // Set by --backend; otherwise the scene decides
+        bool backendSet = false;
+        unsigned int threads = 0;
+        bool pinThreads = false;
+        bool deterministic = false;
+        int reorderInterval = -1;
+        // explicit, dfsph or pbf; empty keeps the scene's pressure solver
+        std::string pressureSolver;
+        float deltaTime = 0.0f;
+        int particleCount = 0;
+        size_t snapshotInterval = 0;
+        size_t checkpointInterval = 0;
+        std::string restoreFile;
+        std::string trajectoryFile;
+        size_t trajectoryInterval = 10;
+        std::string exportFormat;
+        size_t exportInterval = 1;
+        std::string outputDirectory = ".";
+        std::string statsFile;
+        std::string shaderPath = "shaders/FluidSimulator_3D.comp";
+        // gl backend: spawn with SpawnParticles_3D.comp straight into the SSBOs
+        bool gpuSpawn = false;
+        bool quiet = false;
+    };
+
+    struct StepStatistics {
+        double totalMilliseconds = 0.0;
+        double meanMilliseconds = 0.0;
+        double minMilliseconds = 0.0;
+        double maxMilliseconds = 0.0;
+        double medianMilliseconds = 0.0;
+        double p95Milliseconds = 0.0;
+        double particleStepsPerSecond = 0.0;
+    };
+
+    // Over the steps of the run; errors are fractions of the rest density
+    struct PressureSolveSummary {
+        double meanDensityIterations = 0.0;
+        int maxDensityIterations = 0;
+        double meanDensityError = 0.0;
+        double maxDensityError = 0.0;
+        double meanDivergenceIterations = 0.0;
+        int maxDivergenceIterations = 0;
+        double meanDivergenceError = 0.0;
+    };
+
+    // Over the substeps of the run's grid pressure solves; errors are relative to the initial divergence
+    struct GridSolveSummary {
+        double meanIterations = 0.0;
+        int maxIterations = 0;
+        double meanError = 0.0;
+        double maxError = 0.0;
+        double meanSubsteps = 0.0;
+    };
+
+    // Returns false (after printing why) when the arguments are invalid or --help was given.
+    static bool ParseArguments(int argc, char** argv, Options& options);
+    static void PrintUsage(const char* program);
+
+    explicit HeadlessRunner(const Options& options);
+    ~HeadlessRunner();
+
+    // Loads the scene, runs all steps and writes the outputs. Returns the process exit code.
+    int Run();
+
+    const Scene3D& GetScene() const { return scene; }
+    const ParticleData3D& GetParticleData() const { return particleData; }
+    const std::vector<double>& GetStepMilliseconds() const { return stepMilliseconds; }
+    StepStatistics ComputeStatistics() const;
+    PressureSolveSummary SummarizePressureSolves() const;
+    GridSolveSummary SummarizeGridSolves() const;
+    uint64_t GetStateHash() const;
+
+private:
+    bool LoadScene();
+    bool InitBackend();
+    void StepOnce();
+    void SyncParticleData();
+    void PrintEmitterStatistics() const;
+    bool WriteSnapshot(size_t step);
+    bool WriteCheckpoint(size_t step);
+    bool WriteStatistics(const StepStatistics& statistics) const;
+    void PrintStatistics(const StepStatistics& statistics) const;
+    // Mean and worst iterations and errors of the DFSPH, PBF or grid solves; nothing without them.
+    void PrintPressureSolveStatistics() const;
+
+    Options options;
+    Scene3D scene;
+    ParticleData3D particleData;
+    FluidSolverCPU3D* cpuSolver;
+    FluidSolverAPIC3D* gridSolver;
+    // Null when the scene has no emitters or sinks
+    ParticleEmitters3D* emitters;
+#ifdef FLUID_HEADLESS_GL
+    HeadlessGLContext* glContext;
+    FluidSolverGPU3D* gpuSolver;
+    ParticlePoolGPU3D* gpuPool;
+#endif
+    std::vector<double> stepMilliseconds;
+    // CPU backend with DFSPH: the pressure solve of every step
+    std::vector<FluidSolverCPU3D::PressureSolveStats> pressureSolves;
+    // Grid backend: the last substep's pressure solve of every step
+    std::vector<FluidSolverAPIC3D::PressureSolveStats> gridSolves;
+    // Counters carried over from --restore
+    size_t firstStep;
+    double startTime;
+    double simulationTime;
+    std::vector<uint32_t> restoredIds;
+    std::vector<glm::mat3> restoredAffine;
+    TrajectoryRecorder trajectoryRecorder;
+    ParticleExporter3D exporter;
+};
+
+#endif // HEADLESS_RUNNER_H
@@ -1,6 +1,8 @@
 #include "ImGuiManager3D.h"
 #include "Simulation3D.h"
 #include "ShaderManager3D.h"
+#include "TaskScheduler.h"
+#include "Profiler.h"
 
 // Cod adaptat de pe https://github.com/ocornut/imgui
 ImGuiManager3D::ImGuiManager3D(Simulation3D* simulation, ShaderManager3D* shaderManager)
@@ -79,6 +81,143 @@ void ImGuiManager3D::RenderSimulationControls() {
     simulation->setIsPaused(isPaused);
 
     RenderFPS();
+    RenderPlaybackControls();
+    RenderSceneControls();
+    RenderCheckpointControls();
+    RenderTrajectoryControls();
+    RenderExportControls();
+    RenderSchedulerControls();
+    RenderProfiler();
+}
+
+void ImGuiManager3D::RenderSceneControls() {
+    if (!ImGui::CollapsingHeader("Scene")) return;
+
+    const Scene3D& scene = simulation->getScene();
+    ImGui::Text("%s: %d particles, capacity %d", scene.name.c_str(), scene.GetSpawnCount(), scene.GetMaxParticleCount());
+    ImGui::Text("%zu emitters, %zu sinks, %zu obstacles", scene.emitters.size(), scene.sinks.size(), scene.obstacles.size());
+    ParticleSystem3D* particleSystem = simulation->getParticleSystem();
+    if (particleSystem && particleSystem->GetEmitters()) {
+        const ParticlePool3D::Statistics& pool = particleSystem->GetEmitters()->GetPool().GetStatistics();
+        const ParticlePoolGPU3D::Statistics& gpuPool = particleSystem->GetGpuPool()->GetStatistics();
+        ImGui::Text("CPU pool: %zu emitted, %zu removed, %zu rejected, %zu reallocations", pool.emitted, pool.removed, pool.rejected, pool.growths);
+        ImGui::Text("GPU pool: %zu emitted, %zu removed, %zu rejected", gpuPool.emitted, gpuPool.removed, gpuPool.rejected);
+        // The GPU backends' count is in the count buffer; the host copy is only downloaded now and then
+        SimulationType3D type = particleSystem->getSimulationType();
+        bool onGpu = type == SimulationType3D::SLOW || type == SimulationType3D::HASH;
+        ParticleRenderer3D* renderer = particleSystem->GetParticleRenderer();
+        ImGui::Text("Live particles: %zu", onGpu ? renderer->GetParticleBuffers()->GetParticleCount() : renderer->GetParticleData().positions.size());
+    }
+    ImGui::InputText("Scene", scenePath, sizeof(scenePath));
+    if (ImGui::Button("Load Scene")) {
+        sceneStatus = simulation->LoadScene(scenePath) ? "Loaded" : "Load failed, see console";
+    }
+    if (!sceneStatus.empty()) {
+        ImGui::Text("%s", sceneStatus.c_str());
+    }
+}
+
+void ImGuiManager3D::RenderCheckpointControls() {
+    if (!ImGui::CollapsingHeader("Checkpoint")) return;
+
+    ImGui::InputText("File", checkpointPath, sizeof(checkpointPath));
+    if (ImGui::Button("Save Checkpoint")) {
+        checkpointStatus = simulation->SaveCheckpoint(checkpointPath) ? "Saved" : "Save failed, see console";
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Load Checkpoint")) {
+        checkpointStatus = simulation->LoadCheckpoint(checkpointPath) ? "Loaded" : "Load failed, see console";
+    }
+    ImGui::Text("Step %llu, t = %.3f s", static_cast<unsigned long long>(simulation->getStepCount()), simulation->getSimulationTime());
+    if (!checkpointStatus.empty()) {
+        ImGui::Text("%s", checkpointStatus.c_str());
+    }
+}
+
+void ImGuiManager3D::RenderTrajectoryControls() {
+    if (!ImGui::CollapsingHeader("Trajectory")) return;
+
+    TrajectoryRecorder* recorder = simulation->getTrajectoryRecorder();
+    if (!recorder->IsRecording()) {
+        ImGui::InputText("Trajectory File", trajectoryPath, sizeof(trajectoryPath));
+        ImGui::SliderInt("Every N Steps", &trajectoryInterval, 1, 100);
+        if (ImGui::Button("Start Recording")) {
+            TrajectoryRecorder::Options options;
+            options.frameInterval = static_cast<size_t>(trajectoryInterval);
+            recorder->Start(trajectoryPath, options);
+        }
+    }
+    else if (ImGui::Button("Stop Recording")) {
+        recorder->Stop();
+    }
+
+    TrajectoryRecorder::Statistics stats = recorder->GetStatistics();
+    ImGui::Text("Frames: %llu written, %llu dropped", static_cast<unsigned long long>(stats.framesWritten), static_cast<unsigned long long>(stats.framesDropped));
+    ImGui::Text("Writer: %.1f MB/s, ratio %.2f, queue %zu/%zu", stats.megabytesPerSecond, stats.compressionRatio, stats.queueDepth, stats.ringSize);
+    if (stats.fallingBehind) {
+        ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Writer is falling behind, frames are dropped");
+    }
+}
+
+void ImGuiManager3D::RenderExportControls() {
+    if (!ImGui::CollapsingHeader("Export")) return;
+
+    ParticleExporter3D* exporter = simulation->getExporter();
+    if (!exporter->IsRunning()) {
+        const char* formats[] = { "VTU (ParaView)", "PLY" };
+        ImGui::InputText("Export Directory", exportDirectory, sizeof(exportDirectory));
+        ImGui::Combo("Format", &exportFormat, formats, IM_ARRAYSIZE(formats));
+        ImGui::SliderInt("Export Every N Steps", &exportInterval, 1, 100);
+        if (ImGui::Button("Start Export")) {
+            ParticleExporter3D::Options options;
+            options.format = exportFormat == 1 ? ParticleExporter3D::Format::PLY : ParticleExporter3D::Format::VTU;
+            options.directory = exportDirectory;
+            options.frameInterval = static_cast<size_t>(exportInterval);
+            exporter->Start(options);
+        }
+    }
+    else if (ImGui::Button("Stop Export")) {
+        exporter->Stop();
+    }
+
+    ParticleExporter3D::Statistics stats = exporter->GetStatistics();
+    ImGui::Text("Frames: %llu written, %llu dropped", static_cast<unsigned long long>(stats.framesWritten), static_cast<unsigned long long>(stats.framesDropped));
+    ImGui::Text("Encode %.2f ms, writer %.1f MB/s, queue %zu", stats.encodeMilliseconds, stats.writeMegabytesPerSecond, stats.queueDepth);
+}
+
+void ImGuiManager3D::RenderPlaybackControls() {
+    if (shaderManager->GetSimulationType() != SimulationType3D::PLAYBACK) return;
+    if (!ImGui::CollapsingHeader("Playback", ImGuiTreeNodeFlags_DefaultOpen)) return;
+
+    TrajectoryPlayer* player = simulation->getParticleSystem()->GetTrajectoryPlayer();
+    ImGui::InputText("Playback File", playbackPath, sizeof(playbackPath));
+    if (ImGui::Button("Open Trajectory")) {
+        player->Open(playbackPath);
+    }
+    if (!player->IsOpen()) return;
+
+    int frame = static_cast<int>(player->GetCurrentFrame());
+    if (ImGui::SliderInt("Frame", &frame, 0, static_cast<int>(player->GetFrameCount()) - 1)) {
+        player->Seek(static_cast<size_t>(frame));
+    }
+    if (ImGui::Button(player->IsPlaying() ? "Pause Playback" : "Play")) {
+        player->SetPlaying(!player->IsPlaying());
+    }
+    ImGui::SameLine();
+    bool loop = player->GetLoop();
+    if (ImGui::Checkbox("Loop", &loop)) {
+        player->SetLoop(loop);
+    }
+    int stride = static_cast<int>(player->GetStride());
+    if (ImGui::SliderInt("Frame Stride", &stride, 1, 16)) {
+        player->SetStride(static_cast<size_t>(stride));
+    }
+
+    const TrajectoryFormat::IndexEntry& entry = player->GetEntry(static_cast<size_t>(frame));
+    ImGui::Text("Step %llu, t = %.3f s", static_cast<unsigned long long>(entry.step), entry.time);
+    TrajectoryPlayer::Statistics stats = player->GetStatistics();
+    ImGui::Text("Decode: %.1f frames/s, prefetched %zu/%zu, misses %llu", stats.decodeFramesPerSecond, stats.prefetched, stats.prefetchDepth,
+        static_cast<unsigned long long>(stats.misses));
 }
 
 void ImGuiManager3D::RenderFPS() {
@@ -87,6 +226,45 @@ void ImGuiManager3D::RenderFPS() {
     ImGui::Text("FPS: %.1f", fps);
 }
 
+void ImGuiManager3D::RenderSchedulerControls() {
+    TaskScheduler& scheduler = TaskScheduler::Instance();
+    if (schedulerThreads == 0) {
+        schedulerThreads = static_cast<int>(scheduler.GetThreadCount());
+        schedulerPinThreads = scheduler.GetPinThreads();
+    }
+
+    if (!ImGui::CollapsingHeader("CPU Threads")) return;
+
+    ImGui::SliderInt("Threads", &schedulerThreads, 1, static_cast<int>(TaskScheduler::HardwareThreads()));
+    ImGui::Checkbox("Pin Threads", &schedulerPinThreads);
+    if (ImGui::Button("Apply Threads")) {
+        scheduler.Configure(static_cast<unsigned int>(schedulerThreads), schedulerPinThreads);
+        scheduler.ResetStats();
+    }
+
+    std::vector<TaskScheduler::WorkerStats> stats = scheduler.GetStats();
+    for (size_t i = 0; i < stats.size(); ++i) {
+        ImGui::Text("Worker %zu: %zu tasks, %zu stolen, %.1f ms busy", i, stats[i].tasksExecuted, stats[i].tasksStolen, stats[i].busyMilliseconds);
+    }
+}
+
+void ImGuiManager3D::RenderProfiler() {
+    if (!ImGui::CollapsingHeader("Profiler")) return;
+
+    for (const auto& timing : Profiler::Instance().GetTimings()) {
+        ImGui::Text("%s: %.3f ms", timing.first.c_str(), timing.second.average);
+    }
+    for (const auto& counter : Profiler::Instance().GetCounters()) {
+        ImGui::Text("%s: %.3f", counter.first.c_str(), counter.second.average);
+    }
+    if (shaderManager->GetFluidParams().deterministic) {
+        ImGui::Text("State Hash: %016llx", static_cast<unsigned long long>(simulation->getParticleSystem()->GetCpuSolver()->GetLastStateHash()));
+    }
+    if (ImGui::Button("Reset Profiler")) {
+        Profiler::Instance().Reset();
+    }
+}
+
 void ImGuiManager3D::RenderShaderManagerControls() {
     shaderManager->RenderImGui();
 }
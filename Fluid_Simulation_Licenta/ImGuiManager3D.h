@@ -4,6 +4,7 @@
 #include "imgui.h"
 #include "imgui_impl_opengl3.h"
 #include "imgui_impl_glut.h"
+#include <string>
 
 class Simulation3D;
 class ShaderManager3D;
@@ -25,6 +26,26 @@ private:
     void RenderShaderManagerControls();
     void RenderFPS();
     void RenderMenu();
+    void RenderSchedulerControls();
+    void RenderProfiler();
+    void RenderSceneControls();
+    void RenderCheckpointControls();
+    void RenderTrajectoryControls();
+    void RenderPlaybackControls();
+    void RenderExportControls();
+
+    int schedulerThreads = 0;
+    bool schedulerPinThreads = false;
+    char scenePath[256] = "scenes/dam-break.json";
+    std::string sceneStatus;
+    char checkpointPath[256] = "checkpoint.fsc";
+    std::string checkpointStatus;
+    char trajectoryPath[256] = "trajectory.traj";
+    int trajectoryInterval = 10;
+    char playbackPath[256] = "trajectory.traj";
+    char exportDirectory[256] = "export";
+    int exportFormat = 0;
+    int exportInterval = 10;
 
     friend class Simulation3D;
 };
@@ -0,0 +1,262 @@
+#include "Json.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+    // Scene files are shallow; the limit only stops malicious input from overflowing the stack
+    const int MaxDepth = 64;
+
+    class Parser {
+    public:
+        Parser(const std::string& text) : current(text.c_str()), end(text.c_str() + text.size()), lineStart(text.c_str()), line(1) {}
+
+        bool ParseDocument(JsonValue& value) {
+            SkipWhitespace();
+            if (!ParseValue(value, 0)) return false;
+            SkipWhitespace();
+            if (current != end) return Fail("unexpected characters after the document");
+            return true;
+        }
+
+        std::string error;
+
+    private:
+        bool Fail(const std::string& message) {
+            std::ostringstream stream;
+            stream << "line " << line << ", column " << (current - lineStart) + 1 << ": " << message;
+            error = stream.str();
+            return false;
+        }
+
+        void SkipWhitespace() {
+            while (current != end) {
+                char c = *current;
+                if (c == '\n') {
+                    ++line;
+                    lineStart = ++current;
+                }
+                else if (c == ' ' || c == '\t' || c == '\r') ++current;
+                else break;
+            }
+        }
+
+        bool Expect(const char* literal) {
+            size_t length = std::strlen(literal);
+            if (static_cast<size_t>(end - current) < length || std::strncmp(current, literal, length) != 0) return Fail(std::string("expected '") + literal + "'");
+            current += length;
+            return true;
+        }
+
+        bool ParseValue(JsonValue& value, int depth) {
+            if (depth > MaxDepth) return Fail("nesting is too deep");
+            if (current == end) return Fail("unexpected end of input");
+            value.line = line;
+
+            switch (*current) {
+            case '{': return ParseObject(value, depth);
+            case '[': return ParseArray(value, depth);
+            case '"':
+                value.type = JsonValue::Type::String;
+                return ParseString(value.string);
+            case 't':
+                value.type = JsonValue::Type::Bool;
+                value.boolean = true;
+                return Expect("true");
+            case 'f':
+                value.type = JsonValue::Type::Bool;
+                value.boolean = false;
+                return Expect("false");
+            case 'n':
+                value.type = JsonValue::Type::Null;
+                return Expect("null");
+            default:
+                return ParseNumber(value);
+            }
+        }
+
+        bool ParseObject(JsonValue& value, int depth) {
+            value.type = JsonValue::Type::Object;
+            ++current;
+            SkipWhitespace();
+            if (current != end && *current == '}') {
+                ++current;
+                return true;
+            }
+            while (true) {
+                SkipWhitespace();
+                if (current == end || *current != '"') return Fail("expected a member name");
+                std::string key;
+                if (!ParseString(key)) return false;
+                if (value.Find(key)) return Fail("duplicate member '" + key + "'");
+
+                SkipWhitespace();
+                if (current == end || *current != ':') return Fail("expected ':' after '" + key + "'");
+                ++current;
+                SkipWhitespace();
+                value.members.emplace_back(key, JsonValue());
+                if (!ParseValue(value.members.back().second, depth + 1)) return false;
+
+                SkipWhitespace();
+                if (current == end) return Fail("unterminated object");
+                if (*current == ',') {
+                    ++current;
+                    continue;
+                }
+                if (*current == '}') {
+                    ++current;
+                    return true;
+                }
+                return Fail("expected ',' or '}'");
+            }
+        }
+
+        bool ParseArray(JsonValue& value, int depth) {
+            value.type = JsonValue::Type::Array;
+            ++current;
+            SkipWhitespace();
+            if (current != end && *current == ']') {
+                ++current;
+                return true;
+            }
+            while (true) {
+                SkipWhitespace();
+                value.elements.emplace_back();
+                if (!ParseValue(value.elements.back(), depth + 1)) return false;
+
+                SkipWhitespace();
+                if (current == end) return Fail("unterminated array");
+                if (*current == ',') {
+                    ++current;
+                    continue;
+                }
+                if (*current == ']') {
+                    ++current;
+                    return true;
+                }
+                return Fail("expected ',' or ']'");
+            }
+        }
+
+        bool ParseString(std::string& output) {
+            ++current;
+            const char* runStart = current;
+            while (true) {
+                if (current == end || *current == '\n') return Fail("unterminated string");
+                char c = *current;
+                if (c == '"') {
+                    output.append(runStart, current);
+                    ++current;
+                    return true;
+                }
+                if (c != '\\') {
+                    ++current;
+                    continue;
+                }
+
+                output.append(runStart, current);
+                if (++current == end) return Fail("unterminated escape");
+                switch (*current) {
+                case '"': output += '"'; break;
+                case '\\': output += '\\'; break;
+                case '/': output += '/'; break;
+                case 'b': output += '\b'; break;
+                case 'f': output += '\f'; break;
+                case 'n': output += '\n'; break;
+                case 'r': output += '\r'; break;
+                case 't': output += '\t'; break;
+                case 'u': {
+                    if (end - current < 5) return Fail("truncated \\u escape");
+                    char hex[5] = { current[1], current[2], current[3], current[4], 0 };
+                    char* hexEnd = nullptr;
+                    unsigned long code = std::strtoul(hex, &hexEnd, 16);
+                    if (hexEnd != hex + 4) return Fail("invalid \\u escape");
+                    // Scene files are ASCII in practice; anything else is kept as UTF-8 of the BMP code point
+                    if (code < 0x80) output += static_cast<char>(code);
+                    else if (code < 0x800) {
+                        output += static_cast<char>(0xC0 | (code >> 6));
+                        output += static_cast<char>(0x80 | (code & 0x3F));
+                    }
+                    else {
+                        output += static_cast<char>(0xE0 | (code >> 12));
+                        output += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                        output += static_cast<char>(0x80 | (code & 0x3F));
+                    }
+                    current += 4;
+                    break;
+                }
+                default:
+                    return Fail("invalid escape");
+                }
+                runStart = ++current;
+            }
+        }
+
+        bool ParseNumber(JsonValue& value) {
+            const char* start = current;
+            if (current != end && *current == '-') ++current;
+            if (current == end || *current < '0' || *current > '9') {
+                current = start;
+                return Fail("expected a value");
+            }
+            while (current != end && ((*current >= '0' && *current <= '9') || *current == '.' || *current == 'e' || *current == 'E' || *current == '+' || *current == '-')) ++current;
+
+            // strtod needs a terminated string; numbers are short, so copy the token
+            std::string token(start, current);
+            char* tokenEnd = nullptr;
+            value.type = JsonValue::Type::Number;
+            value.number = std::strtod(token.c_str(), &tokenEnd);
+            if (tokenEnd != token.c_str() + token.size()) {
+                current = start;
+                return Fail("malformed number '" + token + "'");
+            }
+            return true;
+        }
+
+        const char* current;
+        const char* end;
+        const char* lineStart;
+        int line;
+    };
+}
+
+const JsonValue* JsonValue::Find(const std::string& key) const {
+    for (const std::pair<std::string, JsonValue>& member : members) {
+        if (member.first == key) return &member.second;
+    }
+    return nullptr;
+}
+
+const char* JsonValue::TypeName(Type type) {
+    switch (type) {
+    case Type::Null: return "null";
+    case Type::Bool: return "a boolean";
+    case Type::Number: return "a number";
+    case Type::String: return "a string";
+    case Type::Array: return "an array";
+    case Type::Object: return "an object";
+    }
+    return "unknown";
+}
+
+bool JsonParser::Parse(const std::string& text, JsonValue& value, std::string& error) {
+    value = JsonValue();
+    Parser parser(text);
+    if (!parser.ParseDocument(value)) {
+        error = parser.error;
+        return false;
+    }
+    return true;
+}
+
+bool JsonParser::ParseFile(const std::string& path, JsonValue& value, std::string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        error = "cannot open file";
+        return false;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return Parse(contents.str(), value, error);
+}
@@ -0,0 +1,40 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal JSON document model for the scene files. Objects keep their members in
+// file order and every value remembers the line it started on, so loaders can
+// point at the offending line when validation fails.
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> elements;
+    std::vector<std::pair<std::string, JsonValue>> members;
+    int line = 0;
+
+    bool IsNumber() const { return type == Type::Number; }
+    bool IsString() const { return type == Type::String; }
+    bool IsArray() const { return type == Type::Array; }
+    bool IsObject() const { return type == Type::Object; }
+    bool IsBool() const { return type == Type::Bool; }
+
+    // Member called key, or nullptr when this is not an object or has no such member.
+    const JsonValue* Find(const std::string& key) const;
+    static const char* TypeName(Type type);
+};
+
+class JsonParser {
+public:
+    // Parses a whole document. On failure returns false and sets error to "line L, column C: message".
+    static bool Parse(const std::string& text, JsonValue& value, std::string& error);
+    static bool ParseFile(const std::string& path, JsonValue& value, std::string& error);
+};
+
+#endif // JSON_H
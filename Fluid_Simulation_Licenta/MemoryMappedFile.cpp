@@ -0,0 +1,97 @@
+#include "MemoryMappedFile.h"
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MemoryMappedFile::MemoryMappedFile() : data(nullptr), size(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr) {}
+#else
+MemoryMappedFile::MemoryMappedFile() : data(nullptr), size(0), fileDescriptor(-1) {}
+#endif
+
+MemoryMappedFile::~MemoryMappedFile() {
+    Close();
+}
+
+bool MemoryMappedFile::Open(const std::string& path) {
+    Close();
+
+#ifdef _WIN32
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        std::cerr << "MemoryMappedFile::Open Error: Cannot open " << path << std::endl;
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+        std::cerr << "MemoryMappedFile::Open Error: " << path << " is empty" << std::endl;
+        Close();
+        return false;
+    }
+    size = static_cast<size_t>(fileSize.QuadPart);
+
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mappingHandle) {
+        std::cerr << "MemoryMappedFile::Open Error: Cannot map " << path << std::endl;
+        Close();
+        return false;
+    }
+
+    data = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (!data) {
+        std::cerr << "MemoryMappedFile::Open Error: Cannot map " << path << std::endl;
+        Close();
+        return false;
+    }
+#else
+    fileDescriptor = open(path.c_str(), O_RDONLY);
+    if (fileDescriptor < 0) {
+        std::cerr << "MemoryMappedFile::Open Error: Cannot open " << path << std::endl;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fileDescriptor, &info) != 0 || info.st_size == 0) {
+        std::cerr << "MemoryMappedFile::Open Error: " << path << " is empty" << std::endl;
+        Close();
+        return false;
+    }
+    size = static_cast<size_t>(info.st_size);
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "MemoryMappedFile::Open Error: Cannot map " << path << std::endl;
+        Close();
+        return false;
+    }
+    // Checkpoints are read front to back once; let the kernel read ahead aggressively
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    data = static_cast<const unsigned char*>(mapping);
+#endif
+    return true;
+}
+
+void MemoryMappedFile::Close() {
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mappingHandle) CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (data) munmap(const_cast<unsigned char*>(data), size);
+    if (fileDescriptor >= 0) close(fileDescriptor);
+    fileDescriptor = -1;
+#endif
+    data = nullptr;
+    size = 0;
+}
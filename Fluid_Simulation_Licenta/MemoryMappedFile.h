@@ -0,0 +1,35 @@
+#ifndef MEMORY_MAPPED_FILE_H
+#define MEMORY_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file mapped into memory. Pages are loaded on first touch,
+// so large files can be handed to glBufferData or copied without reading them first.
+class MemoryMappedFile {
+public:
+    MemoryMappedFile();
+    ~MemoryMappedFile();
+
+    MemoryMappedFile(const MemoryMappedFile&) = delete;
+    MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+
+    bool IsOpen() const { return data != nullptr; }
+    const unsigned char* GetData() const { return data; }
+    size_t GetSize() const { return size; }
+
+private:
+    const unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fileDescriptor;
+#endif
+};
+
+#endif // MEMORY_MAPPED_FILE_H
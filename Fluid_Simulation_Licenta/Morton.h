@@ -0,0 +1,107 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <cstdint>
+
+// Z-order (Morton) codes: the bits of the coordinates are interleaved, so
+// cells that are close in space usually get close indices.
+namespace Morton {
+    // Spreads the low 10 bits of v so there are two zero bits between each of them.
+    inline uint32_t Part1By2(uint32_t v) {
+        v &= 0x000003ff;
+        v = (v ^ (v << 16)) & 0xff0000ff;
+        v = (v ^ (v << 8)) & 0x0300f00f;
+        v = (v ^ (v << 4)) & 0x030c30c3;
+        v = (v ^ (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    inline uint32_t Compact1By2(uint32_t v) {
+        v &= 0x09249249;
+        v = (v ^ (v >> 2)) & 0x030c30c3;
+        v = (v ^ (v >> 4)) & 0x0300f00f;
+        v = (v ^ (v >> 8)) & 0xff0000ff;
+        v = (v ^ (v >> 16)) & 0x000003ff;
+        return v;
+    }
+
+    // Spreads the low 16 bits of v so there is a zero bit between each of them.
+    inline uint32_t Part1By1(uint32_t v) {
+        v &= 0x0000ffff;
+        v = (v ^ (v << 8)) & 0x00ff00ff;
+        v = (v ^ (v << 4)) & 0x0f0f0f0f;
+        v = (v ^ (v << 2)) & 0x33333333;
+        v = (v ^ (v << 1)) & 0x55555555;
+        return v;
+    }
+
+    inline uint32_t Compact1By1(uint32_t v) {
+        v &= 0x55555555;
+        v = (v ^ (v >> 1)) & 0x33333333;
+        v = (v ^ (v >> 2)) & 0x0f0f0f0f;
+        v = (v ^ (v >> 4)) & 0x00ff00ff;
+        v = (v ^ (v >> 8)) & 0x0000ffff;
+        return v;
+    }
+
+    // x and y must fit in 16 bits each.
+    inline uint32_t Encode2D(uint32_t x, uint32_t y) {
+        return Part1By1(x) | (Part1By1(y) << 1);
+    }
+
+    inline void Decode2D(uint32_t code, uint32_t& x, uint32_t& y) {
+        x = Compact1By1(code);
+        y = Compact1By1(code >> 1);
+    }
+
+    // x, y and z must fit in 10 bits each.
+    inline uint32_t Encode3D(uint32_t x, uint32_t y, uint32_t z) {
+        return Part1By2(x) | (Part1By2(y) << 1) | (Part1By2(z) << 2);
+    }
+
+    inline void Decode3D(uint32_t code, uint32_t& x, uint32_t& y, uint32_t& z) {
+        x = Compact1By2(code);
+        y = Compact1By2(code >> 1);
+        z = Compact1By2(code >> 2);
+    }
+
+    // 64-bit codes for coordinates of up to 21 bits each.
+    inline uint64_t Part1By2Wide(uint64_t v) {
+        v &= 0x1fffff;
+        v = (v | (v << 32)) & 0x1f00000000ffffull;
+        v = (v | (v << 16)) & 0x1f0000ff0000ffull;
+        v = (v | (v << 8)) & 0x100f00f00f00f00full;
+        v = (v | (v << 4)) & 0x10c30c30c30c30c3ull;
+        v = (v | (v << 2)) & 0x1249249249249249ull;
+        return v;
+    }
+
+    inline uint64_t Compact1By2Wide(uint64_t v) {
+        v &= 0x1249249249249249ull;
+        v = (v | (v >> 2)) & 0x10c30c30c30c30c3ull;
+        v = (v | (v >> 4)) & 0x100f00f00f00f00full;
+        v = (v | (v >> 8)) & 0x1f0000ff0000ffull;
+        v = (v | (v >> 16)) & 0x1f00000000ffffull;
+        v = (v | (v >> 32)) & 0x1fffff;
+        return v;
+    }
+
+    inline uint64_t Encode3DWide(uint32_t x, uint32_t y, uint32_t z) {
+        return Part1By2Wide(x) | (Part1By2Wide(y) << 1) | (Part1By2Wide(z) << 2);
+    }
+
+    inline void Decode3DWide(uint64_t code, uint32_t& x, uint32_t& y, uint32_t& z) {
+        x = static_cast<uint32_t>(Compact1By2Wide(code));
+        y = static_cast<uint32_t>(Compact1By2Wide(code >> 1));
+        z = static_cast<uint32_t>(Compact1By2Wide(code >> 2));
+    }
+
+    // Number of bits needed to store values in [0, size).
+    inline uint32_t BitsFor(uint32_t size) {
+        uint32_t bits = 0;
+        while ((uint32_t(1) << bits) < size) ++bits;
+        return bits;
+    }
+}
+
+#endif // MORTON_H
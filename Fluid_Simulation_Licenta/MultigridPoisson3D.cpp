@@ -0,0 +1,556 @@
+#include "MultigridPoisson3D.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+    // Z slices per task, so that a task covers about cellGrain cells
+    inline size_t SliceGrain(const glm::ivec3& dims, size_t cellGrain) {
+        size_t slice = static_cast<size_t>(dims.x) * dims.y;
+        return std::max<size_t>(1, cellGrain / std::max<size_t>(slice, 1));
+    }
+
+    inline size_t NaturalIndex(const glm::ivec3& dims, int x, int y, int z) {
+        return (static_cast<size_t>(z) * dims.y + y) * dims.x + x;
+    }
+
+    // Neighbours of an interior cell that are not Neumann; outside the grid counts as outside
+    float CellDiagonal(const glm::ivec3& d, const std::vector<uint8_t>& types, MultigridPoisson3D::CellType outside, int x, int y, int z) {
+        size_t index = NaturalIndex(d, x, y, z);
+        if (types[index] != MultigridPoisson3D::Interior) return 0.0f;
+        size_t strideY = static_cast<size_t>(d.x);
+        size_t strideZ = static_cast<size_t>(d.x) * d.y;
+        auto open = [&](bool inside, size_t neighbour) {
+            return (inside ? types[neighbour] : static_cast<uint8_t>(outside)) != MultigridPoisson3D::Neumann ? 1 : 0;
+        };
+        int count = open(x > 0, index - 1) + open(x + 1 < d.x, index + 1)
+            + open(y > 0, index - strideY) + open(y + 1 < d.y, index + strideY)
+            + open(z > 0, index - strideZ) + open(z + 1 < d.z, index + strideZ);
+        return static_cast<float>(count);
+    }
+}
+
+MultigridPoisson3D::MultigridPoisson3D(TaskScheduler& scheduler)
+    : scheduler(scheduler), dims(0), outside(Neumann), interiorCount(0) {}
+
+size_t MultigridPoisson3D::PackedIndex(const Level& level, int x, int y, int z) {
+    size_t px = static_cast<size_t>(x + 1);
+    size_t row = static_cast<size_t>(z + 1) * (level.dims.y + 2) + (y + 1);
+    return row * level.rowStride + (px & 1) * level.half + (px >> 1);
+}
+
+void MultigridPoisson3D::AllocateLevels() {
+    levels.clear();
+    glm::ivec3 levelDims = dims;
+    while (true) {
+        Level level;
+        level.dims = levelDims;
+        // Padded x runs to dims.x + 1, so a half needs (dims.x + 1) / 2 + 1 slots
+        level.half = static_cast<size_t>(levelDims.x + 1) / 2 + 1;
+        level.rowStride = 2 * level.half;
+        level.planeStride = level.rowStride * (levelDims.y + 2);
+        size_t size = level.planeStride * (levelDims.z + 2);
+        level.diagonal.assign(size, 0.0f);
+        level.inverseDiagonal.assign(size, 0.0f);
+        level.solution.assign(size, 0.0f);
+        level.rhs.assign(size, 0.0f);
+        level.residual.assign(size, 0.0f);
+        level.wallWeight.assign(size, 0.0f);
+        levels.push_back(std::move(level));
+        if (glm::min(levelDims.x, glm::min(levelDims.y, levelDims.z)) <= CoarsestCells || levels.size() == MaxLevels) break;
+        levelDims = (levelDims + 1) / 2;
+    }
+    // Allocated by the first solve that needs them
+    pcgSolution.clear();
+    pcgResidual.clear();
+    pcgDirection.clear();
+    pcgPreconditioned.clear();
+    pcgProduct.clear();
+}
+
+void MultigridPoisson3D::Configure(const glm::ivec3& newDims, const std::vector<uint8_t>& types, CellType newOutside) {
+    outside = newOutside;
+    interiorCount = 0;
+    if (glm::min(newDims.x, glm::min(newDims.y, newDims.z)) < 1) {
+        std::cerr << "MultigridPoisson3D::Configure Error: Empty grid" << std::endl;
+        dims = glm::ivec3(0);
+        levels.clear();
+        return;
+    }
+    if (newDims != dims || levels.empty()) {
+        dims = newDims;
+        AllocateLevels();
+    }
+
+    levels[0].types = types;
+    for (size_t l = 1; l < levels.size(); ++l) {
+        glm::ivec3 coarseDims;
+        CoarsenTypes(levels[l - 1].dims, levels[l - 1].types, outside, coarseDims, levels[l].types, scheduler);
+    }
+
+    for (Level& level : levels) {
+        const glm::ivec3& d = level.dims;
+        scheduler.ParallelFor(0, d.z, SliceGrain(d, CellGrain), [&](size_t zBegin, size_t zEnd) {
+            for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+                for (int y = 0; y < d.y; ++y) {
+                    for (int x = 0; x < d.x; ++x) {
+                        size_t index = PackedIndex(level, x, y, z);
+                        float diagonal = CellDiagonal(d, level.types, outside, x, y, z);
+                        level.diagonal[index] = diagonal;
+                        level.inverseDiagonal[index] = diagonal > 0.0f ? 1.0f / diagonal : 0.0f;
+                    }
+                }
+            }
+        });
+    }
+
+    for (size_t l = 0; l + 1 < levels.size(); ++l) {
+        ComputeWallWeights(levels[l].dims, levels[l].types, levels[l + 1].types, outside, wallWeightScratch, scheduler);
+        Pack(levels[l], wallWeightScratch, levels[l].wallWeight, false);
+    }
+
+    const std::vector<float>& diagonal = levels[0].diagonal;
+    interiorCount = scheduler.ParallelReduce(size_t(0), diagonal.size(), CellGrain, size_t(0),
+        [&](size_t begin, size_t end) {
+            size_t count = 0;
+            for (size_t i = begin; i < end; ++i) count += diagonal[i] > 0.0f;
+            return count;
+        },
+        [](size_t a, size_t b) { return a + b; });
+}
+
+void MultigridPoisson3D::ClassifyFromSDF(const BoundarySDF3D& boundary, const glm::vec3& origin, float cellSize, const glm::ivec3& dims,
+    CellType solidType, std::vector<uint8_t>& types, TaskScheduler& scheduler) {
+    types.resize(static_cast<size_t>(dims.x) * dims.y * dims.z);
+    scheduler.ParallelFor(0, dims.z, SliceGrain(dims, CellGrain), [&](size_t zBegin, size_t zEnd) {
+        for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+            for (int y = 0; y < dims.y; ++y) {
+                for (int x = 0; x < dims.x; ++x) {
+                    glm::vec3 centre = origin + (glm::vec3(x, y, z) + 0.5f) * cellSize;
+                    types[NaturalIndex(dims, x, y, z)] = boundary.Sample(centre).w < 0.0f ? solidType : Interior;
+                }
+            }
+        }
+    });
+}
+
+void MultigridPoisson3D::CoarsenTypes(const glm::ivec3& d, const std::vector<uint8_t>& types, CellType outside,
+    glm::ivec3& coarseDims, std::vector<uint8_t>& coarseTypes, TaskScheduler& scheduler) {
+    coarseDims = (d + 1) / 2;
+    const glm::ivec3& cd = coarseDims;
+    coarseTypes.resize(static_cast<size_t>(cd.x) * cd.y * cd.z);
+    scheduler.ParallelFor(0, cd.z, SliceGrain(cd, CellGrain), [&](size_t zBegin, size_t zEnd) {
+        for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+            for (int y = 0; y < cd.y; ++y) {
+                for (int x = 0; x < cd.x; ++x) {
+                    bool anyDirichlet = false, anyInterior = false;
+                    for (int fz = 2 * z; fz < 2 * z + 2; ++fz) {
+                        for (int fy = 2 * y; fy < 2 * y + 2; ++fy) {
+                            for (int fx = 2 * x; fx < 2 * x + 2; ++fx) {
+                                // The half cells past an odd side are outside
+                                bool inside = fx < d.x && fy < d.y && fz < d.z;
+                                uint8_t type = inside ? types[NaturalIndex(d, fx, fy, fz)] : static_cast<uint8_t>(outside);
+                                anyDirichlet |= type == Dirichlet;
+                                anyInterior |= type == Interior;
+                            }
+                        }
+                    }
+                    coarseTypes[NaturalIndex(cd, x, y, z)] = anyDirichlet ? Dirichlet : anyInterior ? Interior : Neumann;
+                }
+            }
+        }
+    });
+}
+
+void MultigridPoisson3D::ComputeDiagonals(const glm::ivec3& d, const std::vector<uint8_t>& types, CellType outside,
+    std::vector<float>& diagonals, TaskScheduler& scheduler) {
+    diagonals.resize(types.size());
+    scheduler.ParallelFor(0, d.z, SliceGrain(d, CellGrain), [&](size_t zBegin, size_t zEnd) {
+        for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+            for (int y = 0; y < d.y; ++y) {
+                for (int x = 0; x < d.x; ++x) diagonals[NaturalIndex(d, x, y, z)] = CellDiagonal(d, types, outside, x, y, z);
+            }
+        }
+    });
+}
+
+void MultigridPoisson3D::ComputeWallWeights(const glm::ivec3& d, const std::vector<uint8_t>& types, const std::vector<uint8_t>& coarseTypes,
+    CellType outside, std::vector<float>& weights, TaskScheduler& scheduler) {
+    glm::ivec3 cd = (d + 1) / 2;
+    weights.resize(types.size());
+    scheduler.ParallelFor(0, d.z, SliceGrain(d, CellGrain), [&](size_t zBegin, size_t zEnd) {
+        for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+            for (int y = 0; y < d.y; ++y) {
+                for (int x = 0; x < d.x; ++x) {
+                    size_t index = NaturalIndex(d, x, y, z);
+                    float weight = 0.0f;
+                    if (types[index] == Interior) {
+                        glm::ivec3 parent(x / 2, y / 2, z / 2);
+                        glm::ivec3 step((x & 1) ? 1 : -1, (y & 1) ? 1 : -1, (z & 1) ? 1 : -1);
+                        for (int corner = 0; corner < 8; ++corner) {
+                            glm::ivec3 offset(corner & 1, (corner >> 1) & 1, corner >> 2);
+                            glm::ivec3 c = parent + offset * step;
+                            bool inside = c.x >= 0 && c.y >= 0 && c.z >= 0 && c.x < cd.x && c.y < cd.y && c.z < cd.z;
+                            uint8_t type = inside ? coarseTypes[NaturalIndex(cd, c.x, c.y, c.z)] : static_cast<uint8_t>(outside);
+                            if (type != Neumann) continue;
+                            weight += (offset.x ? 0.25f : 0.75f) * (offset.y ? 0.25f : 0.75f) * (offset.z ? 0.25f : 0.75f);
+                        }
+                    }
+                    weights[index] = weight;
+                }
+            }
+        }
+    });
+}
+
+template <typename Fn>
+void MultigridPoisson3D::ForEachRow(const Level& level, int colour, Fn fn) {
+    const glm::ivec3& d = level.dims;
+    scheduler.ParallelFor(0, d.z, SliceGrain(d, CellGrain), [&](size_t zBegin, size_t zEnd) {
+        for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+            for (int y = 0; y < d.y; ++y) {
+                size_t row = (static_cast<size_t>(z + 1) * (d.y + 2) + (y + 1)) * level.rowStride;
+                // Half h holds the cells with padded x = 2k + h, so x = 2k + h - 1
+                for (int h = 0; h < 2; ++h) {
+                    if (colour >= 0 && ((colour + y + z + 1) & 1) != h) continue;
+                    size_t first = row + h * level.half;
+                    size_t neighbours = h == 0 ? row + level.half - 1 : row;
+                    size_t kBegin = h == 0 ? 1 : 0;
+                    size_t kEnd = static_cast<size_t>(d.x - h) / 2 + 1;
+                    fn(first, neighbours, kBegin, kEnd);
+                }
+            }
+        }
+    });
+}
+
+void MultigridPoisson3D::Pack(const Level& level, const std::vector<float>& natural, std::vector<float>& packed, bool interiorOnly) {
+    const glm::ivec3& d = level.dims;
+    scheduler.ParallelFor(0, d.z, SliceGrain(d, CellGrain), [&](size_t zBegin, size_t zEnd) {
+        for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+            for (int y = 0; y < d.y; ++y) {
+                size_t source = NaturalIndex(d, 0, y, z);
+                for (int x = 0; x < d.x; ++x, ++source) {
+                    size_t index = PackedIndex(level, x, y, z);
+                    packed[index] = interiorOnly && level.diagonal[index] == 0.0f ? 0.0f : natural[source];
+                }
+            }
+        }
+    });
+}
+
+void MultigridPoisson3D::Unpack(const Level& level, const std::vector<float>& packed, std::vector<float>& natural) {
+    const glm::ivec3& d = level.dims;
+    natural.resize(static_cast<size_t>(d.x) * d.y * d.z);
+    scheduler.ParallelFor(0, d.z, SliceGrain(d, CellGrain), [&](size_t zBegin, size_t zEnd) {
+        for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+            for (int y = 0; y < d.y; ++y) {
+                size_t target = NaturalIndex(d, 0, y, z);
+                for (int x = 0; x < d.x; ++x, ++target) natural[target] = packed[PackedIndex(level, x, y, z)];
+            }
+        }
+    });
+}
+
+void MultigridPoisson3D::Smooth(Level& level, int colour) {
+    float* x = level.solution.data();
+    const float* rhs = level.rhs.data();
+    const float* inverse = level.inverseDiagonal.data();
+    size_t rowStride = level.rowStride, planeStride = level.planeStride;
+    // Cells that are not solved for have a zero inverse, so they stay at zero
+    ForEachRow(level, colour, [&](size_t first, size_t neighbours, size_t kBegin, size_t kEnd) {
+        float* self = x + first;
+        const float* side = x + neighbours;
+        const float* below = self - rowStride;
+        const float* above = self + rowStride;
+        const float* back = self - planeStride;
+        const float* front = self + planeStride;
+        const float* b = rhs + first;
+        const float* inv = inverse + first;
+        for (size_t k = kBegin; k < kEnd; ++k) {
+            self[k] = (b[k] + side[k] + side[k + 1] + below[k] + above[k] + back[k] + front[k]) * inv[k];
+        }
+    });
+}
+
+void MultigridPoisson3D::ApplyPacked(const Level& level, const std::vector<float>& xs, std::vector<float>& out) {
+    const float* x = xs.data();
+    const float* diagonal = level.diagonal.data();
+    float* result = out.data();
+    size_t rowStride = level.rowStride, planeStride = level.planeStride;
+    ForEachRow(level, -1, [&](size_t first, size_t neighbours, size_t kBegin, size_t kEnd) {
+        const float* self = x + first;
+        const float* side = x + neighbours;
+        const float* below = self - rowStride;
+        const float* above = self + rowStride;
+        const float* back = self - planeStride;
+        const float* front = self + planeStride;
+        const float* diag = diagonal + first;
+        float* o = result + first;
+        for (size_t k = kBegin; k < kEnd; ++k) {
+            float sum = side[k] + side[k + 1] + below[k] + above[k] + back[k] + front[k];
+            // A select of constants, so the loop stays free of branches
+            float solved = diag[k] > 0.0f ? 1.0f : 0.0f;
+            o[k] = (diag[k] * self[k] - sum) * solved;
+        }
+    });
+}
+
+void MultigridPoisson3D::ComputeResidual(Level& level) {
+    const float* x = level.solution.data();
+    const float* rhs = level.rhs.data();
+    const float* diagonal = level.diagonal.data();
+    float* residual = level.residual.data();
+    size_t rowStride = level.rowStride, planeStride = level.planeStride;
+    ForEachRow(level, -1, [&](size_t first, size_t neighbours, size_t kBegin, size_t kEnd) {
+        const float* self = x + first;
+        const float* side = x + neighbours;
+        const float* below = self - rowStride;
+        const float* above = self + rowStride;
+        const float* back = self - planeStride;
+        const float* front = self + planeStride;
+        const float* diag = diagonal + first;
+        const float* b = rhs + first;
+        float* r = residual + first;
+        for (size_t k = kBegin; k < kEnd; ++k) {
+            float sum = side[k] + side[k + 1] + below[k] + above[k] + back[k] + front[k];
+            float solved = diag[k] > 0.0f ? 1.0f : 0.0f;
+            r[k] = (b[k] + sum - diag[k] * self[k]) * solved;
+        }
+    });
+}
+
+void MultigridPoisson3D::Restrict(const Level& fine, Level& coarse) {
+    // The transpose of the prolongation, halved: a coarse cell gathers the residuals of the four fine
+    // cells nearest it along each axis with weights 1/4, 3/4, 3/4, 1/4, and from each of its eight
+    // children the weight they moved off walls. The weights sum to eight, so this is the average of
+    // the eight cells it covers, times the factor of four between the Laplacians of the two spacings.
+    const float Weights[4] = { 0.25f, 0.75f, 0.75f, 0.25f };
+    const glm::ivec3& d = fine.dims;
+    const glm::ivec3& cd = coarse.dims;
+    scheduler.ParallelFor(0, cd.z, SliceGrain(cd, CellGrain), [&](size_t zBegin, size_t zEnd) {
+        for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+            for (int y = 0; y < cd.y; ++y) {
+                for (int x = 0; x < cd.x; ++x) {
+                    size_t index = PackedIndex(coarse, x, y, z);
+                    if (coarse.diagonal[index] == 0.0f) {
+                        coarse.rhs[index] = 0.0f;
+                        continue;
+                    }
+                    float sum = 0.0f;
+                    for (int i = 0; i < 4; ++i) {
+                        int fz = 2 * z - 1 + i;
+                        if (fz < 0 || fz >= d.z) continue;
+                        for (int j = 0; j < 4; ++j) {
+                            int fy = 2 * y - 1 + j;
+                            if (fy < 0 || fy >= d.y) continue;
+                            // Fine x from -1 to dims.x + 1 is inside the padded row and reads zero outside
+                            float row = 0.0f;
+                            for (int k = 0; k < 4; ++k) {
+                                size_t child = PackedIndex(fine, 2 * x - 1 + k, fy, fz);
+                                row += Weights[k] * fine.residual[child];
+                            }
+                            sum += Weights[i] * Weights[j] * row;
+                            if (j == 1 || j == 2) {
+                                if (i == 1 || i == 2) {
+                                    size_t left = PackedIndex(fine, 2 * x, fy, fz), right = PackedIndex(fine, 2 * x + 1, fy, fz);
+                                    sum += fine.wallWeight[left] * fine.residual[left] + fine.wallWeight[right] * fine.residual[right];
+                                }
+                            }
+                        }
+                    }
+                    coarse.rhs[index] = 0.5f * sum;
+                }
+            }
+        }
+    });
+}
+
+void MultigridPoisson3D::Prolongate(const Level& coarse, Level& fine) {
+    // Trilinear between coarse cell centres: a fine cell lies a quarter of a coarse cell from the
+    // centre of its parent, towards the neighbour it takes a quarter from. Dirichlet cells and the
+    // padding hold zero; the weight of Neumann cells goes to the parent.
+    const glm::ivec3& d = fine.dims;
+    scheduler.ParallelFor(0, d.z, SliceGrain(d, CellGrain), [&](size_t zBegin, size_t zEnd) {
+        for (int z = static_cast<int>(zBegin); z < static_cast<int>(zEnd); ++z) {
+            int cz = z / 2, nz = cz + ((z & 1) ? 1 : -1);
+            for (int y = 0; y < d.y; ++y) {
+                int cy = y / 2, ny = cy + ((y & 1) ? 1 : -1);
+                for (int x = 0; x < d.x; ++x) {
+                    size_t index = PackedIndex(fine, x, y, z);
+                    if (fine.diagonal[index] == 0.0f) continue;
+                    int cx = x / 2, nx = cx + ((x & 1) ? 1 : -1);
+                    auto row = [&](int ry, int rz) {
+                        return 0.75f * coarse.solution[PackedIndex(coarse, cx, ry, rz)] + 0.25f * coarse.solution[PackedIndex(coarse, nx, ry, rz)];
+                    };
+                    float near = 0.75f * row(cy, cz) + 0.25f * row(ny, cz);
+                    float far = 0.75f * row(cy, nz) + 0.25f * row(ny, nz);
+                    float parent = coarse.solution[PackedIndex(coarse, cx, cy, cz)];
+                    fine.solution[index] += 0.75f * near + 0.25f * far + fine.wallWeight[index] * parent;
+                }
+            }
+        }
+    });
+}
+
+void MultigridPoisson3D::VCycle(size_t levelIndex, bool zeroGuess) {
+    Level& level = levels[levelIndex];
+    if (zeroGuess) {
+        scheduler.ParallelFor(0, level.solution.size(), CellGrain, [&](size_t begin, size_t end) {
+            std::fill(level.solution.begin() + begin, level.solution.begin() + end, 0.0f);
+        });
+    }
+
+    if (levelIndex + 1 == levels.size()) {
+        for (int sweep = 0; sweep < CoarseSweeps; ++sweep) {
+            Smooth(level, 0);
+            Smooth(level, 1);
+        }
+        for (int sweep = 0; sweep < CoarseSweeps; ++sweep) {
+            Smooth(level, 1);
+            Smooth(level, 0);
+        }
+        return;
+    }
+
+    for (int sweep = 0; sweep < Sweeps; ++sweep) {
+        Smooth(level, 0);
+        Smooth(level, 1);
+    }
+    ComputeResidual(level);
+    Level& coarse = levels[levelIndex + 1];
+    Restrict(level, coarse);
+    VCycle(levelIndex + 1, true);
+    Prolongate(coarse, level);
+    for (int sweep = 0; sweep < Sweeps; ++sweep) {
+        Smooth(level, 1);
+        Smooth(level, 0);
+    }
+}
+
+void MultigridPoisson3D::PreconditionPacked(const std::vector<float>& r, std::vector<float>& out) {
+    Level& fine = levels[0];
+    std::copy(r.begin(), r.end(), fine.rhs.begin());
+    VCycle(0, true);
+    std::copy(fine.solution.begin(), fine.solution.end(), out.begin());
+}
+
+double MultigridPoisson3D::Dot(const std::vector<float>& a, const std::vector<float>& b) const {
+    return scheduler.ParallelReduce(size_t(0), a.size(), CellGrain, 0.0,
+        [&](size_t begin, size_t end) {
+            double sum = 0.0;
+            for (size_t i = begin; i < end; ++i) sum += static_cast<double>(a[i]) * b[i];
+            return sum;
+        },
+        [](double x, double y) { return x + y; });
+}
+
+float MultigridPoisson3D::MaxAbs(const std::vector<float>& values) const {
+    return scheduler.ParallelReduce(size_t(0), values.size(), CellGrain, 0.0f,
+        [&](size_t begin, size_t end) {
+            float largest = 0.0f;
+            for (size_t i = begin; i < end; ++i) largest = std::max(largest, std::fabs(values[i]));
+            return largest;
+        },
+        [](float a, float b) { return std::max(a, b); });
+}
+
+void MultigridPoisson3D::Apply(const std::vector<float>& x, std::vector<float>& out) {
+    if (levels.empty()) return;
+    Level& fine = levels[0];
+    pcgDirection.resize(fine.solution.size(), 0.0f);
+    pcgProduct.resize(fine.solution.size(), 0.0f);
+    Pack(fine, x, pcgDirection, true);
+    ApplyPacked(fine, pcgDirection, pcgProduct);
+    Unpack(fine, pcgProduct, out);
+}
+
+void MultigridPoisson3D::Precondition(const std::vector<float>& r, std::vector<float>& out) {
+    if (levels.empty()) return;
+    Level& fine = levels[0];
+    Pack(fine, r, fine.rhs, true);
+    VCycle(0, true);
+    Unpack(fine, fine.solution, out);
+}
+
+MultigridPoisson3D::SolveStats MultigridPoisson3D::Solve(const std::vector<float>& rhs, std::vector<float>& solution, float tolerance, int maxCycles) {
+    SolveStats stats;
+    if (levels.empty()) return stats;
+    Level& fine = levels[0];
+    Pack(fine, rhs, fine.rhs, true);
+    if (solution.size() == levels[0].types.size()) Pack(fine, solution, fine.solution, true);
+    else std::fill(fine.solution.begin(), fine.solution.end(), 0.0f);
+
+    ComputeResidual(fine);
+    float initial = MaxAbs(fine.residual);
+    stats.initialResidual = initial;
+    if (initial > 0.0f) {
+        stats.error = 1.0f;
+        while (stats.iterations < maxCycles) {
+            stats.iterations++;
+            VCycle(0, false);
+            ComputeResidual(fine);
+            float remaining = MaxAbs(fine.residual);
+            stats.error = remaining / initial;
+            if (remaining <= tolerance * initial) break;
+        }
+    }
+    Unpack(fine, fine.solution, solution);
+    return stats;
+}
+
+MultigridPoisson3D::SolveStats MultigridPoisson3D::SolvePCG(const std::vector<float>& rhs, std::vector<float>& solution, float tolerance, int maxIterations) {
+    SolveStats stats;
+    if (levels.empty()) return stats;
+    Level& fine = levels[0];
+    size_t size = fine.solution.size();
+    // Padding and cells that are not solved for stay zero in every vector
+    pcgSolution.assign(size, 0.0f);
+    pcgResidual.resize(size, 0.0f);
+    pcgDirection.resize(size, 0.0f);
+    pcgPreconditioned.resize(size, 0.0f);
+    pcgProduct.resize(size, 0.0f);
+    Pack(fine, rhs, pcgResidual, true);
+
+    float initial = MaxAbs(pcgResidual);
+    stats.initialResidual = initial;
+    if (initial > 0.0f) {
+        stats.error = 1.0f;
+        float target = tolerance * initial;
+        PreconditionPacked(pcgResidual, pcgPreconditioned);
+        pcgDirection = pcgPreconditioned;
+        double rz = Dot(pcgResidual, pcgPreconditioned);
+
+        while (stats.iterations < maxIterations) {
+            stats.iterations++;
+            ApplyPacked(fine, pcgDirection, pcgProduct);
+            double curvature = Dot(pcgDirection, pcgProduct);
+            if (curvature <= 0.0) break;
+            float alpha = static_cast<float>(rz / curvature);
+
+            float remaining = scheduler.ParallelReduce(size_t(0), size, CellGrain, 0.0f,
+                [&](size_t begin, size_t end) {
+                    float largest = 0.0f;
+                    for (size_t i = begin; i < end; ++i) {
+                        pcgSolution[i] += alpha * pcgDirection[i];
+                        pcgResidual[i] -= alpha * pcgProduct[i];
+                        largest = std::max(largest, std::fabs(pcgResidual[i]));
+                    }
+                    return largest;
+                },
+                [](float a, float b) { return std::max(a, b); });
+            stats.error = remaining / initial;
+            if (remaining <= target) break;
+
+            PreconditionPacked(pcgResidual, pcgPreconditioned);
+            double rzNext = Dot(pcgResidual, pcgPreconditioned);
+            float beta = static_cast<float>(rzNext / rz);
+            rz = rzNext;
+            scheduler.ParallelFor(0, size, CellGrain, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) pcgDirection[i] = pcgPreconditioned[i] + beta * pcgDirection[i];
+            });
+        }
+    }
+    Unpack(fine, pcgSolution, solution);
+    return stats;
+}
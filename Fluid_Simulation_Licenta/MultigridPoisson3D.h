@@ -0,0 +1,133 @@
+#ifndef MULTIGRID_POISSON_3D_H
+#define MULTIGRID_POISSON_3D_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "BoundarySDF3D.h"
+#include "TaskScheduler.h"
+
+// Geometric multigrid for the pressure Poisson equation on a dense cell-centred grid. Every
+// interior cell solves diagonal * x - (sum of its interior neighbours) = rhs, where the diagonal
+// counts the neighbours that are not Neumann. Dirichlet cells are held at zero (a non-zero
+// boundary value belongs in the right-hand side of the cells next to it) and nothing flows through
+// the faces of Neumann cells. Outside the grid is Neumann unless Configure says otherwise.
+//
+// Each coarse level halves every side, down to CoarsestCells; a coarse cell is Dirichlet if any of
+// its eight is, else interior if any is. Prolongation is trilinear between coarse cell centres, with
+// the weight of a Neumann corner moved to the parent, and restriction is its transpose, halved.
+// Every level smooths with red-black Gauss-Seidel: red then black on the way down and black then
+// red on the way up, so a V-cycle is a symmetric preconditioner.
+// A level stores each row as its even cells followed by its odd cells, with a layer of zeros
+// around the grid. One colour of a row is then a unit-stride loop without branches, which the
+// compiler vectorizes, and the rows of a sweep are spread over the task scheduler. Sweeps never
+// read a cell of the colour they write, and every reduction is a fixed tree, so the result does
+// not depend on the thread count.
+class MultigridPoisson3D {
+public:
+    enum CellType : uint8_t { Interior, Dirichlet, Neumann };
+
+    struct SolveStats {
+        int iterations = 0;
+        // Largest residual before the solve, and the largest after it as a fraction of that
+        float initialResidual = 0.0f;
+        float error = 0.0f;
+    };
+
+    explicit MultigridPoisson3D(TaskScheduler& scheduler = TaskScheduler::Instance());
+
+    // Types of the dims.x * dims.y * dims.z cells, x fastest. Only reallocates when dims change.
+    void Configure(const glm::ivec3& dims, const std::vector<uint8_t>& types, CellType outside = Neumann);
+    // Cells whose centre is inside the solid of boundary become solidType, the rest Interior.
+    static void ClassifyFromSDF(const BoundarySDF3D& boundary, const glm::vec3& origin, float cellSize, const glm::ivec3& dims,
+        CellType solidType, std::vector<uint8_t>& types, TaskScheduler& scheduler = TaskScheduler::Instance());
+    // Types of the next coarser level, (dims + 1) / 2 cells.
+    static void CoarsenTypes(const glm::ivec3& dims, const std::vector<uint8_t>& types, CellType outside,
+        glm::ivec3& coarseDims, std::vector<uint8_t>& coarseTypes, TaskScheduler& scheduler = TaskScheduler::Instance());
+    // Diagonal of every cell, zero for the cells that are not solved for (also an interior cell
+    // walled in on all six sides).
+    static void ComputeDiagonals(const glm::ivec3& dims, const std::vector<uint8_t>& types, CellType outside, std::vector<float>& diagonals,
+        TaskScheduler& scheduler = TaskScheduler::Instance());
+    // Weight of the trilinear prolongation from the next level (of coarseTypes) that falls on its
+    // Neumann cells, which an interior cell takes from its parent instead, so the walls do not pull
+    // the correction to zero. Zero for the other cells.
+    static void ComputeWallWeights(const glm::ivec3& dims, const std::vector<uint8_t>& types, const std::vector<uint8_t>& coarseTypes,
+        CellType outside, std::vector<float>& weights, TaskScheduler& scheduler = TaskScheduler::Instance());
+
+    // The vectors below are in the layout of the types given to Configure.
+    // out = A x on the cells solved for, zero elsewhere.
+    void Apply(const std::vector<float>& x, std::vector<float>& out);
+    // out = M^-1 r with one V-cycle from a zero guess.
+    void Precondition(const std::vector<float>& r, std::vector<float>& out);
+    // V-cycles from the guess in solution until the largest residual falls to tolerance times the
+    // initial one, or maxCycles.
+    SolveStats Solve(const std::vector<float>& rhs, std::vector<float>& solution, float tolerance, int maxCycles);
+    // Conjugate gradients preconditioned by one V-cycle, from a zero guess, with the same stopping rule.
+    SolveStats SolvePCG(const std::vector<float>& rhs, std::vector<float>& solution, float tolerance, int maxIterations);
+
+    const glm::ivec3& GetDimensions() const { return dims; }
+    int GetLevelCount() const { return static_cast<int>(levels.size()); }
+    size_t GetInteriorCount() const { return interiorCount; }
+
+    static const size_t CellGrain = 4096;
+    static const int CoarsestCells = 4;
+    static const size_t MaxLevels = 16;
+    // Smoothing sweeps of each colour before and after the coarse correction, and on the coarsest level
+    static const int Sweeps = 2;
+    static const int CoarseSweeps = 8;
+
+private:
+    // One level in the split-row layout: rows of rowStride floats, the even x half then the odd
+    // half, with padded coordinates running from 0 to dims + 1 so every neighbour read is in range
+    struct Level {
+        glm::ivec3 dims;
+        size_t half;
+        size_t rowStride;
+        size_t planeStride;
+        std::vector<uint8_t> types;
+        std::vector<float> diagonal;
+        std::vector<float> inverseDiagonal;
+        std::vector<float> solution;
+        std::vector<float> rhs;
+        std::vector<float> residual;
+        // From ComputeWallWeights
+        std::vector<float> wallWeight;
+    };
+
+    static size_t PackedIndex(const Level& level, int x, int y, int z);
+    void AllocateLevels();
+    // Runs fn(first, neighbours, kBegin, kEnd) over the interior cells of every row: the row's half
+    // starts at first, and the half holding their x neighbours at neighbours, shifted so that the
+    // cell at first + k has its left neighbour at neighbours + k and its right at neighbours + k + 1.
+    // colour 0 or 1 visits the cells with (x + y + z) & 1 == colour, -1 both halves in turn.
+    template <typename Fn>
+    void ForEachRow(const Level& level, int colour, Fn fn);
+    void Pack(const Level& level, const std::vector<float>& natural, std::vector<float>& packed, bool interiorOnly);
+    void Unpack(const Level& level, const std::vector<float>& packed, std::vector<float>& natural);
+    void Smooth(Level& level, int colour);
+    void ApplyPacked(const Level& level, const std::vector<float>& x, std::vector<float>& out);
+    void ComputeResidual(Level& level);
+    void Restrict(const Level& fine, Level& coarse);
+    void Prolongate(const Level& coarse, Level& fine);
+    void VCycle(size_t levelIndex, bool zeroGuess);
+    void PreconditionPacked(const std::vector<float>& r, std::vector<float>& out);
+    double Dot(const std::vector<float>& a, const std::vector<float>& b) const;
+    float MaxAbs(const std::vector<float>& values) const;
+
+    TaskScheduler& scheduler;
+    glm::ivec3 dims;
+    CellType outside;
+    size_t interiorCount;
+    std::vector<Level> levels;
+    std::vector<float> wallWeightScratch;
+
+    // Conjugate gradient vectors, in the layout of the finest level
+    std::vector<float> pcgSolution;
+    std::vector<float> pcgResidual;
+    std::vector<float> pcgDirection;
+    std::vector<float> pcgPreconditioned;
+    std::vector<float> pcgProduct;
+};
+
+#endif // MULTIGRID_POISSON_3D_H
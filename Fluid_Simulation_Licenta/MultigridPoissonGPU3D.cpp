@@ -0,0 +1,238 @@
+#include "MultigridPoissonGPU3D.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+
+MultigridPoissonGPU3D::MultigridPoissonGPU3D(const std::string& shaderPath)
+    : computeShader(new ComputeShader(shaderPath)), dims(0), maxResidualBuffer(0) {
+    glGenBuffers(1, &maxResidualBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, maxResidualBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    CheckGLError("MultigridPoissonGPU3D::MultigridPoissonGPU3D");
+}
+
+MultigridPoissonGPU3D::~MultigridPoissonGPU3D() {
+    ReleaseLevels();
+    glDeleteBuffers(1, &maxResidualBuffer);
+    delete computeShader;
+}
+
+void MultigridPoissonGPU3D::ReleaseLevels() {
+    for (Level& level : levels) {
+        GLuint buffers[5] = { level.diagonal, level.solution, level.rhs, level.residual, level.wallWeight };
+        glDeleteBuffers(5, buffers);
+    }
+    levels.clear();
+}
+
+void MultigridPoissonGPU3D::Configure(const glm::ivec3& newDims, const std::vector<uint8_t>& types, MultigridPoisson3D::CellType outside) {
+    if (glm::min(newDims.x, glm::min(newDims.y, newDims.z)) < 1) {
+        std::cerr << "MultigridPoissonGPU3D::Configure Error: Empty grid" << std::endl;
+        dims = glm::ivec3(0);
+        ReleaseLevels();
+        return;
+    }
+
+    // Same levels as MultigridPoisson3D
+    std::vector<glm::ivec3> levelDims(1, newDims);
+    std::vector<std::vector<uint8_t>> levelTypes(1, types);
+    while (glm::min(levelDims.back().x, glm::min(levelDims.back().y, levelDims.back().z)) > MultigridPoisson3D::CoarsestCells
+        && levelDims.size() < MultigridPoisson3D::MaxLevels) {
+        glm::ivec3 coarseDims;
+        std::vector<uint8_t> coarseTypes;
+        MultigridPoisson3D::CoarsenTypes(levelDims.back(), levelTypes.back(), outside, coarseDims, coarseTypes);
+        levelDims.push_back(coarseDims);
+        levelTypes.push_back(std::move(coarseTypes));
+    }
+
+    if (newDims != dims || levels.size() != levelDims.size()) {
+        ReleaseLevels();
+        dims = newDims;
+        for (const glm::ivec3& d : levelDims) {
+            Level level;
+            level.dims = d;
+            GLsizeiptr size = static_cast<GLsizeiptr>(d.x) * d.y * d.z * sizeof(float);
+            GLuint* buffers[5] = { &level.diagonal, &level.solution, &level.rhs, &level.residual, &level.wallWeight };
+            for (GLuint* buffer : buffers) {
+                glGenBuffers(1, buffer);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffer);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+                glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, nullptr);
+            }
+            levels.push_back(level);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        CheckGLError("MultigridPoissonGPU3D::Configure - Allocate");
+    }
+
+    std::vector<float> values;
+    for (size_t l = 0; l < levels.size(); ++l) {
+        Level& level = levels[l];
+        GLsizeiptr size = static_cast<GLsizeiptr>(levelTypes[l].size() * sizeof(float));
+        MultigridPoisson3D::ComputeDiagonals(level.dims, levelTypes[l], outside, values);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, level.diagonal);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, values.data());
+        if (l == 0) fineDiagonal = values;
+
+        if (l + 1 < levels.size()) MultigridPoisson3D::ComputeWallWeights(level.dims, levelTypes[l], levelTypes[l + 1], outside, values);
+        else values.assign(levelTypes[l].size(), 0.0f);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, level.wallWeight);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, values.data());
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    CheckGLError("MultigridPoissonGPU3D::Configure - Upload");
+}
+
+void MultigridPoissonGPU3D::Upload(const std::vector<float>& rhs, const std::vector<float>& solution) {
+    if (levels.empty()) return;
+    // Cells that are not solved for must hold zero, since the neighbour sums read them
+    size_t count = fineDiagonal.size();
+    if (rhs.size() != count) {
+        std::cerr << "MultigridPoissonGPU3D::Upload Error: Expected " << count << " values, got " << rhs.size() << std::endl;
+        return;
+    }
+    std::vector<float> masked(count);
+    auto upload = [&](const std::vector<float>& values, GLuint buffer) {
+        for (size_t i = 0; i < count; ++i) masked[i] = fineDiagonal[i] > 0.0f ? values[i] : 0.0f;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(float), masked.data());
+    };
+    upload(rhs, levels[0].rhs);
+    if (solution.size() == count) upload(solution, levels[0].solution);
+    else ClearBuffer(levels[0].solution);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    CheckGLError("MultigridPoissonGPU3D::Upload");
+}
+
+void MultigridPoissonGPU3D::Download(std::vector<float>& solution) {
+    if (levels.empty()) return;
+    solution.resize(fineDiagonal.size());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, levels[0].solution);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, solution.size() * sizeof(float), solution.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    CheckGLError("MultigridPoissonGPU3D::Download");
+}
+
+void MultigridPoissonGPU3D::BindLevel(size_t levelIndex) {
+    const Level& level = levels[levelIndex];
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, level.diagonal);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, level.solution);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, level.rhs);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, level.residual);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, level.wallWeight);
+    // The coarsest level binds itself as its coarse level; no pass reads it there
+    const Level& coarse = levels[std::min(levelIndex + 1, levels.size() - 1)];
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, coarse.diagonal);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, coarse.solution);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, coarse.rhs);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, maxResidualBuffer);
+    computeShader->setIVec3("dims", level.dims);
+    computeShader->setIVec3("coarseDims", coarse.dims);
+}
+
+void MultigridPoissonGPU3D::Dispatch(Pass pass, size_t threads) {
+    computeShader->setUInt("pass", pass);
+    computeShader->DispatchGroups(static_cast<GLuint>((threads + NumThreads - 1) / NumThreads));
+}
+
+void MultigridPoissonGPU3D::SmoothLevel(size_t levelIndex, int colour) {
+    const glm::ivec3& d = levels[levelIndex].dims;
+    computeShader->setUInt("colour", static_cast<unsigned int>(colour));
+    Dispatch(Smooth, static_cast<size_t>((d.x + 1) / 2) * d.y);
+}
+
+void MultigridPoissonGPU3D::VCycle(size_t levelIndex, bool zeroGuess) {
+    const Level& level = levels[levelIndex];
+    const glm::ivec3& d = level.dims;
+    if (zeroGuess) ClearBuffer(level.solution);
+    BindLevel(levelIndex);
+
+    // Red-black on the way down, black-red on the way up, as on the CPU
+    if (levelIndex + 1 == levels.size()) {
+        for (int sweep = 0; sweep < MultigridPoisson3D::CoarseSweeps; ++sweep) {
+            SmoothLevel(levelIndex, 0);
+            SmoothLevel(levelIndex, 1);
+        }
+        for (int sweep = 0; sweep < MultigridPoisson3D::CoarseSweeps; ++sweep) {
+            SmoothLevel(levelIndex, 1);
+            SmoothLevel(levelIndex, 0);
+        }
+        return;
+    }
+
+    for (int sweep = 0; sweep < MultigridPoisson3D::Sweeps; ++sweep) {
+        SmoothLevel(levelIndex, 0);
+        SmoothLevel(levelIndex, 1);
+    }
+    const glm::ivec3& cd = levels[levelIndex + 1].dims;
+    Dispatch(Residual, static_cast<size_t>(d.x) * d.y);
+    Dispatch(Restrict, static_cast<size_t>(cd.x) * cd.y);
+    VCycle(levelIndex + 1, true);
+
+    BindLevel(levelIndex);
+    Dispatch(Prolongate, static_cast<size_t>(d.x) * d.y);
+    for (int sweep = 0; sweep < MultigridPoisson3D::Sweeps; ++sweep) {
+        SmoothLevel(levelIndex, 1);
+        SmoothLevel(levelIndex, 0);
+    }
+}
+
+void MultigridPoissonGPU3D::VCycles(int count) {
+    if (levels.empty()) return;
+    computeShader->use();
+    for (int cycle = 0; cycle < count; ++cycle) VCycle(0, false);
+    CheckGLError("MultigridPoissonGPU3D::VCycles");
+}
+
+float MultigridPoissonGPU3D::ComputeMaxResidual() {
+    if (levels.empty()) return 0.0f;
+    ClearBuffer(maxResidualBuffer);
+    computeShader->use();
+    BindLevel(0);
+    Dispatch(Residual, static_cast<size_t>(dims.x) * dims.y);
+
+    GLuint bits = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, maxResidualBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &bits);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    CheckGLError("MultigridPoissonGPU3D::ComputeMaxResidual");
+    float largest;
+    std::memcpy(&largest, &bits, sizeof(float));
+    return largest;
+}
+
+MultigridPoisson3D::SolveStats MultigridPoissonGPU3D::Solve(const std::vector<float>& rhs, std::vector<float>& solution, float tolerance, int maxCycles) {
+    ScopedTimer timer("GPU/Multigrid Solve");
+    MultigridPoisson3D::SolveStats stats;
+    if (levels.empty()) return stats;
+    Upload(rhs, solution);
+
+    float initial = ComputeMaxResidual();
+    stats.initialResidual = initial;
+    if (initial > 0.0f) {
+        stats.error = 1.0f;
+        while (stats.iterations < maxCycles) {
+            stats.iterations++;
+            VCycles(1);
+            float remaining = ComputeMaxResidual();
+            stats.error = remaining / initial;
+            if (remaining <= tolerance * initial) break;
+        }
+    }
+    Download(solution);
+    return stats;
+}
+
+void MultigridPoissonGPU3D::ClearBuffer(GLuint buffer) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void MultigridPoissonGPU3D::CheckGLError(const std::string& operation) {
+    GLenum err;
+    while ((err = glGetError()) != GL_NO_ERROR) {
+        std::cerr << "OpenGL error during " << operation << ": " << std::hex << err << std::dec << std::endl;
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef MULTIGRID_POISSON_GPU_3D_H
+#define MULTIGRID_POISSON_GPU_3D_H
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ComputeShader.h"
+#include "MultigridPoisson3D.h"
+
+// GPU counterpart of MultigridPoisson3D: the same levels, smoother and transfers, run as
+// MultigridPoisson_3D.comp dispatches on one SSBO per level and vector. The levels are built on the
+// host by Configure with MultigridPoisson3D's helpers and uploaded once; after that a V-cycle
+// never waits for the GPU. Only the convergence check reads back, a single float.
+class MultigridPoissonGPU3D {
+public:
+    explicit MultigridPoissonGPU3D(const std::string& shaderPath = "shaders/MultigridPoisson_3D.comp");
+    ~MultigridPoissonGPU3D();
+
+    // Same as MultigridPoisson3D::Configure.
+    void Configure(const glm::ivec3& dims, const std::vector<uint8_t>& types,
+        MultigridPoisson3D::CellType outside = MultigridPoisson3D::Neumann);
+
+    // Natural-layout vectors of the finest level. An empty solution starts from zero.
+    void Upload(const std::vector<float>& rhs, const std::vector<float>& solution);
+    void Download(std::vector<float>& solution);
+    // V-cycles from the current solution, without waiting for them.
+    void VCycles(int count);
+    // Largest residual of the current solution; waits for the GPU.
+    float ComputeMaxResidual();
+    // Uploads, runs V-cycles until the largest residual falls to tolerance times the initial one or
+    // maxCycles, and downloads the solution.
+    MultigridPoisson3D::SolveStats Solve(const std::vector<float>& rhs, std::vector<float>& solution, float tolerance, int maxCycles);
+
+    // For passes that read or write the finest level in place
+    GLuint GetSolutionBuffer() const { return levels.empty() ? 0 : levels[0].solution; }
+    GLuint GetRhsBuffer() const { return levels.empty() ? 0 : levels[0].rhs; }
+    const glm::ivec3& GetDimensions() const { return dims; }
+    int GetLevelCount() const { return static_cast<int>(levels.size()); }
+
+    static const int NumThreads = 64;
+
+private:
+    enum Pass : unsigned int { Smooth = 0, Residual = 1, Restrict = 2, Prolongate = 3 };
+
+    struct Level {
+        glm::ivec3 dims;
+        GLuint diagonal;
+        GLuint solution;
+        GLuint rhs;
+        GLuint residual;
+        GLuint wallWeight;
+    };
+
+    void ReleaseLevels();
+    // Binds level and, when there is one, the next coarser level
+    void BindLevel(size_t levelIndex);
+    void Dispatch(Pass pass, size_t threads);
+    void SmoothLevel(size_t levelIndex, int colour);
+    void VCycle(size_t levelIndex, bool zeroGuess);
+    void ClearBuffer(GLuint buffer);
+    void CheckGLError(const std::string& operation);
+
+    ComputeShader* computeShader;
+    glm::ivec3 dims;
+    std::vector<Level> levels;
+    // Host copy of the finest diagonals, to zero the uploads outside the solved cells
+    std::vector<float> fineDiagonal;
+    GLuint maxResidualBuffer;
+};
+
+#endif // MULTIGRID_POISSON_GPU_3D_H
@@ -1 +1,151 @@
 #include "Octree.h"
+#include <algorithm>
+#include <limits>
+
+#include "Morton.h"
+
+namespace {
+    const uint32_t GridSize = 1u << Octree::MaxLevel;
+    const size_t NodeGrain = 64;
+
+    struct PointBounds {
+        glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+    };
+}
+
+Octree::Octree(TaskScheduler& scheduler) : scheduler(scheduler), radixSort(scheduler), depth(0) {}
+
+void Octree::Clear() {
+    nodes.clear();
+    sortedPoints.clear();
+    pointIndices.clear();
+    keys.clear();
+    depth = 0;
+}
+
+void Octree::Build(const std::vector<glm::vec3>& points, uint32_t leafCapacity) {
+    Clear();
+    size_t count = points.size();
+    if (count == 0) return;
+
+    PointBounds bounds = scheduler.ParallelReduce(size_t(0), count, PointGrain, PointBounds(),
+        [&](size_t begin, size_t end) {
+            PointBounds chunk;
+            for (size_t i = begin; i < end; ++i) {
+                chunk.boundsMin = glm::min(chunk.boundsMin, points[i]);
+                chunk.boundsMax = glm::max(chunk.boundsMax, points[i]);
+            }
+            return chunk;
+        },
+        [](const PointBounds& a, const PointBounds& b) {
+            PointBounds combined;
+            combined.boundsMin = glm::min(a.boundsMin, b.boundsMin);
+            combined.boundsMax = glm::max(a.boundsMax, b.boundsMax);
+            return combined;
+        });
+    glm::vec3 extent = bounds.boundsMax - bounds.boundsMin;
+    float cube = std::max(extent.x, std::max(extent.y, extent.z));
+    if (cube <= 0.0f) cube = 1.0f;
+    float scale = static_cast<float>(GridSize) / cube;
+
+    keys.resize(count);
+    pointIndices.resize(count);
+    scheduler.ParallelFor(0, count, PointGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec3 cell = glm::clamp((points[i] - bounds.boundsMin) * scale, 0.0f, static_cast<float>(GridSize - 1));
+            keys[i] = Morton::Encode3D(static_cast<uint32_t>(cell.x), static_cast<uint32_t>(cell.y), static_cast<uint32_t>(cell.z));
+            pointIndices[i] = static_cast<uint32_t>(i);
+        }
+    });
+    radixSort.Sort(keys, pointIndices, 3 * MaxLevel);
+
+    sortedPoints.resize(count);
+    scheduler.ParallelFor(0, count, PointGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) sortedPoints[i] = points[pointIndices[i]];
+    });
+
+    BuildLevels(leafCapacity, bounds.boundsMin, cube);
+}
+
+void Octree::BuildLevels(uint32_t leafCapacity, const glm::vec3& origin, float cube) {
+    // Quantization rounds, so every box is padded a little to keep its points inside
+    float padding = cube * 1e-5f;
+    Node root = Node();
+    root.boundsMin = origin - padding;
+    root.size = cube + 2.0f * padding;
+    root.pointCount = static_cast<uint32_t>(keys.size());
+    nodes.push_back(root);
+
+    // First sorted point of each octant of each node in the level, plus the end of the last one
+    std::vector<uint32_t> octantStarts;
+    std::vector<uint32_t> childOffsets;
+
+    size_t levelBegin = 0;
+    size_t levelEnd = 1;
+    for (int level = 0; levelBegin < levelEnd; ++level) {
+        depth = level;
+        size_t levelCount = levelEnd - levelBegin;
+        octantStarts.resize(levelCount * 9);
+        childOffsets.resize(levelCount + 1);
+
+        // Octant boundaries by binary search on the next three key bits
+        uint32_t shift = 3 * static_cast<uint32_t>(MaxLevel - level - 1);
+        scheduler.ParallelFor(0, levelCount, NodeGrain, [&](size_t begin, size_t end) {
+            for (size_t n = begin; n < end; ++n) {
+                Node& node = nodes[levelBegin + n];
+                node.childMask = 0;
+                node.childCount = 0;
+                node.firstChild = 0;
+                if (node.pointCount <= leafCapacity || level >= MaxLevel) continue;
+
+                const uint32_t* first = keys.data() + node.firstPoint;
+                const uint32_t* last = first + node.pointCount;
+                uint32_t* starts = octantStarts.data() + n * 9;
+                const uint32_t* cursor = first;
+                for (uint32_t octant = 0; octant < 8; ++octant) {
+                    starts[octant] = static_cast<uint32_t>(cursor - keys.data());
+                    cursor = std::partition_point(cursor, last, [&](uint32_t key) { return ((key >> shift) & 7u) <= octant; });
+                    if (keys.data() + starts[octant] != cursor) {
+                        node.childMask |= static_cast<uint8_t>(1u << octant);
+                        ++node.childCount;
+                    }
+                }
+                starts[8] = static_cast<uint32_t>(last - keys.data());
+            }
+        });
+
+        childOffsets[0] = 0;
+        for (size_t n = 0; n < levelCount; ++n) childOffsets[n + 1] = childOffsets[n] + nodes[levelBegin + n].childCount;
+        if (childOffsets[levelCount] == 0) break;
+        nodes.resize(levelEnd + childOffsets[levelCount]);
+
+        float childSize = cube / static_cast<float>(2u << level) + 2.0f * padding;
+        scheduler.ParallelFor(0, levelCount, NodeGrain, [&](size_t begin, size_t end) {
+            for (size_t n = begin; n < end; ++n) {
+                Node& node = nodes[levelBegin + n];
+                if (node.childCount == 0) continue;
+                node.firstChild = static_cast<uint32_t>(levelEnd + childOffsets[n]);
+                const uint32_t* starts = octantStarts.data() + n * 9;
+                uint32_t child = node.firstChild;
+                for (uint32_t octant = 0; octant < 8; ++octant) {
+                    if ((node.childMask & (1u << octant)) == 0) continue;
+                    Node& childNode = nodes[child++];
+                    childNode = Node();
+                    childNode.firstPoint = starts[octant];
+                    childNode.pointCount = starts[octant + 1] - starts[octant];
+                    childNode.level = static_cast<uint8_t>(level + 1);
+                    // The child's cell is the key prefix of any of its points
+                    uint32_t x, y, z;
+                    Morton::Decode3D(keys[childNode.firstPoint] >> shift << shift, x, y, z);
+                    glm::vec3 cell = glm::vec3(x, y, z) / static_cast<float>(GridSize);
+                    childNode.boundsMin = origin + cell * cube - padding;
+                    childNode.size = childSize;
+                }
+            }
+        });
+
+        levelBegin = levelEnd;
+        levelEnd = nodes.size();
+    }
+}
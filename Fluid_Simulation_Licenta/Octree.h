@@ -1,57 +1,132 @@
 #ifndef OCTREE_H
 #define OCTREE_H
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
-#include <memory>
-#include <iostream>
+#include <glm/glm.hpp>
 
-struct Point3D {
-    float x, y, z;
+#include "RadixSort.h"
+#include "TaskScheduler.h"
 
-    Point3D(float x, float y, float z) : x(x), y(y), z(z) {}
-};
+// Linear octree over a point set. Points are quantized to a 1024^3 grid over their bounding cube,
+// Morton encoded in parallel and radix sorted, so every node is a contiguous range of the sorted
+// points. Nodes are built level by level from the sorted keys into one array: the children of a
+// node are stored next to each other, in octant order, and empty octants get no node.
+// Queries walk the array with a fixed stack and hand every point found to a visitor, so they never
+// allocate and can run from many threads at once.
+class Octree {
+public:
+    struct Node {
+        glm::vec3 boundsMin;
+        float size;
+        // Range of the node's points in sorted order
+        uint32_t firstPoint;
+        uint32_t pointCount;
+        // Index of the first child; 0 for leaves, since the root is never a child
+        uint32_t firstChild;
+        // Bit o is set when octant o (x in bit 0, y in bit 1, z in bit 2) has a child
+        uint8_t childMask;
+        uint8_t childCount;
+        uint8_t level;
+    };
 
-struct AABB3D {
-    Point3D center;
-    float halfDimension;
+    explicit Octree(TaskScheduler& scheduler = TaskScheduler::Instance());
 
-    AABB3D(Point3D center, float halfDimension) : center(center), halfDimension(halfDimension) {}
+    // Rebuilds the tree over points. Nodes with at most leafCapacity points are not split.
+    void Build(const std::vector<glm::vec3>& points, uint32_t leafCapacity = DefaultLeafCapacity);
+    void Clear();
 
-    bool contains(Point3D point) const {
-        return (point.x >= center.x - halfDimension &&
-            point.x <= center.x + halfDimension &&
-            point.y >= center.y - halfDimension &&
-            point.y <= center.y + halfDimension &&
-            point.z >= center.z - halfDimension &&
-            point.z <= center.z + halfDimension);
-    }
+    // Calls visit(index, position) for every point inside [boundsMin, boundsMax], where index is
+    // the point's position in the array given to Build.
+    template <typename Visitor>
+    void QueryRange(const glm::vec3& boundsMin, const glm::vec3& boundsMax, Visitor&& visit) const;
+    // Calls visit(index, position) for every point within radius of centre.
+    template <typename Visitor>
+    void QueryRadius(const glm::vec3& centre, float radius, Visitor&& visit) const;
 
-    bool intersects(const AABB3D& other) const {
-        return !(other.center.x - other.halfDimension > center.x + halfDimension ||
-            other.center.x + other.halfDimension < center.x - halfDimension ||
-            other.center.y - other.halfDimension > center.y + halfDimension ||
-            other.center.y + other.halfDimension < center.y - halfDimension ||
-            other.center.z - other.halfDimension > center.z + halfDimension ||
-            other.center.z + other.halfDimension < center.z - halfDimension);
-    }
-};
-
-class Octree {
-public:
-    Octree(AABB3D boundary, int capacity);
-    ~Octree();
+    bool IsEmpty() const { return nodes.empty(); }
+    const std::vector<Node>& GetNodes() const { return nodes; }
+    const std::vector<glm::vec3>& GetSortedPoints() const { return sortedPoints; }
+    const std::vector<uint32_t>& GetPointIndices() const { return pointIndices; }
+    int GetDepth() const { return depth; }
 
-    bool insert(Point3D point);
-    void subdivide();
-    std::vector<Point3D> queryRange(AABB3D range);
-    void print() const;
+    static const uint32_t DefaultLeafCapacity = 16;
+    static const int MaxLevel = 10;
+    static const size_t PointGrain = 4096;
+    // Traversal stack that any walk over the nodes needs: every level adds at most 7 siblings
+    static const int StackSize = 7 * MaxLevel + 1;
 
 private:
-    AABB3D boundary;
-    int capacity;
-    std::vector<Point3D> points;
-    bool divided;
-    std::unique_ptr<Octree> children[8];
+
+    // Splits the nodes of one level after the other, starting from the root over the grid cube at origin.
+    void BuildLevels(uint32_t leafCapacity, const glm::vec3& origin, float cube);
+
+    TaskScheduler& scheduler;
+    RadixSort radixSort;
+    std::vector<Node> nodes;
+    std::vector<glm::vec3> sortedPoints;
+    std::vector<uint32_t> pointIndices;
+    std::vector<uint32_t> keys;
+    int depth;
 };
 
+template <typename Visitor>
+void Octree::QueryRange(const glm::vec3& boundsMin, const glm::vec3& boundsMax, Visitor&& visit) const {
+    if (nodes.empty()) return;
+    uint32_t stack[StackSize];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const Node& node = nodes[stack[--stackSize]];
+        glm::vec3 nodeMax = node.boundsMin + node.size;
+        if (glm::any(glm::greaterThan(node.boundsMin, boundsMax)) || glm::any(glm::lessThan(nodeMax, boundsMin))) continue;
+
+        uint32_t last = node.firstPoint + node.pointCount;
+        if (glm::all(glm::greaterThanEqual(node.boundsMin, boundsMin)) && glm::all(glm::lessThanEqual(nodeMax, boundsMax))) {
+            // Entirely inside: every point is a hit
+            for (uint32_t i = node.firstPoint; i < last; ++i) visit(pointIndices[i], sortedPoints[i]);
+        }
+        else if (node.childCount == 0) {
+            for (uint32_t i = node.firstPoint; i < last; ++i) {
+                const glm::vec3& point = sortedPoints[i];
+                if (glm::all(glm::greaterThanEqual(point, boundsMin)) && glm::all(glm::lessThanEqual(point, boundsMax))) visit(pointIndices[i], point);
+            }
+        }
+        else {
+            for (uint32_t c = node.childCount; c > 0; --c) stack[stackSize++] = node.firstChild + c - 1;
+        }
+    }
+}
+
+template <typename Visitor>
+void Octree::QueryRadius(const glm::vec3& centre, float radius, Visitor&& visit) const {
+    if (nodes.empty()) return;
+    float sqrRadius = radius * radius;
+    uint32_t stack[StackSize];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const Node& node = nodes[stack[--stackSize]];
+        glm::vec3 nodeMax = node.boundsMin + node.size;
+        glm::vec3 nearest = glm::clamp(centre, node.boundsMin, nodeMax);
+        if (glm::dot(nearest - centre, nearest - centre) > sqrRadius) continue;
+
+        uint32_t last = node.firstPoint + node.pointCount;
+        glm::vec3 farthest = glm::max(glm::abs(node.boundsMin - centre), glm::abs(nodeMax - centre));
+        if (glm::dot(farthest, farthest) <= sqrRadius) {
+            for (uint32_t i = node.firstPoint; i < last; ++i) visit(pointIndices[i], sortedPoints[i]);
+        }
+        else if (node.childCount == 0) {
+            for (uint32_t i = node.firstPoint; i < last; ++i) {
+                glm::vec3 offset = sortedPoints[i] - centre;
+                if (glm::dot(offset, offset) <= sqrRadius) visit(pointIndices[i], sortedPoints[i]);
+            }
+        }
+        else {
+            for (uint32_t c = node.childCount; c > 0; --c) stack[stackSize++] = node.firstChild + c - 1;
+        }
+    }
+}
+
 #endif // OCTREE_H
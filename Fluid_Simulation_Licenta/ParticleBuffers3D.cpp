@@ -1,11 +1,16 @@
 #include "ParticleBuffers3D.h"
+#include <algorithm>
 
-ParticleBuffers3D::ParticleBuffers3D(size_t particleCount, ComputeShader* computeShader)
-    : particleCount(particleCount), computeShader(computeShader) {
-    InitBuffers(particleCount);
+ParticleBuffers3D::ParticleBuffers3D(size_t particleCount, ComputeShader* computeShader, size_t capacity)
+    : particleCount(particleCount), capacity(0), countChangedOnGpu(false), computeShader(computeShader) {
+    InitBuffers(particleCount, capacity);
 }
 
 ParticleBuffers3D::~ParticleBuffers3D() {
+    ReleaseBuffers();
+}
+
+void ParticleBuffers3D::ReleaseBuffers() {
     glDeleteBuffers(1, &positionsBuffer);
     glDeleteBuffers(1, &predictedPositionsBuffer);
     glDeleteBuffers(1, &velocitiesBuffer);
@@ -13,10 +18,20 @@ ParticleBuffers3D::~ParticleBuffers3D() {
     glDeleteBuffers(1, &spatialIndicesBuffer);
     glDeleteBuffers(1, &spatialOffsetsBuffer);
     glDeleteBuffers(1, &debugBuffer);
+    glDeleteBuffers(1, &countBuffer);
+}
+
+void ParticleBuffers3D::EnsureCapacity(size_t count) {
+    if (count > capacity) {
+        ReleaseBuffers();
+        InitBuffers(count);
+    }
+    SetParticleCount(count);
 }
 
-void ParticleBuffers3D::InitBuffers(size_t particleCount) {
+void ParticleBuffers3D::InitBuffers(size_t particleCount, size_t capacity) {
     this->particleCount = particleCount;
+    this->capacity = std::max(particleCount, capacity);
     std::cout << "Initializing buffers..." << std::endl;
 
     if (!glewIsSupported("GL_VERSION_4_3")) {
@@ -41,13 +56,16 @@ void ParticleBuffers3D::InitBuffers(size_t particleCount) {
         CheckGLError("BindBase " + bufferName + "Buffer");
         };
 
-    initBuffer(positionsBuffer, 0, particleCount * sizeof(glm::vec3), "positions");
-    initBuffer(predictedPositionsBuffer, 1, particleCount * sizeof(glm::vec3), "predictedPositions");
-    initBuffer(velocitiesBuffer, 2, particleCount * sizeof(glm::vec3), "velocities");
-    initBuffer(densitiesBuffer, 3, particleCount * sizeof(glm::vec2), "densities");
-    initBuffer(spatialIndicesBuffer, 4, particleCount * sizeof(glm::uvec3), "spatialIndices");
-    initBuffer(spatialOffsetsBuffer, 5, particleCount * sizeof(glm::uint), "spatialOffsets");
-    initBuffer(debugBuffer, 6, particleCount * 8 * sizeof(glm::uint), "debug");
+    initBuffer(positionsBuffer, 0, this->capacity * sizeof(glm::vec3), "positions");
+    initBuffer(predictedPositionsBuffer, 1, this->capacity * sizeof(glm::vec3), "predictedPositions");
+    initBuffer(velocitiesBuffer, 2, this->capacity * sizeof(glm::vec3), "velocities");
+    initBuffer(densitiesBuffer, 3, this->capacity * sizeof(glm::vec2), "densities");
+    initBuffer(spatialIndicesBuffer, 4, this->capacity * sizeof(glm::uvec3), "spatialIndices");
+    initBuffer(spatialOffsetsBuffer, 5, this->capacity * sizeof(glm::uint), "spatialOffsets");
+    initBuffer(debugBuffer, 6, this->capacity * 8 * sizeof(glm::uint), "debug");
+    initBuffer(countBuffer, 7, 8 * sizeof(GLuint), "count");
+    countChangedOnGpu = false;
+    WriteCountBuffer();
 
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     std::cout << "Buffers initialized successfully." << std::endl;
@@ -83,9 +101,11 @@ void ParticleBuffers3D::UpdateSpatialData(const std::vector<glm::uvec3>& spatial
 }
 
 void ParticleBuffers3D::UpdateAllBuffers(const ParticleData3D& particleData) {
+    EnsureCapacity(particleData.positions.size());
+
     auto updateBuffer = [&](GLuint buffer, const auto& data, const std::string& errorMsg) {
         glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, data.size() * sizeof(data[0]), data.data(), GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, data.size() * sizeof(data[0]), data.data());
         CheckGLError(errorMsg);
         };
 
@@ -99,11 +119,34 @@ void ParticleBuffers3D::UpdateAllBuffers(const ParticleData3D& particleData) {
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
+void ParticleBuffers3D::UpdateRange(const ParticleData3D& particleData, size_t first, size_t count) {
+    if (first + count > capacity) {
+        std::cerr << "ParticleBuffers3D::UpdateRange Error: Slots up to " << first + count << " exceed the capacity of " << capacity << std::endl;
+        return;
+    }
+    SetParticleCount(std::max(GetParticleCount(), first + count));
+
+    auto updateRange = [&](GLuint buffer, const auto& data, const std::string& errorMsg) {
+        const size_t elementSize = sizeof(data[0]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * elementSize, count * elementSize, data.data() + first);
+        CheckGLError(errorMsg);
+        };
+
+    updateRange(positionsBuffer, particleData.positions, "Update range of positionsBuffer");
+    updateRange(predictedPositionsBuffer, particleData.predictedPositions, "Update range of predictedPositionsBuffer");
+    updateRange(velocitiesBuffer, particleData.velocities, "Update range of velocitiesBuffer");
+    updateRange(densitiesBuffer, particleData.densities, "Update range of densitiesBuffer");
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
 void ParticleBuffers3D::RetrieveData(std::vector<glm::vec3>& positions, std::vector<glm::vec3>& velocities, std::vector<glm::vec3>& predictedPositions, std::vector<glm::vec2>& densities) {
-    positions.resize(particleCount);
-    velocities.resize(particleCount);
-    predictedPositions.resize(particleCount);
-    densities.resize(particleCount);
+    size_t count = GetParticleCount();
+    positions.resize(count);
+    velocities.resize(count);
+    predictedPositions.resize(count);
+    densities.resize(count);
 
     auto retrieveBufferData = [this](GLuint buffer, auto& data, const std::string& bufferName) {
         using ValueType = typename std::remove_reference<decltype(data)>::type::value_type;
@@ -128,8 +171,9 @@ void ParticleBuffers3D::RetrieveData(std::vector<glm::vec3>& positions, std::vec
 }
 
 void ParticleBuffers3D::RetrieveSpatialData(std::vector<glm::uvec3>& spatialIndices, std::vector<glm::uint>& spatialOffsets) {
-    spatialIndices.resize(particleCount);
-    spatialOffsets.resize(particleCount);
+    size_t count = GetParticleCount();
+    spatialIndices.resize(count);
+    spatialOffsets.resize(count);
 
     auto retrieveBufferData = [this](GLuint buffer, auto& data, const std::string& bufferName) {
         using ValueType = typename std::remove_reference<decltype(data)>::type::value_type;
@@ -151,6 +195,68 @@ void ParticleBuffers3D::RetrieveSpatialData(std::vector<glm::uvec3>& spatialIndi
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
+void ParticleBuffers3D::BindParticleBuffers() {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionsBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, predictedPositionsBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, velocitiesBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, densitiesBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, spatialIndicesBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, spatialOffsetsBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, debugBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, countBuffer);
+    CheckGLError("ParticleBuffers3D::BindParticleBuffers");
+}
+
+void ParticleBuffers3D::SetParticleCount(size_t count) {
+    if (count > capacity) {
+        std::cerr << "ParticleBuffers3D::SetParticleCount Error: " << count << " particles exceed the capacity of " << capacity << std::endl;
+        count = capacity;
+    }
+    particleCount = count;
+    countChangedOnGpu = false;
+    WriteCountBuffer();
+}
+
+size_t ParticleBuffers3D::GetParticleCount() {
+    if (countChangedOnGpu) {
+        GLuint count = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 3 * sizeof(GLuint), sizeof(GLuint), &count);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        CheckGLError("ParticleBuffers3D::GetParticleCount");
+        particleCount = count;
+        countChangedOnGpu = false;
+    }
+    return particleCount;
+}
+
+void ParticleBuffers3D::WriteCountBuffer() {
+    GLuint count = static_cast<GLuint>(particleCount);
+    GLuint command[8] = {
+        (count + DispatchGroupSize - 1) / DispatchGroupSize, 1, 1, count,
+        count, 1, 0, 0
+    };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(command), command);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    CheckGLError("ParticleBuffers3D::WriteCountBuffer");
+}
+
+GLuint ParticleBuffers3D::SwapColumn(Column column, GLuint replacement) {
+    GLuint* target = nullptr;
+    GLuint binding = 0;
+    switch (column) {
+    case Column::Positions: target = &positionsBuffer; binding = 0; break;
+    case Column::PredictedPositions: target = &predictedPositionsBuffer; binding = 1; break;
+    case Column::Velocities: target = &velocitiesBuffer; binding = 2; break;
+    case Column::Densities: target = &densitiesBuffer; binding = 3; break;
+    }
+    GLuint previous = *target;
+    *target = replacement;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, replacement);
+    return previous;
+}
+
 GLuint ParticleBuffers3D::GetSpatialOffsetsBuffer() const {
     return spatialOffsetsBuffer;
 }
@@ -182,7 +288,7 @@ void ParticleBuffers3D::CheckGLError(const std::string& operation) {
 }
 
 void ParticleBuffers3D::RetrieveDebugData(std::vector<glm::uint>& debugValues) {
-    debugValues.resize(particleCount * 8);
+    debugValues.resize(GetParticleCount() * 8);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, debugBuffer);
     glm::uint* debugValuesPtr = (glm::uint*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, debugValues.size() * sizeof(glm::uint), GL_MAP_READ_BIT);
     if (debugValuesPtr) {
@@ -208,3 +314,110 @@ void ParticleBuffers3D::useComputeShader() {
         std::cerr << "Compute shader program is not currently active." << std::endl;
     }
 }
+
+bool ParticleBuffers3D::StreamBufferToCheckpoint(CheckpointWriter& writer, GLuint buffer, uint32_t tag, size_t elementSize) {
+    size_t totalBytes = particleCount * elementSize;
+    if (!writer.BeginChunk(tag, static_cast<uint32_t>(elementSize), totalBytes)) return false;
+
+    size_t blockSize = std::min(StagingBlockSize, std::max<size_t>(totalBytes, 1));
+    GLuint staging[2];
+    GLsync fences[2] = { nullptr, nullptr };
+    size_t blockBytes[2] = { 0, 0 };
+    glGenBuffers(2, staging);
+    for (GLuint stagingBuffer : staging) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, stagingBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, blockSize, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+
+    auto issueCopy = [&](int slot, size_t offset) {
+        blockBytes[slot] = std::min(blockSize, totalBytes - offset);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, staging[slot]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, 0, blockBytes[slot]);
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    };
+
+    bool ok = true;
+    size_t issued = 0;
+    if (totalBytes > 0) {
+        issueCopy(0, 0);
+        issued = blockBytes[0];
+    }
+    for (int slot = 0; ok && fences[slot]; slot ^= 1) {
+        // Queue the next block before waiting on this one
+        if (issued < totalBytes) {
+            issueCopy(slot ^ 1, issued);
+            issued += blockBytes[slot ^ 1];
+        }
+
+        glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fences[slot]);
+        fences[slot] = nullptr;
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, staging[slot]);
+        const void* mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, blockBytes[slot], GL_MAP_READ_BIT);
+        if (!mapped) {
+            std::cerr << "ParticleBuffers3D::StreamBufferToCheckpoint Error: Failed to map staging buffer" << std::endl;
+            ok = false;
+        }
+        else {
+            ok = writer.Write(mapped, blockBytes[slot]);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+    }
+
+    for (GLsync fence : fences) {
+        if (fence) glDeleteSync(fence);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(2, staging);
+    CheckGLError("StreamBufferToCheckpoint");
+
+    return ok && writer.EndChunk();
+}
+
+bool ParticleBuffers3D::WriteCheckpointColumns(CheckpointWriter& writer) {
+    if (writer.GetState().particleCount != GetParticleCount()) {
+        std::cerr << "ParticleBuffers3D::WriteCheckpointColumns Error: Checkpoint expects " << writer.GetState().particleCount
+            << " particles, the buffers hold " << particleCount << std::endl;
+        return false;
+    }
+
+    return StreamBufferToCheckpoint(writer, positionsBuffer, Checkpoint3D::Positions, sizeof(glm::vec3))
+        && StreamBufferToCheckpoint(writer, velocitiesBuffer, Checkpoint3D::Velocities, sizeof(glm::vec3))
+        && StreamBufferToCheckpoint(writer, predictedPositionsBuffer, Checkpoint3D::PredictedPositions, sizeof(glm::vec3))
+        && StreamBufferToCheckpoint(writer, densitiesBuffer, Checkpoint3D::Densities, sizeof(glm::vec2));
+}
+
+bool ParticleBuffers3D::LoadCheckpointColumns(const CheckpointReader& reader) {
+    size_t count = static_cast<size_t>(reader.GetState().particleCount);
+    const unsigned char* positions = reader.GetColumn(Checkpoint3D::Positions, sizeof(glm::vec3));
+    if (!positions) {
+        std::cerr << "ParticleBuffers3D::LoadCheckpointColumns Error: Checkpoint has no positions" << std::endl;
+        return false;
+    }
+
+    EnsureCapacity(count);
+
+    // The mapped pages go straight to the driver; there is no copy on the host
+    auto uploadColumn = [&](GLuint buffer, const unsigned char* data, size_t elementSize, const std::string& bufferName) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        if (data) {
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * elementSize, data);
+        }
+        else {
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, nullptr);
+        }
+        CheckGLError("Load " + bufferName + "Buffer");
+    };
+
+    const unsigned char* predicted = reader.GetColumn(Checkpoint3D::PredictedPositions, sizeof(glm::vec3));
+    uploadColumn(positionsBuffer, positions, sizeof(glm::vec3), "positions");
+    uploadColumn(velocitiesBuffer, reader.GetColumn(Checkpoint3D::Velocities, sizeof(glm::vec3)), sizeof(glm::vec3), "velocities");
+    uploadColumn(predictedPositionsBuffer, predicted ? predicted : positions, sizeof(glm::vec3), "predictedPositions");
+    uploadColumn(densitiesBuffer, reader.GetColumn(Checkpoint3D::Densities, sizeof(glm::vec2)), sizeof(glm::vec2), "densities");
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return true;
+}
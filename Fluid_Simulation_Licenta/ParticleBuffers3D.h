@@ -7,29 +7,71 @@
 #include <iostream>
 #include "ParticleData.h"
 #include "ComputeShader.h"
+#include "Checkpoint3D.h"
 
 class ParticleBuffers3D {
 public:
-    ParticleBuffers3D(size_t particleCount, ComputeShader* computeShader);
+    enum class Column { Positions, PredictedPositions, Velocities, Densities };
+
+    // capacity sizes the SSBOs up front; the buffers only grow when more particles than that arrive.
+    ParticleBuffers3D(size_t particleCount, ComputeShader* computeShader, size_t capacity = 0);
     ~ParticleBuffers3D();
 
-    void InitBuffers(size_t particleCount);
+    void InitBuffers(size_t particleCount, size_t capacity = 0);
 
     void UpdateData(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& velocities, const std::vector<glm::vec3>& predictedPositions, const std::vector<glm::vec2>& densities);
     void UpdateSpatialData(const std::vector<glm::uvec3>& spatialIndices, const std::vector<glm::uint>& spatialOffsets);
     void UpdateAllBuffers(const ParticleData3D& particleData);
+    // Uploads slots [first, first + count) of the particle columns, e.g. freshly emitted particles.
+    void UpdateRange(const ParticleData3D& particleData, size_t first, size_t count);
     void RetrieveData(std::vector<glm::vec3>& positions, std::vector<glm::vec3>& velocities, std::vector<glm::vec3>& predictedPositions, std::vector<glm::vec2>& densities);
     void RetrieveSpatialData(std::vector<glm::uvec3>& spatialIndices, std::vector<glm::uint>& spatialOffsets);
+    // Rebinds every SSBO to the binding InitBuffers gave it, after other passes have taken some over.
+    void BindParticleBuffers();
     GLuint GetSpatialOffsetsBuffer() const;
     GLuint GetSpatialIndicesBuffer() const;
+    // Current column buffers; SwapColumn may replace them between steps.
+    GLuint GetPositionsBuffer() const { return positionsBuffer; }
+    GLuint GetVelocitiesBuffer() const { return velocitiesBuffer; }
+    // Live count plus the indirect dispatch (offset 0) and draw (offset DrawCommandOffset) arguments,
+    // bound to binding 7. See shaders/particleCount_3D.glsl.
+    GLuint GetCountBuffer() const { return countBuffer; }
+    // Puts replacement in place of column and returns the old buffer, for passes that write a new column elsewhere.
+    GLuint SwapColumn(Column column, GLuint replacement);
     void DebugBufferData();
     void CheckGLError(const std::string& operation);
 
     void RetrieveDebugData(std::vector<glm::uint>& debugValues);
 
+    // Streams the particle columns into the checkpoint through two staging buffers, so the
+    // copy of the next block on the GPU overlaps with writing the current one to disk.
+    bool WriteCheckpointColumns(CheckpointWriter& writer);
+    // Uploads the columns straight from the mapped checkpoint, resizing the buffers if needed.
+    bool LoadCheckpointColumns(const CheckpointReader& reader);
+    // Live count. After a GPU pass changed it this reads it back, which waits for the GPU.
+    size_t GetParticleCount();
+    size_t GetCapacity() const { return capacity; }
+    // Sets the live count from the host, keeping the contents, so it is limited to the capacity.
+    void SetParticleCount(size_t count);
+    // Called by passes that change the count in the count buffer; the next GetParticleCount reads it back.
+    void MarkCountChangedOnGpu() { countChangedOnGpu = true; }
+
     void useComputeShader();
 
+    // Threads per group the simulation kernels are dispatched with
+    static const GLuint DispatchGroupSize = 64;
+    static const GLintptr DrawCommandOffset = 4 * sizeof(GLuint);
+
 private:
+    void ReleaseBuffers();
+    // Makes room for count particles, reallocating (and losing the contents) only past the capacity.
+    void EnsureCapacity(size_t count);
+    // Uploads particleCount and the matching indirect arguments.
+    void WriteCountBuffer();
+    bool StreamBufferToCheckpoint(CheckpointWriter& writer, GLuint buffer, uint32_t tag, size_t elementSize);
+
+    static const size_t StagingBlockSize = size_t(16) << 20;
+
     GLuint positionsBuffer;
     GLuint predictedPositionsBuffer;
     GLuint velocitiesBuffer;
@@ -37,8 +79,11 @@ private:
     GLuint spatialIndicesBuffer;
     GLuint spatialOffsetsBuffer;
     GLuint debugBuffer;
+    GLuint countBuffer;
 
     size_t particleCount;
+    size_t capacity;
+    bool countChangedOnGpu;
 
     ComputeShader* computeShader;
 };
@@ -3,7 +3,6 @@
 
 #include <glm/glm.hpp>
 #include <vector>
-#include <GL/glew.h>
 
 struct ParticleData {
     std::vector<glm::vec2> positions;
@@ -11,7 +10,7 @@ struct ParticleData {
     std::vector<glm::vec2> predictedPositions;
     std::vector<glm::vec2> densities;
     std::vector<glm::uvec3> spatialIndices;
-    std::vector<GLuint> spatialOffsets;
+    std::vector<glm::uint> spatialOffsets;
 };
 
 
@@ -21,7 +20,7 @@ struct ParticleData3D {
     std::vector<glm::vec3> predictedPositions;
     std::vector<glm::vec2> densities;
     std::vector<glm::uvec3> spatialIndices;
-    std::vector<GLuint> spatialOffsets;
+    std::vector<glm::uint> spatialOffsets;
 };
 
 #endif // PARTICLE_DATA_H
@@ -0,0 +1,105 @@
+#include "ParticleEmitters3D.h"
+#include <algorithm>
+#include <cmath>
+
+#include "Philox.h"
+
+namespace {
+    // Second key word, so emitter draws never repeat the spawn jitter of the same seed
+    const uint32_t EmitKey = 0x454D4954u;
+}
+
+ParticleEmitters3D::ParticleEmitters3D(const Scene3D& scene, TaskScheduler& scheduler)
+    : scheduler(scheduler), emitters(scene.emitters), sinks(scene.sinks), seed(scene.seed), pool(scheduler), lastRemoved(0) {
+    pool.SetMaxParticleCount(static_cast<size_t>(scene.GetMaxParticleCount()));
+}
+
+uint32_t ParticleEmitters3D::EmittedBefore(const Emitter3D& emitter, double time) {
+    double stop = emitter.stopTime < 0.0f ? time : std::min(time, static_cast<double>(emitter.stopTime));
+    double active = std::max(0.0, stop - emitter.startTime);
+    return static_cast<uint32_t>(std::min(std::floor(active * emitter.rate), 4294967295.0));
+}
+
+glm::vec3 ParticleEmitters3D::EmitPosition(const Emitter3D& emitter, uint32_t emitterIndex, uint32_t serial, uint32_t seed, float deltaTime) {
+    glm::vec3 direction = emitter.direction;
+    glm::vec3 helper = std::abs(direction.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    glm::vec3 u = glm::normalize(glm::cross(helper, direction));
+    glm::vec3 v = glm::cross(direction, u);
+
+    // Uniform over the disc: the square root keeps the density flat towards the rim
+    Philox4x32 random = Philox4x32::Generate(serial, emitterIndex, 0, 0, seed, EmitKey);
+    float radius = emitter.radius * std::sqrt(Philox4x32::ToUnitFloat(random.v[0]));
+    float angle = 6.28318530718f * Philox4x32::ToUnitFloat(random.v[1]);
+    float along = Philox4x32::ToUnitFloat(random.v[2]) * emitter.speed * deltaTime;
+    return emitter.position + (u * std::cos(angle) + v * std::sin(angle)) * radius + direction * along;
+}
+
+bool ParticleEmitters3D::InsideSink(const Sink3D& sink, const glm::vec3& position) {
+    glm::vec3 offset = glm::abs(position - sink.centre);
+    return glm::all(glm::lessThanEqual(offset, sink.size * 0.5f));
+}
+
+const std::vector<ParticleEmitters3D::Batch>& ParticleEmitters3D::Advance(double time, float deltaTime) {
+    batches.clear();
+    for (size_t e = 0; e < emitters.size(); ++e) {
+        uint32_t first = EmittedBefore(emitters[e], time);
+        uint32_t last = EmittedBefore(emitters[e], time + deltaTime);
+        if (last > first) {
+            Batch batch = { static_cast<uint32_t>(e), first, last - first };
+            batches.push_back(batch);
+        }
+    }
+    return batches;
+}
+
+bool ParticleEmitters3D::Update(ParticleData3D& particleData, std::vector<uint32_t>* ids, double time, float deltaTime) {
+    if (pool.GetCapacity() < pool.GetMaxParticleCount()) pool.Reserve(particleData, pool.GetMaxParticleCount());
+    size_t count = particleData.positions.size();
+    bool changed = false;
+    lastRemoved = 0;
+
+    if (!sinks.empty() && count > 0) {
+        removeFlags.resize(count);
+        size_t inside = scheduler.ParallelReduce(size_t(0), count, ParticleGrain, size_t(0),
+            [&](size_t begin, size_t end) {
+                size_t found = 0;
+                for (size_t i = begin; i < end; ++i) {
+                    bool remove = false;
+                    for (const Sink3D& sink : sinks) remove = remove || InsideSink(sink, particleData.positions[i]);
+                    removeFlags[i] = remove ? 1 : 0;
+                    found += remove ? 1 : 0;
+                }
+                return found;
+            },
+            [](size_t a, size_t b) { return a + b; });
+        if (inside > 0) lastRemoved = pool.Compact(particleData, ids, removeFlags);
+        changed = lastRemoved > 0;
+    }
+
+    const std::vector<Batch>& released = Advance(time, deltaTime);
+    size_t total = 0;
+    for (const Batch& batch : released) total += batch.count;
+    size_t room = pool.GetMaxParticleCount() > 0 ? pool.GetMaxParticleCount() - std::min(pool.GetMaxParticleCount(), particleData.positions.size()) : total;
+    if (total == 0) return changed;
+
+    // Only what fits is generated; Emit clamps to the same room and counts the rest as rejected
+    size_t generated = std::min(total, room);
+    emitPositions.resize(generated);
+    emitVelocities.resize(generated);
+    size_t offset = 0;
+    for (const Batch& batch : released) {
+        if (offset >= generated) break;
+        const Emitter3D& emitter = emitters[batch.emitter];
+        size_t batchCount = std::min<size_t>(batch.count, generated - offset);
+        scheduler.ParallelFor(0, batchCount, ParticleGrain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                emitPositions[offset + i] = EmitPosition(emitter, batch.emitter, batch.firstSerial + static_cast<uint32_t>(i), seed, deltaTime);
+                emitVelocities[offset + i] = emitter.direction * emitter.speed;
+            }
+        });
+        offset += batchCount;
+    }
+
+    size_t emitted = pool.Emit(particleData, ids, emitPositions.data(), emitVelocities.data(), total);
+    return changed || emitted > 0;
+}
@@ -0,0 +1,66 @@
+#ifndef PARTICLE_EMITTERS_3D_H
+#define PARTICLE_EMITTERS_3D_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleData.h"
+#include "ParticlePool3D.h"
+#include "Scene3D.h"
+#include "TaskScheduler.h"
+
+// Runs a scene's emitters and sinks on the host copy of the particles.
+// The number of particles an emitter has released by time t is floor(rate * active time),
+// and particle n of emitter e always gets the same Philox draw, so a run continued from a
+// checkpoint emits exactly what the uninterrupted run would have. ParticlePoolGPU3D
+// uses the same batches and positions on the GPU.
+class ParticleEmitters3D {
+public:
+    // Particles emitter releases this step: serials [firstSerial, firstSerial + count)
+    struct Batch {
+        uint32_t emitter;
+        uint32_t firstSerial;
+        uint32_t count;
+    };
+
+    explicit ParticleEmitters3D(const Scene3D& scene, TaskScheduler& scheduler = TaskScheduler::Instance());
+
+    bool IsActive() const { return !emitters.empty() || !sinks.empty(); }
+    const std::vector<Emitter3D>& GetEmitters() const { return emitters; }
+    const std::vector<Sink3D>& GetSinks() const { return sinks; }
+    uint32_t GetSeed() const { return seed; }
+    ParticlePool3D& GetPool() { return pool; }
+    const ParticlePool3D& GetPool() const { return pool; }
+
+    // Removes the particles inside sinks, then appends what the emitters release between
+    // time and time + deltaTime. Returns true when the particle count changed.
+    bool Update(ParticleData3D& particleData, std::vector<uint32_t>* ids, double time, float deltaTime);
+    // The emitter batches for the step from time to time + deltaTime.
+    const std::vector<Batch>& Advance(double time, float deltaTime);
+    // Particles the sinks removed at the last Update; when non-zero, the pool's destinations say where the rest went.
+    size_t GetLastRemovedCount() const { return lastRemoved; }
+
+    static uint32_t EmittedBefore(const Emitter3D& emitter, double time);
+    // Where particle serial of emitter leaves its disc. Particles of one step are spread over
+    // the distance the stream travels in deltaTime, so a steady stream has no visible layers.
+    static glm::vec3 EmitPosition(const Emitter3D& emitter, uint32_t emitterIndex, uint32_t serial, uint32_t seed, float deltaTime);
+    static bool InsideSink(const Sink3D& sink, const glm::vec3& position);
+
+    static const size_t ParticleGrain = 4096;
+
+private:
+    TaskScheduler& scheduler;
+    std::vector<Emitter3D> emitters;
+    std::vector<Sink3D> sinks;
+    uint32_t seed;
+    ParticlePool3D pool;
+    size_t lastRemoved;
+
+    std::vector<Batch> batches;
+    std::vector<uint8_t> removeFlags;
+    std::vector<glm::vec3> emitPositions;
+    std::vector<glm::vec3> emitVelocities;
+};
+
+#endif // PARTICLE_EMITTERS_3D_H
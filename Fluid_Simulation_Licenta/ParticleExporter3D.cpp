@@ -0,0 +1,332 @@
+#include "ParticleExporter3D.h"
+#include "FrameDropWarning.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+    const size_t EncodeGrain = 16384;
+    const uint8_t VtkVertex = 1;
+
+    template <typename T>
+    void Store(char* destination, const T& value) {
+        std::memcpy(destination, &value, sizeof(T));
+    }
+
+    uint32_t ParticleId(const std::vector<uint32_t>* ids, size_t i) {
+        return ids ? (*ids)[i] : static_cast<uint32_t>(i);
+    }
+
+    std::string FileName(const std::string& prefix, uint64_t step, ParticleExporter3D::Format format) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "_%06llu.", static_cast<unsigned long long>(step));
+        return prefix + name + ParticleExporter3D::Extension(format);
+    }
+}
+
+ParticleExporter3D::ParticleExporter3D(TaskScheduler& scheduler)
+    : scheduler(scheduler), running(false), stopRequested(false), writeFailed(false), writeSeconds(0.0) {}
+
+ParticleExporter3D::~ParticleExporter3D() {
+    if (running) Stop();
+}
+
+const char* ParticleExporter3D::Extension(Format format) {
+    return format == Format::PLY ? "ply" : "vtu";
+}
+
+bool ParticleExporter3D::Start(const Options& options) {
+    if (running) Stop();
+
+    this->options = options;
+    this->options.frameInterval = std::max<size_t>(1, options.frameInterval);
+    this->options.queueDepth = std::max<size_t>(1, options.queueDepth);
+    if (this->options.directory.empty()) this->options.directory = ".";
+
+    std::error_code error;
+    std::filesystem::create_directories(this->options.directory, error);
+
+    // Probe the directory so a bad path fails here instead of on every frame
+    std::string probePath = this->options.directory + "/" + this->options.prefix + ".probe";
+    {
+        std::ofstream probe(probePath, std::ios::binary | std::ios::trunc);
+        if (!probe.is_open()) {
+            std::cerr << "ParticleExporter3D::Start Error: Cannot write to " << this->options.directory << std::endl;
+            return false;
+        }
+    }
+    std::remove(probePath.c_str());
+
+    buffers.assign(this->options.queueDepth, PendingFrame());
+    freeBuffers.clear();
+    for (size_t i = 0; i < buffers.size(); ++i) freeBuffers.push_back(i);
+    queuedBuffers.clear();
+    writtenFrames.clear();
+    statistics = Statistics();
+    writeSeconds = 0.0;
+    writeFailed = false;
+
+    stopRequested = false;
+    running = true;
+    writer = std::thread(&ParticleExporter3D::WriterLoop, this);
+    return true;
+}
+
+bool ParticleExporter3D::Stop() {
+    if (!running) return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopRequested = true;
+    }
+    queueChanged.notify_all();
+    writer.join();
+    running = false;
+
+    bool ok = !writeFailed;
+    if (options.format == Format::VTU && !writtenFrames.empty()) ok = WriteCollection() && ok;
+    buffers.clear();
+    freeBuffers.clear();
+    return ok;
+}
+
+void ParticleExporter3D::SubmitFrame(uint64_t step, double time, const ParticleData3D& particleData, const std::vector<uint32_t>* ids) {
+    if (!running || step % options.frameInterval != 0) return;
+
+    size_t bufferIndex;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        statistics.framesSubmitted++;
+        if (freeBuffers.empty()) {
+            if (!options.blockWhenFull) {
+                statistics.framesDropped++;
+                FrameDropWarning::Report("ParticleExporter3D", step, statistics.framesDropped);
+                return;
+            }
+            queueChanged.wait(lock, [this]() { return !freeBuffers.empty(); });
+        }
+        bufferIndex = freeBuffers.back();
+        freeBuffers.pop_back();
+    }
+
+    // The buffer belongs to the producer until it is queued, so encoding runs without the lock
+    auto start = std::chrono::steady_clock::now();
+    PendingFrame& frame = buffers[bufferIndex];
+    frame.path = FileName(options.prefix, step, options.format);
+    frame.time = time;
+    if (ids && ids->size() != particleData.positions.size()) ids = nullptr;
+    Encode(options.format, particleData, ids, time, frame.bytes, scheduler);
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        statistics.encodeMilliseconds = milliseconds;
+        queuedBuffers.push_back(bufferIndex);
+    }
+    queueChanged.notify_all();
+}
+
+void ParticleExporter3D::WriterLoop() {
+    while (true) {
+        size_t bufferIndex;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queueChanged.wait(lock, [this]() { return stopRequested || !queuedBuffers.empty(); });
+            if (queuedBuffers.empty()) return;
+            bufferIndex = queuedBuffers.front();
+            queuedBuffers.pop_front();
+        }
+
+        const PendingFrame& frame = buffers[bufferIndex];
+        std::string path = options.directory + "/" + frame.path;
+        auto start = std::chrono::steady_clock::now();
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(frame.bytes.data(), static_cast<std::streamsize>(frame.bytes.size()));
+        file.close();
+        bool ok = static_cast<bool>(file);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!ok) std::cerr << "ParticleExporter3D::WriterLoop Error: Failed to write " << path << std::endl;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ok) {
+                statistics.framesWritten++;
+                statistics.bytesWritten += frame.bytes.size();
+                writeSeconds += seconds;
+                // The writer takes the frames in submission order, so the collection stays sorted by time
+                if (options.format == Format::VTU) writtenFrames.push_back(std::make_pair(frame.time, frame.path));
+            } else {
+                writeFailed = true;
+            }
+            freeBuffers.push_back(bufferIndex);
+        }
+        queueChanged.notify_all();
+    }
+}
+
+bool ParticleExporter3D::WriteCollection() const {
+    std::string path = options.directory + "/" + options.prefix + ".pvd";
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "ParticleExporter3D::WriteCollection Error: Cannot write " << path << std::endl;
+        return false;
+    }
+    file.precision(9);
+    file << "<?xml version=\"1.0\"?>\n"
+        << "<VTKFile type=\"Collection\" version=\"1.0\" byte_order=\"LittleEndian\">\n"
+        << "  <Collection>\n";
+    for (const std::pair<double, std::string>& frame : writtenFrames) {
+        file << "    <DataSet timestep=\"" << frame.first << "\" part=\"0\" file=\"" << frame.second << "\"/>\n";
+    }
+    file << "  </Collection>\n"
+        << "</VTKFile>\n";
+    return static_cast<bool>(file);
+}
+
+ParticleExporter3D::Statistics ParticleExporter3D::GetStatistics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Statistics result = statistics;
+    result.queueDepth = queuedBuffers.size();
+    result.writeMegabytesPerSecond = writeSeconds > 0.0 ? static_cast<double>(statistics.bytesWritten) / (1024.0 * 1024.0) / writeSeconds : 0.0;
+    return result;
+}
+
+void ParticleExporter3D::Encode(Format format, const ParticleData3D& particleData, const std::vector<uint32_t>* ids, double time,
+    std::vector<char>& output, TaskScheduler& scheduler) {
+    if (format == Format::PLY) EncodePLY(particleData, ids, time, output, scheduler);
+    else EncodeVTU(particleData, ids, time, output, scheduler);
+}
+
+void ParticleExporter3D::EncodeVTU(const ParticleData3D& particleData, const std::vector<uint32_t>* ids, double time,
+    std::vector<char>& output, TaskScheduler& scheduler) {
+    size_t count = particleData.positions.size();
+    bool hasVelocities = particleData.velocities.size() == count;
+    bool hasDensities = particleData.densities.size() == count;
+
+    // Appended arrays in file order, each preceded by its UInt64 byte count
+    enum { Points, Velocity, Density, NearDensity, Id, Connectivity, Offsets, Types, ArrayCount };
+    const size_t elementBytes[ArrayCount] = { 12, 12, 4, 4, 4, 4, 4, 1 };
+    uint64_t offsets[ArrayCount];
+    uint64_t appendedBytes = 0;
+    for (int a = 0; a < ArrayCount; ++a) {
+        offsets[a] = appendedBytes;
+        appendedBytes += sizeof(uint64_t) + elementBytes[a] * count;
+    }
+
+    std::ostringstream xml;
+    xml.precision(9);
+    xml << "<?xml version=\"1.0\"?>\n"
+        << "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"LittleEndian\" header_type=\"UInt64\">\n"
+        << "  <UnstructuredGrid>\n"
+        << "    <FieldData>\n"
+        << "      <DataArray type=\"Float64\" Name=\"TimeValue\" NumberOfTuples=\"1\" format=\"ascii\">" << time << "</DataArray>\n"
+        << "    </FieldData>\n"
+        << "    <Piece NumberOfPoints=\"" << count << "\" NumberOfCells=\"" << count << "\">\n"
+        << "      <PointData Scalars=\"density\" Vectors=\"velocity\">\n"
+        << "        <DataArray type=\"Float32\" Name=\"velocity\" NumberOfComponents=\"3\" format=\"appended\" offset=\"" << offsets[Velocity] << "\"/>\n"
+        << "        <DataArray type=\"Float32\" Name=\"density\" format=\"appended\" offset=\"" << offsets[Density] << "\"/>\n"
+        << "        <DataArray type=\"Float32\" Name=\"near_density\" format=\"appended\" offset=\"" << offsets[NearDensity] << "\"/>\n"
+        << "        <DataArray type=\"UInt32\" Name=\"id\" format=\"appended\" offset=\"" << offsets[Id] << "\"/>\n"
+        << "      </PointData>\n"
+        << "      <Points>\n"
+        << "        <DataArray type=\"Float32\" NumberOfComponents=\"3\" format=\"appended\" offset=\"" << offsets[Points] << "\"/>\n"
+        << "      </Points>\n"
+        << "      <Cells>\n"
+        << "        <DataArray type=\"Int32\" Name=\"connectivity\" format=\"appended\" offset=\"" << offsets[Connectivity] << "\"/>\n"
+        << "        <DataArray type=\"Int32\" Name=\"offsets\" format=\"appended\" offset=\"" << offsets[Offsets] << "\"/>\n"
+        << "        <DataArray type=\"UInt8\" Name=\"types\" format=\"appended\" offset=\"" << offsets[Types] << "\"/>\n"
+        << "      </Cells>\n"
+        << "    </Piece>\n"
+        << "  </UnstructuredGrid>\n"
+        << "  <AppendedData encoding=\"raw\">\n"
+        << "   _";
+    std::string header = xml.str();
+    const std::string footer = "\n  </AppendedData>\n</VTKFile>\n";
+
+    output.resize(header.size() + appendedBytes + footer.size());
+    char* appended = output.data() + header.size();
+    std::memcpy(output.data(), header.data(), header.size());
+    std::memcpy(appended + appendedBytes, footer.data(), footer.size());
+    for (int a = 0; a < ArrayCount; ++a) Store(appended + offsets[a], static_cast<uint64_t>(elementBytes[a] * count));
+
+    char* arrays[ArrayCount];
+    for (int a = 0; a < ArrayCount; ++a) arrays[a] = appended + offsets[a] + sizeof(uint64_t);
+
+    scheduler.ParallelFor(0, count, EncodeGrain, [&](size_t begin, size_t end) {
+        size_t n = end - begin;
+        std::memcpy(arrays[Points] + begin * 12, &particleData.positions[begin], n * sizeof(glm::vec3));
+        if (hasVelocities) std::memcpy(arrays[Velocity] + begin * 12, &particleData.velocities[begin], n * sizeof(glm::vec3));
+        else std::memset(arrays[Velocity] + begin * 12, 0, n * 12);
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec2 density = hasDensities ? particleData.densities[i] : glm::vec2(0.0f);
+            Store(arrays[Density] + i * 4, density.x);
+            Store(arrays[NearDensity] + i * 4, density.y);
+            Store(arrays[Id] + i * 4, ParticleId(ids, i));
+            Store(arrays[Connectivity] + i * 4, static_cast<int32_t>(i));
+            Store(arrays[Offsets] + i * 4, static_cast<int32_t>(i + 1));
+        }
+        std::memset(arrays[Types] + begin, VtkVertex, n);
+    });
+}
+
+void ParticleExporter3D::EncodePLY(const ParticleData3D& particleData, const std::vector<uint32_t>* ids, double time,
+    std::vector<char>& output, TaskScheduler& scheduler) {
+    size_t count = particleData.positions.size();
+    bool hasVelocities = particleData.velocities.size() == count;
+    bool hasDensities = particleData.densities.size() == count;
+    const size_t vertexBytes = 9 * 4;
+
+    std::ostringstream text;
+    text.precision(9);
+    text << "ply\n"
+        << "format binary_little_endian 1.0\n"
+        << "comment time " << time << "\n"
+        << "element vertex " << count << "\n"
+        << "property float x\n"
+        << "property float y\n"
+        << "property float z\n"
+        << "property float vx\n"
+        << "property float vy\n"
+        << "property float vz\n"
+        << "property float density\n"
+        << "property float near_density\n"
+        << "property uint id\n"
+        << "end_header\n";
+    std::string header = text.str();
+
+    output.resize(header.size() + vertexBytes * count);
+    std::memcpy(output.data(), header.data(), header.size());
+    char* vertices = output.data() + header.size();
+
+    scheduler.ParallelFor(0, count, EncodeGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            char* vertex = vertices + i * vertexBytes;
+            glm::vec3 velocity = hasVelocities ? particleData.velocities[i] : glm::vec3(0.0f);
+            glm::vec2 density = hasDensities ? particleData.densities[i] : glm::vec2(0.0f);
+            Store(vertex, particleData.positions[i]);
+            Store(vertex + 12, velocity);
+            Store(vertex + 24, density);
+            Store(vertex + 32, ParticleId(ids, i));
+        }
+    });
+}
+
+bool ParticleExporter3D::ExportFile(const std::string& path, Format format, const ParticleData3D& particleData,
+    const std::vector<uint32_t>* ids, double time) {
+    if (ids && ids->size() != particleData.positions.size()) ids = nullptr;
+    std::vector<char> bytes;
+    Encode(format, particleData, ids, time, bytes, TaskScheduler::Instance());
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "ParticleExporter3D::ExportFile Error: Cannot write " << path << std::endl;
+        return false;
+    }
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    return static_cast<bool>(file);
+}
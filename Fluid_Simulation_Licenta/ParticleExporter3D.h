@@ -0,0 +1,103 @@
+#ifndef PARTICLE_EXPORTER_3D_H
+#define PARTICLE_EXPORTER_3D_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ParticleData.h"
+#include "TaskScheduler.h"
+
+// Writes particle frames for ParaView: binary VTU (appended raw data, no base64) or
+// binary little-endian PLY, with position, velocity, density, near density and id.
+// SubmitFrame encodes the frame into a pooled buffer with a ParallelFor over chunks
+// of particles; a writer thread then puts the buffer on disk, so the simulation only
+// pays for the encode. VTU series also get a .pvd collection with the frame times.
+class ParticleExporter3D {
+public:
+    enum class Format { VTU, PLY };
+
+    struct Options {
+        Format format = Format::VTU;
+        std::string directory = ".";
+        std::string prefix = "particles";
+        size_t frameInterval = 1;
+        // Encoded frames waiting for the writer; when all are in flight the frame is dropped or waited for
+        size_t queueDepth = 3;
+        bool blockWhenFull = false;
+    };
+
+    struct Statistics {
+        uint64_t framesSubmitted = 0;
+        uint64_t framesWritten = 0;
+        uint64_t framesDropped = 0;
+        uint64_t bytesWritten = 0;
+        double encodeMilliseconds = 0.0;
+        double writeMegabytesPerSecond = 0.0;
+        size_t queueDepth = 0;
+    };
+
+    explicit ParticleExporter3D(TaskScheduler& scheduler = TaskScheduler::Instance());
+    ~ParticleExporter3D();
+
+    ParticleExporter3D(const ParticleExporter3D&) = delete;
+    ParticleExporter3D& operator=(const ParticleExporter3D&) = delete;
+
+    bool Start(const Options& options);
+    // Waits for queued frames and writes the .pvd collection for VTU series.
+    bool Stop();
+    bool IsRunning() const { return running; }
+    // True when SubmitFrame would export the frame of this step.
+    bool WantsFrame(uint64_t step) const { return running && step % options.frameInterval == 0; }
+
+    // Exports the frame if step is a multiple of the frame interval. ids (optional) are written as the "id" field.
+    void SubmitFrame(uint64_t step, double time, const ParticleData3D& particleData, const std::vector<uint32_t>* ids = nullptr);
+
+    Statistics GetStatistics() const;
+
+    static const char* Extension(Format format);
+    // Encodes one frame into output. Exposed for one-off exports and tests.
+    static void Encode(Format format, const ParticleData3D& particleData, const std::vector<uint32_t>* ids, double time,
+        std::vector<char>& output, TaskScheduler& scheduler);
+    // Encodes and writes one file synchronously.
+    static bool ExportFile(const std::string& path, Format format, const ParticleData3D& particleData,
+        const std::vector<uint32_t>* ids = nullptr, double time = 0.0);
+
+private:
+    struct PendingFrame {
+        std::string path;
+        double time;
+        std::vector<char> bytes;
+    };
+
+    static void EncodeVTU(const ParticleData3D& particleData, const std::vector<uint32_t>* ids, double time,
+        std::vector<char>& output, TaskScheduler& scheduler);
+    static void EncodePLY(const ParticleData3D& particleData, const std::vector<uint32_t>* ids, double time,
+        std::vector<char>& output, TaskScheduler& scheduler);
+    void WriterLoop();
+    bool WriteCollection() const;
+
+    TaskScheduler& scheduler;
+    Options options;
+    bool running;
+
+    std::vector<PendingFrame> buffers;
+    std::vector<size_t> freeBuffers;
+    std::deque<size_t> queuedBuffers;
+    mutable std::mutex mutex;
+    std::condition_variable queueChanged;
+    bool stopRequested;
+    bool writeFailed;
+    std::thread writer;
+
+    // (time, file name) of every frame the writer put on disk, for the .pvd collection
+    std::vector<std::pair<double, std::string>> writtenFrames;
+    Statistics statistics;
+    double writeSeconds;
+};
+
+#endif // PARTICLE_EXPORTER_3D_H
@@ -1,86 +1,91 @@
 #include "ParticleGenerator3D.h"
+#include <algorithm>
+#include <cmath>
 
-ParticleGenerator3D::ParticleGenerator3D(int particleCount, glm::vec3 initialVelocity, glm::vec3 spawnCentre, glm::vec3 spawnSize, float jitterStr)
-    : particleCount(particleCount), initialVelocity(initialVelocity), spawnCentre(spawnCentre), spawnSize(spawnSize), jitterStr(jitterStr) {
-    InitBuffers();
-}
+#include "Philox.h"
+#include "TaskScheduler.h"
 
-ParticleGenerator3D::~ParticleGenerator3D() {
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+namespace {
+    // Second key word, so spawn streams never collide with other users of the same seed
+    const uint32_t SpawnKey = 0x5350574Eu;
 }
 
-void ParticleGenerator3D::InitBuffers() {
-    glGenVertexArrays(1, &VAO);
-    CheckGLError("InitBuffers::glGenVertexArrays");
-    glGenBuffers(1, &VBO);
-    CheckGLError("InitBuffers::glGenBuffers");
-
-    glBindVertexArray(VAO);
-    CheckGLError("InitBuffers::glBindVertexArray");
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    CheckGLError("InitBuffers::glBindBuffer");
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    CheckGLError("InitBuffers::glVertexAttribPointer");
-    glEnableVertexAttribArray(0);
-    CheckGLError("InitBuffers::glEnableVertexAttribArray");
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    CheckGLError("InitBuffers::glBindBuffer unbind");
-    glBindVertexArray(0);
-    CheckGLError("InitBuffers::glBindVertexArray unbind");
+ParticleGenerator3D::ParticleGenerator3D(int particleCount, glm::vec3 initialVelocity, glm::vec3 spawnCentre, glm::vec3 spawnSize, float jitterStr,
+    uint32_t seed, uint32_t stream)
+    : particleCount(std::max(particleCount, 0)), initialVelocity(initialVelocity), spawnCentre(spawnCentre), spawnSize(spawnSize), jitterStr(jitterStr),
+    seed(seed), stream(stream), latticeDims(CalculateLatticeDimensions(particleCount, spawnSize)) {
 }
 
+ParticleGenerator3D::~ParticleGenerator3D() {}
+
 int ParticleGenerator3D::GetParticleCount() const {
     return particleCount;
 }
 
 ParticleGenerator3D::ParticleSpawnData3D ParticleGenerator3D::GetSpawnData() {
-    int numParticlesPerAxis = static_cast<int>(std::cbrt(particleCount));
     ParticleSpawnData3D data(particleCount);
-    std::mt19937 rng(42);
-    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
-
-    int i = 0;
-    for (int x = 0; x < numParticlesPerAxis; ++x) {
-        for (int y = 0; y < numParticlesPerAxis; ++y) {
-            for (int z = 0; z < numParticlesPerAxis; ++z) {
-                glm::vec3 spawnPos = CalculateSpawnPosition(x, y, z, numParticlesPerAxis, rng, dist);
-                data.positions[i] = spawnPos;
-                data.velocities[i] = initialVelocity;
-                ++i;
-            }
-        }
-    }
-
-    UpdateBufferData(data.positions);
-
+    Generate(data.positions.data(), data.velocities.data());
     return data;
 }
 
-void ParticleGenerator3D::CalculateGridDimensions(int& numParticlesPerAxis) const {
-    numParticlesPerAxis = static_cast<int>(std::cbrt(particleCount));
+void ParticleGenerator3D::Generate(glm::vec3* positions, glm::vec3* velocities) const {
+    TaskScheduler::Instance().ParallelFor(0, static_cast<size_t>(particleCount), SpawnGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            positions[i] = SpawnPosition(static_cast<int>(i));
+            velocities[i] = initialVelocity;
+        }
+    });
 }
 
-glm::vec3 ParticleGenerator3D::CalculateSpawnPosition(int x, int y, int z, int numParticlesPerAxis, std::mt19937& rng,
-    std::uniform_real_distribution<float>& dist) const {
+glm::ivec3 ParticleGenerator3D::CalculateLatticeDimensions(int count, const glm::vec3& size) {
+    if (count <= 0) return glm::ivec3(0);
+
+    // Spacing comes from the axes that have an extent; flat axes get a single layer
+    glm::vec3 extent = glm::abs(size);
+    float volume = 1.0f;
+    int activeAxes = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (extent[axis] > 0.0f) {
+            volume *= extent[axis];
+            activeAxes++;
+        }
+    }
+    glm::ivec3 dims(1);
+    if (activeAxes > 0) {
+        float spacing = std::pow(volume / static_cast<float>(count), 1.0f / activeAxes);
+        for (int axis = 0; axis < 3; ++axis) {
+            if (extent[axis] > 0.0f) dims[axis] = std::max(static_cast<int>(std::floor(extent[axis] / spacing)), 1);
+        }
+    }
+    extent = glm::max(extent, glm::vec3(1e-6f));
 
-    float tx = numParticlesPerAxis <= 1 ? 0.5f : static_cast<float>(x) / (numParticlesPerAxis - 1);
-    float ty = numParticlesPerAxis <= 1 ? 0.5f : static_cast<float>(y) / (numParticlesPerAxis - 1);
-    float tz = numParticlesPerAxis <= 1 ? 0.5f : static_cast<float>(z) / (numParticlesPerAxis - 1);
+    // Add layers along the axis with the widest gaps until every particle has a slot
+    while (static_cast<long long>(dims.x) * dims.y * dims.z < count) {
+        glm::vec3 gaps = extent / glm::vec3(dims);
+        int axis = gaps.x >= gaps.y ? (gaps.x >= gaps.z ? 0 : 2) : (gaps.y >= gaps.z ? 1 : 2);
+        dims[axis]++;
+    }
+    return dims;
+}
 
-    glm::vec3 jitter = glm::vec3(dist(rng) - 0.5f, dist(rng) - 0.5f, dist(rng) - 0.5f) * jitterStr;
+glm::vec3 ParticleGenerator3D::SpawnPosition(int index) const {
+    // x varies fastest and y slowest, so an incomplete lattice leaves its gap at the top
+    int x = index % latticeDims.x;
+    int z = (index / latticeDims.x) % latticeDims.z;
+    int y = index / (latticeDims.x * latticeDims.z);
 
-    glm::vec3 spawnPos = glm::vec3(tx, ty, tz) * spawnSize + jitter;
-    spawnPos = glm::clamp(spawnPos, glm::vec3(0.0f), spawnSize) + (spawnCentre - spawnSize / 2.0f);
+    glm::vec3 t;
+    t.x = latticeDims.x <= 1 ? 0.5f : static_cast<float>(x) / (latticeDims.x - 1);
+    t.y = latticeDims.y <= 1 ? 0.5f : static_cast<float>(y) / (latticeDims.y - 1);
+    t.z = latticeDims.z <= 1 ? 0.5f : static_cast<float>(z) / (latticeDims.z - 1);
 
-    return spawnPos;
-}
+    Philox4x32 random = Philox4x32::Generate(static_cast<uint32_t>(index), stream, 0, 0, seed, SpawnKey);
+    glm::vec3 jitter = glm::vec3(Philox4x32::ToUnitFloat(random.v[0]) - 0.5f, Philox4x32::ToUnitFloat(random.v[1]) - 0.5f,
+        Philox4x32::ToUnitFloat(random.v[2]) - 0.5f) * jitterStr;
 
-void ParticleGenerator3D::UpdateBufferData(const std::vector<glm::vec3>& positions) {
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    CheckGLError("UpdateBufferData");
+    glm::vec3 spawnPos = t * spawnSize + jitter;
+    spawnPos = glm::clamp(spawnPos, glm::vec3(0.0f), spawnSize) + (spawnCentre - spawnSize / 2.0f);
+    return spawnPos;
 }
 
 void ParticleGenerator3D::DebugParticle(const glm::vec3& position, const glm::vec3& velocity) const {
@@ -94,10 +99,3 @@ void ParticleGenerator3D::DebugParticle(const glm::vec3& position, const glm::ve
         std::cerr << "ParticleGenerator3D::DebugParticle Error: Particle out of bounds!\n";
     }
 }
-
-void ParticleGenerator3D::CheckGLError(const std::string& operation) const {
-    GLenum err;
-    while ((err = glGetError()) != GL_NO_ERROR) {
-        std::cerr << "ParticleGenerator3D::CheckGLError OpenGL error during " << operation << ": " << std::hex << err << std::dec << std::endl;
-    }
-}
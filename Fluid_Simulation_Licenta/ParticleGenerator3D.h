@@ -1,12 +1,16 @@
 #ifndef PARTICLEGENERATOR3D_H
 #define PARTICLEGENERATOR3D_H
 
-#include <GL/glew.h>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <vector>
-#include <random>
 #include <iostream>
 
+// Places particles on a jittered lattice that fills the spawn box. The lattice has
+// the box's aspect ratio and a slot for every particle; the partial layer, if any,
+// is the top one. Jitter comes from Philox keyed by (seed, stream, particle index),
+// so the result does not depend on the thread count, and the GPU spawn shader
+// (ParticleSpawnerGPU3D) draws the same numbers.
 class ParticleGenerator3D {
 public:
     struct ParticleSpawnData3D {
@@ -16,28 +20,41 @@ public:
         ParticleSpawnData3D(int count) : positions(count), velocities(count) {}
     };
 
-    ParticleGenerator3D(int particleCount, glm::vec3 initialVelocity, glm::vec3 spawnCentre, glm::vec3 spawnSize, float jitterStr);
+    ParticleGenerator3D(int particleCount, glm::vec3 initialVelocity, glm::vec3 spawnCentre, glm::vec3 spawnSize, float jitterStr,
+        uint32_t seed = DefaultSeed, uint32_t stream = 0);
     ~ParticleGenerator3D();
 
     int GetParticleCount() const;
     ParticleSpawnData3D GetSpawnData();
+    // Writes the particles to positions[0..count) and velocities[0..count) in parallel.
+    void Generate(glm::vec3* positions, glm::vec3* velocities) const;
+    glm::vec3 SpawnPosition(int index) const;
+
+    glm::ivec3 GetLatticeDimensions() const { return latticeDims; }
+    glm::vec3 GetInitialVelocity() const { return initialVelocity; }
+    glm::vec3 GetSpawnCentre() const { return spawnCentre; }
+    glm::vec3 GetSpawnSize() const { return spawnSize; }
+    float GetJitterStrength() const { return jitterStr; }
+    uint32_t GetSeed() const { return seed; }
+    uint32_t GetStream() const { return stream; }
+
+    // Smallest lattice with about equal spacing on every axis and at least count slots.
+    static glm::ivec3 CalculateLatticeDimensions(int count, const glm::vec3& size);
+
+    static const uint32_t DefaultSeed = 42;
+    static const size_t SpawnGrain = 8192;
 
 private:
-    void InitBuffers();
-    void CalculateGridDimensions(int& numParticlesPerAxis) const;
-    glm::vec3 CalculateSpawnPosition(int x, int y, int z, int numParticlesPerAxis, std::mt19937& rng,
-        std::uniform_real_distribution<float>& dist) const;
-    void UpdateBufferData(const std::vector<glm::vec3>& positions);
     void DebugParticle(const glm::vec3& position, const glm::vec3& velocity) const;
-    void CheckGLError(const std::string& operation) const;
 
     int particleCount;
     glm::vec3 initialVelocity;
     glm::vec3 spawnCentre;
     glm::vec3 spawnSize;
     float jitterStr;
-
-    GLuint VAO, VBO;
+    uint32_t seed;
+    uint32_t stream;
+    glm::ivec3 latticeDims;
 };
 
 #endif // PARTICLEGENERATOR3D_H
@@ -0,0 +1,157 @@
+#include "ParticlePool3D.h"
+#include <algorithm>
+#include <iostream>
+
+ParticlePool3D::ParticlePool3D(TaskScheduler& scheduler)
+    : scheduler(scheduler), capacity(0), maxParticleCount(0) {}
+
+void ParticlePool3D::Reserve(ParticleData3D& particleData, size_t capacity) {
+    // Compaction swaps columns with their scratch twins, so both sides need the capacity
+    this->capacity = std::max(this->capacity, capacity);
+    particleData.positions.reserve(this->capacity);
+    particleData.velocities.reserve(this->capacity);
+    particleData.predictedPositions.reserve(this->capacity);
+    particleData.densities.reserve(this->capacity);
+    particleData.spatialIndices.reserve(this->capacity);
+    particleData.spatialOffsets.reserve(this->capacity);
+    destinations.reserve(this->capacity);
+    idRanks.reserve(this->capacity);
+    vec3Scratch.reserve(this->capacity);
+    vec2Scratch.reserve(this->capacity);
+    uvec3Scratch.reserve(this->capacity);
+    uintScratch.reserve(this->capacity);
+    statistics.capacity = this->capacity;
+}
+
+void ParticlePool3D::Grow(ParticleData3D& particleData, size_t count) {
+    // Doubling keeps the number of reallocations logarithmic in the final count
+    size_t newCapacity = std::max(count, capacity * 2);
+    if (maxParticleCount > 0) newCapacity = std::min(newCapacity, std::max(count, maxParticleCount));
+    Reserve(particleData, newCapacity);
+    statistics.growths++;
+}
+
+size_t ParticlePool3D::Emit(ParticleData3D& particleData, std::vector<uint32_t>* ids, const glm::vec3* positions, const glm::vec3* velocities, size_t count) {
+    size_t oldCount = particleData.positions.size();
+    if (maxParticleCount > 0) {
+        size_t room = maxParticleCount > oldCount ? maxParticleCount - oldCount : 0;
+        statistics.rejected += count > room ? count - room : 0;
+        count = std::min(count, room);
+    }
+    if (count == 0) return 0;
+
+    size_t newCount = oldCount + count;
+    if (newCount > capacity || newCount > particleData.positions.capacity()) Grow(particleData, newCount);
+
+    // Optional columns are only kept in step when they were already sized for the particles
+    bool spatial = particleData.spatialIndices.size() == oldCount && particleData.spatialOffsets.size() == oldCount;
+    particleData.positions.insert(particleData.positions.end(), positions, positions + count);
+    particleData.velocities.insert(particleData.velocities.end(), velocities, velocities + count);
+    particleData.predictedPositions.resize(oldCount);
+    particleData.predictedPositions.insert(particleData.predictedPositions.end(), positions, positions + count);
+    particleData.densities.resize(newCount, glm::vec2(0.0f));
+    if (spatial) {
+        particleData.spatialIndices.resize(newCount, glm::uvec3(0));
+        particleData.spatialOffsets.resize(newCount, 0);
+    }
+
+    if (ids) {
+        if (ids->size() != oldCount) {
+            ids->resize(oldCount);
+            for (size_t i = 0; i < oldCount; ++i) (*ids)[i] = static_cast<uint32_t>(i);
+        }
+        for (size_t i = oldCount; i < newCount; ++i) ids->push_back(static_cast<uint32_t>(i));
+    }
+
+    statistics.emitted += count;
+    return count;
+}
+
+size_t ParticlePool3D::ExclusiveScan(std::vector<uint32_t>& values, size_t count) {
+    size_t numChunks = (count + CompactGrain - 1) / CompactGrain;
+    chunkSums.assign(numChunks + 1, 0);
+
+    scheduler.ParallelFor(0, count, CompactGrain, [&](size_t begin, size_t end) {
+        size_t sum = 0;
+        for (size_t i = begin; i < end; ++i) sum += values[i];
+        chunkSums[begin / CompactGrain + 1] = sum;
+    });
+
+    for (size_t chunk = 1; chunk <= numChunks; ++chunk) {
+        chunkSums[chunk] += chunkSums[chunk - 1];
+    }
+
+    scheduler.ParallelFor(0, count, CompactGrain, [&](size_t begin, size_t end) {
+        size_t running = chunkSums[begin / CompactGrain];
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t value = values[i];
+            values[i] = static_cast<uint32_t>(running);
+            running += value;
+        }
+    });
+    return chunkSums[numChunks];
+}
+
+template <typename T>
+void ParticlePool3D::CompactColumn(std::vector<T>& column, std::vector<T>& scratch, size_t count, size_t newCount) {
+    if (column.size() != count) return;
+    scratch.resize(newCount);
+    scheduler.ParallelFor(0, count, CompactGrain, [&](size_t begin, size_t end) {
+        for (size_t slot = begin; slot < end; ++slot) {
+            uint32_t destination = destinations[slot];
+            if (destination != UINT32_MAX) scratch[destination] = column[slot];
+        }
+    });
+    column.swap(scratch);
+}
+
+size_t ParticlePool3D::Compact(ParticleData3D& particleData, std::vector<uint32_t>* ids, const std::vector<uint8_t>& removeFlags) {
+    size_t count = particleData.positions.size();
+    if (removeFlags.size() < count) {
+        std::cerr << "ParticlePool3D::Compact Error: " << removeFlags.size() << " flags for " << count << " particles" << std::endl;
+        return 0;
+    }
+    if (count > capacity) Reserve(particleData, count);
+
+    // Survivors keep their relative order: the new slot is the number of survivors before them
+    destinations.resize(count);
+    scheduler.ParallelFor(0, count, CompactGrain, [&](size_t begin, size_t end) {
+        for (size_t slot = begin; slot < end; ++slot) destinations[slot] = removeFlags[slot] ? 0u : 1u;
+    });
+    size_t newCount = ExclusiveScan(destinations, count);
+    size_t removed = count - newCount;
+    if (removed == 0) return 0;
+    scheduler.ParallelFor(0, count, CompactGrain, [&](size_t begin, size_t end) {
+        for (size_t slot = begin; slot < end; ++slot) {
+            if (removeFlags[slot]) destinations[slot] = UINT32_MAX;
+        }
+    });
+
+    CompactColumn(particleData.positions, vec3Scratch, count, newCount);
+    CompactColumn(particleData.velocities, vec3Scratch, count, newCount);
+    CompactColumn(particleData.predictedPositions, vec3Scratch, count, newCount);
+    CompactColumn(particleData.densities, vec2Scratch, count, newCount);
+    CompactColumn(particleData.spatialIndices, uvec3Scratch, count, newCount);
+    CompactColumn(particleData.spatialOffsets, uintScratch, count, newCount);
+
+    if (ids && ids->size() == count) {
+        // Rank the surviving ids the same way, so the ids stay dense without changing their order
+        idRanks.assign(count, 0);
+        scheduler.ParallelFor(0, count, CompactGrain, [&](size_t begin, size_t end) {
+            for (size_t slot = begin; slot < end; ++slot) {
+                if (!removeFlags[slot]) idRanks[(*ids)[slot]] = 1;
+            }
+        });
+        ExclusiveScan(idRanks, count);
+        scheduler.ParallelFor(0, count, CompactGrain, [&](size_t begin, size_t end) {
+            for (size_t slot = begin; slot < end; ++slot) (*ids)[slot] = idRanks[(*ids)[slot]];
+        });
+        CompactColumn(*ids, uintScratch, count, newCount);
+    }
+    else if (ids) {
+        ids->clear();
+    }
+
+    statistics.removed += removed;
+    return removed;
+}
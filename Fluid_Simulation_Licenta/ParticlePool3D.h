@@ -0,0 +1,74 @@
+#ifndef PARTICLE_POOL_3D_H
+#define PARTICLE_POOL_3D_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleData.h"
+#include "TaskScheduler.h"
+
+// Adds and removes particles of a ParticleData3D without reallocating on every change.
+// The live particles always fill slots [0, count), so the solvers never see dead slots:
+// Emit appends at the end and Compact closes the gaps with a parallel stable compaction
+// that keeps the memory order of the survivors. Storage grows geometrically once the
+// reserved capacity is used up, so steady emission and removal never allocate.
+class ParticlePool3D {
+public:
+    struct Statistics {
+        size_t emitted = 0;
+        size_t removed = 0;
+        // Emissions refused because the pool was at its particle limit
+        size_t rejected = 0;
+        // Reallocations past the reserved capacity
+        size_t growths = 0;
+        size_t capacity = 0;
+    };
+
+    explicit ParticlePool3D(TaskScheduler& scheduler = TaskScheduler::Instance());
+
+    // Most particles the pool holds at once, 0 = no limit.
+    void SetMaxParticleCount(size_t count) { maxParticleCount = count; }
+    size_t GetMaxParticleCount() const { return maxParticleCount; }
+    // Reserves every column of particleData, and the compaction scratch, for capacity particles.
+    void Reserve(ParticleData3D& particleData, size_t capacity);
+
+    // Appends count particles and returns how many fit under the limit.
+    // ids (optional, FluidSolverCPU3D's spawn index per slot) are extended with fresh indices.
+    size_t Emit(ParticleData3D& particleData, std::vector<uint32_t>* ids, const glm::vec3* positions, const glm::vec3* velocities, size_t count);
+    // Removes every slot whose flag is non-zero and returns how many were removed.
+    // ids are renumbered by rank so they stay a permutation of [0, count), which the
+    // deterministic neighbour lists of FluidSolverCPU3D rely on.
+    size_t Compact(ParticleData3D& particleData, std::vector<uint32_t>* ids, const std::vector<uint8_t>& removeFlags);
+
+    // New slot of every slot of the last Compact that removed particles, UINT32_MAX for the removed
+    // ones; for per-slot state kept outside particleData.
+    const std::vector<uint32_t>& GetLastDestinations() const { return destinations; }
+    const Statistics& GetStatistics() const { return statistics; }
+    size_t GetCapacity() const { return capacity; }
+
+    static const size_t CompactGrain = 8192;
+
+private:
+    // Exclusive prefix sum of values[0, count) in place; returns the total.
+    size_t ExclusiveScan(std::vector<uint32_t>& values, size_t count);
+    template <typename T>
+    void CompactColumn(std::vector<T>& column, std::vector<T>& scratch, size_t count, size_t newCount);
+    void Grow(ParticleData3D& particleData, size_t count);
+
+    TaskScheduler& scheduler;
+    size_t capacity;
+    size_t maxParticleCount;
+    Statistics statistics;
+
+    // New slot of every old slot, only meaningful for survivors
+    std::vector<uint32_t> destinations;
+    std::vector<uint32_t> idRanks;
+    std::vector<size_t> chunkSums;
+    std::vector<glm::vec3> vec3Scratch;
+    std::vector<glm::vec2> vec2Scratch;
+    std::vector<glm::uvec3> uvec3Scratch;
+    std::vector<uint32_t> uintScratch;
+};
+
+#endif // PARTICLE_POOL_3D_H
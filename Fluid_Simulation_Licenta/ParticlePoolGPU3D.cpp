@@ -0,0 +1,142 @@
+#include "ParticlePoolGPU3D.h"
+#include <algorithm>
+#include <string>
+
+namespace {
+    struct LifecycleCounters {
+        GLuint keptCount;
+        GLuint emittedTotal;
+        GLuint removedTotal;
+        GLuint rejectedTotal;
+    };
+}
+
+ParticlePoolGPU3D::ParticlePoolGPU3D(const std::string& shaderPath)
+    : computeShader(new ComputeShader(shaderPath)), lifecycleBuffer(0), scanBuffer(0), spareVec3Buffer(0), spareVec2Buffer(0), scratchCapacity(0) {
+    LifecycleCounters counters = {};
+    glGenBuffers(1, &lifecycleBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lifecycleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(LifecycleCounters), &counters, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    CheckGLError("ParticlePoolGPU3D - Init counters");
+}
+
+ParticlePoolGPU3D::~ParticlePoolGPU3D() {
+    glDeleteBuffers(1, &lifecycleBuffer);
+    glDeleteBuffers(1, &scanBuffer);
+    glDeleteBuffers(1, &spareVec3Buffer);
+    glDeleteBuffers(1, &spareVec2Buffer);
+    delete computeShader;
+}
+
+void ParticlePoolGPU3D::EnsureScratch(size_t capacity) {
+    if (capacity <= scratchCapacity) return;
+    glDeleteBuffers(1, &scanBuffer);
+    glDeleteBuffers(1, &spareVec3Buffer);
+    glDeleteBuffers(1, &spareVec2Buffer);
+
+    auto createBuffer = [](GLuint& buffer, size_t size) {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    };
+    size_t blocks = (capacity + NumThreads - 1) / NumThreads;
+    createBuffer(scanBuffer, (capacity + blocks) * sizeof(GLuint));
+    // Same sizes as the buffers' columns, since the two trade places on every scatter
+    createBuffer(spareVec3Buffer, capacity * sizeof(glm::vec3));
+    createBuffer(spareVec2Buffer, capacity * sizeof(glm::vec2));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    scratchCapacity = capacity;
+    CheckGLError("ParticlePoolGPU3D::EnsureScratch");
+}
+
+void ParticlePoolGPU3D::Update(ParticleEmitters3D& emitters, ParticleBuffers3D& buffers, double time, float deltaTime) {
+    const std::vector<ParticleEmitters3D::Batch>& batches = emitters.Advance(time, deltaTime);
+    const std::vector<Sink3D>& sinks = emitters.GetSinks();
+    size_t capacity = buffers.GetCapacity();
+    // Nothing spawns or despawns: the count on the GPU stays what the host last saw
+    if (batches.empty() && sinks.empty()) return;
+    if (sinks.size() > static_cast<size_t>(MaxSinks)) {
+        std::cerr << "ParticlePoolGPU3D::Update Error: Only the first " << MaxSinks << " of " << sinks.size() << " sinks are used" << std::endl;
+    }
+
+    EnsureScratch(capacity);
+    computeShader->use();
+    buffers.BindParticleBuffers();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, scanBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, lifecycleBuffer);
+    computeShader->setUInt("capacity", static_cast<unsigned int>(capacity));
+    GLuint countBuffer = buffers.GetCountBuffer();
+
+    if (!sinks.empty()) {
+        int sinkCount = static_cast<int>(std::min(sinks.size(), static_cast<size_t>(MaxSinks)));
+        computeShader->setInt("sinkCount", sinkCount);
+        for (int s = 0; s < sinkCount; ++s) {
+            computeShader->setVec3("sinkMin[" + std::to_string(s) + "]", sinks[s].centre - sinks[s].size * 0.5f);
+            computeShader->setVec3("sinkMax[" + std::to_string(s) + "]", sinks[s].centre + sinks[s].size * 0.5f);
+        }
+        computeShader->setUInt("pass", Scan);
+        computeShader->DispatchComputeIndirect(countBuffer);
+        computeShader->setUInt("pass", ScanBlocks);
+        computeShader->DispatchGroups(1);
+
+        // Each column is scattered into the spare buffer of its size, which then takes its place
+        const ParticleBuffers3D::Column columns[] = {
+            ParticleBuffers3D::Column::Positions, ParticleBuffers3D::Column::PredictedPositions,
+            ParticleBuffers3D::Column::Velocities, ParticleBuffers3D::Column::Densities
+        };
+        computeShader->setUInt("pass", Scatter);
+        for (unsigned int c = 0; c < 4; ++c) {
+            GLuint& spare = columns[c] == ParticleBuffers3D::Column::Densities ? spareVec2Buffer : spareVec3Buffer;
+            computeShader->setUInt("column", c);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, spare);
+            computeShader->DispatchComputeIndirect(countBuffer);
+            spare = buffers.SwapColumn(columns[c], spare);
+        }
+        computeShader->setUInt("pass", Shrink);
+        computeShader->DispatchGroups(1);
+    }
+
+    for (const ParticleEmitters3D::Batch& batch : batches) {
+        const Emitter3D& emitter = emitters.GetEmitters()[batch.emitter];
+        computeShader->setUInt("emitCount", batch.count);
+        computeShader->setUInt("emitterIndex", batch.emitter);
+        computeShader->setUInt("firstSerial", batch.firstSerial);
+        computeShader->setUInt("seed", emitters.GetSeed());
+        computeShader->setVec3("emitterPosition", emitter.position);
+        computeShader->setVec3("emitterDirection", emitter.direction);
+        computeShader->setFloat("emitterSpeed", emitter.speed);
+        computeShader->setFloat("emitterRadius", emitter.radius);
+        computeShader->setFloat("deltaTime", deltaTime);
+        computeShader->setUInt("pass", Emit);
+        computeShader->DispatchGroups((batch.count + NumThreads - 1) / NumThreads);
+    }
+    computeShader->setUInt("pass", Finalize);
+    computeShader->DispatchGroups(1);
+
+    // Only these passes move the count; the solvers size their passes from the count buffer, so the
+    // flag costs a readback only where the host asks for the count, next to the render readback
+    buffers.MarkCountChangedOnGpu();
+    buffers.BindParticleBuffers();
+    CheckGLError("ParticlePoolGPU3D::Update");
+}
+
+const ParticlePoolGPU3D::Statistics& ParticlePoolGPU3D::GetStatistics() {
+    LifecycleCounters counters = {};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lifecycleBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(LifecycleCounters), &counters);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    CheckGLError("ParticlePoolGPU3D::GetStatistics");
+
+    statistics.emitted = counters.emittedTotal;
+    statistics.removed = counters.removedTotal;
+    statistics.rejected = counters.rejectedTotal;
+    return statistics;
+}
+
+void ParticlePoolGPU3D::CheckGLError(const std::string& operation) {
+    GLenum err;
+    while ((err = glGetError()) != GL_NO_ERROR) {
+        std::cerr << "OpenGL error during " << operation << ": " << std::hex << err << std::dec << std::endl;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef PARTICLE_POOL_GPU_3D_H
+#define PARTICLE_POOL_GPU_3D_H
+
+#include <GL/glew.h>
+#include <string>
+
+#include "ComputeShader.h"
+#include "ParticleBuffers3D.h"
+#include "ParticleEmitters3D.h"
+
+// GPU counterpart of ParticlePool3D: runs ParticleLifecycle_3D.comp on the particle SSBOs,
+// so emitting and removing particles needs no host copy and never reallocates.
+// Removal is a stream compaction (scan of the keep flags, then a scatter per column into a
+// spare buffer that is swapped in). The live count stays in the buffers' count buffer and every
+// count-dependent pass is dispatched indirectly from it, so an Update never waits for the GPU.
+class ParticlePoolGPU3D {
+public:
+    struct Statistics {
+        size_t emitted = 0;
+        size_t removed = 0;
+        size_t rejected = 0;
+    };
+
+    explicit ParticlePoolGPU3D(const std::string& shaderPath = "shaders/ParticleLifecycle_3D.comp");
+    ~ParticlePoolGPU3D();
+
+    // Removes the particles inside emitters' sinks and appends what its emitters release
+    // between time and time + deltaTime. The new count is only on the GPU until the buffers read it.
+    void Update(ParticleEmitters3D& emitters, ParticleBuffers3D& buffers, double time, float deltaTime);
+
+    // Reads the running totals back, so it waits for the queued passes.
+    const Statistics& GetStatistics();
+
+    static const int NumThreads = 64;
+    static const int MaxSinks = 8;
+
+private:
+    enum Pass : unsigned int { Scan = 0, ScanBlocks = 1, Scatter = 2, Shrink = 3, Emit = 4, Finalize = 5 };
+
+    void EnsureScratch(size_t capacity);
+    void CheckGLError(const std::string& operation);
+
+    ComputeShader* computeShader;
+    GLuint lifecycleBuffer;
+    GLuint scanBuffer;
+    // Spare columns the scatter writes into; after a swap they hold the buffers' previous columns
+    GLuint spareVec3Buffer;
+    GLuint spareVec2Buffer;
+    size_t scratchCapacity;
+    Statistics statistics;
+};
+
+#endif // PARTICLE_POOL_GPU_3D_H
@@ -1,13 +1,15 @@
 #include "ParticleRenderer3D.h"
+#include <algorithm>
 
-ParticleRenderer3D::ParticleRenderer3D(size_t particleCount, Shader* shader, ComputeShader* computeShader, GPUSort* gpuSorter, const ParticleGenerator3D::ParticleSpawnData3D& spawnData)
-    : shader(shader), computeShader(computeShader), gpuSorter(gpuSorter) {
-    particleBuffers = new ParticleBuffers3D(particleCount, computeShader);
-    InitParticleData(particleCount, spawnData);
+ParticleRenderer3D::ParticleRenderer3D(Shader* shader, ComputeShader* computeShader, GPUSort* gpuSorter, const ParticleData3D& spawnData, size_t capacity)
+    : shader(shader), computeShader(computeShader), gpuSorter(gpuSorter), positionBasedFluids(nullptr), capacity(std::max(capacity, spawnData.positions.size())), drawFromCountBuffer(false) {
+    particleBuffers = new ParticleBuffers3D(spawnData.positions.size(), computeShader, this->capacity);
+    InitParticleData(spawnData);
     InitRenderBuffers();
 }
 
 ParticleRenderer3D::~ParticleRenderer3D() {
+    delete positionBasedFluids;
     delete particleBuffers;
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
@@ -31,7 +33,8 @@ void ParticleRenderer3D::InitRenderBuffers() {
     CheckGLError("ParticleRenderer3D::InitRenderBuffers - BindPositionBuffer");
 
     if (!particleData.positions.empty()) {
-        glBufferData(GL_ARRAY_BUFFER, particleData.positions.size() * sizeof(glm::vec3), particleData.positions.data(), GL_DYNAMIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, particleData.positions.size() * sizeof(glm::vec3), particleData.positions.data());
         CheckGLError("ParticleRenderer3D::InitRenderBuffers - PositionBufferData");
     }
     else {
@@ -52,7 +55,8 @@ void ParticleRenderer3D::InitRenderBuffers() {
     CheckGLError("ParticleRenderer3D::InitRenderBuffers - BindVelocityBuffer");
 
     if (!particleData.velocities.empty()) {
-        glBufferData(GL_ARRAY_BUFFER, particleData.velocities.size() * sizeof(glm::vec3), particleData.velocities.data(), GL_DYNAMIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, particleData.velocities.size() * sizeof(glm::vec3), particleData.velocities.data());
         CheckGLError("ParticleRenderer3D::InitRenderBuffers - VelocityBufferData");
     }
     else {
@@ -73,10 +77,13 @@ void ParticleRenderer3D::InitRenderBuffers() {
     CheckGLError("ParticleRenderer3D::InitRenderBuffers - UnbindVertexArray");
 }
 
-void ParticleRenderer3D::InitParticleData(size_t particleCount, const ParticleGenerator3D::ParticleSpawnData3D& spawnData) {
-    particleData.positions = spawnData.positions;
-    particleData.velocities = spawnData.velocities;
-    particleData.predictedPositions = spawnData.positions;
+void ParticleRenderer3D::InitParticleData(const ParticleData3D& spawnData) {
+    // Copy assignment would shrink the reserved capacity to the spawn count, so reserve first and copy the elements
+    size_t particleCount = spawnData.positions.size();
+    particlePool.Reserve(particleData, capacity);
+    particleData.positions.assign(spawnData.positions.begin(), spawnData.positions.end());
+    particleData.velocities.assign(spawnData.velocities.begin(), spawnData.velocities.end());
+    particleData.predictedPositions.assign(spawnData.positions.begin(), spawnData.positions.end());
 
     particleData.densities.resize(particleCount);
     particleData.spatialIndices.resize(particleCount);
@@ -90,16 +97,9 @@ void ParticleRenderer3D::InitParticleData(size_t particleCount, const ParticleGe
 }
 
 void ParticleRenderer3D::ResizeBuffers() {
-    useComputeShader();
-    glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
-    glBufferData(GL_ARRAY_BUFFER, particleData.positions.size() * sizeof(glm::vec3), particleData.positions.data(), GL_DYNAMIC_DRAW);
-    CheckGLError("ParticleRenderer3D::ResizeBuffers - Resize positionVBO");
-
-    glBindBuffer(GL_ARRAY_BUFFER, velocityVBO);
-    glBufferData(GL_ARRAY_BUFFER, particleData.velocities.size() * sizeof(glm::vec3), particleData.velocities.data(), GL_DYNAMIC_DRAW);
-    CheckGLError("ParticleRenderer3D::ResizeBuffers - Resize velocityVBO");
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0); // Unbind the buffer
+    // updateBuffer only reallocates once the particles outgrow the capacity
+    capacity = std::max(capacity, particleData.positions.size());
+    UpdateRenderBuffers();
 }
 
 void ParticleRenderer3D::UpdateParticlesSlow() {
@@ -108,52 +108,51 @@ void ParticleRenderer3D::UpdateParticlesSlow() {
     useComputeShader();
     CheckGLError("ParticleRenderer3D::UpdateParticlesSlow - Use Compute Shader Program");
 
-    GLuint particleCount = static_cast<GLuint>(particleData.positions.size());
-    if (!validateParticleData(particleCount, NumThreads)) return;
-
-    computeShader->DispatchComputeShader(particleCount, NumThreads);
-    RetrieveAndDebugData();
+    // The GPU pool may have changed the count since the last frame; the count buffer sizes the launch
+    boundaryTexture.Bind(computeShader);
+    particleBuffers->BindParticleBuffers();
+    computeShader->DispatchComputeIndirect(particleBuffers->GetCountBuffer());
 
-    updateBuffer(positionVBO, particleData.positions, "positions");
-    updateBuffer(velocityVBO, particleData.velocities, "velocities");
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    CheckGLError("ParticleRenderer3D::UpdateParticlesSlow - BindBuffer 0");
+    CopyRenderBuffers();
 }
 
-void ParticleRenderer3D::UpdateParticlesHash() {
+void ParticleRenderer3D::UpdateParticlesHash(const FluidParams3D& params) {
     CheckGLError("ParticleRenderer3D::UpdateParticlesHash - Before BindBuffers");
 
     useComputeShader();
     CheckGLError("ParticleRenderer3D::UpdateParticlesHash - Use Compute Shader Program");
 
-    GLuint particleCount = static_cast<GLuint>(particleData.positions.size());
-    if (!validateParticleData(particleCount, NumThreads)) return;
+    particleBuffers->BindParticleBuffers();
 
-    // First pass
+    // First pass, over the capacity: the slots past the live particles get EmptyKey entries, so
+    // neither this pass nor the sort needs the count the pool left in the count buffer
+    GLuint entries = static_cast<GLuint>(particleBuffers->GetCapacity());
     computeShader->setBool("passType", false);
-    computeShader->DispatchComputeShader(particleCount, NumThreads);
+    computeShader->setUInt("numEntries", entries);
+    computeShader->DispatchGroups((entries + HashThreads - 1) / HashThreads);
 
-    // Sort particles
-    particleBuffers->RetrieveSpatialData(particleData.spatialIndices, particleData.spatialOffsets);
+    // Sort particles; the entries and offsets stay on the GPU
+    gpuSorter->SetRebinThreshold(params.rebinThreshold);
+    gpuSorter->SortAndCalculateOffsets(particleBuffers->GetSpatialIndicesBuffer(), particleBuffers->GetSpatialOffsetsBuffer(), entries);
     useComputeShader();
-    gpuSorter->UpdateBuffers(particleData.spatialIndices, particleData.spatialOffsets);
-    gpuSorter->Sort();
-    gpuSorter->RetrieveSpatialData(particleData.spatialIndices, particleData.spatialOffsets);
-    useComputeShader();
-    particleBuffers->UpdateSpatialData(particleData.spatialIndices, particleData.spatialOffsets);
+    // The sorter binds its own buffers to the shared binding points
+    particleBuffers->BindParticleBuffers();
 
     // Apply physics
     computeShader->setBool("passType", true);
-    computeShader->DispatchComputeShader(particleCount, NumThreads);
+    computeShader->DispatchComputeIndirect(particleBuffers->GetCountBuffer());
 
-    RetrieveAndDebugData();
+    CopyRenderBuffers();
+}
 
-    updateBuffer(positionVBO, particleData.positions, "positions");
-    updateBuffer(velocityVBO, particleData.velocities, "velocities");
+void ParticleRenderer3D::UpdateParticlesPBF(const FluidParams3D& params) {
+    CheckGLError("ParticleRenderer3D::UpdateParticlesPBF - Before Step");
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    CheckGLError("ParticleRenderer3D::UpdateParticlesHash - BindBuffer 0");
+    if (!positionBasedFluids) positionBasedFluids = new PositionBasedFluidsGPU3D();
+    boundaryTexture.Update(params);
+    positionBasedFluids->Step(*particleBuffers, boundaryTexture, params);
+
+    CopyRenderBuffers();
 }
 
 void ParticleRenderer3D::useComputeShader() {
@@ -177,32 +176,20 @@ bool ParticleRenderer3D::validateParticleData(GLuint particleCount, GLuint numTh
 }
 
 void ParticleRenderer3D::addParticles(const std::vector<glm::vec3>& newPositions) {
-    size_t newParticleCount = particleData.positions.size() + newPositions.size();
-
-    // Reserve space for new particles
-    particleData.positions.reserve(newParticleCount);
-    particleData.velocities.reserve(newParticleCount);
-    particleData.predictedPositions.reserve(newParticleCount);
-    particleData.densities.reserve(newParticleCount);
-    particleData.spatialIndices.reserve(newParticleCount);
-    particleData.spatialOffsets.reserve(newParticleCount);
-
-    // Add new particles
-    particleData.positions.insert(particleData.positions.end(), newPositions.begin(), newPositions.end());
-    particleData.velocities.insert(particleData.velocities.end(), newPositions.size(), glm::vec3(10.0f, 10.0f, 10.0f));
-    particleData.predictedPositions.insert(particleData.predictedPositions.end(), newPositions.begin(), newPositions.end());
-
-    particleData.densities.insert(particleData.densities.end(), newPositions.size(), glm::vec2(0.0f, 0.0f));
-    particleData.spatialIndices.insert(particleData.spatialIndices.end(), newPositions.size(), glm::uvec3(0));
-    particleData.spatialOffsets.insert(particleData.spatialOffsets.end(), newPositions.size(), 0);
-
-    // Reinitialize buffers with new size
-    ResizeBuffers();
+    size_t firstNew = particleData.positions.size();
+    std::vector<glm::vec3> newVelocities(newPositions.size(), glm::vec3(10.0f, 10.0f, 10.0f));
+    size_t added = particlePool.Emit(particleData, nullptr, newPositions.data(), newVelocities.data(), newPositions.size());
 
-    particleBuffers->InitBuffers(newParticleCount);
-    particleBuffers->UpdateAllBuffers(particleData);
+    // Only the new slots are uploaded while the particles fit the capacity
+    if (particleData.positions.size() > particleBuffers->GetCapacity()) {
+        particleBuffers->UpdateAllBuffers(particleData);
+    }
+    else {
+        particleBuffers->UpdateRange(particleData, firstNew, added);
+    }
+    ResizeBuffers();
 
-    std::cout << "Added " << newPositions.size() << " particles. Total particles: " << particleData.positions.size() << std::endl;
+    std::cout << "Added " << added << " particles. Total particles: " << particleData.positions.size() << std::endl;
 }
 
 void ParticleRenderer3D::updateBuffer(GLuint buffer, const std::vector<glm::vec3>& data, const std::string& bufferName) {
@@ -217,9 +204,10 @@ void ParticleRenderer3D::updateBuffer(GLuint buffer, const std::vector<glm::vec3
     // Calculate the new data size
     GLsizeiptr dataSize = data.size() * sizeof(glm::vec3);
 
-    // If the buffer size is different from the data size, reallocate the buffer
-    if (bufferSize != dataSize) {
-        glBufferData(GL_ARRAY_BUFFER, dataSize, nullptr, GL_DYNAMIC_DRAW);
+    // Reallocate only when the data outgrows the buffer; draws use the particle count, not the buffer size
+    if (bufferSize < dataSize) {
+        GLsizeiptr capacitySize = static_cast<GLsizeiptr>(std::max(capacity, data.size()) * sizeof(glm::vec3));
+        glBufferData(GL_ARRAY_BUFFER, capacitySize, nullptr, GL_DYNAMIC_DRAW);
         CheckGLError("ParticleRenderer3D::UpdateParticles - " + bufferName + " BufferData");
     }
 
@@ -232,6 +220,60 @@ void ParticleRenderer3D::updateBuffer(GLuint buffer, const std::vector<glm::vec3
     }
 }
 
+void ParticleRenderer3D::CopyRenderBuffers() {
+    // The whole capacity is copied on the GPU: reading the count back would wait for the step, and the
+    // draw command in the count buffer limits what is drawn. The host copy is left as it was.
+    drawFromCountBuffer = true;
+    GLsizeiptr size = static_cast<GLsizeiptr>(particleBuffers->GetCapacity() * sizeof(glm::vec3));
+    auto copyColumn = [&](GLuint source, GLuint target, const std::string& bufferName) {
+        glBindBuffer(GL_COPY_READ_BUFFER, source);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, target);
+        GLint targetSize = 0;
+        glGetBufferParameteriv(GL_COPY_WRITE_BUFFER, GL_BUFFER_SIZE, &targetSize);
+        // The SSBOs grow past the initial capacity when a checkpoint or upload brings more particles
+        if (targetSize < size) {
+            glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+        }
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+        CheckGLError("ParticleRenderer3D::CopyRenderBuffers - " + bufferName);
+        };
+
+    copyColumn(particleBuffers->GetPositionsBuffer(), positionVBO, "positions");
+    copyColumn(particleBuffers->GetVelocitiesBuffer(), velocityVBO, "velocities");
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void ParticleRenderer3D::UpdateRenderBuffers() {
+    drawFromCountBuffer = false;
+    updateBuffer(positionVBO, particleData.positions, "positions");
+    updateBuffer(velocityVBO, particleData.velocities, "velocities");
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleRenderer3D::UploadParticleData() {
+    useComputeShader();
+    // The CPU backend's emitters and sinks may have changed the count since the last upload
+    particleBuffers->UpdateAllBuffers(particleData);
+}
+
+bool ParticleRenderer3D::WriteCheckpoint(CheckpointWriter& writer, bool fromGpu) {
+    if (!fromGpu) {
+        return writer.WriteParticleData(particleData);
+    }
+    useComputeShader();
+    return particleBuffers->WriteCheckpointColumns(writer);
+}
+
+bool ParticleRenderer3D::LoadCheckpoint(const CheckpointReader& reader) {
+    useComputeShader();
+    if (!particleBuffers->LoadCheckpointColumns(reader)) return false;
+
+    // The host copy feeds the render buffers, the time step limits and the CPU backend
+    if (!reader.ReadParticleData(particleData)) return false;
+    ResizeBuffers();
+    return true;
+}
 
 void ParticleRenderer3D::RetrieveAndDebugData() {
     useComputeShader();
@@ -262,7 +304,15 @@ void ParticleRenderer3D::DrawParticles(Camera* camera) {
     glPointSize(5.0f);
     CheckGLError("ParticleRenderer3D::DrawParticles - PointSize");
 
-    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(particleData.positions.size()));
+    // The render buffers were copied from the SSBOs, so the draw command in the count buffer has their count
+    if (drawFromCountBuffer) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, particleBuffers->GetCountBuffer());
+        glDrawArraysIndirect(GL_POINTS, reinterpret_cast<const void*>(ParticleBuffers3D::DrawCommandOffset));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else {
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(particleData.positions.size()));
+    }
     CheckGLError("ParticleRenderer3D::DrawParticles - DrawArrays");
 
     glBindVertexArray(0);
@@ -288,21 +338,25 @@ ParticleBuffers3D* ParticleRenderer3D::GetParticleBuffers() const {
     return particleBuffers;
 }
 
+float ParticleRenderer3D::MaxLength(const std::vector<glm::vec3>& values) const {
+    const size_t grainSize = 4096;
+    return TaskScheduler::Instance().ParallelReduce(size_t(0), values.size(), grainSize, 0.0f,
+        [&](size_t begin, size_t end) {
+            float maxLength = 0.0f;
+            for (size_t i = begin; i < end; ++i) {
+                maxLength = std::max(maxLength, glm::length(values[i]));
+            }
+            return maxLength;
+        },
+        [](float a, float b) { return std::max(a, b); });
+}
+
 float ParticleRenderer3D::GetMaxVelocity() const {
-    float maxVelocity = 0.0f;
-    for (const auto& velocity : particleData.velocities) {
-        maxVelocity = std::max(maxVelocity, glm::length(velocity));
-    }
-    return maxVelocity;
+    return MaxLength(particleData.velocities);
 }
 
 float ParticleRenderer3D::GetMaxAcceleration(float deltaTime) const {
-    float maxAcceleration = 0.0f;
-    for (size_t i = 0; i < particleData.velocities.size(); ++i) {
-        glm::vec3 acceleration = particleData.velocities[i] / deltaTime;
-        maxAcceleration = std::max(maxAcceleration, glm::length(acceleration));
-    }
-    return maxAcceleration;
+    return MaxLength(particleData.velocities) / deltaTime;
 }
 
 void ParticleRenderer3D::DebugParticleData() {
@@ -8,25 +8,43 @@
 #include <functional>
 
 #include "Shader.h"
+#include "BoundaryTexture3D.h"
 #include "ParticleBuffers3D.h"
 #include "ParticleGenerator3D.h"
+#include "ParticlePool3D.h"
 #include "ComputeShader.h"
 #include "ParticleData.h"
 #include "GPUSort.h"
+#include "PositionBasedFluidsGPU3D.h"
 #include "Camera.h"
+#include "TaskScheduler.h"
 
 class ParticleRenderer3D {
 public:
-    ParticleRenderer3D(size_t particleCount, Shader* shader, ComputeShader* computeShader, GPUSort* gpuSorter, const ParticleGenerator3D::ParticleSpawnData3D& spawnData);
+    // capacity is the most particles the scene can hold; the SSBOs and render buffers are sized for it once.
+    ParticleRenderer3D(Shader* shader, ComputeShader* computeShader, GPUSort* gpuSorter, const ParticleData3D& spawnData, size_t capacity);
     ~ParticleRenderer3D();
 
     void UpdateParticlesSlow();
-    void UpdateParticlesHash();
+    void UpdateParticlesHash(const FluidParams3D& params);
+    // Steps either GPU backend with PositionBasedFluids_3D.comp instead of the selected shader.
+    void UpdateParticlesPBF(const FluidParams3D& params);
     void useComputeShader();
     bool validateParticleData(GLuint particleCount, GLuint numThreads);
     void addParticles(const std::vector<glm::vec3>& newPositions);
+    // Solids baked into the GPU backends' boundary field with the box.
+    void SetObstacles(const std::vector<Obstacle3D>& obstacles) { boundaryTexture.SetObstacles(obstacles); }
+    // Rebakes the boundary field after the box changed.
+    void UpdateBoundary(const FluidParams3D& params) { boundaryTexture.Update(params); }
     void updateBuffer(GLuint buffer, const std::vector<glm::vec3>& data, const std::string& bufferName);
+    void UpdateRenderBuffers();
+    void UploadParticleData();
+    // Reads the SSBOs back into the host copy, which waits for the GPU. The steps only copy the
+    // SSBOs into the render buffers, so this is for explicit downloads (export, backend switch, debug).
     void RetrieveAndDebugData();
+    // fromGpu streams the SSBOs; otherwise the host columns (the CPU backend's state) are written.
+    bool WriteCheckpoint(CheckpointWriter& writer, bool fromGpu);
+    bool LoadCheckpoint(const CheckpointReader& reader);
     void DrawParticles(Camera* camera);
 
     void get_apply_set(std::function<void(std::vector<glm::vec3>&, std::vector<glm::vec3>&, float)> func, float deltaTime);
@@ -44,14 +62,26 @@ private:
     GPUSort* gpuSorter;
     ParticleBuffers3D* particleBuffers;
     ParticleData3D particleData;
+    ParticlePool3D particlePool;
+    BoundaryTexture3D boundaryTexture;
+    // Created by the first PBF step
+    PositionBasedFluidsGPU3D* positionBasedFluids;
     GLuint VAO, VBO;
     GLuint positionVBO, velocityVBO;
+    size_t capacity;
+    // Set while the GPU backends run: the draw count then comes from the count buffer, like their dispatches
+    bool drawFromCountBuffer;
 
     static const int NumThreads = 64;
+    // local_size_x of FluidSimulatorHash_3D.comp
+    static const GLuint HashThreads = 1024;
 
     void InitRenderBuffers();
-    void InitParticleData(size_t particleCount, const ParticleGenerator3D::ParticleSpawnData3D& spawnData);
+    void InitParticleData(const ParticleData3D& spawnData);
     void ResizeBuffers();
+    // GPU-to-GPU copy of the position and velocity SSBOs into the render buffers after a GPU step.
+    void CopyRenderBuffers();
+    float MaxLength(const std::vector<glm::vec3>& values) const;
     void CheckGLError(const std::string& operation);
 };
 
@@ -0,0 +1,41 @@
+#include "ParticleSpawnerGPU3D.h"
+
+ParticleSpawnerGPU3D::ParticleSpawnerGPU3D(const std::string& shaderPath)
+    : computeShader(new ComputeShader(shaderPath)) {}
+
+ParticleSpawnerGPU3D::~ParticleSpawnerGPU3D() {
+    delete computeShader;
+}
+
+void ParticleSpawnerGPU3D::Spawn(const ParticleGenerator3D& generator, ParticleBuffers3D& buffers, size_t firstParticle) {
+    int count = generator.GetParticleCount();
+    if (count <= 0) return;
+    if (firstParticle + static_cast<size_t>(count) > buffers.GetCapacity()) {
+        std::cerr << "ParticleSpawnerGPU3D::Spawn Error: " << count << " particles at slot " << firstParticle
+            << " exceed the buffer capacity of " << buffers.GetCapacity() << std::endl;
+        return;
+    }
+
+    computeShader->use();
+    buffers.BindParticleBuffers();
+    computeShader->setUInt("particleCount", static_cast<unsigned int>(count));
+    computeShader->setUInt("firstParticle", static_cast<unsigned int>(firstParticle));
+    computeShader->setIVec3("latticeDims", generator.GetLatticeDimensions());
+    computeShader->setVec3("spawnCentre", generator.GetSpawnCentre());
+    computeShader->setVec3("spawnSize", generator.GetSpawnSize());
+    computeShader->setVec3("initialVelocity", generator.GetInitialVelocity());
+    computeShader->setFloat("jitterStrength", generator.GetJitterStrength());
+    computeShader->setUInt("seed", generator.GetSeed());
+    computeShader->setUInt("stream", generator.GetStream());
+    computeShader->DispatchComputeShader(static_cast<GLuint>(count), NumThreads);
+}
+
+void ParticleSpawnerGPU3D::SpawnScene(const Scene3D& scene, ParticleBuffers3D& buffers) {
+    size_t offset = 0;
+    for (size_t b = 0; b < scene.fluidBlocks.size(); ++b) {
+        const FluidBlock3D& block = scene.fluidBlocks[b];
+        ParticleGenerator3D generator(block.particleCount, block.velocity, block.centre, block.size, block.jitter, scene.seed, static_cast<uint32_t>(b));
+        Spawn(generator, buffers, offset);
+        offset += static_cast<size_t>(block.particleCount);
+    }
+}
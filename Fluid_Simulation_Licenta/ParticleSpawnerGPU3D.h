@@ -0,0 +1,29 @@
+#ifndef PARTICLE_SPAWNER_GPU_3D_H
+#define PARTICLE_SPAWNER_GPU_3D_H
+
+#include <string>
+
+#include "ComputeShader.h"
+#include "ParticleBuffers3D.h"
+#include "ParticleGenerator3D.h"
+#include "Scene3D.h"
+
+// Runs SpawnParticles_3D.comp to fill the particle SSBOs without a host copy or
+// upload. Uses the same lattice and Philox streams as ParticleGenerator3D::Generate.
+class ParticleSpawnerGPU3D {
+public:
+    explicit ParticleSpawnerGPU3D(const std::string& shaderPath = "shaders/SpawnParticles_3D.comp");
+    ~ParticleSpawnerGPU3D();
+
+    // Writes the generator's particles to slots [firstParticle, firstParticle + count) of buffers.
+    void Spawn(const ParticleGenerator3D& generator, ParticleBuffers3D& buffers, size_t firstParticle);
+    // Spawns every fluid block of scene back to back, like SceneLoader3D::Spawn does on the host.
+    void SpawnScene(const Scene3D& scene, ParticleBuffers3D& buffers);
+
+    static const int NumThreads = 64;
+
+private:
+    ComputeShader* computeShader;
+};
+
+#endif // PARTICLE_SPAWNER_GPU_3D_H
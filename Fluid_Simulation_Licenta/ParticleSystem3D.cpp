@@ -1,38 +1,156 @@
 #include "ParticleSystem3D.h"
 
-ParticleSystem3D::ParticleSystem3D(ShaderManager3D* shaderManager) : shaderManager(shaderManager), particleGenerator(nullptr), particleRenderer(nullptr) {
-    InitParticleGenerator();
-    ParticleGenerator3D::ParticleSpawnData3D spawnData = particleGenerator->GetSpawnData();
+ParticleSystem3D::ParticleSystem3D(ShaderManager3D* shaderManager, const Scene3D& scene) : shaderManager(shaderManager), particleRenderer(nullptr), cpuSolver(new FluidSolverCPU3D()), gridSolver(new FluidSolverAPIC3D()), trajectoryPlayer(new TrajectoryPlayer()), emitters(nullptr), gpuPool(nullptr) {
+    size_t capacity = static_cast<size_t>(scene.GetMaxParticleCount());
+    ParticleData3D spawnData;
+    SceneLoader3D::Spawn(scene, spawnData);
+    cpuSolver->Reserve(capacity);
+    cpuSolver->SetObstacles(scene.obstacles);
+    gridSolver->Reserve(capacity);
+    gridSolver->SetObstacles(scene.obstacles);
     GPUSort* gpuSorter = new GPUSort();
-    particleRenderer = new ParticleRenderer3D(particleGenerator->GetParticleCount(), shaderManager->GetShader(), shaderManager->GetComputeShader(), gpuSorter, spawnData);
+    particleRenderer = new ParticleRenderer3D(shaderManager->GetShader(), shaderManager->GetComputeShader(), gpuSorter, spawnData, capacity);
+    particleRenderer->SetObstacles(scene.obstacles);
+
+    if (!scene.emitters.empty() || !scene.sinks.empty()) {
+        emitters = new ParticleEmitters3D(scene);
+        gpuPool = new ParticlePoolGPU3D();
+    }
 }
 
 ParticleSystem3D::~ParticleSystem3D() {
-    delete particleGenerator;
     delete particleRenderer;
+    delete cpuSolver;
+    delete gridSolver;
+    delete trajectoryPlayer;
+    delete gpuPool;
+    delete emitters;
 }
 
-void ParticleSystem3D::InitParticleGenerator() {
-    float boxWidth = 1024.0f;
-    float boxHeight = 300.0f;
-    float boxDepth = 1024.0f;
-
-    particleGenerator = new ParticleGenerator3D(
-        10000,
-        glm::vec3(10.0f, 10.0f, 10.0f),
-        glm::vec3(boxWidth / 2, boxHeight / 2, boxDepth / 2),
-        glm::vec3(boxWidth, boxHeight, boxDepth),
-        0.1f
-    );
+void ParticleSystem3D::UpdateEmitters() {
+    float deltaTime = shaderManager->GetFluidParams().deltaTime;
+    if (Type == SimulationType3D::CPU) {
+        ParticleData3D& particleData = particleRenderer->GetParticleData();
+        emitters->Update(particleData, &cpuSolver->GetParticleIds(), simulationTime, deltaTime);
+        if (emitters->GetLastRemovedCount() > 0) cpuSolver->CompactSlots(emitters->GetPool().GetLastDestinations());
+    }
+    else if (Type == SimulationType3D::GRID) {
+        emitters->Update(particleRenderer->GetParticleData(), nullptr, simulationTime, deltaTime);
+    }
+    else {
+        // The GPU backends' state is in the SSBOs, so the pool works there; the host copy picks up
+        // the new count with the next download
+        gpuPool->Update(*emitters, *particleRenderer->GetParticleBuffers(), simulationTime, deltaTime);
+    }
+    simulationTime += deltaTime;
 }
 
 void ParticleSystem3D::UpdateParticles() {
-    if (Type == SimulationType3D::SLOW) {
+    setSimulationType(shaderManager->GetSimulationType());
+    if (emitters && Type != SimulationType3D::PLAYBACK) {
+        UpdateEmitters();
+    }
+
+    bool onGpu = Type == SimulationType3D::SLOW || Type == SimulationType3D::HASH;
+    if (onGpu && shaderManager->GetFluidParams().pressureSolver == PressureSolver3D::PBF) {
+        particleRenderer->UpdateParticlesPBF(shaderManager->GetFluidParams());
+    }
+    else if (Type == SimulationType3D::SLOW) {
+        particleRenderer->UpdateBoundary(shaderManager->GetFluidParams());
         particleRenderer->UpdateParticlesSlow();
     }
+    else if (Type == SimulationType3D::HASH) {
+        particleRenderer->UpdateParticlesHash(shaderManager->GetFluidParams());
+    }
+    else if (Type == SimulationType3D::CPU) {
+        cpuSolver->Step(particleRenderer->GetParticleData(), shaderManager->GetFluidParams());
+        particleRenderer->UpdateRenderBuffers();
+    }
+    else if (Type == SimulationType3D::GRID) {
+        gridSolver->Step(particleRenderer->GetParticleData(), shaderManager->GetFluidParams());
+        particleRenderer->UpdateRenderBuffers();
+    }
     else {
-        particleRenderer->UpdateParticlesHash();
+        // Nothing is simulated; decoded frames are swapped into the host copy and uploaded to the render VBOs
+        ParticleData3D& particleData = particleRenderer->GetParticleData();
+        if (trajectoryPlayer->AcquireFrame(particleData.positions, particleData.velocities)) {
+            particleData.predictedPositions.resize(particleData.positions.size());
+            particleData.densities.resize(particleData.positions.size());
+            particleRenderer->UpdateRenderBuffers();
+        }
+    }
+    if (onGpu) {
+        hostCopyStale = true;
+        if (++stepsSinceDownload >= TimeStepDownloadInterval) DownloadParticleData();
+    }
+}
+
+void ParticleSystem3D::DownloadParticleData() {
+    // Played frames replace the host copy, so the SSBOs are only read back while a GPU backend runs
+    bool onGpu = Type == SimulationType3D::SLOW || Type == SimulationType3D::HASH;
+    if (!hostCopyStale || !onGpu) return;
+    particleRenderer->RetrieveAndDebugData();
+    hostCopyStale = false;
+    stepsSinceDownload = 0;
+}
+
+bool ParticleSystem3D::WriteCheckpoint(CheckpointWriter& writer) {
+    // The CPU backends' state is the host copy; the GPU backends' state is in the SSBOs
+    bool onCpu = Type == SimulationType3D::CPU;
+    bool onGpu = Type == SimulationType3D::SLOW || Type == SimulationType3D::HASH;
+    if (Type == SimulationType3D::PLAYBACK) {
+        ParticleData3D& particleData = particleRenderer->GetParticleData();
+        particleData.predictedPositions = particleData.positions;
+    }
+    if (!particleRenderer->WriteCheckpoint(writer, onGpu)) return false;
+
+    const std::vector<uint32_t>& ids = cpuSolver->GetParticleIds();
+    if (onCpu && ids.size() == writer.GetState().particleCount) {
+        return writer.WriteChunk(Checkpoint3D::ParticleIds, sizeof(uint32_t), ids.data(), ids.size() * sizeof(uint32_t));
+    }
+    if (Type == SimulationType3D::GRID) {
+        std::vector<glm::mat3> affine;
+        gridSolver->GetAffine(particleRenderer->GetParticleData(), affine);
+        return writer.WriteChunk(Checkpoint3D::Affine, sizeof(glm::mat3), affine.data(), affine.size() * sizeof(glm::mat3));
+    }
+    return true;
+}
+
+bool ParticleSystem3D::LoadCheckpoint(const CheckpointReader& reader) {
+    // The loaded state replaces the played frames, so skip the restart that leaving playback requests
+    if (Type == SimulationType3D::PLAYBACK) {
+        trajectoryPlayer->Close();
+    }
+    Type = shaderManager->GetSimulationType();
+    if (!particleRenderer->LoadCheckpoint(reader)) return false;
+    hostCopyStale = false;
+    cpuSolver->RestoreState(reader.ReadParticleIds(), static_cast<size_t>(reader.GetState().stepCount));
+    std::vector<glm::mat3> affine = reader.ReadAffine();
+    if (Type == SimulationType3D::GRID && affine.empty()) {
+        std::cerr << "ParticleSystem3D::LoadCheckpoint Warning: No affine matrices in the checkpoint, so they start from zero" << std::endl;
+    }
+    gridSolver->RestoreState(affine, particleRenderer->GetParticleData());
+    simulationTime = reader.GetState().simulationTime;
+    return true;
+}
+
+void ParticleSystem3D::setSimulationType(SimulationType3D value) {
+    // The CPU backends work on the host copy; take the GPU backends' state from the SSBOs when entering
+    // them and hand theirs back when leaving them
+    bool onCpu = Type == SimulationType3D::CPU || Type == SimulationType3D::GRID;
+    bool onGpu = Type == SimulationType3D::SLOW || Type == SimulationType3D::HASH;
+    if (onGpu && (value == SimulationType3D::CPU || value == SimulationType3D::GRID)) {
+        DownloadParticleData();
+    }
+    if (onCpu && value != SimulationType3D::CPU && value != SimulationType3D::GRID) {
+        particleRenderer->UploadParticleData();
+    }
+    // Played frames may not match the SSBOs in size, so leaving playback starts a fresh simulation
+    if (Type == SimulationType3D::PLAYBACK && value != SimulationType3D::PLAYBACK) {
+        trajectoryPlayer->Close();
+        Simulation3D::resetSimulationFlag = true;
     }
+    Type = value;
 }
 
 void ParticleSystem3D::DrawParticles(Camera* camera) {
@@ -1,44 +1,71 @@
 #ifndef PARTICLESYSTEM3D_H
 #define PARTICLESYSTEM3D_H
 
-#include "ParticleGenerator3D.h"
 #include "ParticleRenderer3D.h"
 #include "ShaderManager3D.h"
+#include "FluidSolverCPU3D.h"
+#include "FluidSolverAPIC3D.h"
+#include "SimulationType3D.h"
+#include "Checkpoint3D.h"
+#include "TrajectoryPlayer.h"
+#include "Scene3D.h"
+#include "ParticleEmitters3D.h"
+#include "ParticlePoolGPU3D.h"
 #include <functional>
 #include <vector>
 #include <glm/vec3.hpp>
 
-enum class SimulationType3D {
-    SLOW,
-    HASH
-};
-
 class ShaderManager3D;
 
 class ParticleSystem3D {
 public:
-    ParticleSystem3D(ShaderManager3D* shaderManager);
+    // Spawns the scene's fluid blocks; every particle buffer is sized for the scene's maximum particle count.
+    ParticleSystem3D(ShaderManager3D* shaderManager, const Scene3D& scene);
     ~ParticleSystem3D();
 
-    void InitParticleGenerator();
     void UpdateParticles();
     void DrawParticles(Camera* camera);
 
     ParticleRenderer3D* GetParticleRenderer() const;
+    FluidSolverCPU3D* GetCpuSolver() const { return cpuSolver; }
+    FluidSolverAPIC3D* GetGridSolver() const { return gridSolver; }
+    TrajectoryPlayer* GetTrajectoryPlayer() const { return trajectoryPlayer; }
+    // Null when the scene has no emitters or sinks
+    ParticleEmitters3D* GetEmitters() const { return emitters; }
+    ParticlePoolGPU3D* GetGpuPool() const { return gpuPool; }
 
     void ApplyFunctionToParticles(std::function<void(std::vector<glm::vec3>&, std::vector<glm::vec3>&, float)> func, float deltaTime);
 
+    // The time step limits use the host copy, which the GPU backends refresh every TimeStepDownloadInterval steps.
     float GetMaxVelocity() const;
     float GetMaxAcceleration(float deltaTime) const;
+    // Brings the host copy up to date after GPU steps, for the trajectory and exports. The CPU backends work on it already.
+    void DownloadParticleData();
+
+    bool WriteCheckpoint(CheckpointWriter& writer);
+    bool LoadCheckpoint(const CheckpointReader& reader);
 
-    void setSimulationType(SimulationType3D value) { Type = value; }
+    void setSimulationType(SimulationType3D value);
     SimulationType3D getSimulationType() { return Type; }
 
 private:
-    ParticleGenerator3D* particleGenerator;
+    // Runs the emitters and sinks on whichever side holds the state of the current backend.
+    void UpdateEmitters();
+
     ParticleRenderer3D* particleRenderer;
+    FluidSolverCPU3D* cpuSolver;
+    FluidSolverAPIC3D* gridSolver;
+    TrajectoryPlayer* trajectoryPlayer;
+    ParticleEmitters3D* emitters;
+    ParticlePoolGPU3D* gpuPool;
     ShaderManager3D* shaderManager;
+    double simulationTime = 0.0;
     SimulationType3D Type = SimulationType3D::SLOW;
+    // Set by GPU steps, which only copy the SSBOs into the render buffers
+    bool hostCopyStale = false;
+    int stepsSinceDownload = 0;
+
+    static const int TimeStepDownloadInterval = 30;
 };
 
 #endif // PARTICLESYSTEM3D_H
@@ -0,0 +1,43 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <cstdint>
+
+// Philox4x32-10 counter-based generator (Salmon et al., "Parallel random numbers:
+// as easy as 1, 2, 3"). The output is a pure function of (counter, key), so any
+// thread can draw the numbers of any particle without shared state.
+// shaders/philox.glsl implements the same rounds for the compute shaders.
+struct Philox4x32 {
+    uint32_t v[4];
+
+    static Philox4x32 Generate(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t k0, uint32_t k1) {
+        const uint32_t M0 = 0xD2511F53u;
+        const uint32_t M1 = 0xCD9E8D57u;
+        const uint32_t W0 = 0x9E3779B9u;
+        const uint32_t W1 = 0xBB67AE85u;
+
+        for (int round = 0; round < 10; ++round) {
+            uint64_t product0 = static_cast<uint64_t>(M0) * c0;
+            uint64_t product1 = static_cast<uint64_t>(M1) * c2;
+            uint32_t hi0 = static_cast<uint32_t>(product0 >> 32);
+            uint32_t lo0 = static_cast<uint32_t>(product0);
+            uint32_t hi1 = static_cast<uint32_t>(product1 >> 32);
+            uint32_t lo1 = static_cast<uint32_t>(product1);
+            c0 = hi1 ^ c1 ^ k0;
+            c1 = lo1;
+            c2 = hi0 ^ c3 ^ k1;
+            c3 = lo0;
+            k0 += W0;
+            k1 += W1;
+        }
+        Philox4x32 result = { { c0, c1, c2, c3 } };
+        return result;
+    }
+
+    // Uniform float in [0, 1) from the top 24 bits
+    static float ToUnitFloat(uint32_t value) {
+        return static_cast<float>(value >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+#endif // PHILOX_H
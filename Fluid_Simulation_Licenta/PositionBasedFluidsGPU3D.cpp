@@ -0,0 +1,87 @@
+#include "PositionBasedFluidsGPU3D.h"
+#include "FluidSolverGPU3D.h"
+#include "Profiler.h"
+#include "SPHKernels.h"
+
+namespace {
+    // Same as FluidSolverCPU3D: the artificial pressure reaches pbfTensileStrength at this fraction of the radius
+    const float TensileDistance = 0.2f;
+}
+
+PositionBasedFluidsGPU3D::PositionBasedFluidsGPU3D(const std::string& shaderPath)
+    : computeShader(new ComputeShader(shaderPath)), scratchBuffer(0), scratchCapacity(0) {}
+
+PositionBasedFluidsGPU3D::~PositionBasedFluidsGPU3D() {
+    glDeleteBuffers(1, &scratchBuffer);
+    delete computeShader;
+}
+
+void PositionBasedFluidsGPU3D::EnsureScratch(size_t capacity) {
+    if (capacity <= scratchCapacity) return;
+    glDeleteBuffers(1, &scratchBuffer);
+
+    // Same size as the buffers' vec3 columns, since the two trade places on every swap
+    glGenBuffers(1, &scratchBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, scratchBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    scratchCapacity = capacity;
+    CheckGLError("PositionBasedFluidsGPU3D::EnsureScratch");
+}
+
+void PositionBasedFluidsGPU3D::Step(ParticleBuffers3D& buffers, const BoundaryTexture3D& boundary, const FluidParams3D& params) {
+    ScopedTimer timer("GPU/PBF Step");
+    // The prediction and the sort run over the capacity, so the count never has to come back to the host
+    size_t capacity = buffers.GetCapacity();
+    if (capacity == 0) return;
+    EnsureScratch(capacity);
+
+    computeShader->use();
+    FluidSolverGPU3D::ApplyParams(computeShader, params);
+    SPHKernels kernels(params.smoothingRadius);
+    float spacing = 2.0f * params.particleRadius;
+    computeShader->setFloat("maxVelocity", params.maxVelocity);
+    computeShader->setFloat("restVolume", spacing * spacing * spacing);
+    computeShader->setFloat("pbfRelaxation", params.pbfRelaxation);
+    computeShader->setFloat("pbfTensileStrength", params.pbfTensileStrength);
+    computeShader->setFloat("tensileReference", kernels.SmoothingKernelPoly6(TensileDistance * params.smoothingRadius));
+    computeShader->setFloat("xsphViscosity", params.xsphViscosity);
+    boundary.Bind(computeShader);
+
+    // Slots past the live particles get EmptyKey entries, which the sort puts last
+    buffers.BindParticleBuffers();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, scratchBuffer);
+    computeShader->setUInt("pass", Predict);
+    computeShader->setUInt("numEntries", static_cast<unsigned int>(capacity));
+    computeShader->DispatchGroups(static_cast<GLuint>((capacity + NumThreads - 1) / NumThreads));
+    // The sorter takes over bindings 0 and 1 with the spatial entries and offsets
+    sorter.SortAndCalculateOffsets(buffers.GetSpatialIndicesBuffer(), buffers.GetSpatialOffsetsBuffer(), capacity);
+
+    computeShader->use();
+    for (int iteration = 0; iteration < params.pbfIterations; ++iteration) {
+        Dispatch(buffers, Lambda);
+        DispatchIntoColumn(buffers, Correct, ParticleBuffers3D::Column::PredictedPositions);
+    }
+    DispatchIntoColumn(buffers, Velocity, ParticleBuffers3D::Column::Velocities);
+    Dispatch(buffers, Finalize);
+    CheckGLError("PositionBasedFluidsGPU3D::Step");
+}
+
+void PositionBasedFluidsGPU3D::Dispatch(ParticleBuffers3D& buffers, Pass pass) {
+    buffers.BindParticleBuffers();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, scratchBuffer);
+    computeShader->setUInt("pass", pass);
+    computeShader->DispatchComputeIndirect(buffers.GetCountBuffer());
+}
+
+void PositionBasedFluidsGPU3D::DispatchIntoColumn(ParticleBuffers3D& buffers, Pass pass, ParticleBuffers3D::Column column) {
+    Dispatch(buffers, pass);
+    scratchBuffer = buffers.SwapColumn(column, scratchBuffer);
+}
+
+void PositionBasedFluidsGPU3D::CheckGLError(const std::string& operation) {
+    GLenum err;
+    while ((err = glGetError()) != GL_NO_ERROR) {
+        std::cerr << "OpenGL error during " << operation << ": " << std::hex << err << std::dec << std::endl;
+    }
+}
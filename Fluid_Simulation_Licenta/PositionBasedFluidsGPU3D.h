@@ -0,0 +1,44 @@
+#ifndef POSITION_BASED_FLUIDS_GPU_3D_H
+#define POSITION_BASED_FLUIDS_GPU_3D_H
+
+#include <GL/glew.h>
+#include <string>
+
+#include "BoundaryTexture3D.h"
+#include "ComputeShader.h"
+#include "FluidParams3D.h"
+#include "GPUSort.h"
+#include "ParticleBuffers3D.h"
+
+// GPU counterpart of the CPU solver's PBF mode: runs PositionBasedFluids_3D.comp on the particle
+// SSBOs. A step predicts the positions, hashes and sorts them with GPUSort, runs pbfIterations
+// lambda and correction passes, and takes the XSPH velocities from the result. Every pass is
+// dispatched indirectly from the count buffer except Predict and the sort, which pad to the
+// capacity, so a step never reads the count back.
+class PositionBasedFluidsGPU3D {
+public:
+    explicit PositionBasedFluidsGPU3D(const std::string& shaderPath = "shaders/PositionBasedFluids_3D.comp");
+    ~PositionBasedFluidsGPU3D();
+
+    // Advances the particles in buffers by params.deltaTime, colliding with the boundary field.
+    void Step(ParticleBuffers3D& buffers, const BoundaryTexture3D& boundary, const FluidParams3D& params);
+
+    static const int NumThreads = 64;
+
+private:
+    enum Pass : unsigned int { Predict = 0, Lambda = 1, Correct = 2, Velocity = 3, Finalize = 4 };
+
+    void EnsureScratch(size_t capacity);
+    void Dispatch(ParticleBuffers3D& buffers, Pass pass);
+    // Runs a pass that writes the scratch column, then swaps the scratch in for column.
+    void DispatchIntoColumn(ParticleBuffers3D& buffers, Pass pass, ParticleBuffers3D::Column column);
+    void CheckGLError(const std::string& operation);
+
+    ComputeShader* computeShader;
+    GPUSort sorter;
+    // vec3 column the correction and velocity passes write; after a swap it holds the replaced column
+    GLuint scratchBuffer;
+    size_t scratchCapacity;
+};
+
+#endif // POSITION_BASED_FLUIDS_GPU_3D_H
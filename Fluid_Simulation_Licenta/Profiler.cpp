@@ -0,0 +1,45 @@
+#include "Profiler.h"
+
+namespace {
+    const double smoothing = 0.1;
+}
+
+Profiler& Profiler::Instance() {
+    static Profiler instance;
+    return instance;
+}
+
+void Profiler::Record(std::map<std::string, Entry>& entries, const std::string& name, double value) {
+    Entry& entry = entries[name];
+    entry.last = value;
+    entry.average = entry.samples == 0 ? value : entry.average + (value - entry.average) * smoothing;
+    entry.samples++;
+}
+
+void Profiler::AddTiming(const std::string& name, double milliseconds) {
+    if (!enabled) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    Record(timings, name, milliseconds);
+}
+
+void Profiler::SetCounter(const std::string& name, double value) {
+    if (!enabled) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    Record(counters, name, value);
+}
+
+void Profiler::Reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    timings.clear();
+    counters.clear();
+}
+
+std::map<std::string, Profiler::Entry> Profiler::GetTimings() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return timings;
+}
+
+std::map<std::string, Profiler::Entry> Profiler::GetCounters() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
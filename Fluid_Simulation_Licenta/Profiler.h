@@ -0,0 +1,54 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Process-wide collection of phase timings and counters.
+// Timings are smoothed with an exponential moving average so they can be shown every frame.
+class Profiler {
+public:
+    struct Entry {
+        double last = 0.0;
+        double average = 0.0;
+        size_t samples = 0;
+    };
+
+    static Profiler& Instance();
+
+    void AddTiming(const std::string& name, double milliseconds);
+    void SetCounter(const std::string& name, double value);
+    void Reset();
+
+    std::map<std::string, Entry> GetTimings() const;
+    std::map<std::string, Entry> GetCounters() const;
+
+    void setEnabled(bool value) { enabled = value; }
+    bool isEnabled() const { return enabled; }
+
+private:
+    Profiler() = default;
+    void Record(std::map<std::string, Entry>& entries, const std::string& name, double value);
+
+    mutable std::mutex mutex;
+    std::map<std::string, Entry> timings;
+    std::map<std::string, Entry> counters;
+    bool enabled = true;
+};
+
+// Adds the lifetime of the object to the named timing.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const std::string& name) : name(name), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        Profiler::Instance().AddTiming(name, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    std::string name;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // PROFILER_H
@@ -1,86 +1,190 @@
-#include "Octree.h"
+#include "QuadTree.h"
+#include <algorithm>
+#include <limits>
 
-Octree::Octree(AABB3D boundary, int capacity)
-    : boundary(boundary), capacity(capacity), divided(false) {}
+#include "Morton.h"
 
-Octree::~Octree() {}
+namespace {
+    const uint32_t GridSize = 1u << Quadtree::MaxLevel;
+    const size_t NodeGrain = 64;
+    const size_t QueryGrain = 256;
 
-bool Octree::insert(Point3D point) {
-    if (!boundary.contains(point)) {
-        return false;
-    }
+    struct PointBounds {
+        glm::vec2 boundsMin = glm::vec2(std::numeric_limits<float>::max());
+        glm::vec2 boundsMax = glm::vec2(-std::numeric_limits<float>::max());
+    };
+}
 
-    if (points.size() < capacity) {
-        points.push_back(point);
-        return true;
-    }
+Quadtree::Quadtree(TaskScheduler& scheduler) : scheduler(scheduler), radixSort(scheduler), depth(0) {}
 
-    if (!divided) {
-        subdivide();
-    }
+void Quadtree::Clear() {
+    nodes.clear();
+    sortedPoints.clear();
+    pointIndices.clear();
+    keys.clear();
+    depth = 0;
+}
 
-    for (int i = 0; i < 8; ++i) {
-        if (children[i]->insert(point)) {
-            return true;
+void Quadtree::Build(const std::vector<glm::vec2>& positions, uint32_t leafCapacity) {
+    Clear();
+    size_t count = positions.size();
+    if (count == 0) return;
+
+    PointBounds bounds = scheduler.ParallelReduce(size_t(0), count, PointGrain, PointBounds(),
+        [&](size_t begin, size_t end) {
+            PointBounds chunk;
+            for (size_t i = begin; i < end; ++i) {
+                chunk.boundsMin = glm::min(chunk.boundsMin, positions[i]);
+                chunk.boundsMax = glm::max(chunk.boundsMax, positions[i]);
+            }
+            return chunk;
+        },
+        [](const PointBounds& a, const PointBounds& b) {
+            PointBounds combined;
+            combined.boundsMin = glm::min(a.boundsMin, b.boundsMin);
+            combined.boundsMax = glm::max(a.boundsMax, b.boundsMax);
+            return combined;
+        });
+    glm::vec2 extent = bounds.boundsMax - bounds.boundsMin;
+    float square = std::max(extent.x, extent.y);
+    if (square <= 0.0f) square = 1.0f;
+    float scale = static_cast<float>(GridSize) / square;
+
+    keys.resize(count);
+    pointIndices.resize(count);
+    scheduler.ParallelFor(0, count, PointGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec2 cell = glm::clamp((positions[i] - bounds.boundsMin) * scale, 0.0f, static_cast<float>(GridSize - 1));
+            keys[i] = Morton::Encode2D(static_cast<uint32_t>(cell.x), static_cast<uint32_t>(cell.y));
+            pointIndices[i] = static_cast<uint32_t>(i);
         }
-    }
+    });
+    radixSort.Sort(keys, pointIndices, 2 * MaxLevel);
 
-    return false;
-}
+    sortedPoints.resize(count);
+    scheduler.ParallelFor(0, count, PointGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) sortedPoints[i] = positions[pointIndices[i]];
+    });
 
-void Octree::subdivide() {
-    float x = boundary.center.x;
-    float y = boundary.center.y;
-    float z = boundary.center.z;
-    float half = boundary.halfDimension / 2;
-
-    children[0] = std::make_unique<Octree>(AABB3D(Point3D(x - half, y - half, z - half), half), capacity);
-    children[1] = std::make_unique<Octree>(AABB3D(Point3D(x + half, y - half, z - half), half), capacity);
-    children[2] = std::make_unique<Octree>(AABB3D(Point3D(x - half, y + half, z - half), half), capacity);
-    children[3] = std::make_unique<Octree>(AABB3D(Point3D(x + half, y + half, z - half), half), capacity);
-    children[4] = std::make_unique<Octree>(AABB3D(Point3D(x - half, y - half, z + half), half), capacity);
-    children[5] = std::make_unique<Octree>(AABB3D(Point3D(x + half, y - half, z + half), half), capacity);
-    children[6] = std::make_unique<Octree>(AABB3D(Point3D(x - half, y + half, z + half), half), capacity);
-    children[7] = std::make_unique<Octree>(AABB3D(Point3D(x + half, y + half, z + half), half), capacity);
-
-    divided = true;
+    BuildLevels(leafCapacity, bounds.boundsMin, square);
 }
 
-std::vector<Point3D> Octree::queryRange(AABB3D range) {
-    std::vector<Point3D> pointsInRange;
-
-    if (!boundary.intersects(range)) {
-        return pointsInRange;
-    }
-
-    for (const Point3D& point : points) {
-        if (range.contains(point)) {
-            pointsInRange.push_back(point);
-        }
-    }
-
-    if (divided) {
-        for (int i = 0; i < 8; ++i) {
-            std::vector<Point3D> childPoints = children[i]->queryRange(range);
-            pointsInRange.insert(pointsInRange.end(), childPoints.begin(), childPoints.end());
-        }
+void Quadtree::BuildLevels(uint32_t leafCapacity, const glm::vec2& origin, float square) {
+    // Quantization rounds, so every box is padded a little to keep its points inside
+    float padding = square * 1e-5f;
+    Node root = Node();
+    root.boundsMin = origin - padding;
+    root.size = square + 2.0f * padding;
+    root.pointCount = static_cast<uint32_t>(keys.size());
+    nodes.push_back(root);
+
+    size_t levelBegin = 0;
+    size_t levelEnd = 1;
+    for (int level = 0; levelBegin < levelEnd; ++level) {
+        depth = level;
+        size_t levelCount = levelEnd - levelBegin;
+        // First sorted point of each quadrant of each node in the level, plus the end of the last one
+        quadrantStarts.resize(levelCount * 5);
+        childOffsets.resize(levelCount + 1);
+
+        // Quadrant boundaries by binary search on the next two key bits
+        uint32_t shift = 2 * static_cast<uint32_t>(MaxLevel - level - 1);
+        scheduler.ParallelFor(0, levelCount, NodeGrain, [&](size_t begin, size_t end) {
+            for (size_t n = begin; n < end; ++n) {
+                Node& node = nodes[levelBegin + n];
+                node.childMask = 0;
+                node.childCount = 0;
+                node.firstChild = 0;
+                if (node.pointCount <= leafCapacity || level >= MaxLevel) continue;
+
+                const uint32_t* first = keys.data() + node.firstPoint;
+                const uint32_t* last = first + node.pointCount;
+                uint32_t* starts = quadrantStarts.data() + n * 5;
+                const uint32_t* cursor = first;
+                for (uint32_t quadrant = 0; quadrant < 4; ++quadrant) {
+                    starts[quadrant] = static_cast<uint32_t>(cursor - keys.data());
+                    cursor = std::partition_point(cursor, last, [&](uint32_t key) { return ((key >> shift) & 3u) <= quadrant; });
+                    if (keys.data() + starts[quadrant] != cursor) {
+                        node.childMask |= static_cast<uint8_t>(1u << quadrant);
+                        ++node.childCount;
+                    }
+                }
+                starts[4] = static_cast<uint32_t>(last - keys.data());
+            }
+        });
+
+        childOffsets[0] = 0;
+        for (size_t n = 0; n < levelCount; ++n) childOffsets[n + 1] = childOffsets[n] + nodes[levelBegin + n].childCount;
+        if (childOffsets[levelCount] == 0) break;
+        nodes.resize(levelEnd + childOffsets[levelCount]);
+
+        float childSize = square / static_cast<float>(2u << level) + 2.0f * padding;
+        scheduler.ParallelFor(0, levelCount, NodeGrain, [&](size_t begin, size_t end) {
+            for (size_t n = begin; n < end; ++n) {
+                Node& node = nodes[levelBegin + n];
+                if (node.childCount == 0) continue;
+                node.firstChild = static_cast<uint32_t>(levelEnd + childOffsets[n]);
+                const uint32_t* starts = quadrantStarts.data() + n * 5;
+                uint32_t child = node.firstChild;
+                for (uint32_t quadrant = 0; quadrant < 4; ++quadrant) {
+                    if ((node.childMask & (1u << quadrant)) == 0) continue;
+                    Node& childNode = nodes[child++];
+                    childNode = Node();
+                    childNode.firstPoint = starts[quadrant];
+                    childNode.pointCount = starts[quadrant + 1] - starts[quadrant];
+                    childNode.level = static_cast<uint8_t>(level + 1);
+                    // The child's cell is the key prefix of any of its points
+                    uint32_t x, y;
+                    Morton::Decode2D(keys[childNode.firstPoint] >> shift << shift, x, y);
+                    glm::vec2 cell = glm::vec2(x, y) / static_cast<float>(GridSize);
+                    childNode.boundsMin = origin + cell * square - padding;
+                    childNode.size = childSize;
+                }
+            }
+        });
+
+        levelBegin = levelEnd;
+        levelEnd = nodes.size();
     }
+}
 
-    return pointsInRange;
+size_t Quadtree::QueryRange(const glm::vec2& boundsMin, const glm::vec2& boundsMax, uint32_t* results, size_t maxResults) const {
+    size_t found = 0;
+    QueryRange(boundsMin, boundsMax, [&](uint32_t index, const glm::vec2&) {
+        if (found < maxResults) results[found] = index;
+        ++found;
+    });
+    return found;
 }
 
-void Octree::print() const {
-    std::cout << "Boundary: (" << boundary.center.x << ", " << boundary.center.y << ", " << boundary.center.z << ") with half dimension " << boundary.halfDimension << "\n";
-    std::cout << "Points: ";
-    for (const auto& point : points) {
-        std::cout << "(" << point.x << ", " << point.y << ", " << point.z << ") ";
-    }
-    std::cout << "\n";
+size_t Quadtree::QueryRadius(const glm::vec2& centre, float radius, uint32_t* results, size_t maxResults) const {
+    size_t found = 0;
+    QueryRadius(centre, radius, [&](uint32_t index, const glm::vec2&) {
+        if (found < maxResults) results[found] = index;
+        ++found;
+    });
+    return found;
+}
 
-    if (divided) {
-        for (int i = 0; i < 8; ++i) {
-            std::cout << "Child " << i << ":\n";
-            children[i]->print();
+void Quadtree::FindNeighbours(float radius, std::vector<uint32_t>& offsets, std::vector<uint32_t>& neighbours) const {
+    size_t count = sortedPoints.size();
+    offsets.resize(count + 1);
+    offsets[0] = 0;
+    // Walking the points in sorted order keeps consecutive queries in the same part of the tree
+    scheduler.ParallelFor(0, count, QueryGrain, [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; ++s) {
+            uint32_t found = 0;
+            QueryRadius(sortedPoints[s], radius, [&](uint32_t, const glm::vec2&) { ++found; });
+            offsets[pointIndices[s] + 1] = found;
         }
-    }
+    });
+    for (size_t i = 0; i < count; ++i) offsets[i + 1] += offsets[i];
+
+    neighbours.resize(offsets[count]);
+    scheduler.ParallelFor(0, count, QueryGrain, [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; ++s) {
+            uint32_t* row = neighbours.data() + offsets[pointIndices[s]];
+            QueryRadius(sortedPoints[s], radius, [&](uint32_t index, const glm::vec2&) { *row++ = index; });
+        }
+    });
 }
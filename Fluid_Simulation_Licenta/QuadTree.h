@@ -1,56 +1,147 @@
 #ifndef QUADTREE_H
 #define QUADTREE_H
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
-#include <memory>
-#include <iostream>
+#include <glm/glm.hpp>
 
-struct Point {
-    float x, y;
+#include "RadixSort.h"
+#include "TaskScheduler.h"
 
-    Point(float x, float y) : x(x), y(y) {}
-};
+// Linear quadtree over the 2D particle positions, cheap enough to rebuild every frame.
+// Build inserts all points at once: they are quantized to a 65536^2 grid over their bounding
+// square, Morton encoded and radix sorted, and the nodes are split level by level from the sorted
+// keys, so a rebuild is O(N log N) at worst. Nodes live in one pooled array with the children of a
+// node next to each other; the pool and the point columns keep their capacity between builds.
+// Queries keep their traversal stack on the calling thread and either hand every point to a
+// visitor or write indices into a caller-provided buffer, so they never allocate.
+class Quadtree {
+public:
+    struct Node {
+        glm::vec2 boundsMin;
+        float size;
+        // Range of the node's points in sorted order
+        uint32_t firstPoint;
+        uint32_t pointCount;
+        // Index of the first child; 0 for leaves, since the root is never a child
+        uint32_t firstChild;
+        // Bit q is set when quadrant q (x in bit 0, y in bit 1) has a child
+        uint8_t childMask;
+        uint8_t childCount;
+        uint8_t level;
+    };
 
-struct AABB {
-    Point center;
-    float halfDimension;
+    explicit Quadtree(TaskScheduler& scheduler = TaskScheduler::Instance());
 
-    AABB(Point center, float halfDimension) : center(center), halfDimension(halfDimension) {}
+    // Rebuilds the tree over positions, e.g. ParticleData::positions. Nodes with at most
+    // leafCapacity points are not split.
+    void Build(const std::vector<glm::vec2>& positions, uint32_t leafCapacity = DefaultLeafCapacity);
+    void Clear();
 
-    bool contains(Point point) const {
-        return (point.x >= center.x - halfDimension &&
-            point.x <= center.x + halfDimension &&
-            point.y >= center.y - halfDimension &&
-            point.y <= center.y + halfDimension);
-    }
+    // Calls visit(index, position) for every point inside [boundsMin, boundsMax], where index is
+    // the point's position in the array given to Build.
+    template <typename Visitor>
+    void QueryRange(const glm::vec2& boundsMin, const glm::vec2& boundsMax, Visitor&& visit) const;
+    // Calls visit(index, position) for every point within radius of centre.
+    template <typename Visitor>
+    void QueryRadius(const glm::vec2& centre, float radius, Visitor&& visit) const;
 
-    bool intersects(const AABB& other) const {
-        return !(other.center.x - other.halfDimension > center.x + halfDimension ||
-            other.center.x + other.halfDimension < center.x - halfDimension ||
-            other.center.y - other.halfDimension > center.y + halfDimension ||
-            other.center.y + other.halfDimension < center.y - halfDimension);
-    }
-};
+    // Write the indices of the points found into results, at most maxResults of them, and return
+    // how many points matched. A return value above maxResults means the buffer was too small.
+    size_t QueryRange(const glm::vec2& boundsMin, const glm::vec2& boundsMax, uint32_t* results, size_t maxResults) const;
+    size_t QueryRadius(const glm::vec2& centre, float radius, uint32_t* results, size_t maxResults) const;
 
-class Quadtree {
-public:
-    Quadtree(AABB boundary, int capacity);
-    ~Quadtree();
+    // Neighbour lists of every point within radius, the point itself included, as compressed rows:
+    // the neighbours of point i are neighbours[offsets[i]] up to neighbours[offsets[i + 1]].
+    // Counts, scans and fills in parallel; the two buffers belong to the caller and are reused.
+    void FindNeighbours(float radius, std::vector<uint32_t>& offsets, std::vector<uint32_t>& neighbours) const;
+
+    bool IsEmpty() const { return nodes.empty(); }
+    size_t GetPointCount() const { return sortedPoints.size(); }
+    const std::vector<Node>& GetNodes() const { return nodes; }
+    const std::vector<glm::vec2>& GetSortedPoints() const { return sortedPoints; }
+    const std::vector<uint32_t>& GetPointIndices() const { return pointIndices; }
+    int GetDepth() const { return depth; }
 
-    bool insert(Point point);
-    void subdivide();
-    std::vector<Point> queryRange(AABB range);
-    void print() const;
+    static const uint32_t DefaultLeafCapacity = 16;
+    static const int MaxLevel = 16;
+    static const size_t PointGrain = 4096;
 
 private:
-    AABB boundary;
-    int capacity;
-    std::vector<Point> points;
-    bool divided;
-    std::unique_ptr<Quadtree> northeast;
-    std::unique_ptr<Quadtree> northwest;
-    std::unique_ptr<Quadtree> southeast;
-    std::unique_ptr<Quadtree> southwest;
+    // Every level adds at most 3 siblings to the stack
+    static const int StackSize = 3 * MaxLevel + 1;
+
+    // Splits the nodes of one level after the other, starting from the root over the grid square at origin.
+    void BuildLevels(uint32_t leafCapacity, const glm::vec2& origin, float square);
+
+    TaskScheduler& scheduler;
+    RadixSort radixSort;
+    std::vector<Node> nodes;
+    std::vector<glm::vec2> sortedPoints;
+    std::vector<uint32_t> pointIndices;
+    std::vector<uint32_t> keys;
+    std::vector<uint32_t> quadrantStarts;
+    std::vector<uint32_t> childOffsets;
+    int depth;
 };
 
+template <typename Visitor>
+void Quadtree::QueryRange(const glm::vec2& boundsMin, const glm::vec2& boundsMax, Visitor&& visit) const {
+    if (nodes.empty()) return;
+    uint32_t stack[StackSize];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const Node& node = nodes[stack[--stackSize]];
+        glm::vec2 nodeMax = node.boundsMin + node.size;
+        if (glm::any(glm::greaterThan(node.boundsMin, boundsMax)) || glm::any(glm::lessThan(nodeMax, boundsMin))) continue;
+
+        uint32_t last = node.firstPoint + node.pointCount;
+        if (glm::all(glm::greaterThanEqual(node.boundsMin, boundsMin)) && glm::all(glm::lessThanEqual(nodeMax, boundsMax))) {
+            // Entirely inside: every point is a hit
+            for (uint32_t i = node.firstPoint; i < last; ++i) visit(pointIndices[i], sortedPoints[i]);
+        }
+        else if (node.childCount == 0) {
+            for (uint32_t i = node.firstPoint; i < last; ++i) {
+                const glm::vec2& point = sortedPoints[i];
+                if (glm::all(glm::greaterThanEqual(point, boundsMin)) && glm::all(glm::lessThanEqual(point, boundsMax))) visit(pointIndices[i], point);
+            }
+        }
+        else {
+            for (uint32_t c = node.childCount; c > 0; --c) stack[stackSize++] = node.firstChild + c - 1;
+        }
+    }
+}
+
+template <typename Visitor>
+void Quadtree::QueryRadius(const glm::vec2& centre, float radius, Visitor&& visit) const {
+    if (nodes.empty()) return;
+    float sqrRadius = radius * radius;
+    uint32_t stack[StackSize];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const Node& node = nodes[stack[--stackSize]];
+        glm::vec2 nodeMax = node.boundsMin + node.size;
+        glm::vec2 nearest = glm::clamp(centre, node.boundsMin, nodeMax);
+        if (glm::dot(nearest - centre, nearest - centre) > sqrRadius) continue;
+
+        uint32_t last = node.firstPoint + node.pointCount;
+        glm::vec2 farthest = glm::max(glm::abs(node.boundsMin - centre), glm::abs(nodeMax - centre));
+        if (glm::dot(farthest, farthest) <= sqrRadius) {
+            for (uint32_t i = node.firstPoint; i < last; ++i) visit(pointIndices[i], sortedPoints[i]);
+        }
+        else if (node.childCount == 0) {
+            for (uint32_t i = node.firstPoint; i < last; ++i) {
+                glm::vec2 offset = sortedPoints[i] - centre;
+                if (glm::dot(offset, offset) <= sqrRadius) visit(pointIndices[i], sortedPoints[i]);
+            }
+        }
+        else {
+            for (uint32_t c = node.childCount; c > 0; --c) stack[stackSize++] = node.firstChild + c - 1;
+        }
+    }
+}
+
 #endif // QUADTREE_H
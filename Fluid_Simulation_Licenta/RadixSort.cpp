@@ -0,0 +1,47 @@
+#include "RadixSort.h"
+#include <algorithm>
+
+RadixSort::RadixSort(TaskScheduler& scheduler) : scheduler(scheduler) {}
+
+void RadixSort::Sort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values, uint32_t keyBits) {
+    size_t count = keys.size();
+    if (count < 2) return;
+
+    keyScratch.resize(count);
+    valueScratch.resize(count);
+    size_t numChunks = (count + Grain - 1) / Grain;
+    histograms.resize(numChunks * BucketCount);
+
+    for (uint32_t shift = 0; shift < keyBits; shift += DigitBits) {
+        scheduler.ParallelFor(0, count, Grain, [&](size_t begin, size_t end) {
+            size_t* histogram = &histograms[(begin / Grain) * BucketCount];
+            std::fill(histogram, histogram + BucketCount, size_t(0));
+            for (size_t i = begin; i < end; ++i) {
+                histogram[(keys[i] >> shift) & (BucketCount - 1)]++;
+            }
+        });
+
+        // Turn the counts into scatter offsets: all chunks of bucket 0 first, then bucket 1, ...
+        size_t running = 0;
+        for (uint32_t bucket = 0; bucket < BucketCount; ++bucket) {
+            for (size_t chunk = 0; chunk < numChunks; ++chunk) {
+                size_t& slot = histograms[chunk * BucketCount + bucket];
+                size_t bucketCount = slot;
+                slot = running;
+                running += bucketCount;
+            }
+        }
+
+        scheduler.ParallelFor(0, count, Grain, [&](size_t begin, size_t end) {
+            size_t* offsets = &histograms[(begin / Grain) * BucketCount];
+            for (size_t i = begin; i < end; ++i) {
+                size_t destination = offsets[(keys[i] >> shift) & (BucketCount - 1)]++;
+                keyScratch[destination] = keys[i];
+                valueScratch[destination] = values[i];
+            }
+        });
+
+        keys.swap(keyScratch);
+        values.swap(valueScratch);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <cstdint>
+#include <vector>
+
+#include "TaskScheduler.h"
+
+// Parallel LSD radix sort of 32-bit key/value pairs on the TaskScheduler.
+// Every pass histograms fixed-size chunks, scans the histograms bucket-major and
+// scatters each chunk in order, so the sort is stable and its result does not
+// depend on the number of threads.
+class RadixSort {
+public:
+    explicit RadixSort(TaskScheduler& scheduler = TaskScheduler::Instance());
+
+    // Sorts keys ascending and moves values along. Only the low keyBits bits of the keys are looked at.
+    void Sort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values, uint32_t keyBits = 32);
+
+    static const uint32_t DigitBits = 8;
+    static const uint32_t BucketCount = 1u << DigitBits;
+    static const size_t Grain = 8192;
+
+private:
+    TaskScheduler& scheduler;
+    std::vector<uint32_t> keyScratch;
+    std::vector<uint32_t> valueScratch;
+    std::vector<size_t> histograms;
+};
+
+#endif // RADIX_SORT_H
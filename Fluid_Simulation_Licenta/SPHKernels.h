@@ -0,0 +1,82 @@
+#ifndef SPH_KERNELS_H
+#define SPH_KERNELS_H
+
+#include <cmath>
+
+// CPU mirror of shaders/FluidSimulationKernels.glsl.
+// The scaling factors are the same values ShaderManager3D uploads as uniforms.
+struct SPHKernels {
+    float radius;
+    float poly6ScalingFactor;
+    float spikyPow3ScalingFactor;
+    float spikyPow2ScalingFactor;
+    float spikyPow3DerivativeScalingFactor;
+    float spikyPow2DerivativeScalingFactor;
+
+    explicit SPHKernels(float radius) : radius(radius) {
+        const float pi = 3.14159265358979f;
+        poly6ScalingFactor = 315.0f / (64.0f * pi * std::pow(radius, 9.0f));
+        spikyPow3ScalingFactor = 15.0f / (pi * std::pow(radius, 6.0f));
+        spikyPow2ScalingFactor = -45.0f / (pi * std::pow(radius, 6.0f));
+        spikyPow3DerivativeScalingFactor = -45.0f / (pi * std::pow(radius, 6.0f));
+        spikyPow2DerivativeScalingFactor = -135.0f / (pi * std::pow(radius, 6.0f));
+    }
+
+    float SmoothingKernelPoly6(float dst) const {
+        if (dst < radius) {
+            float v = radius * radius - dst * dst;
+            return v * v * v * poly6ScalingFactor;
+        }
+        return 0.0f;
+    }
+
+    float SpikyKernelPow3(float dst) const {
+        if (dst < radius) {
+            float v = radius - dst;
+            return v * v * v * spikyPow3ScalingFactor;
+        }
+        return 0.0f;
+    }
+
+    float SpikyKernelPow2(float dst) const {
+        if (dst < radius) {
+            float v = radius - dst;
+            return v * v * spikyPow2ScalingFactor;
+        }
+        return 0.0f;
+    }
+
+    float DerivativeSpikyPow3(float dst) const {
+        if (dst <= radius) {
+            float v = radius - dst;
+            return -v * v * spikyPow3DerivativeScalingFactor;
+        }
+        return 0.0f;
+    }
+
+    float DerivativeSpikyPow2(float dst) const {
+        if (dst <= radius) {
+            float v = radius - dst;
+            return -v * spikyPow2DerivativeScalingFactor;
+        }
+        return 0.0f;
+    }
+
+    // Signed slope of SpikyKernelPow3, negative inside the radius. The DFSPH solver pairs it with
+    // SmoothingKernelPoly6 densities, which stay positive.
+    float SpikyPow3Slope(float dst) const {
+        if (dst <= radius) {
+            float v = radius - dst;
+            return v * v * spikyPow3DerivativeScalingFactor;
+        }
+        return 0.0f;
+    }
+
+    float DensityKernel(float dst) const { return SpikyKernelPow2(dst); }
+    float NearDensityKernel(float dst) const { return SpikyKernelPow3(dst); }
+    float DensityDerivative(float dst) const { return DerivativeSpikyPow2(dst); }
+    float NearDensityDerivative(float dst) const { return DerivativeSpikyPow3(dst); }
+    float ViscosityKernel(float dst) const { return SmoothingKernelPoly6(dst); }
+};
+
+#endif // SPH_KERNELS_H
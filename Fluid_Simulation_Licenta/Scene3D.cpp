@@ -0,0 +1,475 @@
+#include "Scene3D.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "Json.h"
+#include "ParticleGenerator3D.h"
+#include "TriangleMesh3D.h"
+
+namespace {
+    // Lattice spacing of the presets is about one particle diameter (2 * particleRadius)
+    Scene3D DefaultScene() {
+        Scene3D scene;
+        scene.name = "default";
+        scene.fluidBlocks.push_back(FluidBlock3D());
+        scene.params.deltaTime = 0.005f;
+        scene.params.smoothingRadius = 4.0f;
+        scene.params.boundingBoxMin = glm::vec3(0.0f);
+        scene.params.boundingBoxMax = glm::vec3(64.0f);
+        return scene;
+    }
+
+    Scene3D LargeScene() {
+        Scene3D scene = DefaultScene();
+        scene.name = "large";
+        scene.fluidBlocks[0].particleCount = 50000;
+        scene.fluidBlocks[0].centre = glm::vec3(48.0f, 40.0f, 48.0f);
+        scene.fluidBlocks[0].size = glm::vec3(72.0f);
+        scene.params.boundingBoxMax = glm::vec3(96.0f);
+        return scene;
+    }
+
+    Scene3D DamBreakScene() {
+        Scene3D scene = DefaultScene();
+        scene.name = "dam-break";
+        scene.fluidBlocks[0].particleCount = 20000;
+        scene.fluidBlocks[0].centre = glm::vec3(14.0f, 30.0f, 32.0f);
+        scene.fluidBlocks[0].size = glm::vec3(26.0f, 58.0f, 60.0f);
+        return scene;
+    }
+
+    // The settings the GUI used to hardcode: a wide block thrown into the slow shader's 32 unit box
+    Scene3D SandboxScene() {
+        Scene3D scene;
+        scene.name = "sandbox";
+        scene.backend = SimulationType3D::SLOW;
+        FluidBlock3D block;
+        block.centre = glm::vec3(512.0f, 150.0f, 512.0f);
+        block.size = glm::vec3(1024.0f, 300.0f, 1024.0f);
+        block.velocity = glm::vec3(10.0f);
+        scene.fluidBlocks.push_back(block);
+        return scene;
+    }
+
+    bool EndsWith(const std::string& text, const std::string& suffix) {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // Files named in a scene are relative to the scene file unless they are absolute
+    std::string ResolvePath(const std::string& scenePath, const std::string& path) {
+        bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'));
+        if (absolute) return path;
+        return scenePath.substr(0, scenePath.find_last_of("/\\") + 1) + path;
+    }
+
+    // Reads typed fields out of the parsed document. The first problem is reported with
+    // its line and the rest of the file is still checked, so one run lists every mistake.
+    class SceneReader {
+    public:
+        explicit SceneReader(const std::string& path) : path(path), valid(true) {}
+
+        bool IsValid() const { return valid; }
+
+        void Error(const JsonValue& value, const std::string& message) {
+            std::cerr << "SceneLoader3D::LoadFile Error: " << path << ":" << value.line << ": " << message << std::endl;
+            valid = false;
+        }
+
+        bool Expect(const JsonValue& value, JsonValue::Type type, const std::string& field) {
+            if (value.type == type) return true;
+            Error(value, "'" + field + "' must be " + JsonValue::TypeName(type) + ", not " + JsonValue::TypeName(value.type));
+            return false;
+        }
+
+        void CheckMembers(const JsonValue& object, const std::string& field, std::initializer_list<const char*> allowed) {
+            for (const std::pair<std::string, JsonValue>& member : object.members) {
+                bool known = std::any_of(allowed.begin(), allowed.end(), [&](const char* name) { return member.first == name; });
+                if (!known) Error(member.second, "unknown member '" + member.first + "' in '" + field + "'");
+            }
+        }
+
+        void ReadFloat(const JsonValue& object, const char* key, float& output, float minimum, float maximum) {
+            const JsonValue* value = object.Find(key);
+            if (!value || !Expect(*value, JsonValue::Type::Number, key)) return;
+            if (!std::isfinite(value->number) || value->number < minimum || value->number > maximum) {
+                Error(*value, "'" + std::string(key) + "' = " + std::to_string(value->number) + " is outside [" + std::to_string(minimum) + ", " + std::to_string(maximum) + "]");
+                return;
+            }
+            output = static_cast<float>(value->number);
+        }
+
+        void ReadInt(const JsonValue& object, const char* key, int& output, int minimum, int maximum) {
+            const JsonValue* value = object.Find(key);
+            if (!value || !Expect(*value, JsonValue::Type::Number, key)) return;
+            if (value->number != std::floor(value->number) || value->number < minimum || value->number > maximum) {
+                Error(*value, "'" + std::string(key) + "' must be an integer in [" + std::to_string(minimum) + ", " + std::to_string(maximum) + "]");
+                return;
+            }
+            output = static_cast<int>(value->number);
+        }
+
+        void ReadBool(const JsonValue& object, const char* key, bool& output) {
+            const JsonValue* value = object.Find(key);
+            if (value && Expect(*value, JsonValue::Type::Bool, key)) output = value->boolean;
+        }
+
+        void ReadVec3(const JsonValue& object, const char* key, glm::vec3& output, bool required) {
+            const JsonValue* value = object.Find(key);
+            if (!value) {
+                if (required) Error(object, "missing '" + std::string(key) + "'");
+                return;
+            }
+            if (!Expect(*value, JsonValue::Type::Array, key)) return;
+            if (value->elements.size() != 3) {
+                Error(*value, "'" + std::string(key) + "' must have 3 components");
+                return;
+            }
+            for (int axis = 0; axis < 3; ++axis) {
+                const JsonValue& component = value->elements[axis];
+                if (!Expect(component, JsonValue::Type::Number, key)) return;
+                if (!std::isfinite(component.number)) {
+                    Error(component, "'" + std::string(key) + "' is not finite");
+                    return;
+                }
+                output[axis] = static_cast<float>(component.number);
+            }
+        }
+
+        // An array of [x, y, z] arrays
+        void ReadPoints(const JsonValue& object, const char* key, std::vector<glm::vec3>& output) {
+            const JsonValue* value = object.Find(key);
+            if (!value) {
+                Error(object, "missing '" + std::string(key) + "'");
+                return;
+            }
+            if (!Expect(*value, JsonValue::Type::Array, key)) return;
+            output.reserve(value->elements.size());
+            for (const JsonValue& element : value->elements) {
+                if (!Expect(element, JsonValue::Type::Array, key) || element.elements.size() != 3) {
+                    Error(element, "every entry of '" + std::string(key) + "' must have 3 components");
+                    return;
+                }
+                glm::vec3 point(0.0f);
+                for (int axis = 0; axis < 3; ++axis) {
+                    const JsonValue& component = element.elements[axis];
+                    if (!Expect(component, JsonValue::Type::Number, key) || !std::isfinite(component.number)) return;
+                    point[axis] = static_cast<float>(component.number);
+                }
+                output.push_back(point);
+            }
+        }
+
+        // An array of [a, b, c] vertex indices
+        void ReadTriangles(const JsonValue& object, const char* key, std::vector<glm::uvec3>& output) {
+            const JsonValue* value = object.Find(key);
+            if (!value) {
+                Error(object, "missing '" + std::string(key) + "'");
+                return;
+            }
+            if (!Expect(*value, JsonValue::Type::Array, key)) return;
+            output.reserve(value->elements.size());
+            for (const JsonValue& element : value->elements) {
+                if (!Expect(element, JsonValue::Type::Array, key) || element.elements.size() != 3) {
+                    Error(element, "every entry of '" + std::string(key) + "' must have 3 indices");
+                    return;
+                }
+                glm::uvec3 triangle(0);
+                for (int corner = 0; corner < 3; ++corner) {
+                    const JsonValue& index = element.elements[corner];
+                    if (!Expect(index, JsonValue::Type::Number, key)) return;
+                    if (index.number != std::floor(index.number) || index.number < 0.0 || index.number > 4294967295.0) {
+                        Error(index, "'" + std::string(key) + "' indices must be non-negative integers");
+                        return;
+                    }
+                    triangle[corner] = static_cast<uint32_t>(index.number);
+                }
+                output.push_back(triangle);
+            }
+        }
+
+        bool Inside(const glm::vec3& point, const FluidParams3D& params) const {
+            return glm::all(glm::greaterThanEqual(point, params.boundingBoxMin)) && glm::all(glm::lessThanEqual(point, params.boundingBoxMax));
+        }
+
+    private:
+        std::string path;
+        bool valid;
+    };
+
+    void ReadSolver(SceneReader& reader, const JsonValue& solver, FluidParams3D& params) {
+        if (!reader.Expect(solver, JsonValue::Type::Object, "solver")) return;
+        reader.CheckMembers(solver, "solver", { "deltaTime", "gravity", "collisionDamping", "smoothingRadius", "targetDensity", "pressureMultiplier",
+            "nearPressureMultiplier", "viscosityStrength", "particleRadius", "maxVelocity", "reorderInterval", "deterministic", "boundaryResolution",
+            "longRangeStrength", "longRangeSoftening", "barnesHutTheta", "rebinThreshold",
+            "pressureSolver", "densityTolerance", "divergenceTolerance", "maxPressureIterations",
+            "pbfIterations", "pbfRelaxation", "pbfTensileStrength", "xsphViscosity", "gridCellSize", "gridPressureTolerance" });
+        reader.ReadFloat(solver, "deltaTime", params.deltaTime, 1e-6f, 1.0f);
+        reader.ReadFloat(solver, "gravity", params.gravity, -1000.0f, 1000.0f);
+        reader.ReadFloat(solver, "collisionDamping", params.collisionDamping, 0.0f, 1.0f);
+        reader.ReadFloat(solver, "smoothingRadius", params.smoothingRadius, 1e-3f, 1000.0f);
+        reader.ReadFloat(solver, "targetDensity", params.targetDensity, 1e-6f, 1e6f);
+        reader.ReadFloat(solver, "pressureMultiplier", params.pressureMultiplier, 0.0f, 1e6f);
+        reader.ReadFloat(solver, "nearPressureMultiplier", params.nearPressureMultiplier, 0.0f, 1e6f);
+        reader.ReadFloat(solver, "viscosityStrength", params.viscosityStrength, 0.0f, 1e6f);
+        reader.ReadFloat(solver, "particleRadius", params.particleRadius, 1e-4f, 100.0f);
+        reader.ReadFloat(solver, "maxVelocity", params.maxVelocity, 1e-3f, 1e6f);
+        reader.ReadInt(solver, "reorderInterval", params.reorderInterval, 0, 1 << 20);
+        reader.ReadBool(solver, "deterministic", params.deterministic);
+        reader.ReadInt(solver, "boundaryResolution", params.boundaryResolution, 2, 1024);
+        reader.ReadFloat(solver, "longRangeStrength", params.longRangeStrength, -1e6f, 1e6f);
+        reader.ReadFloat(solver, "longRangeSoftening", params.longRangeSoftening, 1e-3f, 1000.0f);
+        reader.ReadFloat(solver, "barnesHutTheta", params.barnesHutTheta, 0.0f, 2.0f);
+        reader.ReadFloat(solver, "rebinThreshold", params.rebinThreshold, 0.0f, 1.0f);
+        if (const JsonValue* pressureSolver = solver.Find("pressureSolver")) {
+            if (reader.Expect(*pressureSolver, JsonValue::Type::String, "pressureSolver")) {
+                if (pressureSolver->string == "explicit") params.pressureSolver = PressureSolver3D::Explicit;
+                else if (pressureSolver->string == "dfsph") params.pressureSolver = PressureSolver3D::DFSPH;
+                else if (pressureSolver->string == "pbf") params.pressureSolver = PressureSolver3D::PBF;
+                else reader.Error(*pressureSolver, "unknown pressureSolver '" + pressureSolver->string + "', expected explicit, dfsph or pbf");
+            }
+        }
+        reader.ReadFloat(solver, "densityTolerance", params.densityTolerance, 1e-6f, 1.0f);
+        reader.ReadFloat(solver, "divergenceTolerance", params.divergenceTolerance, 1e-6f, 1.0f);
+        reader.ReadInt(solver, "maxPressureIterations", params.maxPressureIterations, 1, 10000);
+        reader.ReadInt(solver, "pbfIterations", params.pbfIterations, 1, 1000);
+        reader.ReadFloat(solver, "pbfRelaxation", params.pbfRelaxation, 0.0f, 1e6f);
+        reader.ReadFloat(solver, "pbfTensileStrength", params.pbfTensileStrength, 0.0f, 10.0f);
+        reader.ReadFloat(solver, "xsphViscosity", params.xsphViscosity, 0.0f, 1.0f);
+        reader.ReadFloat(solver, "gridCellSize", params.gridCellSize, 0.0f, 1e6f);
+        reader.ReadFloat(solver, "gridPressureTolerance", params.gridPressureTolerance, 1e-8f, 1.0f);
+    }
+
+    void ReadBackend(SceneReader& reader, const JsonValue& backend, SimulationType3D& type) {
+        if (!reader.Expect(backend, JsonValue::Type::String, "backend")) return;
+        if (backend.string == "cpu") type = SimulationType3D::CPU;
+        else if (backend.string == "gpu-slow") type = SimulationType3D::SLOW;
+        else if (backend.string == "gpu-hash") type = SimulationType3D::HASH;
+        else if (backend.string == "grid") type = SimulationType3D::GRID;
+        else reader.Error(backend, "unknown backend '" + backend.string + "', expected cpu, gpu-slow, gpu-hash or grid");
+    }
+}
+
+int Scene3D::GetSpawnCount() const {
+    int count = 0;
+    for (const FluidBlock3D& block : fluidBlocks) count += block.particleCount;
+    return count;
+}
+
+int Scene3D::GetMaxParticleCount() const {
+    return std::max(maxParticleCount, GetSpawnCount());
+}
+
+bool SceneLoader3D::Load(const std::string& name, Scene3D& scene) {
+    if (name == "default") scene = DefaultScene();
+    else if (name == "large") scene = LargeScene();
+    else if (name == "dam-break") scene = DamBreakScene();
+    else if (name == "sandbox") scene = SandboxScene();
+    else if (EndsWith(name, ".json")) return LoadFile(name, scene);
+    else {
+        std::cerr << "SceneLoader3D::Load Error: Unknown scene '" << name << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SceneLoader3D::LoadFile(const std::string& path, Scene3D& scene) {
+    JsonValue document;
+    std::string error;
+    if (!JsonParser::ParseFile(path, document, error)) {
+        std::cerr << "SceneLoader3D::LoadFile Error: " << path << ": " << error << std::endl;
+        return false;
+    }
+
+    SceneReader reader(path);
+    if (!reader.Expect(document, JsonValue::Type::Object, "scene")) return false;
+    reader.CheckMembers(document, "scene", { "name", "backend", "seed", "maxParticles", "bounds", "solver", "fluidBlocks", "emitters", "sinks", "obstacles" });
+
+    // Unset members keep the defaults of the default preset
+    Scene3D loaded = DefaultScene();
+    loaded.fluidBlocks.clear();
+    loaded.name = path;
+    if (const JsonValue* name = document.Find("name")) {
+        if (reader.Expect(*name, JsonValue::Type::String, "name")) loaded.name = name->string;
+    }
+    if (const JsonValue* backend = document.Find("backend")) ReadBackend(reader, *backend, loaded.backend);
+    reader.ReadInt(document, "maxParticles", loaded.maxParticleCount, 1, 1 << 28);
+    int seed = static_cast<int>(loaded.seed);
+    reader.ReadInt(document, "seed", seed, 0, 0x7FFFFFFF);
+    loaded.seed = static_cast<uint32_t>(seed);
+    if (const JsonValue* solver = document.Find("solver")) ReadSolver(reader, *solver, loaded.params);
+
+    if (const JsonValue* bounds = document.Find("bounds")) {
+        if (reader.Expect(*bounds, JsonValue::Type::Object, "bounds")) {
+            reader.CheckMembers(*bounds, "bounds", { "min", "max" });
+            reader.ReadVec3(*bounds, "min", loaded.params.boundingBoxMin, true);
+            reader.ReadVec3(*bounds, "max", loaded.params.boundingBoxMax, true);
+            if (!glm::all(glm::lessThan(loaded.params.boundingBoxMin, loaded.params.boundingBoxMax))) {
+                reader.Error(*bounds, "'bounds.min' must be below 'bounds.max' on every axis");
+            }
+        }
+    }
+
+    const JsonValue* blocks = document.Find("fluidBlocks");
+    if (!blocks) reader.Error(document, "missing 'fluidBlocks'");
+    else if (reader.Expect(*blocks, JsonValue::Type::Array, "fluidBlocks")) {
+        for (const JsonValue& entry : blocks->elements) {
+            if (!reader.Expect(entry, JsonValue::Type::Object, "fluidBlocks[]")) continue;
+            reader.CheckMembers(entry, "fluidBlocks[]", { "centre", "size", "particles", "velocity", "jitter" });
+            FluidBlock3D block;
+            reader.ReadVec3(entry, "centre", block.centre, true);
+            reader.ReadVec3(entry, "size", block.size, true);
+            reader.ReadVec3(entry, "velocity", block.velocity, false);
+            reader.ReadFloat(entry, "jitter", block.jitter, 0.0f, 1.0f);
+            if (!entry.Find("particles")) reader.Error(entry, "missing 'particles'");
+            reader.ReadInt(entry, "particles", block.particleCount, 1, 1 << 28);
+            if (glm::any(glm::lessThanEqual(block.size, glm::vec3(0.0f)))) reader.Error(entry, "'size' must be positive");
+            else if (!reader.Inside(block.centre - block.size * 0.5f, loaded.params) || !reader.Inside(block.centre + block.size * 0.5f, loaded.params)) {
+                reader.Error(entry, "fluid block does not fit inside the bounds");
+            }
+            loaded.fluidBlocks.push_back(block);
+        }
+    }
+
+    if (const JsonValue* emitters = document.Find("emitters")) {
+        if (reader.Expect(*emitters, JsonValue::Type::Array, "emitters")) {
+            for (const JsonValue& entry : emitters->elements) {
+                if (!reader.Expect(entry, JsonValue::Type::Object, "emitters[]")) continue;
+                reader.CheckMembers(entry, "emitters[]", { "position", "direction", "speed", "radius", "rate", "start", "stop" });
+                Emitter3D emitter;
+                reader.ReadVec3(entry, "position", emitter.position, true);
+                reader.ReadVec3(entry, "direction", emitter.direction, false);
+                reader.ReadFloat(entry, "speed", emitter.speed, 0.0f, 1e4f);
+                reader.ReadFloat(entry, "radius", emitter.radius, 1e-3f, 1e4f);
+                reader.ReadFloat(entry, "rate", emitter.rate, 1e-3f, 1e9f);
+                reader.ReadFloat(entry, "start", emitter.startTime, 0.0f, 1e9f);
+                reader.ReadFloat(entry, "stop", emitter.stopTime, -1.0f, 1e9f);
+                if (glm::length(emitter.direction) < 1e-6f) reader.Error(entry, "'direction' must not be zero");
+                else emitter.direction = glm::normalize(emitter.direction);
+                if (!reader.Inside(emitter.position, loaded.params)) reader.Error(entry, "emitter lies outside the bounds");
+                if (emitter.stopTime >= 0.0f && emitter.stopTime <= emitter.startTime) reader.Error(entry, "'stop' must come after 'start'");
+                loaded.emitters.push_back(emitter);
+            }
+        }
+    }
+
+    if (const JsonValue* sinks = document.Find("sinks")) {
+        if (reader.Expect(*sinks, JsonValue::Type::Array, "sinks")) {
+            for (const JsonValue& entry : sinks->elements) {
+                if (!reader.Expect(entry, JsonValue::Type::Object, "sinks[]")) continue;
+                reader.CheckMembers(entry, "sinks[]", { "centre", "size" });
+                Sink3D sink;
+                reader.ReadVec3(entry, "centre", sink.centre, true);
+                reader.ReadVec3(entry, "size", sink.size, true);
+                if (glm::any(glm::lessThanEqual(sink.size, glm::vec3(0.0f)))) reader.Error(entry, "'size' must be positive");
+                else if (!reader.Inside(sink.centre, loaded.params)) reader.Error(entry, "sink lies outside the bounds");
+                loaded.sinks.push_back(sink);
+            }
+        }
+    }
+
+    if (const JsonValue* obstacles = document.Find("obstacles")) {
+        if (reader.Expect(*obstacles, JsonValue::Type::Array, "obstacles")) {
+            for (const JsonValue& entry : obstacles->elements) {
+                if (!reader.Expect(entry, JsonValue::Type::Object, "obstacles[]")) continue;
+                reader.CheckMembers(entry, "obstacles[]", { "type", "centre", "size", "radius", "vertices", "triangles", "file" });
+                Obstacle3D obstacle;
+                if (const JsonValue* type = entry.Find("type")) {
+                    if (!reader.Expect(*type, JsonValue::Type::String, "type")) continue;
+                    if (type->string == "sphere") obstacle.shape = Obstacle3D::Shape::Sphere;
+                    else if (type->string == "mesh") obstacle.shape = Obstacle3D::Shape::Mesh;
+                    else if (type->string != "box") {
+                        reader.Error(*type, "unknown obstacle type '" + type->string + "', expected box, sphere or mesh");
+                        continue;
+                    }
+                }
+                reader.ReadVec3(entry, "centre", obstacle.centre, true);
+                if (obstacle.shape == Obstacle3D::Shape::Sphere) {
+                    float radius = 0.0f;
+                    if (!entry.Find("radius")) reader.Error(entry, "missing 'radius'");
+                    reader.ReadFloat(entry, "radius", radius, 1e-4f, 1e6f);
+                    obstacle.size = glm::vec3(2.0f * radius);
+                }
+                else {
+                    reader.ReadVec3(entry, "size", obstacle.size, true);
+                    if (glm::any(glm::lessThanEqual(obstacle.size, glm::vec3(0.0f)))) reader.Error(entry, "'size' must be positive");
+                }
+                const JsonValue* file = entry.Find("file");
+                if (obstacle.shape != Obstacle3D::Shape::Mesh && file) reader.Error(*file, "'file' is only read for mesh obstacles");
+                else if (obstacle.shape == Obstacle3D::Shape::Mesh && file) {
+                    if (entry.Find("vertices") || entry.Find("triangles")) reader.Error(entry, "a mesh takes either 'file' or 'vertices' and 'triangles'");
+                    else if (reader.Expect(*file, JsonValue::Type::String, "file")) {
+                        std::string error;
+                        obstacle.mesh = TriangleMesh3D::LoadObj(ResolvePath(path, file->string), error);
+                        if (!obstacle.mesh) reader.Error(*file, error);
+                    }
+                }
+                else if (obstacle.shape == Obstacle3D::Shape::Mesh) {
+                    std::vector<glm::vec3> vertices;
+                    std::vector<glm::uvec3> triangles;
+                    reader.ReadPoints(entry, "vertices", vertices);
+                    reader.ReadTriangles(entry, "triangles", triangles);
+                    std::shared_ptr<TriangleMesh3D> mesh = std::make_shared<TriangleMesh3D>(std::move(vertices), std::move(triangles));
+                    std::string error;
+                    if (!mesh->Validate(error)) reader.Error(entry, error);
+                    obstacle.mesh = mesh;
+                }
+                loaded.obstacles.push_back(obstacle);
+            }
+        }
+    }
+
+    if (reader.IsValid()) {
+        if (loaded.GetSpawnCount() == 0 && loaded.emitters.empty()) reader.Error(document, "the scene spawns no particles");
+        if (!loaded.emitters.empty() && loaded.maxParticleCount == 0) reader.Error(document, "scenes with emitters must declare 'maxParticles'");
+        if (loaded.maxParticleCount > 0 && loaded.maxParticleCount < loaded.GetSpawnCount()) {
+            reader.Error(document, "'maxParticles' is below the " + std::to_string(loaded.GetSpawnCount()) + " particles of the fluid blocks");
+        }
+    }
+    if (!reader.IsValid()) return false;
+
+    scene = loaded;
+    return true;
+}
+
+std::vector<std::string> SceneLoader3D::GetPresetNames() {
+    return { "default", "large", "dam-break", "sandbox" };
+}
+
+void SceneLoader3D::Spawn(const Scene3D& scene, ParticleData3D& particleData) {
+    size_t capacity = static_cast<size_t>(scene.GetMaxParticleCount());
+    particleData.positions.clear();
+    particleData.velocities.clear();
+    particleData.positions.reserve(capacity);
+    particleData.velocities.reserve(capacity);
+    particleData.predictedPositions.reserve(capacity);
+    particleData.densities.reserve(capacity);
+
+    // Size the columns first so every block generates in place, in parallel
+    particleData.positions.resize(static_cast<size_t>(scene.GetSpawnCount()));
+    particleData.velocities.resize(particleData.positions.size());
+    size_t offset = 0;
+    for (size_t b = 0; b < scene.fluidBlocks.size(); ++b) {
+        const FluidBlock3D& block = scene.fluidBlocks[b];
+        ParticleGenerator3D generator(block.particleCount, block.velocity, block.centre, block.size, block.jitter, scene.seed, static_cast<uint32_t>(b));
+        generator.Generate(particleData.positions.data() + offset, particleData.velocities.data() + offset);
+        offset += static_cast<size_t>(block.particleCount);
+    }
+    particleData.predictedPositions.assign(particleData.positions.begin(), particleData.positions.end());
+    particleData.densities.assign(particleData.positions.size(), glm::vec2(0.0f));
+}
+
+void SceneLoader3D::SetParticleCount(Scene3D& scene, int count) {
+    int declared = scene.GetSpawnCount();
+    if (scene.fluidBlocks.empty() || declared <= 0 || count <= 0) return;
+
+    // The rounding remainder goes out one particle per block, so the total is exact
+    int assigned = 0;
+    for (FluidBlock3D& block : scene.fluidBlocks) {
+        int share = static_cast<int>(static_cast<long long>(block.particleCount) * count / declared);
+        block.particleCount = share;
+        assigned += share;
+    }
+    for (size_t i = 0; assigned < count; i = (i + 1) % scene.fluidBlocks.size(), ++assigned) scene.fluidBlocks[i].particleCount++;
+    if (scene.maxParticleCount > 0) scene.maxParticleCount = std::max(scene.maxParticleCount - declared + count, count);
+}
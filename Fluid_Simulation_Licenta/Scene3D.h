@@ -0,0 +1,74 @@
+#ifndef SCENE_3D_H
+#define SCENE_3D_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "FluidParams3D.h"
+#include "ParticleData.h"
+#include "SimulationType3D.h"
+
+// A box of fluid spawned on a jittered lattice when the scene starts.
+struct FluidBlock3D {
+    glm::vec3 centre = glm::vec3(32.0f, 24.0f, 32.0f);
+    glm::vec3 size = glm::vec3(42.0f);
+    int particleCount = 10000;
+    glm::vec3 velocity = glm::vec3(0.0f);
+    float jitter = 0.1f;
+};
+
+// Adds particles through a disc while the simulation runs.
+struct Emitter3D {
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    float speed = 5.0f;
+    float radius = 2.0f;
+    // Particles per second of simulated time
+    float rate = 1000.0f;
+    float startTime = 0.0f;
+    // Negative = never stops
+    float stopTime = -1.0f;
+};
+
+// Removes every particle that enters the box, e.g. a drain.
+struct Sink3D {
+    glm::vec3 centre = glm::vec3(0.0f);
+    glm::vec3 size = glm::vec3(4.0f);
+};
+
+// Everything needed to start a 3D run: the fluid to spawn, emitters, sinks and obstacles,
+// the solver settings and the backend to run on.
+struct Scene3D {
+    std::string name = "default";
+    SimulationType3D backend = SimulationType3D::CPU;
+    // Upper bound for emitters; every particle buffer is sized for it once. 0 = the spawned count.
+    int maxParticleCount = 0;
+    // Keys the spawn jitter; fluid block k draws from stream k
+    uint32_t seed = 42;
+    std::vector<FluidBlock3D> fluidBlocks;
+    std::vector<Emitter3D> emitters;
+    std::vector<Sink3D> sinks;
+    std::vector<Obstacle3D> obstacles;
+    FluidParams3D params;
+
+    int GetSpawnCount() const;
+    int GetMaxParticleCount() const;
+};
+
+class SceneLoader3D {
+public:
+    // Fills scene with the built-in preset called name, or reads it from a .json file.
+    // Returns false (after printing why) for unknown names and invalid files.
+    static bool Load(const std::string& name, Scene3D& scene);
+    static bool LoadFile(const std::string& path, Scene3D& scene);
+    static std::vector<std::string> GetPresetNames();
+
+    // Spawns the fluid blocks into particleData, reserving every column for the scene's maximum particle count.
+    static void Spawn(const Scene3D& scene, ParticleData3D& particleData);
+    // Spreads count particles over the fluid blocks in proportion to their declared counts.
+    static void SetParticleCount(Scene3D& scene, int count);
+};
+
+#endif // SCENE_3D_H
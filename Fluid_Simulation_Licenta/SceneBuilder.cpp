@@ -2,6 +2,8 @@
 #include <vector>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "TriangleMesh3D.h"
+
 SceneBuilder::SceneBuilder(ShaderManager3D* shaderManager)
     : shaderManager(shaderManager), boundingBox(nullptr), floorMesh(nullptr) {
     createMeshes();
@@ -61,6 +63,18 @@ void SceneBuilder::updateBoundingBox() {
     boundingBox->updateVertices(vertices.data(), 8);
 }
 
+void SceneBuilder::setObstacles(const std::vector<Obstacle3D>& obstacles) {
+    destroyObstacleMeshes();
+    for (const Obstacle3D& obstacle : obstacles) {
+        if (obstacle.shape != Obstacle3D::Shape::Mesh || !obstacle.mesh) continue;
+        std::vector<glm::vec3> vertices = obstacle.mesh->Place(obstacle.centre, obstacle.size);
+        std::vector<GLfloat> colors(vertices.size() * 3, 0.45f);
+        const std::vector<glm::uvec3>& triangles = obstacle.mesh->GetTriangles();
+        obstacleMeshes.push_back(new Mesh(glm::value_ptr(vertices[0]), colors.data(), glm::value_ptr(triangles[0]),
+            vertices.size(), triangles.size() * 3, GL_TRIANGLES));
+    }
+}
+
 void SceneBuilder::renderMeshes() {
     auto shader = shaderManager->GetShader();
     shader->use();
@@ -73,12 +87,19 @@ void SceneBuilder::renderMeshes() {
     glLineWidth(5.0f);
 
     boundingBox->render();
+    for (Mesh* obstacleMesh : obstacleMeshes) obstacleMesh->render();
     //floorMesh->render();
 }
 
 void SceneBuilder::destroyMeshes() {
     delete boundingBox;
     delete floorMesh;
+    destroyObstacleMeshes();
+}
+
+void SceneBuilder::destroyObstacleMeshes() {
+    for (Mesh* obstacleMesh : obstacleMeshes) delete obstacleMesh;
+    obstacleMeshes.clear();
 }
 
 std::vector<GLfloat> SceneBuilder::generateBoundingBoxVertices(const glm::vec3& min, const glm::vec3& max) {
@@ -2,6 +2,7 @@
 #define SCENE_BUILDER_H
 
 #include "ShaderManager3D.h"
+#include "FluidParams3D.h"
 #include "Mesh.h"
 #include <vector>
 #include <glm/glm.hpp>
@@ -13,15 +14,19 @@ public:
 
     void renderMeshes();
     void updateBoundingBox();
+    // Replaces the drawn obstacle meshes with the mesh obstacles of a scene, placed like the solver places them.
+    void setObstacles(const std::vector<Obstacle3D>& obstacles);
 
 private:
     ShaderManager3D* shaderManager;
     Mesh* boundingBox;
     Mesh* floorMesh;
     Mesh* skyboxMesh;
+    std::vector<Mesh*> obstacleMeshes;
 
     void createMeshes();
     void destroyMeshes();
+    void destroyObstacleMeshes();
     std::vector<GLfloat> generateBoundingBoxVertices(const glm::vec3& min, const glm::vec3& max);
     std::vector<GLfloat> generateFloorVertices();
     std::vector<GLfloat> generateSkyboxVertices();
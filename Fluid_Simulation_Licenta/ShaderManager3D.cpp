@@ -1,4 +1,5 @@
 #include "ShaderManager3D.h"
+#include "FluidSolverGPU3D.h"
 
 ShaderManager3D::ShaderManager3D()
     : projection(glm::mat4(1.0f)),
@@ -58,34 +59,14 @@ void ShaderManager3D::SetupComputeShader(const std::string& shaderFile) {
         delete computeShader;
     }
     computeShader = new ComputeShader("shaders/" + shaderFile);
+    currentComputeShader = shaderFile;
     computeShader->use();
 
     ApplyComputeShaderSettings();
 }
 
 void ShaderManager3D::ApplyComputeShaderSettings() {
-    computeShader->setUInt("numParticles", 10000); 
-    computeShader->setFloat("gravity", gravity);
-    computeShader->setFloat("deltaTime", 0.0007f);
-    computeShader->setFloat("collisionDamping", collisionDamping);
-    computeShader->setFloat("smoothingRadius", smoothingRadius);
-    computeShader->setFloat("targetDensity", targetDensity);
-    computeShader->setFloat("pressureMultiplier", pressureMultiplier);
-    computeShader->setFloat("nearPressureMultiplier", nearPressureMultiplier);
-    computeShader->setFloat("viscosityStrength", viscosityStrength);
-    computeShader->setVec3("boundsSize", glm::vec3(124.0f, 124.0f, 124.0f));
-    computeShader->setVec3("boundingBoxMin", boundingBoxMin);
-    computeShader->setVec3("boundingBoxMax", boundingBoxMax);
-    computeShader->setVec3("interactionInputPoint", interactionInputPoint);
-    computeShader->setFloat("interactionInputStrength", interactionInputStrength);
-    computeShader->setFloat("interactionInputRadius", interactionInputRadius);
-    computeShader->setFloat("Poly6ScalingFactor", 315.0f / (64.0f * static_cast<float>(M_PI) * powf(smoothingRadius, 9.0f)));
-    computeShader->setFloat("SpikyPow3ScalingFactor", 15.0f / (static_cast<float>(M_PI) * powf(smoothingRadius, 6.0f)));
-    computeShader->setFloat("SpikyPow2ScalingFactor", -45.0f / (static_cast<float>(M_PI) * powf(smoothingRadius, 6.0f)));
-    computeShader->setFloat("SpikyPow3DerivativeScalingFactor", -45.0f / (static_cast<float>(M_PI) * powf(smoothingRadius, 6.0f)));
-    computeShader->setFloat("SpikyPow2DerivativeScalingFactor", -135.0f / (static_cast<float>(M_PI) * powf(smoothingRadius, 6.0f)));
-
-    computeShader->setBool("debugEnabled", false);
+    FluidSolverGPU3D::ApplyParams(computeShader, GetFluidParams());
 }
 
 Shader* ShaderManager3D::GetShader() const {
@@ -108,8 +89,44 @@ glm::vec3 ShaderManager3D::GetBoundingBoxMax() const {
     return boundingBoxMax;
 }
 
+FluidParams3D ShaderManager3D::GetFluidParams() const {
+    FluidParams3D params;
+    params.deltaTime = deltaTime;
+    params.gravity = gravity;
+    params.collisionDamping = collisionDamping;
+    params.smoothingRadius = smoothingRadius;
+    params.targetDensity = targetDensity;
+    params.pressureMultiplier = pressureMultiplier;
+    params.nearPressureMultiplier = nearPressureMultiplier;
+    params.viscosityStrength = viscosityStrength;
+    params.boundingBoxMin = boundingBoxMin;
+    params.boundingBoxMax = boundingBoxMax;
+    params.interactionInputPoint = interactionInputPoint;
+    params.interactionInputStrength = interactionInputStrength;
+    params.interactionInputRadius = interactionInputRadius;
+    params.isXButtonDown = isXButtonDown;
+    params.reorderInterval = reorderInterval;
+    params.deterministic = deterministic;
+    params.longRangeStrength = longRangeStrength;
+    params.longRangeSoftening = longRangeSoftening;
+    params.barnesHutTheta = barnesHutTheta;
+    params.rebinThreshold = rebinThreshold;
+    params.pressureSolver = pressureSolver;
+    params.densityTolerance = densityTolerance;
+    params.divergenceTolerance = divergenceTolerance;
+    params.maxPressureIterations = maxPressureIterations;
+    params.pbfIterations = pbfIterations;
+    params.pbfRelaxation = pbfRelaxation;
+    params.pbfTensileStrength = pbfTensileStrength;
+    params.xsphViscosity = xsphViscosity;
+    params.gridCellSize = gridCellSize;
+    params.gridPressureTolerance = gridPressureTolerance;
+    return params;
+}
+
 
 void ShaderManager3D::UpdateComputeShaderSettings(float timeStep) {
+    deltaTime = timeStep;
     computeShader->use();
     computeShader->setFloat("deltaTime", timeStep);
 }
@@ -122,12 +139,11 @@ void ShaderManager3D::RenderImGui() {
     ImGui::SetNextWindowSize(ImVec2(static_cast<float>(windowWidth) / 4, static_cast<float>(windowHeight) * 3 / 4), ImGuiCond_Always);
     ImGui::Begin("Shader Manager", nullptr, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse);
 
-    static const char* shaderOptions[] = { "SPH (slow)", "SPH (hashing)" };
-    static int currentShaderIndex = 0;
+    static const char* shaderOptions[] = { "SPH (slow)", "SPH (hashing)", "SPH (CPU)", "Playback", "APIC (CPU grid)" };
+    int currentShaderIndex = static_cast<int>(simulationType);
 
     if (ImGui::Combo("Compute Shader", &currentShaderIndex, shaderOptions, IM_ARRAYSIZE(shaderOptions))) {
-        const char* selectedShader = (currentShaderIndex == 0) ? "FluidSimulator_3D.comp" : "FluidSimulatorHash_3D.comp";
-        SetupComputeShader(selectedShader);
+        SetSimulationType(static_cast<SimulationType3D>(currentShaderIndex));
     }
 
     RenderComputeShaderControls();
@@ -135,6 +151,52 @@ void ShaderManager3D::RenderImGui() {
     ImGui::End();
 }
 
+void ShaderManager3D::SetSimulationType(SimulationType3D type) {
+    simulationType = type;
+    // The CPU backends and playback keep the current particles, so only GPU selections reload a shader
+    if (simulationType == SimulationType3D::SLOW || simulationType == SimulationType3D::HASH) {
+        const char* selectedShader = (simulationType == SimulationType3D::SLOW) ? "FluidSimulator_3D.comp" : "FluidSimulatorHash_3D.comp";
+        if (currentComputeShader != selectedShader) {
+            SetupComputeShader(selectedShader);
+        }
+    }
+}
+
+void ShaderManager3D::SetFluidParams(const FluidParams3D& params) {
+    deltaTime = params.deltaTime;
+    gravity = params.gravity;
+    collisionDamping = params.collisionDamping;
+    smoothingRadius = params.smoothingRadius;
+    targetDensity = params.targetDensity;
+    pressureMultiplier = params.pressureMultiplier;
+    nearPressureMultiplier = params.nearPressureMultiplier;
+    viscosityStrength = params.viscosityStrength;
+    boundingBoxMin = params.boundingBoxMin;
+    boundingBoxMax = params.boundingBoxMax;
+    interactionInputStrength = params.interactionInputStrength;
+    interactionInputRadius = params.interactionInputRadius;
+    reorderInterval = params.reorderInterval;
+    deterministic = params.deterministic;
+    longRangeStrength = params.longRangeStrength;
+    longRangeSoftening = params.longRangeSoftening;
+    barnesHutTheta = params.barnesHutTheta;
+    rebinThreshold = params.rebinThreshold;
+    pressureSolver = params.pressureSolver;
+    densityTolerance = params.densityTolerance;
+    divergenceTolerance = params.divergenceTolerance;
+    maxPressureIterations = params.maxPressureIterations;
+    pbfIterations = params.pbfIterations;
+    pbfRelaxation = params.pbfRelaxation;
+    pbfTensileStrength = params.pbfTensileStrength;
+    xsphViscosity = params.xsphViscosity;
+    gridCellSize = params.gridCellSize;
+    gridPressureTolerance = params.gridPressureTolerance;
+    boundingBoxChanged = true;
+
+    computeShader->use();
+    ApplyComputeShaderSettings();
+}
+
 void ShaderManager3D::SetInteractionInputPoint(const glm::vec3& point) {
     interactionInputPoint = point;
     computeShader->use();
@@ -143,7 +205,7 @@ void ShaderManager3D::SetInteractionInputPoint(const glm::vec3& point) {
 
 void ShaderManager3D::UpdateMouseStateAndSetUniforms() {
     ImGuiIO& io = ImGui::GetIO();
-    glm::bvec2 isXButtonDown = glm::bvec2(false, false);
+    isXButtonDown = glm::bvec2(false, false);
 
     if (io.MouseDown[0]) {
         ImVec2 mousePos = ImGui::GetMousePos();
@@ -170,6 +232,41 @@ void ShaderManager3D::RenderComputeShaderControls() {
     ImGui::SliderFloat("Viscosity Strength", &viscosityStrength, 0.0f, 10.0f);
     ImGui::SliderFloat("Interaction Input Strength", &interactionInputStrength, 0.0f, 30.0f);
     ImGui::SliderFloat("Interaction Input Radius", &interactionInputRadius, 0.0f, 300.0f);
+    if (simulationType == SimulationType3D::CPU) {
+        ImGui::SliderInt("Reorder Interval (steps, 0 = off)", &reorderInterval, 0, 256);
+        ImGui::Checkbox("Deterministic", &deterministic);
+        ImGui::SliderFloat("Long-Range Strength (0 = off)", &longRangeStrength, 0.0f, 10.0f);
+        ImGui::SliderFloat("Long-Range Softening", &longRangeSoftening, 0.01f, 10.0f);
+        ImGui::SliderFloat("Barnes-Hut Theta", &barnesHutTheta, 0.0f, 1.5f);
+    }
+    // The grid backend always projects its face velocities, so it has no pressure solver to pick
+    if (simulationType == SimulationType3D::GRID) {
+        ImGui::SliderFloat("Grid Cell Size (0 = 4 * radius)", &gridCellSize, 0.0f, 16.0f);
+        ImGui::SliderFloat("Grid Pressure Tolerance", &gridPressureTolerance, 1e-6f, 1e-2f, "%.6f");
+        ImGui::SliderInt("Max Pressure Iterations", &maxPressureIterations, 1, 500);
+    }
+    else {
+        // DFSPH only exists on the CPU; the GPU backends run the explicit shaders for it
+        static const char* pressureSolverOptions[] = { "Explicit", "DFSPH (CPU)", "PBF" };
+        int pressureSolverIndex = static_cast<int>(pressureSolver);
+        if (ImGui::Combo("Pressure Solver", &pressureSolverIndex, pressureSolverOptions, IM_ARRAYSIZE(pressureSolverOptions))) {
+            pressureSolver = static_cast<PressureSolver3D>(pressureSolverIndex);
+        }
+        if (pressureSolver == PressureSolver3D::DFSPH && simulationType == SimulationType3D::CPU) {
+            ImGui::SliderFloat("Density Tolerance", &densityTolerance, 0.0001f, 0.05f, "%.4f");
+            ImGui::SliderFloat("Divergence Tolerance", &divergenceTolerance, 0.0001f, 0.05f, "%.4f");
+            ImGui::SliderInt("Max Pressure Iterations", &maxPressureIterations, 1, 500);
+        }
+        else if (pressureSolver == PressureSolver3D::PBF) {
+            ImGui::SliderInt("PBF Iterations", &pbfIterations, 1, 20);
+            ImGui::SliderFloat("PBF Relaxation", &pbfRelaxation, 0.0f, 1.0f, "%.4f");
+            ImGui::SliderFloat("PBF Tensile Strength", &pbfTensileStrength, 0.0f, 1.0f);
+            ImGui::SliderFloat("XSPH Viscosity", &xsphViscosity, 0.0f, 0.5f);
+        }
+    }
+    if (simulationType == SimulationType3D::CPU || simulationType == SimulationType3D::HASH) {
+        ImGui::SliderFloat("Incremental Re-sort Threshold (0 = off)", &rebinThreshold, 0.0f, 1.0f);
+    }
 
     if (ImGui::SliderFloat3("Bounding Box Min (xMin, yMin, zMin)", glm::value_ptr(boundingBoxMin), 0.0f, 2000.0f)) {
         boundingBoxMin = glm::min(boundingBoxMin, boundingBoxMax);
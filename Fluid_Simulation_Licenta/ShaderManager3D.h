@@ -14,6 +14,8 @@
 #include <GL/freeglut.h>
 #include "Camera.h"
 #include "Movement.h"
+#include "FluidParams3D.h"
+#include "SimulationType3D.h"
 
 class ShaderManager3D {
 public:
@@ -42,6 +44,12 @@ public:
     Movement* GetMovementHandler() const { return movementHandler; }
     glm::vec3 GetBoundingBoxMin() const;
     glm::vec3 GetBoundingBoxMax() const;
+    SimulationType3D GetSimulationType() const { return simulationType; }
+    FluidParams3D GetFluidParams() const;
+    // Restores settings saved in a checkpoint and uploads them to the compute shader.
+    void SetFluidParams(const FluidParams3D& params);
+    // Same as picking the backend in the combo box; a different GPU shader requests a restart.
+    void SetSimulationType(SimulationType3D type);
 
     bool isBoundingBoxChanged() const { return boundingBoxChanged; }
     void resetBoundingBoxChanged() { boundingBoxChanged = false; }
@@ -70,6 +78,25 @@ private:
     float viscosityStrength = 1.0f;
     float interactionInputStrength = 1.0f;
     float interactionInputRadius = 1.0f;
+    float deltaTime = 0.0007f;
+    int reorderInterval = 16;
+    bool deterministic = false;
+    float longRangeStrength = 0.0f;
+    float longRangeSoftening = 1.0f;
+    float barnesHutTheta = 0.5f;
+    float rebinThreshold = 0.25f;
+    PressureSolver3D pressureSolver = PressureSolver3D::Explicit;
+    float densityTolerance = 0.001f;
+    float divergenceTolerance = 0.001f;
+    int maxPressureIterations = 100;
+    int pbfIterations = 4;
+    float pbfRelaxation = 0.01f;
+    float pbfTensileStrength = 0.1f;
+    float xsphViscosity = 0.05f;
+    float gridCellSize = 0.0f;
+    float gridPressureTolerance = 1e-4f;
+    glm::bvec2 isXButtonDown = glm::bvec2(false, false);
+    SimulationType3D simulationType = SimulationType3D::SLOW;
     std::string currentComputeShader;
 
     void RenderComputeShaderControls();
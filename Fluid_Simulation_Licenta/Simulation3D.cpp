@@ -9,6 +9,15 @@ Simulation3D::Simulation3D(int argc, char** argv) {
 }
 
 void Simulation3D::Initialize(int argc, char** argv) {
+    // "--scene NAME" picks a preset or a .json scene file; without it the sandbox preset keeps the old GUI setup
+    std::string sceneName = "sandbox";
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--scene") sceneName = argv[i + 1];
+    }
+    if (!SceneLoader3D::Load(sceneName, scene)) {
+        SceneLoader3D::Load("sandbox", scene);
+    }
+
     InitializeGLUT(argc, argv);
     InitializeGLEW();
     InitializeManagers();
@@ -32,13 +41,19 @@ void Simulation3D::InitializeGLEW() {
 void Simulation3D::InitializeManagers() {
     shaderManager = new ShaderManager3D();
     shaderManager->SetupShaders();
-    particleSystem = new ParticleSystem3D(shaderManager);
+    shaderManager->SetSimulationType(scene.backend);
+    shaderManager->SetFluidParams(scene.params);
+    particleSystem = new ParticleSystem3D(shaderManager, scene);
+    resetSimulationFlag = false;
+    trajectoryRecorder = new TrajectoryRecorder();
+    exporter = new ParticleExporter3D();
 
     imguiManager = new ImGuiManager3D(this, shaderManager);
     imguiManager->Init();
     debugPrint("ImGui manager initialized.");
 
     sceneBuilder = new SceneBuilder(shaderManager);
+    sceneBuilder->setObstacles(scene.obstacles);
 }
 
 Simulation3D::~Simulation3D() {
@@ -51,12 +66,71 @@ void Simulation3D::Cleanup() {
     delete shaderManager;
     delete particleSystem;
     delete sceneBuilder; 
+    delete trajectoryRecorder;
+    delete exporter;
 }
 
 void Simulation3D::RestartSimulation() {
     delete particleSystem;
-    particleSystem = new ParticleSystem3D(shaderManager);
-    resetSimulationFlag = false; 
+    particleSystem = new ParticleSystem3D(shaderManager, scene);
+    resetSimulationFlag = false;
+    stepCount = 0;
+    simulationTime = 0.0;
+}
+
+bool Simulation3D::LoadScene(const std::string& name) {
+    Scene3D loaded;
+    if (!SceneLoader3D::Load(name, loaded)) return false;
+
+    scene = loaded;
+    shaderManager->SetSimulationType(scene.backend);
+    shaderManager->SetFluidParams(scene.params);
+    sceneBuilder->setObstacles(scene.obstacles);
+    RestartSimulation();
+    return true;
+}
+
+bool Simulation3D::SaveCheckpoint(const std::string& path) {
+    Checkpoint3D::State state;
+    SimulationType3D type = shaderManager->GetSimulationType();
+    // The GPU backends' emitters and sinks change the count in the SSBOs, not in the host copy
+    ParticleRenderer3D* renderer = particleSystem->GetParticleRenderer();
+    bool onGpu = type == SimulationType3D::SLOW || type == SimulationType3D::HASH;
+    state.particleCount = onGpu ? renderer->GetParticleBuffers()->GetParticleCount() : renderer->GetParticleData().positions.size();
+    state.stepCount = stepCount;
+    state.simulationTime = simulationTime;
+    // A played frame is saved as a CPU state, so loading it continues by simulating
+    state.simulationType = static_cast<uint32_t>(type == SimulationType3D::PLAYBACK ? SimulationType3D::CPU : type);
+    state.params = shaderManager->GetFluidParams();
+
+    CheckpointWriter writer;
+    if (!writer.Open(path, state)) return false;
+    bool written = particleSystem->WriteCheckpoint(writer);
+    return writer.Close() && written;
+}
+
+bool Simulation3D::LoadCheckpoint(const std::string& path) {
+    CheckpointReader reader;
+    if (!reader.Open(path)) return false;
+
+    const Checkpoint3D::State& state = reader.GetState();
+    // Playback is never saved, see SaveCheckpoint
+    if (state.simulationType > static_cast<uint32_t>(SimulationType3D::GRID) || state.simulationType == static_cast<uint32_t>(SimulationType3D::PLAYBACK)) {
+        std::cerr << "Simulation3D::LoadCheckpoint Error: Unknown simulation type " << state.simulationType << std::endl;
+        return false;
+    }
+
+    shaderManager->SetSimulationType(static_cast<SimulationType3D>(state.simulationType));
+    // A different compute shader invalidates the particle system, so rebuild it before loading into it
+    if (resetSimulationFlag) {
+        RestartSimulation();
+    }
+    shaderManager->SetFluidParams(state.params);
+    if (!particleSystem->LoadCheckpoint(reader)) return false;
+
+    stepCount = state.stepCount;
+    simulationTime = state.simulationTime;
+    return true;
 }
 
 void Simulation3D::Run() {
@@ -206,6 +280,23 @@ void Simulation3D::RunSimulationFrame(float frameTime) {
         // Ensure timeStep is within a reasonable range
         float minTimeStep = 0.0001f;
         float maxTimeStep = 0.01f;
+
+        // The grid backend substeps on its own to keep particles within a cell, so it runs at the frame rate
+        if (particleSystem->getSimulationType() == SimulationType3D::GRID) {
+            adaptiveTimeStep = 1.0f / 60.0f;
+            maxTimeStep = 1.0f / 60.0f;
+        }
+        // DFSPH solves for its pressure, so stiff pressure accelerations do not limit the step;
+        // only the distance a particle travels in one step does
+        else if (particleSystem->getSimulationType() == SimulationType3D::CPU && shaderManager->GetFluidParams().pressureSolver == PressureSolver3D::DFSPH) {
+            adaptiveTimeStep = 0.4f * (smoothingRadius / maxVelocity);
+            maxTimeStep = 0.04f;
+        }
+        // PBF is stable at a fixed frame-rate step on every backend; it only stops short of 1/60 s for fast particles
+        else if (shaderManager->GetFluidParams().pressureSolver == PressureSolver3D::PBF && particleSystem->getSimulationType() != SimulationType3D::PLAYBACK) {
+            adaptiveTimeStep = 0.4f * (smoothingRadius / maxVelocity);
+            maxTimeStep = 1.0f / 60.0f;
+        }
         adaptiveTimeStep = glm::clamp(adaptiveTimeStep, minTimeStep, maxTimeStep);
 
         float timeStep = adaptiveTimeStep * timeScale;
@@ -215,10 +306,34 @@ void Simulation3D::RunSimulationFrame(float frameTime) {
 
         for (int i = 0; i < iterationsPerFrame; i++) {
             particleSystem->UpdateParticles();
+            stepCount++;
+            simulationTime += timeStep;
+            RecordTrajectoryFrame();
+            ExportFrame();
         }
     }
 }
 
+void Simulation3D::RecordTrajectoryFrame() {
+    if (!trajectoryRecorder->WantsFrame(stepCount)) return;
+
+    // The GPU backends only update the host copy on download; the CPU backends work on it
+    particleSystem->DownloadParticleData();
+    const ParticleData3D& particleData = particleSystem->GetParticleRenderer()->GetParticleData();
+    const std::vector<uint32_t>* ids = particleSystem->getSimulationType() == SimulationType3D::CPU ? &particleSystem->GetCpuSolver()->GetParticleIds() : nullptr;
+    trajectoryRecorder->SubmitFrame(stepCount, simulationTime, particleData.positions, particleData.velocities,
+        shaderManager->GetBoundingBoxMin(), shaderManager->GetBoundingBoxMax(), ids);
+}
+
+void Simulation3D::ExportFrame() {
+    if (!exporter->WantsFrame(stepCount)) return;
+
+    particleSystem->DownloadParticleData();
+    const ParticleData3D& particleData = particleSystem->GetParticleRenderer()->GetParticleData();
+    const std::vector<uint32_t>* ids = particleSystem->getSimulationType() == SimulationType3D::CPU ? &particleSystem->GetCpuSolver()->GetParticleIds() : nullptr;
+    exporter->SubmitFrame(stepCount, simulationTime, particleData, ids);
+}
+
 void Simulation3D::UpdateSettings(float timeStep) {
     shaderManager->UpdateComputeShaderSettings(timeStep);
 }
@@ -17,6 +17,9 @@
 #include <iomanip>
 #include "AppState.h"
 #include "SceneBuilder.h"
+#include "TrajectoryRecorder.h"
+#include "ParticleExporter3D.h"
+#include "Scene3D.h"
 
 class ShaderManager3D;
 class ParticleSystem3D;
@@ -35,6 +38,14 @@ public:
     void RunSimulationFrame(float frameTime);
     void UpdateSettings(float timeStep);
     void RestartSimulation();
+    // Loads a preset or .json scene, applies its settings and backend, and restarts with it.
+    bool LoadScene(const std::string& name);
+    const Scene3D& getScene() const { return scene; }
+    // Saves or restores particles, solver settings and the step/time counters.
+    bool SaveCheckpoint(const std::string& path);
+    bool LoadCheckpoint(const std::string& path);
+    TrajectoryRecorder* getTrajectoryRecorder() const { return trajectoryRecorder; }
+    ParticleExporter3D* getExporter() const { return exporter; }
 
     static void DisplayCallback();
     static void TimerCallback(int value);
@@ -55,6 +66,9 @@ public:
     AppState getAppState() const { return appState; }
     void setAppState(AppState state) { appState = state; }
     void setResetSimulationFlag(float value) { resetSimulationFlag = value; }
+    ParticleSystem3D* getParticleSystem() const { return particleSystem; }
+    uint64_t getStepCount() const { return stepCount; }
+    double getSimulationTime() const { return simulationTime; }
 
     static bool resetSimulationFlag;
 
@@ -68,11 +82,16 @@ private:
     void Cleanup();
     void DisplayCurrentTime();
     void ImGuiDisplay();
+    void RecordTrajectoryFrame();
+    void ExportFrame();
 
     ShaderManager3D* shaderManager;
     ParticleSystem3D* particleSystem;
     ImGuiManager3D* imguiManager;
     SceneBuilder* sceneBuilder;
+    TrajectoryRecorder* trajectoryRecorder;
+    ParticleExporter3D* exporter;
+    Scene3D scene;
 
     bool isPaused = false;
     float timeScale = 1.0f;
@@ -80,6 +99,8 @@ private:
     AppState appState = AppState::MENU;
 
     int iterationsPerFrame = 1;
+    uint64_t stepCount = 0;
+    double simulationTime = 0.0;
 
     int mainWindowId;
     int windowID;
@@ -0,0 +1,15 @@
+// SimulationType3D.h
+#ifndef SIMULATIONTYPE3D_H
+#define SIMULATIONTYPE3D_H
+
+enum class SimulationType3D {
+    SLOW,
+    HASH,
+    CPU,
+    // Replays a recorded trajectory instead of simulating
+    PLAYBACK,
+    // APIC particles with a MAC grid pressure solve on the CPU (FluidSolverAPIC3D)
+    GRID
+};
+
+#endif // SIMULATIONTYPE3D_H
@@ -0,0 +1,102 @@
+#include "SparseBlockGrid3D.h"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    const size_t CellGrain = 4096;
+    const size_t BlockGrain = 64;
+    const size_t MinTableSize = 64;
+}
+
+SparseBlockGrid3D::SparseBlockGrid3D(TaskScheduler& scheduler) : scheduler(scheduler), tableCapacity(0), tableMask(0) {}
+
+void SparseBlockGrid3D::Clear() {
+    blockKeys.clear();
+    values.clear();
+    tableMask = 0;
+}
+
+size_t SparseBlockGrid3D::GetMemoryBytes() const {
+    return values.size() * sizeof(uint32_t) + blockKeys.size() * sizeof(uint64_t) + GetTableSize() * (sizeof(uint64_t) + sizeof(uint32_t));
+}
+
+glm::ivec3 SparseBlockGrid3D::CellFromKey(uint32_t key) const {
+    uint32_t bx, by, bz, x, y, z;
+    Morton::Decode3DWide(blockKeys[key >> (3 * BlockBits)], bx, by, bz);
+    Morton::Decode3D(key & (BlockCells - 1), x, y, z);
+    return glm::ivec3((bx << BlockBits) | x, (by << BlockBits) | y, (bz << BlockBits) | z);
+}
+
+bool SparseBlockGrid3D::InsertBlocks(const std::vector<glm::ivec3>& cells, size_t tableSize) {
+    if (tableSize > tableCapacity) {
+        tableKeys.reset(new std::atomic<uint64_t>[tableSize]);
+        tableCapacity = tableSize;
+    }
+    tableMask = static_cast<uint32_t>(tableSize - 1);
+    scheduler.ParallelFor(0, tableSize, CellGrain, [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; ++b) tableKeys[b].store(EmptyKey, std::memory_order_relaxed);
+    });
+
+    // Stop once half the buckets are taken, so probing always ends at an empty bucket
+    std::atomic<size_t> inserted(0);
+    std::atomic<bool> full(false);
+    scheduler.ParallelFor(0, cells.size(), CellGrain, [&](size_t begin, size_t end) {
+        uint64_t previous = EmptyKey;
+        for (size_t i = begin; i < end && !full.load(std::memory_order_relaxed); ++i) {
+            // Neighbouring cells mostly share a block, so skip the repeats without hashing
+            uint64_t key = BlockKey(cells[i]);
+            if (key == previous) continue;
+            previous = key;
+
+            uint32_t bucket = HashBlockKey(key) & tableMask;
+            while (true) {
+                uint64_t expected = EmptyKey;
+                if (tableKeys[bucket].compare_exchange_strong(expected, key, std::memory_order_relaxed)) {
+                    if (inserted.fetch_add(1, std::memory_order_relaxed) + 1 > tableSize / 2) full.store(true, std::memory_order_relaxed);
+                    break;
+                }
+                if (expected == key) break;
+                bucket = (bucket + 1) & tableMask;
+            }
+        }
+    });
+    return !full.load();
+}
+
+void SparseBlockGrid3D::Build(const std::vector<glm::ivec3>& cells) {
+    size_t previousBlocks = blockKeys.size();
+    Clear();
+    if (cells.empty()) return;
+
+    // Start from twice the blocks of the last build and grow until the blocks fit
+    size_t tableSize = MinTableSize;
+    while (tableSize < 2 * previousBlocks) tableSize <<= 1;
+    while (!InsertBlocks(cells, tableSize)) tableSize *= 4;
+
+    for (size_t b = 0; b < tableSize; ++b) {
+        uint64_t key = tableKeys[b].load(std::memory_order_relaxed);
+        if (key != EmptyKey) blockKeys.push_back(key);
+    }
+    if (blockKeys.size() > MaxBlocks) {
+        std::cerr << "SparseBlockGrid3D::Build Error: " << blockKeys.size() << " blocks do not fit in 32-bit cell keys" << std::endl;
+        Clear();
+        return;
+    }
+    // Ranks follow the Morton order of the blocks, whatever order the threads inserted them in
+    std::sort(blockKeys.begin(), blockKeys.end());
+
+    size_t blockCount = blockKeys.size();
+    tableRanks.resize(tableSize);
+    scheduler.ParallelFor(0, blockCount, BlockGrain, [&](size_t begin, size_t end) {
+        for (size_t rank = begin; rank < end; ++rank) {
+            uint32_t bucket = HashBlockKey(blockKeys[rank]) & tableMask;
+            while (tableKeys[bucket].load(std::memory_order_relaxed) != blockKeys[rank]) bucket = (bucket + 1) & tableMask;
+            tableRanks[bucket] = static_cast<uint32_t>(rank);
+        }
+    });
+
+    values.resize(blockCount * BlockCells);
+    scheduler.ParallelFor(0, blockCount, BlockGrain, [&](size_t begin, size_t end) {
+        std::fill(values.begin() + begin * BlockCells, values.begin() + end * BlockCells, Empty);
+    });
+}
@@ -0,0 +1,102 @@
+#ifndef SPARSE_BLOCK_GRID_3D_H
+#define SPARSE_BLOCK_GRID_3D_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Morton.h"
+#include "TaskScheduler.h"
+
+// Sparse grid of 8^3-cell blocks over a lattice of up to 2^24 cells per axis. Only the blocks that
+// hold at least one of the cells given to Build are stored, so memory grows with the occupied
+// volume instead of the extent of the lattice. A power-of-two hash table with linear probing maps
+// a block's coordinate to its rank, and every block keeps one value per cell in a dense array, so
+// a lookup is one probe sequence and one array read; cells of the same block share the probe.
+// Blocks are ranked in Morton order of their coordinates and cells in Morton order inside a block,
+// so a cell's key, rank * 512 + its Morton index in the block, both indexes its value and sorts the
+// cells in Morton order.
+class SparseBlockGrid3D {
+public:
+    explicit SparseBlockGrid3D(TaskScheduler& scheduler = TaskScheduler::Instance());
+
+    // Stores the blocks that contain any of cells and sets every value to Empty.
+    // Coordinates must lie in [0, MaxAxisCells).
+    void Build(const std::vector<glm::ivec3>& cells);
+    void Clear();
+
+    // Key of a cell, or Empty when its block is not stored. probes counts the buckets read.
+    uint32_t FindKey(const glm::ivec3& cell, uint32_t& probes) const {
+        uint32_t rank = FindBlock(BlockKey(cell), probes);
+        return rank == Empty ? Empty : (rank << (3 * BlockBits)) | LocalIndex(cell);
+    }
+    // Value stored for a cell, or Empty when its block is not stored.
+    uint32_t Find(const glm::ivec3& cell, uint32_t& probes) const {
+        uint32_t key = FindKey(cell, probes);
+        return key == Empty ? Empty : values[key];
+    }
+    glm::ivec3 CellFromKey(uint32_t key) const;
+
+    uint32_t GetValue(uint32_t key) const { return values[key]; }
+    void SetValue(uint32_t key, uint32_t value) { values[key] = value; }
+
+    size_t GetBlockCount() const { return blockKeys.size(); }
+    size_t GetTableSize() const { return blockKeys.empty() ? 0 : size_t(tableMask) + 1; }
+    // Bits a cell key needs: the block rank above the cell's index in the block.
+    uint32_t GetKeyBits() const { return 3 * BlockBits + Morton::BitsFor(static_cast<uint32_t>(blockKeys.size())); }
+    // Bytes held by the stored blocks and the hash table.
+    size_t GetMemoryBytes() const;
+
+    static const int BlockBits = 3;
+    static const int BlockSize = 1 << BlockBits;
+    static const uint32_t BlockCells = 1u << (3 * BlockBits);
+    static const int MaxAxisCells = BlockSize << 21;
+    // Keys are 32 bits, which leaves room for this many blocks
+    static const size_t MaxBlocks = size_t(1) << (32 - 3 * BlockBits);
+    static const uint32_t Empty = 0xFFFFFFFFu;
+
+private:
+    static uint64_t BlockKey(const glm::ivec3& cell) {
+        return Morton::Encode3DWide(static_cast<uint32_t>(cell.x) >> BlockBits, static_cast<uint32_t>(cell.y) >> BlockBits,
+            static_cast<uint32_t>(cell.z) >> BlockBits);
+    }
+    static uint32_t LocalIndex(const glm::ivec3& cell) {
+        const int mask = BlockSize - 1;
+        return Morton::Encode3D(static_cast<uint32_t>(cell.x & mask), static_cast<uint32_t>(cell.y & mask), static_cast<uint32_t>(cell.z & mask));
+    }
+    static uint32_t HashBlockKey(uint64_t key) {
+        key *= 0x9E3779B97F4A7C15ull;
+        return static_cast<uint32_t>(key ^ (key >> 32));
+    }
+
+    uint32_t FindBlock(uint64_t key, uint32_t& probes) const {
+        if (blockKeys.empty()) return Empty;
+        uint32_t bucket = HashBlockKey(key) & tableMask;
+        while (true) {
+            ++probes;
+            uint64_t stored = tableKeys[bucket].load(std::memory_order_relaxed);
+            if (stored == key) return tableRanks[bucket];
+            if (stored == EmptyKey) return Empty;
+            bucket = (bucket + 1) & tableMask;
+        }
+    }
+
+    // Inserts the blocks of cells into a table of tableSize buckets; false if more than half of them filled up.
+    bool InsertBlocks(const std::vector<glm::ivec3>& cells, size_t tableSize);
+
+    static const uint64_t EmptyKey = ~uint64_t(0);
+
+    TaskScheduler& scheduler;
+    // Morton codes of the stored blocks in rank order
+    std::vector<uint64_t> blockKeys;
+    std::unique_ptr<std::atomic<uint64_t>[]> tableKeys;
+    std::vector<uint32_t> tableRanks;
+    size_t tableCapacity;
+    uint32_t tableMask;
+    std::vector<uint32_t> values;
+};
+
+#endif // SPARSE_BLOCK_GRID_3D_H
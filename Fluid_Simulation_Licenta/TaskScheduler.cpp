@@ -0,0 +1,291 @@
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+    thread_local const TaskScheduler* currentScheduler = nullptr;
+    thread_local unsigned int currentWorkerIndex = 0;
+}
+
+TaskScheduler& TaskScheduler::Instance() {
+    static TaskScheduler instance;
+    return instance;
+}
+
+TaskScheduler::TaskScheduler(unsigned int numThreads, bool pinThreads)
+    : threadCount(numThreads == 0 ? HardwareThreads() : numThreads), pinThreads(pinThreads) {
+    StartWorkers();
+}
+
+TaskScheduler::~TaskScheduler() {
+    StopWorkers();
+}
+
+unsigned int TaskScheduler::HardwareThreads() {
+    unsigned int count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : count;
+}
+
+void TaskScheduler::Configure(unsigned int numThreads, bool pinThreads) {
+    if (numThreads == 0) numThreads = HardwareThreads();
+    if (numThreads == threadCount && pinThreads == this->pinThreads) return;
+
+    StopWorkers();
+    threadCount = numThreads;
+    this->pinThreads = pinThreads;
+    StartWorkers();
+
+    std::cout << "TaskScheduler: " << threadCount << " thread(s)" << (pinThreads ? ", pinned" : "") << std::endl;
+}
+
+void TaskScheduler::StartWorkers() {
+    stopping = false;
+    workers.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; ++i) {
+        workers.push_back(new Worker());
+    }
+
+    // Slot 0 belongs to whichever thread submits work; only slots 1..N-1 get a thread.
+    for (unsigned int i = 1; i < threadCount; ++i) {
+        workers[i]->thread = std::thread(&TaskScheduler::WorkerLoop, this, i);
+        if (pinThreads) {
+            PinThread(workers[i]->thread, i);
+        }
+    }
+}
+
+void TaskScheduler::StopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+
+    for (Worker* worker : workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+        delete worker;
+    }
+    workers.clear();
+    queuedTasks = 0;
+}
+
+void TaskScheduler::PinThread(std::thread& thread, unsigned int core) {
+    unsigned int hardwareCore = core % HardwareThreads();
+#ifdef _WIN32
+    DWORD_PTR mask = static_cast<DWORD_PTR>(1) << (hardwareCore % (sizeof(DWORD_PTR) * 8));
+    if (SetThreadAffinityMask(thread.native_handle(), mask) == 0) {
+        std::cerr << "TaskScheduler: failed to pin worker to core " << hardwareCore << std::endl;
+    }
+#else
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(hardwareCore, &cpuSet);
+    if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuSet) != 0) {
+        std::cerr << "TaskScheduler: failed to pin worker to core " << hardwareCore << std::endl;
+    }
+#endif
+}
+
+void TaskScheduler::WorkerLoop(unsigned int index) {
+    currentScheduler = this;
+    currentWorkerIndex = index;
+
+    while (!stopping) {
+        if (TryRunOne(index)) continue;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeCondition.wait_for(lock, std::chrono::milliseconds(1), [this] {
+            return stopping || queuedTasks.load() > 0;
+        });
+    }
+
+    currentScheduler = nullptr;
+}
+
+unsigned int TaskScheduler::CurrentWorkerIndex() const {
+    return currentScheduler == this ? currentWorkerIndex : 0;
+}
+
+void TaskScheduler::Push(unsigned int workerIndex, QueuedTask task) {
+    {
+        std::lock_guard<std::mutex> lock(workers[workerIndex]->mutex);
+        workers[workerIndex]->tasks.push_back(std::move(task));
+    }
+    queuedTasks.fetch_add(1);
+    wakeCondition.notify_one();
+}
+
+bool TaskScheduler::PopLocal(unsigned int workerIndex, QueuedTask& task) {
+    Worker* worker = workers[workerIndex];
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    if (worker->tasks.empty()) return false;
+    task = std::move(worker->tasks.back());
+    worker->tasks.pop_back();
+    return true;
+}
+
+bool TaskScheduler::Steal(unsigned int thiefIndex, QueuedTask& task) {
+    for (unsigned int offset = 1; offset < threadCount; ++offset) {
+        Worker* victim = workers[(thiefIndex + offset) % threadCount];
+        std::unique_lock<std::mutex> lock(victim->mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim->tasks.empty()) continue;
+        task = std::move(victim->tasks.front());
+        victim->tasks.pop_front();
+        workers[thiefIndex]->tasksStolen.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+bool TaskScheduler::TryRunOne(unsigned int workerIndex) {
+    QueuedTask task;
+    if (!PopLocal(workerIndex, task) && !Steal(workerIndex, task)) {
+        return false;
+    }
+    queuedTasks.fetch_sub(1);
+    Execute(workerIndex, task);
+    return true;
+}
+
+void TaskScheduler::Execute(unsigned int workerIndex, QueuedTask& task) {
+    auto start = std::chrono::steady_clock::now();
+    task.work();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    Worker* worker = workers[workerIndex];
+    worker->tasksExecuted.fetch_add(1, std::memory_order_relaxed);
+    worker->busyNanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+
+    task.counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void TaskScheduler::Wait(TaskCounter& counter) {
+    unsigned int index = CurrentWorkerIndex();
+    while (counter.pending.load(std::memory_order_acquire) > 0) {
+        if (!TryRunOne(index)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void TaskScheduler::ParallelFor(size_t begin, size_t end, size_t grainSize, const RangeFunction& body) {
+    if (end <= begin) return;
+    if (grainSize == 0) grainSize = 1;
+
+    size_t numChunks = (end - begin + grainSize - 1) / grainSize;
+    if (threadCount == 1 || numChunks == 1) {
+        for (size_t chunkBegin = begin; chunkBegin < end; chunkBegin += grainSize) {
+            body(chunkBegin, std::min(chunkBegin + grainSize, end));
+        }
+        return;
+    }
+
+    TaskCounter counter;
+    counter.pending = numChunks;
+
+    // Hand every worker a contiguous block of chunks; idle workers steal from the front.
+    for (size_t chunk = numChunks; chunk-- > 0;) {
+        size_t chunkBegin = begin + chunk * grainSize;
+        size_t chunkEnd = std::min(chunkBegin + grainSize, end);
+        unsigned int owner = static_cast<unsigned int>(chunk * threadCount / numChunks);
+        Push(owner, { [&body, chunkBegin, chunkEnd]() { body(chunkBegin, chunkEnd); }, &counter });
+    }
+
+    Wait(counter);
+}
+
+void TaskScheduler::RunAll(std::vector<Task>& tasks) {
+    if (tasks.empty()) return;
+    if (threadCount == 1) {
+        for (Task& task : tasks) task();
+        return;
+    }
+
+    TaskCounter counter;
+    counter.pending = tasks.size();
+    for (Task& task : tasks) {
+        unsigned int owner = nextSubmitWorker.fetch_add(1) % threadCount;
+        Push(owner, { task, &counter });
+    }
+    Wait(counter);
+}
+
+void TaskScheduler::ResetStats() {
+    for (Worker* worker : workers) {
+        worker->tasksExecuted = 0;
+        worker->tasksStolen = 0;
+        worker->busyNanoseconds = 0;
+    }
+}
+
+std::vector<TaskScheduler::WorkerStats> TaskScheduler::GetStats() const {
+    std::vector<WorkerStats> stats(workers.size());
+    for (size_t i = 0; i < workers.size(); ++i) {
+        stats[i].tasksExecuted = workers[i]->tasksExecuted.load();
+        stats[i].tasksStolen = workers[i]->tasksStolen.load();
+        stats[i].busyMilliseconds = workers[i]->busyNanoseconds.load() / 1.0e6;
+    }
+    return stats;
+}
+
+TaskGraph::NodeId TaskGraph::AddNode(const std::string& name, std::function<void()> work) {
+    Node node;
+    node.name = name;
+    node.work = std::move(work);
+    nodes.push_back(std::move(node));
+    return nodes.size() - 1;
+}
+
+void TaskGraph::AddDependency(NodeId before, NodeId after) {
+    nodes[before].successors.push_back(after);
+    nodes[after].predecessorCount++;
+}
+
+void TaskGraph::Clear() {
+    nodes.clear();
+}
+
+void TaskGraph::Run(TaskScheduler& scheduler) {
+    if (nodes.empty()) return;
+
+    std::unique_ptr<std::atomic<size_t>[]> remaining(new std::atomic<size_t>[nodes.size()]);
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        remaining[i] = nodes[i].predecessorCount;
+    }
+
+    TaskScheduler::TaskCounter counter;
+    counter.pending = nodes.size();
+
+    std::function<void(NodeId)> launch = [&](NodeId id) {
+        scheduler.Push(scheduler.CurrentWorkerIndex(), { [&, id]() {
+            auto start = std::chrono::steady_clock::now();
+            nodes[id].work();
+            nodes[id].milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            for (NodeId successor : nodes[id].successors) {
+                if (remaining[successor].fetch_sub(1) == 1) {
+                    launch(successor);
+                }
+            }
+        }, &counter });
+    };
+
+    for (NodeId id = 0; id < nodes.size(); ++id) {
+        if (nodes[id].predecessorCount == 0) {
+            launch(id);
+        }
+    }
+
+    scheduler.Wait(counter);
+}
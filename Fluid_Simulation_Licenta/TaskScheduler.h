@@ -0,0 +1,149 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool used by the CPU simulation paths.
+// Every worker owns a deque: it pushes and pops its own work at the back and
+// steals from the front of the other deques when it runs dry. Threads that wait
+// on a batch (ParallelFor, TaskGraph::Run) keep executing tasks while they wait,
+// so nested parallel loops never deadlock.
+class TaskScheduler {
+public:
+    using Task = std::function<void()>;
+    using RangeFunction = std::function<void(size_t, size_t)>;
+
+    struct WorkerStats {
+        size_t tasksExecuted = 0;
+        size_t tasksStolen = 0;
+        double busyMilliseconds = 0.0;
+    };
+
+    // Shared pool used by the application; sized to the hardware by default.
+    static TaskScheduler& Instance();
+
+    // numThreads counts the calling thread, so 1 means "run everything inline".
+    explicit TaskScheduler(unsigned int numThreads = 0, bool pinThreads = false);
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    void Configure(unsigned int numThreads, bool pinThreads);
+    unsigned int GetThreadCount() const { return threadCount; }
+    bool GetPinThreads() const { return pinThreads; }
+
+    // Splits [begin, end) into chunks of grainSize and runs body(chunkBegin, chunkEnd) on the pool.
+    // Chunk boundaries depend only on grainSize, never on the thread count.
+    void ParallelFor(size_t begin, size_t end, size_t grainSize, const RangeFunction& body);
+
+    // Reduces map(chunkBegin, chunkEnd) over grain-sized chunks. The chunk results are
+    // combined in a fixed pairwise tree, so floating point results do not depend on the
+    // thread count or on which worker ran which chunk.
+    template <typename T, typename MapFunction, typename CombineFunction>
+    T ParallelReduce(size_t begin, size_t end, size_t grainSize, T identity, MapFunction map, CombineFunction combine) {
+        if (end <= begin) return identity;
+        if (grainSize == 0) grainSize = 1;
+
+        size_t numChunks = (end - begin + grainSize - 1) / grainSize;
+        std::vector<T> partials(numChunks, identity);
+        ParallelFor(begin, end, grainSize, [&](size_t chunkBegin, size_t chunkEnd) {
+            partials[(chunkBegin - begin) / grainSize] = map(chunkBegin, chunkEnd);
+        });
+
+        for (size_t stride = 1; stride < numChunks; stride *= 2) {
+            for (size_t i = 0; i + stride < numChunks; i += 2 * stride) {
+                partials[i] = combine(partials[i], partials[i + stride]);
+            }
+        }
+        return partials[0];
+    }
+
+    // Runs a batch of independent tasks and returns once all of them finished.
+    void RunAll(std::vector<Task>& tasks);
+
+    void ResetStats();
+    std::vector<WorkerStats> GetStats() const;
+
+    static unsigned int HardwareThreads();
+
+private:
+    friend class TaskGraph;
+
+    struct TaskCounter {
+        std::atomic<size_t> pending{ 0 };
+    };
+
+    struct QueuedTask {
+        Task work;
+        TaskCounter* counter;
+    };
+
+    struct Worker {
+        std::deque<QueuedTask> tasks;
+        std::mutex mutex;
+        std::thread thread;
+        std::atomic<size_t> tasksExecuted{ 0 };
+        std::atomic<size_t> tasksStolen{ 0 };
+        std::atomic<long long> busyNanoseconds{ 0 };
+    };
+
+    void StartWorkers();
+    void StopWorkers();
+    void WorkerLoop(unsigned int index);
+    void Push(unsigned int workerIndex, QueuedTask task);
+    bool TryRunOne(unsigned int workerIndex);
+    bool PopLocal(unsigned int workerIndex, QueuedTask& task);
+    bool Steal(unsigned int thiefIndex, QueuedTask& task);
+    void Execute(unsigned int workerIndex, QueuedTask& task);
+    void Wait(TaskCounter& counter);
+    unsigned int CurrentWorkerIndex() const;
+    void PinThread(std::thread& thread, unsigned int core);
+
+    unsigned int threadCount;
+    bool pinThreads;
+    std::vector<Worker*> workers;
+
+    std::mutex sleepMutex;
+    std::condition_variable wakeCondition;
+    std::atomic<size_t> queuedTasks{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::atomic<unsigned int> nextSubmitWorker{ 0 };
+};
+
+// Small dependency graph of tasks. Nodes whose predecessors are done run
+// concurrently on the scheduler, so independent step phases overlap.
+class TaskGraph {
+public:
+    using NodeId = size_t;
+
+    NodeId AddNode(const std::string& name, std::function<void()> work);
+    void AddDependency(NodeId before, NodeId after);
+    void Run(TaskScheduler& scheduler);
+    void Clear();
+
+    size_t GetNodeCount() const { return nodes.size(); }
+    const std::string& GetNodeName(NodeId id) const { return nodes[id].name; }
+    double GetNodeMilliseconds(NodeId id) const { return nodes[id].milliseconds; }
+
+private:
+    struct Node {
+        std::string name;
+        std::function<void()> work;
+        std::vector<NodeId> successors;
+        size_t predecessorCount = 0;
+        double milliseconds = 0.0;
+    };
+
+    std::vector<Node> nodes;
+};
+
+#endif // TASK_SCHEDULER_H
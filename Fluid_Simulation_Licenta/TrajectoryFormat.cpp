@@ -0,0 +1,353 @@
+#include "TrajectoryFormat.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+    const size_t HeaderSize = 16;
+    const size_t FrameHeaderSize = 64;
+    const size_t IndexEntrySize = 32;
+    const size_t FooterSize = 20;
+
+    // Rice parameters are chosen per block of values
+    const size_t RiceBlock = 64;
+    const uint32_t RiceParameterBits = 4;
+    // Quotients this large are written as an escape followed by the raw value
+    const uint32_t EscapeQuotient = 24;
+    const uint32_t RawValueBits = 17;
+
+    class BitWriter {
+    public:
+        explicit BitWriter(std::vector<uint8_t>& output) : output(output), accumulator(0), bits(0) {}
+
+        void Write(uint32_t value, uint32_t count) {
+            accumulator |= static_cast<uint64_t>(value) << bits;
+            bits += count;
+            while (bits >= 8) {
+                output.push_back(static_cast<uint8_t>(accumulator));
+                accumulator >>= 8;
+                bits -= 8;
+            }
+        }
+
+        void WriteOnes(uint32_t count) {
+            while (count > 16) {
+                Write(0xFFFF, 16);
+                count -= 16;
+            }
+            Write((1u << count) - 1, count);
+        }
+
+        void Flush() {
+            if (bits > 0) output.push_back(static_cast<uint8_t>(accumulator));
+            accumulator = 0;
+            bits = 0;
+        }
+
+    private:
+        std::vector<uint8_t>& output;
+        uint64_t accumulator;
+        uint32_t bits;
+    };
+
+    uint32_t CountTrailingZeros(uint64_t value) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return static_cast<uint32_t>(index);
+#else
+        return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+    }
+
+    class BitReader {
+    public:
+        BitReader(const uint8_t* data, size_t size) : data(data), size(size), position(0), accumulator(0), bits(0) {}
+
+        bool Read(uint32_t count, uint32_t& value) {
+            if (bits < count) Fill();
+            if (bits < count) return false;
+            value = static_cast<uint32_t>(accumulator & ((uint64_t(1) << count) - 1));
+            Consume(count);
+            return true;
+        }
+
+        // Counts ones up to limit, consuming the terminating zero if there is one.
+        // Runs are found a whole accumulator at a time instead of bit by bit.
+        bool ReadUnary(uint32_t limit, uint32_t& ones) {
+            ones = 0;
+            while (true) {
+                Fill();
+                if (bits == 0) return false;
+                uint64_t available = bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+                uint64_t zeros = ~accumulator & available;
+                uint32_t run = zeros ? CountTrailingZeros(zeros) : bits;
+                if (ones + run >= limit) {
+                    Consume(limit - ones);
+                    ones = limit;
+                    return true;
+                }
+                ones += run;
+                if (zeros) {
+                    Consume(run + 1);
+                    return true;
+                }
+                Consume(run);
+            }
+        }
+
+        size_t BytesConsumed() const { return position - bits / 8; }
+
+    private:
+        void Fill() {
+            while (bits <= 56 && position < size) {
+                accumulator |= static_cast<uint64_t>(data[position++]) << bits;
+                bits += 8;
+            }
+        }
+
+        void Consume(uint32_t count) {
+            accumulator = count >= 64 ? 0 : accumulator >> count;
+            bits -= count;
+        }
+
+        const uint8_t* data;
+        size_t size;
+        size_t position;
+        uint64_t accumulator;
+        uint32_t bits;
+    };
+
+    uint32_t ZigZag(int32_t value) {
+        return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    }
+
+    int32_t UnZigZag(uint32_t value) {
+        return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+    }
+
+    uint32_t BestRiceParameter(const uint32_t* values, size_t count) {
+        uint32_t best = 0;
+        uint64_t bestCost = UINT64_MAX;
+        for (uint32_t k = 0; k < (1u << RiceParameterBits); ++k) {
+            uint64_t cost = 0;
+            for (size_t i = 0; i < count; ++i) {
+                uint32_t quotient = values[i] >> k;
+                cost += quotient < EscapeQuotient ? quotient + 1 + k : EscapeQuotient + RawValueBits;
+            }
+            if (cost < bestCost) {
+                bestCost = cost;
+                best = k;
+            }
+        }
+        return best;
+    }
+}
+
+uint16_t TrajectoryFormat::QuantizePosition(float value, float minimum, float maximum) {
+    float extent = maximum - minimum;
+    if (extent <= 0.0f) return 0;
+    float normalized = std::min(std::max((value - minimum) / extent, 0.0f), 1.0f);
+    return static_cast<uint16_t>(std::lround(normalized * 65535.0f));
+}
+
+float TrajectoryFormat::DequantizePosition(uint16_t value, float minimum, float maximum) {
+    return minimum + (maximum - minimum) * (static_cast<float>(value) / 65535.0f);
+}
+
+float TrajectoryFormat::VelocityRange(const std::vector<glm::vec3>& velocities) {
+    float largest = 0.0f;
+    for (const glm::vec3& velocity : velocities) {
+        largest = std::max(largest, std::max(std::abs(velocity.x), std::max(std::abs(velocity.y), std::abs(velocity.z))));
+    }
+    float range = 1.0f;
+    while (range < largest && range < 1.0e30f) range *= 2.0f;
+    return range;
+}
+
+void TrajectoryFormat::EncodeChannel(const uint16_t* current, const uint16_t* previous, size_t count, std::vector<uint8_t>& output) {
+    BitWriter writer(output);
+    uint32_t values[RiceBlock];
+
+    for (size_t begin = 0; begin < count; begin += RiceBlock) {
+        size_t blockCount = std::min(RiceBlock, count - begin);
+        for (size_t i = 0; i < blockCount; ++i) {
+            int32_t base = previous ? previous[begin + i] : 0;
+            values[i] = ZigZag(static_cast<int32_t>(current[begin + i]) - base);
+        }
+
+        uint32_t k = BestRiceParameter(values, blockCount);
+        writer.Write(k, RiceParameterBits);
+        for (size_t i = 0; i < blockCount; ++i) {
+            uint32_t quotient = values[i] >> k;
+            if (quotient < EscapeQuotient) {
+                writer.WriteOnes(quotient);
+                writer.Write(0, 1);
+                if (k > 0) writer.Write(values[i] & ((1u << k) - 1), k);
+            }
+            else {
+                writer.WriteOnes(EscapeQuotient);
+                writer.Write(values[i], RawValueBits);
+            }
+        }
+    }
+    writer.Flush();
+}
+
+size_t TrajectoryFormat::DecodeChannel(const uint8_t* data, size_t size, const uint16_t* previous, size_t count, uint16_t* output) {
+    BitReader reader(data, size);
+
+    for (size_t begin = 0; begin < count; begin += RiceBlock) {
+        size_t blockCount = std::min(RiceBlock, count - begin);
+        uint32_t k;
+        if (!reader.Read(RiceParameterBits, k)) return 0;
+
+        for (size_t i = 0; i < blockCount; ++i) {
+            uint32_t quotient, value;
+            if (!reader.ReadUnary(EscapeQuotient, quotient)) return 0;
+            if (quotient < EscapeQuotient) {
+                uint32_t remainder = 0;
+                if (k > 0 && !reader.Read(k, remainder)) return 0;
+                value = (quotient << k) | remainder;
+            }
+            else if (!reader.Read(RawValueBits, value)) {
+                return 0;
+            }
+            int32_t base = previous ? previous[begin + i] : 0;
+            output[begin + i] = static_cast<uint16_t>(base + UnZigZag(value));
+        }
+    }
+    return reader.BytesConsumed();
+}
+
+namespace {
+    template <typename T>
+    T LoadValue(const uint8_t* data) {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    void ParseFrameHeader(const uint8_t* data, TrajectoryFormat::FrameHeader& header) {
+        header.step = LoadValue<uint64_t>(data);
+        header.time = LoadValue<double>(data + 8);
+        header.particleCount = LoadValue<uint32_t>(data + 16);
+        header.flags = LoadValue<uint32_t>(data + 20);
+        header.boundsMin = glm::vec3(LoadValue<float>(data + 24), LoadValue<float>(data + 28), LoadValue<float>(data + 32));
+        header.boundsMax = glm::vec3(LoadValue<float>(data + 36), LoadValue<float>(data + 40), LoadValue<float>(data + 44));
+        header.velocityRange = LoadValue<float>(data + 48);
+        header.payloadBytes = LoadValue<uint64_t>(data + 56);
+    }
+}
+
+bool TrajectoryReader::Open(const std::string& path) {
+    this->path = path;
+    index.clear();
+    currentFrame = SIZE_MAX;
+
+    if (!mapping.Open(path)) return false;
+    const uint8_t* data = mapping.GetData();
+    uint64_t fileSize = mapping.GetSize();
+
+    if (fileSize < HeaderSize || LoadValue<uint32_t>(data) != TrajectoryFormat::Magic || LoadValue<uint32_t>(data + 4) > TrajectoryFormat::Version) {
+        std::cerr << "TrajectoryReader::Open Error: " << path << " is not a trajectory this build can read" << std::endl;
+        mapping.Close();
+        return false;
+    }
+
+    const uint8_t* footer = data + fileSize - FooterSize;
+    uint64_t indexOffset = fileSize >= HeaderSize + FooterSize ? LoadValue<uint64_t>(footer) : 0;
+    uint64_t entryCount = fileSize >= HeaderSize + FooterSize ? LoadValue<uint64_t>(footer + 8) : 0;
+    if (fileSize < HeaderSize + FooterSize || LoadValue<uint32_t>(footer + 16) != TrajectoryFormat::IndexMagic
+        || indexOffset + entryCount * IndexEntrySize + FooterSize != fileSize) {
+        std::cerr << "TrajectoryReader::Open Error: " << path << " has no index; the recorder was not stopped" << std::endl;
+        mapping.Close();
+        return false;
+    }
+
+    index.resize(static_cast<size_t>(entryCount));
+    for (size_t i = 0; i < index.size(); ++i) {
+        const uint8_t* entry = data + indexOffset + i * IndexEntrySize;
+        index[i].step = LoadValue<uint64_t>(entry);
+        index[i].time = LoadValue<double>(entry + 8);
+        index[i].offset = LoadValue<uint64_t>(entry + 16);
+        index[i].flags = LoadValue<uint32_t>(entry + 24);
+        if (index[i].offset + FrameHeaderSize > indexOffset) {
+            std::cerr << "TrajectoryReader::Open Error: Index of " << path << " is corrupt" << std::endl;
+            index.clear();
+            mapping.Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TrajectoryReader::DecodeAt(size_t frame, TrajectoryFormat::FrameHeader& header) {
+    currentFrame = SIZE_MAX;
+    const uint8_t* frameData = mapping.GetData() + index[frame].offset;
+    ParseFrameHeader(frameData, header);
+    if (index[frame].offset + FrameHeaderSize + header.payloadBytes > mapping.GetSize()) return false;
+
+    const uint8_t* payload = frameData + FrameHeaderSize;
+    size_t payloadSize = static_cast<size_t>(header.payloadBytes);
+    bool keyFrame = (header.flags & TrajectoryFormat::KeyFrameFlag) != 0;
+    size_t count = header.particleCount;
+    size_t offset = 0;
+    for (uint32_t c = 0; c < TrajectoryFormat::Channels; ++c) {
+        std::vector<uint16_t>& channel = current.channels[c];
+        if (!keyFrame && channel.size() != count) return false;
+        channel.resize(count);
+        // Differences are added in place, so the previous frame is the output buffer
+        size_t used = count == 0 ? 0 : TrajectoryFormat::DecodeChannel(payload + offset, payloadSize - offset,
+            keyFrame ? nullptr : channel.data(), count, channel.data());
+        if (count > 0 && used == 0) return false;
+        offset += used;
+    }
+    currentFrame = frame;
+    return true;
+}
+
+bool TrajectoryReader::ReadFrame(size_t frame, std::vector<glm::vec3>& positions, std::vector<glm::vec3>& velocities,
+    TrajectoryFormat::FrameHeader* header) {
+    if (frame >= index.size()) {
+        std::cerr << "TrajectoryReader::ReadFrame Error: Frame " << frame << " is out of range" << std::endl;
+        return false;
+    }
+
+    size_t keyFrame = frame;
+    while (keyFrame > 0 && (index[keyFrame].flags & TrajectoryFormat::KeyFrameFlag) == 0) keyFrame--;
+
+    // Continue from the cached frame when it is in the same chunk, otherwise restart at the key frame
+    size_t start = keyFrame;
+    if (currentFrame != SIZE_MAX && currentFrame >= keyFrame && currentFrame <= frame) start = currentFrame + 1;
+
+    for (size_t i = start; i <= frame; ++i) {
+        if (!DecodeAt(i, currentHeader)) {
+            std::cerr << "TrajectoryReader::ReadFrame Error: Frame " << i << " of " << path << " is corrupt" << std::endl;
+            currentFrame = SIZE_MAX;
+            return false;
+        }
+    }
+
+    const TrajectoryFormat::FrameHeader& frameHeader = currentHeader;
+    size_t count = frameHeader.particleCount;
+    positions.resize(count);
+    velocities.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        positions[i] = glm::vec3(
+            TrajectoryFormat::DequantizePosition(current.channels[0][i], frameHeader.boundsMin.x, frameHeader.boundsMax.x),
+            TrajectoryFormat::DequantizePosition(current.channels[1][i], frameHeader.boundsMin.y, frameHeader.boundsMax.y),
+            TrajectoryFormat::DequantizePosition(current.channels[2][i], frameHeader.boundsMin.z, frameHeader.boundsMax.z));
+        velocities[i] = glm::vec3(
+            TrajectoryFormat::DequantizePosition(current.channels[3][i], -frameHeader.velocityRange, frameHeader.velocityRange),
+            TrajectoryFormat::DequantizePosition(current.channels[4][i], -frameHeader.velocityRange, frameHeader.velocityRange),
+            TrajectoryFormat::DequantizePosition(current.channels[5][i], -frameHeader.velocityRange, frameHeader.velocityRange));
+    }
+    if (header) *header = frameHeader;
+    return true;
+}
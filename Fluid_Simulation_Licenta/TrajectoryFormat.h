@@ -0,0 +1,87 @@
+#ifndef TRAJECTORY_FORMAT_H
+#define TRAJECTORY_FORMAT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "MemoryMappedFile.h"
+
+// Compressed trajectory file written by TrajectoryRecorder.
+// Little-endian. A 16-byte header ("FSTR", u32 version, u64 reserved) is followed by
+// frames and a seek index at the end of the file:
+//   frame  : FrameHeader, then six Rice coded channels (px py pz vx vy vz)
+//   index  : IndexEntry per frame, then u64 index offset, u64 entry count, "FSTI"
+// Positions are quantized to 16 bits inside the frame's bounding box and velocities
+// to 16 bits inside +-velocityRange. Each channel stores the zigzagged difference to
+// the previous frame, except on key frames, which restart from zero so that every
+// chunk of frames between two key frames can be decoded on its own.
+namespace TrajectoryFormat {
+    const uint32_t Magic = 0x52545346;      // "FSTR"
+    const uint32_t IndexMagic = 0x49545346; // "FSTI"
+    const uint32_t Version = 1;
+    const uint32_t KeyFrameFlag = 1;
+    const uint32_t Channels = 6;
+
+    struct FrameHeader {
+        uint64_t step = 0;
+        double time = 0.0;
+        uint32_t particleCount = 0;
+        uint32_t flags = 0;
+        glm::vec3 boundsMin = glm::vec3(0.0f);
+        glm::vec3 boundsMax = glm::vec3(0.0f);
+        float velocityRange = 0.0f;
+        uint32_t reserved = 0;
+        uint64_t payloadBytes = 0;
+    };
+
+    struct IndexEntry {
+        uint64_t step = 0;
+        double time = 0.0;
+        uint64_t offset = 0;
+        uint32_t flags = 0;
+        uint32_t reserved = 0;
+    };
+
+    // Quantized frame: six channels of particleCount values each.
+    struct QuantizedFrame {
+        std::vector<uint16_t> channels[Channels];
+    };
+
+    uint16_t QuantizePosition(float value, float minimum, float maximum);
+    float DequantizePosition(uint16_t value, float minimum, float maximum);
+    // Smallest power of two >= the largest velocity component, so the range rarely changes between frames.
+    float VelocityRange(const std::vector<glm::vec3>& velocities);
+
+    // Appends the Rice coded differences of current against previous (or against zero when previous is null).
+    void EncodeChannel(const uint16_t* current, const uint16_t* previous, size_t count, std::vector<uint8_t>& output);
+    // Decodes count values from data, adding them to previous (or zero). Returns the bytes consumed, 0 on error.
+    size_t DecodeChannel(const uint8_t* data, size_t size, const uint16_t* previous, size_t count, uint16_t* output);
+}
+
+// Random access to a memory-mapped trajectory file through its seek index.
+// Seeking costs at most one chunk of decoding, whatever the length of the file.
+class TrajectoryReader {
+public:
+    bool Open(const std::string& path);
+
+    size_t GetFrameCount() const { return index.size(); }
+    const TrajectoryFormat::IndexEntry& GetEntry(size_t frame) const { return index[frame]; }
+    // Decodes a frame; seeks to the key frame before it and decodes forward.
+    bool ReadFrame(size_t frame, std::vector<glm::vec3>& positions, std::vector<glm::vec3>& velocities,
+        TrajectoryFormat::FrameHeader* header = nullptr);
+
+private:
+    bool DecodeAt(size_t frame, TrajectoryFormat::FrameHeader& header);
+
+    MemoryMappedFile mapping;
+    std::string path;
+    std::vector<TrajectoryFormat::IndexEntry> index;
+    // Last decoded frame, so reading frames in order does not restart at the key frame
+    TrajectoryFormat::QuantizedFrame current;
+    TrajectoryFormat::FrameHeader currentHeader;
+    size_t currentFrame = SIZE_MAX;
+};
+
+#endif // TRAJECTORY_FORMAT_H
@@ -0,0 +1,225 @@
+#include "TrajectoryPlayer.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+TrajectoryPlayer::TrajectoryPlayer()
+    : frameCount(0), open(false), currentFrame(0), shownFrame(SIZE_MAX), stride(1), playing(false), loop(true),
+    decodingFrame(SIZE_MAX), stopRequested(false), decodeSeconds(0.0) {}
+
+TrajectoryPlayer::~TrajectoryPlayer() {
+    Close();
+}
+
+bool TrajectoryPlayer::Open(const std::string& path, size_t prefetchDepth) {
+    Close();
+    if (!reader.Open(path)) return false;
+    if (reader.GetFrameCount() == 0) {
+        std::cerr << "TrajectoryPlayer::Open Error: " << path << " has no frames" << std::endl;
+        return false;
+    }
+
+    frameCount = reader.GetFrameCount();
+    index.resize(frameCount);
+    for (size_t i = 0; i < frameCount; ++i) index[i] = reader.GetEntry(i);
+
+    cache.assign(std::max<size_t>(1, prefetchDepth), CachedFrame());
+    currentFrame = 0;
+    shownFrame = SIZE_MAX;
+    failedFrames.clear();
+    decodingFrame = SIZE_MAX;
+    statistics = Statistics();
+    statistics.prefetchDepth = cache.size();
+    decodeSeconds = 0.0;
+
+    stopRequested = false;
+    open = true;
+    worker = std::thread(&TrajectoryPlayer::WorkerLoop, this);
+    return true;
+}
+
+void TrajectoryPlayer::Close() {
+    if (!open) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopRequested = true;
+    }
+    windowChanged.notify_all();
+    worker.join();
+
+    open = false;
+    playing = false;
+    cache.clear();
+    index.clear();
+    frameCount = 0;
+}
+
+void TrajectoryPlayer::Seek(size_t frame) {
+    if (!open) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentFrame = std::min(frame, frameCount - 1);
+        shownFrame = SIZE_MAX;
+        failedFrames.clear();
+    }
+    windowChanged.notify_all();
+}
+
+size_t TrajectoryPlayer::GetCurrentFrame() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return currentFrame;
+}
+
+void TrajectoryPlayer::SetPlaying(bool value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    playing = value;
+}
+
+bool TrajectoryPlayer::IsPlaying() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return playing;
+}
+
+void TrajectoryPlayer::SetLoop(bool value) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        loop = value;
+    }
+    windowChanged.notify_all();
+}
+
+void TrajectoryPlayer::SetStride(size_t value) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stride = std::max<size_t>(1, value);
+    }
+    windowChanged.notify_all();
+}
+
+size_t TrajectoryPlayer::WindowFrame(size_t offset) const {
+    size_t frame = currentFrame + offset * stride;
+    if (frame < frameCount) return frame;
+    return loop ? frame % frameCount : SIZE_MAX;
+}
+
+bool TrajectoryPlayer::InWindow(size_t frame) const {
+    for (size_t i = 0; i < cache.size(); ++i) {
+        if (WindowFrame(i) == frame) return true;
+    }
+    return false;
+}
+
+bool TrajectoryPlayer::HasFailed(size_t frame) const {
+    return std::find(failedFrames.begin(), failedFrames.end(), frame) != failedFrames.end();
+}
+
+size_t TrajectoryPlayer::NextFrameToDecode() const {
+    // Nearest first, so the frame the render loop needs next is never behind the read-ahead
+    for (size_t i = 0; i < cache.size(); ++i) {
+        size_t frame = WindowFrame(i);
+        if (frame == SIZE_MAX) break;
+        if (frame == decodingFrame || HasFailed(frame) || (i == 0 && frame == shownFrame)) continue;
+        bool cached = std::any_of(cache.begin(), cache.end(), [frame](const CachedFrame& entry) { return entry.frame == frame; });
+        if (!cached) return frame;
+    }
+    return SIZE_MAX;
+}
+
+void TrajectoryPlayer::WorkerLoop() {
+    std::vector<glm::vec3> positions, velocities;
+    while (true) {
+        size_t frame;
+        size_t slot = SIZE_MAX;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            windowChanged.wait(lock, [&]() {
+                if (stopRequested) return true;
+                if (NextFrameToDecode() == SIZE_MAX) return false;
+                slot = SIZE_MAX;
+                for (size_t i = 0; i < cache.size(); ++i) {
+                    if (cache[i].frame == SIZE_MAX || !InWindow(cache[i].frame)) {
+                        slot = i;
+                        break;
+                    }
+                }
+                return slot != SIZE_MAX;
+            });
+            if (stopRequested) return;
+
+            frame = NextFrameToDecode();
+            decodingFrame = frame;
+            // Decode into the evicted slot's storage so frames never allocate after warm-up
+            cache[slot].frame = SIZE_MAX;
+            positions.swap(cache[slot].positions);
+            velocities.swap(cache[slot].velocities);
+        }
+
+        TrajectoryFormat::FrameHeader header;
+        auto start = std::chrono::steady_clock::now();
+        bool ok = reader.ReadFrame(frame, positions, velocities, &header);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            decodingFrame = SIZE_MAX;
+            positions.swap(cache[slot].positions);
+            velocities.swap(cache[slot].velocities);
+            if (ok) {
+                cache[slot].frame = frame;
+                cache[slot].header = header;
+                statistics.framesDecoded++;
+                decodeSeconds += seconds;
+            }
+            else {
+                // A corrupt frame would be retried forever; skip it until the next seek. The frames
+                // after it in its chunk are delta coded from it and fail too, so each is recorded.
+                failedFrames.push_back(frame);
+            }
+        }
+        windowChanged.notify_all();
+    }
+}
+
+bool TrajectoryPlayer::AcquireFrame(std::vector<glm::vec3>& positions, std::vector<glm::vec3>& velocities, TrajectoryFormat::FrameHeader* header) {
+    if (!open) return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (currentFrame == shownFrame) return false;
+        if (HasFailed(currentFrame)) {
+            // Playback stops at the corrupt frame, wherever in the read-ahead it was found
+            playing = false;
+            return false;
+        }
+
+        auto entry = std::find_if(cache.begin(), cache.end(), [this](const CachedFrame& cached) { return cached.frame == currentFrame; });
+        if (entry == cache.end()) {
+            statistics.misses++;
+            return false;
+        }
+
+        positions.swap(entry->positions);
+        velocities.swap(entry->velocities);
+        if (header) *header = entry->header;
+        entry->frame = SIZE_MAX;
+        shownFrame = currentFrame;
+        statistics.framesShown++;
+
+        if (playing) {
+            size_t next = currentFrame + stride;
+            if (next < frameCount) currentFrame = next;
+            else if (loop) currentFrame = next % frameCount;
+            else playing = false;
+        }
+    }
+    windowChanged.notify_all();
+    return true;
+}
+
+TrajectoryPlayer::Statistics TrajectoryPlayer::GetStatistics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Statistics result = statistics;
+    result.prefetched = static_cast<size_t>(std::count_if(cache.begin(), cache.end(), [](const CachedFrame& entry) { return entry.frame != SIZE_MAX; }));
+    if (decodeSeconds > 0.0) result.decodeFramesPerSecond = result.framesDecoded / decodeSeconds;
+    return result;
+}
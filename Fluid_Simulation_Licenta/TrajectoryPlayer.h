@@ -0,0 +1,100 @@
+#ifndef TRAJECTORY_PLAYER_H
+#define TRAJECTORY_PLAYER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "TrajectoryFormat.h"
+
+// Plays back a recorded trajectory. A worker thread decodes the frames after the
+// current one into a small cache (read-ahead), so the render loop only swaps a
+// finished frame into its own buffers. Seeking moves the read-ahead window; the
+// worker restarts at the key frame of the target chunk, so a seek costs at most
+// one chunk of decoding regardless of the file length.
+class TrajectoryPlayer {
+public:
+    struct Statistics {
+        uint64_t framesDecoded = 0;
+        uint64_t framesShown = 0;
+        // Frames the render loop asked for before the worker had them
+        uint64_t misses = 0;
+        double decodeFramesPerSecond = 0.0;
+        size_t prefetched = 0;
+        size_t prefetchDepth = 0;
+    };
+
+    TrajectoryPlayer();
+    ~TrajectoryPlayer();
+
+    TrajectoryPlayer(const TrajectoryPlayer&) = delete;
+    TrajectoryPlayer& operator=(const TrajectoryPlayer&) = delete;
+
+    bool Open(const std::string& path, size_t prefetchDepth = 8);
+    void Close();
+    bool IsOpen() const { return open; }
+
+    size_t GetFrameCount() const { return frameCount; }
+    const TrajectoryFormat::IndexEntry& GetEntry(size_t frame) const { return index[frame]; }
+    size_t GetCurrentFrame() const;
+
+    // Transport, driven by the render loop
+    void Seek(size_t frame);
+    void SetPlaying(bool value);
+    bool IsPlaying() const;
+    // Frames to advance per shown frame; above 1 the frames in between are skipped
+    void SetStride(size_t value);
+    size_t GetStride() const { return stride; }
+    void SetLoop(bool value);
+    bool GetLoop() const { return loop; }
+
+    // Swaps the current frame into positions and velocities if the worker has decoded it,
+    // then advances when playing. The caller's old vectors are reused for later frames.
+    bool AcquireFrame(std::vector<glm::vec3>& positions, std::vector<glm::vec3>& velocities, TrajectoryFormat::FrameHeader* header = nullptr);
+
+    Statistics GetStatistics() const;
+
+private:
+    struct CachedFrame {
+        size_t frame = SIZE_MAX;
+        TrajectoryFormat::FrameHeader header;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> velocities;
+    };
+
+    void WorkerLoop();
+    // Next frame of the read-ahead window that is neither cached nor being decoded, or SIZE_MAX.
+    size_t NextFrameToDecode() const;
+    size_t WindowFrame(size_t offset) const;
+    bool InWindow(size_t frame) const;
+    bool HasFailed(size_t frame) const;
+
+    TrajectoryReader reader;
+    std::vector<TrajectoryFormat::IndexEntry> index;
+    size_t frameCount;
+    bool open;
+
+    size_t currentFrame;
+    size_t shownFrame;
+    // Frames whose decode failed; not decoded again until Seek or Open
+    std::vector<size_t> failedFrames;
+    size_t stride;
+    bool playing;
+    bool loop;
+
+    std::vector<CachedFrame> cache;
+    size_t decodingFrame;
+    mutable std::mutex mutex;
+    std::condition_variable windowChanged;
+    bool stopRequested;
+    std::thread worker;
+
+    Statistics statistics;
+    double decodeSeconds;
+};
+
+#endif // TRAJECTORY_PLAYER_H
@@ -0,0 +1,266 @@
+#include "TrajectoryRecorder.h"
+#include "FrameDropWarning.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    const double ShortfallWindowSeconds = 1.0;
+
+    template <typename T>
+    void Append(std::vector<uint8_t>& buffer, const T& value) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+    }
+
+    void AppendVec3(std::vector<uint8_t>& buffer, const glm::vec3& value) {
+        Append(buffer, value.x);
+        Append(buffer, value.y);
+        Append(buffer, value.z);
+    }
+}
+
+TrajectoryRecorder::TrajectoryRecorder()
+    : fileOffset(0), recording(false), writeFailed(false), stopRequested(false), framesInChunk(0), writerBusySeconds(0.0) {}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+    if (recording) Stop();
+}
+
+bool TrajectoryRecorder::Start(const std::string& path, const Options& options) {
+    if (recording) Stop();
+
+    this->path = path;
+    this->options = options;
+    this->options.frameInterval = std::max<size_t>(1, options.frameInterval);
+    this->options.ringSize = std::max<size_t>(1, options.ringSize);
+    this->options.framesPerChunk = std::max<size_t>(1, options.framesPerChunk);
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "TrajectoryRecorder::Start Error: Cannot write " << path << std::endl;
+        return false;
+    }
+
+    fileOffset = 0;
+    writeFailed = false;
+    std::vector<uint8_t> header;
+    Append(header, TrajectoryFormat::Magic);
+    Append(header, TrajectoryFormat::Version);
+    Append(header, uint64_t(0));
+    if (!WriteBytes(header.data(), header.size())) return false;
+
+    slots.assign(this->options.ringSize, Slot());
+    freeSlots.clear();
+    for (size_t i = 0; i < slots.size(); ++i) freeSlots.push_back(i);
+    queuedSlots.clear();
+    index.clear();
+    framesInChunk = 0;
+    previousHeader = TrajectoryFormat::FrameHeader();
+    statistics = Statistics();
+    statistics.ringSize = slots.size();
+    writerBusySeconds = 0.0;
+    lastShortfall = std::chrono::steady_clock::time_point();
+
+    stopRequested = false;
+    recording = true;
+    writer = std::thread(&TrajectoryRecorder::WriterLoop, this);
+    return true;
+}
+
+bool TrajectoryRecorder::Stop() {
+    if (!recording) return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopRequested = true;
+    }
+    queueChanged.notify_all();
+    writer.join();
+    recording = false;
+
+    // Seek index and footer
+    std::vector<uint8_t> footer;
+    uint64_t indexOffset = fileOffset;
+    for (const TrajectoryFormat::IndexEntry& entry : index) {
+        Append(footer, entry.step);
+        Append(footer, entry.time);
+        Append(footer, entry.offset);
+        Append(footer, entry.flags);
+        Append(footer, entry.reserved);
+    }
+    Append(footer, indexOffset);
+    Append(footer, static_cast<uint64_t>(index.size()));
+    Append(footer, TrajectoryFormat::IndexMagic);
+    bool ok = WriteBytes(footer.data(), footer.size());
+    file.close();
+
+    slots.clear();
+    freeSlots.clear();
+    if (!ok || writeFailed) {
+        std::cerr << "TrajectoryRecorder::Stop Error: " << path << " is incomplete" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void TrajectoryRecorder::SubmitFrame(uint64_t step, double time, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& velocities,
+    const glm::vec3& boundsMin, const glm::vec3& boundsMax, const std::vector<uint32_t>* ids) {
+    if (!recording || step % options.frameInterval != 0) return;
+
+    size_t slotIndex;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        statistics.framesSubmitted++;
+        if (freeSlots.empty()) {
+            lastShortfall = std::chrono::steady_clock::now();
+            if (!options.blockWhenFull) {
+                statistics.framesDropped++;
+                FrameDropWarning::Report("TrajectoryRecorder", step, statistics.framesDropped);
+                return;
+            }
+            queueChanged.wait(lock, [this]() { return !freeSlots.empty(); });
+        }
+        slotIndex = freeSlots.back();
+        freeSlots.pop_back();
+    }
+
+    // The slot belongs to the producer until it is queued, so the copy runs without the lock
+    Slot& slot = slots[slotIndex];
+    slot.step = step;
+    slot.time = time;
+    slot.boundsMin = boundsMin;
+    slot.boundsMax = boundsMax;
+    slot.positions.assign(positions.begin(), positions.end());
+    slot.velocities.assign(velocities.begin(), velocities.end());
+    if (ids && ids->size() == positions.size()) slot.ids.assign(ids->begin(), ids->end());
+    else slot.ids.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queuedSlots.push_back(slotIndex);
+    }
+    queueChanged.notify_all();
+}
+
+void TrajectoryRecorder::WriterLoop() {
+    while (true) {
+        size_t slotIndex;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queueChanged.wait(lock, [this]() { return stopRequested || !queuedSlots.empty(); });
+            if (queuedSlots.empty()) return;
+            slotIndex = queuedSlots.front();
+            queuedSlots.pop_front();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok = !writeFailed && EncodeFrame(slots[slotIndex]);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            writerBusySeconds += seconds;
+            if (ok) statistics.framesWritten++;
+            freeSlots.push_back(slotIndex);
+        }
+        queueChanged.notify_all();
+    }
+}
+
+bool TrajectoryRecorder::EncodeFrame(Slot& slot) {
+    size_t count = std::min(slot.positions.size(), slot.velocities.size());
+
+    // Store particles in id order so consecutive frames line up after the solver reorders its slots
+    slotOfParticle.resize(count);
+    bool useIds = slot.ids.size() == count;
+    if (useIds) {
+        std::fill(slotOfParticle.begin(), slotOfParticle.end(), UINT32_MAX);
+        for (size_t i = 0; i < count && useIds; ++i) {
+            uint32_t id = slot.ids[i];
+            if (id >= count || slotOfParticle[id] != UINT32_MAX) useIds = false;
+            else slotOfParticle[id] = static_cast<uint32_t>(i);
+        }
+    }
+    if (!useIds) {
+        for (size_t i = 0; i < count; ++i) slotOfParticle[i] = static_cast<uint32_t>(i);
+    }
+
+    TrajectoryFormat::FrameHeader header;
+    header.step = slot.step;
+    header.time = slot.time;
+    header.particleCount = static_cast<uint32_t>(count);
+    header.boundsMin = slot.boundsMin;
+    header.boundsMax = slot.boundsMax;
+    header.velocityRange = TrajectoryFormat::VelocityRange(slot.velocities);
+
+    bool keyFrame = framesInChunk == 0 || header.particleCount != previousHeader.particleCount || index.empty();
+    if (keyFrame) framesInChunk = 0;
+    header.flags = keyFrame ? TrajectoryFormat::KeyFrameFlag : 0;
+
+    for (uint32_t c = 0; c < TrajectoryFormat::Channels; ++c) currentFrame.channels[c].resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const glm::vec3& p = slot.positions[slotOfParticle[i]];
+        const glm::vec3& v = slot.velocities[slotOfParticle[i]];
+        for (int axis = 0; axis < 3; ++axis) {
+            currentFrame.channels[axis][i] = TrajectoryFormat::QuantizePosition(p[axis], header.boundsMin[axis], header.boundsMax[axis]);
+            currentFrame.channels[3 + axis][i] = TrajectoryFormat::QuantizePosition(v[axis], -header.velocityRange, header.velocityRange);
+        }
+    }
+
+    payload.clear();
+    for (uint32_t c = 0; c < TrajectoryFormat::Channels; ++c) {
+        TrajectoryFormat::EncodeChannel(currentFrame.channels[c].data(), keyFrame ? nullptr : previousFrame.channels[c].data(), count, payload);
+    }
+    header.payloadBytes = payload.size();
+
+    std::vector<uint8_t> headerBytes;
+    Append(headerBytes, header.step);
+    Append(headerBytes, header.time);
+    Append(headerBytes, header.particleCount);
+    Append(headerBytes, header.flags);
+    AppendVec3(headerBytes, header.boundsMin);
+    AppendVec3(headerBytes, header.boundsMax);
+    Append(headerBytes, header.velocityRange);
+    Append(headerBytes, header.reserved);
+    Append(headerBytes, header.payloadBytes);
+
+    TrajectoryFormat::IndexEntry entry;
+    entry.step = header.step;
+    entry.time = header.time;
+    entry.offset = fileOffset;
+    entry.flags = header.flags;
+    if (!WriteBytes(headerBytes.data(), headerBytes.size()) || !WriteBytes(payload.data(), payload.size())) return false;
+    index.push_back(entry);
+
+    std::swap(previousFrame, currentFrame);
+    previousHeader = header;
+    framesInChunk = (framesInChunk + 1) % options.framesPerChunk;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    statistics.rawBytes += count * 2 * sizeof(glm::vec3);
+    statistics.compressedBytes += headerBytes.size() + payload.size();
+    return true;
+}
+
+bool TrajectoryRecorder::WriteBytes(const void* data, size_t bytes) {
+    file.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+    if (!file) {
+        if (!writeFailed) std::cerr << "TrajectoryRecorder Error: Write to " << path << " failed" << std::endl;
+        writeFailed = true;
+        return false;
+    }
+    fileOffset += bytes;
+    return true;
+}
+
+TrajectoryRecorder::Statistics TrajectoryRecorder::GetStatistics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Statistics result = statistics;
+    result.queueDepth = queuedSlots.size();
+    if (writerBusySeconds > 0.0) result.megabytesPerSecond = result.rawBytes / (1024.0 * 1024.0) / writerBusySeconds;
+    if (result.compressedBytes > 0) result.compressionRatio = static_cast<double>(result.rawBytes) / result.compressedBytes;
+    result.fallingBehind = lastShortfall != std::chrono::steady_clock::time_point()
+        && std::chrono::duration<double>(std::chrono::steady_clock::now() - lastShortfall).count() < ShortfallWindowSeconds;
+    return result;
+}
@@ -0,0 +1,112 @@
+#ifndef TRAJECTORY_RECORDER_H
+#define TRAJECTORY_RECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "TrajectoryFormat.h"
+
+// Records every Nth frame of positions and velocities to a TrajectoryFormat file.
+// SubmitFrame only copies the state into a free slot of a ring of staging buffers;
+// quantizing, delta encoding, compression and disk writes happen on a background
+// thread so the render loop never waits on the disk. When every slot is still
+// queued the frame is dropped (or the caller blocks, if blockWhenFull is set) and
+// the statistics report that the producer is outrunning the writer.
+class TrajectoryRecorder {
+public:
+    struct Options {
+        size_t frameInterval = 10;
+        size_t ringSize = 4;
+        // A key frame starts every this many frames; frames in between only store differences
+        size_t framesPerChunk = 32;
+        bool blockWhenFull = false;
+    };
+
+    struct Statistics {
+        uint64_t framesSubmitted = 0;
+        uint64_t framesWritten = 0;
+        uint64_t framesDropped = 0;
+        uint64_t rawBytes = 0;
+        uint64_t compressedBytes = 0;
+        // Raw float data the writer thread got through per second of its busy time
+        double megabytesPerSecond = 0.0;
+        double compressionRatio = 0.0;
+        size_t queueDepth = 0;
+        size_t ringSize = 0;
+        // A frame was dropped, or had to wait for a slot, in the last second
+        bool fallingBehind = false;
+    };
+
+    TrajectoryRecorder();
+    ~TrajectoryRecorder();
+
+    TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+    TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+    bool Start(const std::string& path, const Options& options);
+    // Drains the queue, writes the seek index and closes the file.
+    bool Stop();
+    bool IsRecording() const { return recording; }
+    // True when SubmitFrame would queue the frame of this step.
+    bool WantsFrame(uint64_t step) const { return recording && step % options.frameInterval == 0; }
+
+    // Queues the frame if step is a multiple of the frame interval. ids (optional) maps
+    // each slot to its particle, so frames stay comparable when the solver reorders.
+    void SubmitFrame(uint64_t step, double time, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& velocities,
+        const glm::vec3& boundsMin, const glm::vec3& boundsMax, const std::vector<uint32_t>* ids = nullptr);
+
+    Statistics GetStatistics() const;
+
+private:
+    struct Slot {
+        uint64_t step = 0;
+        double time = 0.0;
+        glm::vec3 boundsMin = glm::vec3(0.0f);
+        glm::vec3 boundsMax = glm::vec3(0.0f);
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> velocities;
+        std::vector<uint32_t> ids;
+    };
+
+    void WriterLoop();
+    bool EncodeFrame(Slot& slot);
+    bool WriteBytes(const void* data, size_t bytes);
+
+    Options options;
+    std::string path;
+    std::ofstream file;
+    uint64_t fileOffset;
+    std::atomic<bool> recording;
+    bool writeFailed;
+
+    std::vector<Slot> slots;
+    std::vector<size_t> freeSlots;
+    std::deque<size_t> queuedSlots;
+    mutable std::mutex mutex;
+    std::condition_variable queueChanged;
+    bool stopRequested;
+    std::thread writer;
+
+    // Writer thread state
+    TrajectoryFormat::QuantizedFrame previousFrame;
+    TrajectoryFormat::QuantizedFrame currentFrame;
+    TrajectoryFormat::FrameHeader previousHeader;
+    size_t framesInChunk;
+    std::vector<TrajectoryFormat::IndexEntry> index;
+    std::vector<uint8_t> payload;
+    std::vector<uint32_t> slotOfParticle;
+
+    Statistics statistics;
+    double writerBusySeconds;
+    std::chrono::steady_clock::time_point lastShortfall;
+};
+
+#endif // TRAJECTORY_RECORDER_H
@@ -0,0 +1,331 @@
+#include "TriangleBVH3D.h"
+#include <algorithm>
+#include <limits>
+
+#include "TriangleMesh3D.h"
+
+namespace {
+    const size_t BoundsGrain = 4096;
+    const int TraversalStackSize = 128;
+    // Relative cost of visiting an inner node against testing one triangle
+    const float TraversalCost = 1.0f;
+
+    struct RangeBounds {
+        glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+        glm::vec3 centroidMin = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 centroidMax = glm::vec3(-std::numeric_limits<float>::max());
+    };
+
+    struct Bin {
+        glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+        uint32_t count = 0;
+    };
+
+    struct Bins {
+        Bin axes[3][TriangleBVH3D::BinCount];
+    };
+
+    float SurfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+        glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+        return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+    }
+
+    RangeBounds CombineBounds(const RangeBounds& a, const RangeBounds& b) {
+        RangeBounds result;
+        result.boundsMin = glm::min(a.boundsMin, b.boundsMin);
+        result.boundsMax = glm::max(a.boundsMax, b.boundsMax);
+        result.centroidMin = glm::min(a.centroidMin, b.centroidMin);
+        result.centroidMax = glm::max(a.centroidMax, b.centroidMax);
+        return result;
+    }
+
+    Bins CombineBins(const Bins& a, const Bins& b) {
+        Bins result;
+        for (int axis = 0; axis < 3; ++axis) {
+            for (int i = 0; i < TriangleBVH3D::BinCount; ++i) {
+                Bin& bin = result.axes[axis][i];
+                bin.boundsMin = glm::min(a.axes[axis][i].boundsMin, b.axes[axis][i].boundsMin);
+                bin.boundsMax = glm::max(a.axes[axis][i].boundsMax, b.axes[axis][i].boundsMax);
+                bin.count = a.axes[axis][i].count + b.axes[axis][i].count;
+            }
+        }
+        return result;
+    }
+}
+
+struct TriangleBVH3D::BuildContext {
+    explicit BuildContext(TaskScheduler& scheduler) : scheduler(scheduler) {}
+
+    TaskScheduler& scheduler;
+    std::vector<glm::vec3> primitiveMin;
+    std::vector<glm::vec3> primitiveMax;
+    std::vector<glm::vec3> centroids;
+    std::vector<uint32_t> order;
+    // A range of n triangles owns 2n - 1 slots from its node on, so the halves never share one
+    std::vector<BuildNode> buildNodes;
+
+    int BinIndex(uint32_t primitive, int axis, const RangeBounds& bounds) const {
+        float extent = bounds.centroidMax[axis] - bounds.centroidMin[axis];
+        float scaled = (centroids[primitive][axis] - bounds.centroidMin[axis]) / extent * static_cast<float>(BinCount);
+        return std::min(static_cast<int>(scaled), BinCount - 1);
+    }
+};
+
+TriangleBVH3D::TriangleBVH3D() : depth(0) {}
+
+void TriangleBVH3D::Clear() {
+    nodes.clear();
+    corners.clear();
+    triangleIds.clear();
+    depth = 0;
+}
+
+void TriangleBVH3D::Build(const std::vector<glm::vec3>& vertices, const std::vector<glm::uvec3>& triangles, TaskScheduler& scheduler) {
+    Clear();
+    size_t count = triangles.size();
+    if (count == 0) return;
+
+    BuildContext context(scheduler);
+    context.primitiveMin.resize(count);
+    context.primitiveMax.resize(count);
+    context.centroids.resize(count);
+    context.order.resize(count);
+    context.buildNodes.resize(2 * count - 1);
+    scheduler.ParallelFor(0, count, BoundsGrain, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            const glm::uvec3& tri = triangles[t];
+            context.primitiveMin[t] = glm::min(vertices[tri.x], glm::min(vertices[tri.y], vertices[tri.z]));
+            context.primitiveMax[t] = glm::max(vertices[tri.x], glm::max(vertices[tri.y], vertices[tri.z]));
+            context.centroids[t] = (context.primitiveMin[t] + context.primitiveMax[t]) * 0.5f;
+            context.order[t] = static_cast<uint32_t>(t);
+        }
+    });
+
+    BuildRange(context, 0, 0, static_cast<uint32_t>(count), 0);
+
+    // Depth-first copy that puts siblings next to each other and drops the unused slots
+    struct Pending {
+        uint32_t buildIndex;
+        uint32_t nodeIndex;
+        int level;
+    };
+    std::vector<Pending> pending;
+    pending.push_back({ 0, 0, 0 });
+    nodes.resize(1);
+    while (!pending.empty()) {
+        Pending current = pending.back();
+        pending.pop_back();
+        const BuildNode& source = context.buildNodes[current.buildIndex];
+        Node node;
+        node.boundsMin = source.boundsMin;
+        node.boundsMax = source.boundsMax;
+        node.count = source.count;
+        node.first = source.first;
+        depth = std::max(depth, current.level);
+        if (source.count == 0) {
+            node.first = static_cast<uint32_t>(nodes.size());
+            nodes.resize(nodes.size() + 2);
+            pending.push_back({ source.right, node.first + 1, current.level + 1 });
+            pending.push_back({ source.left, node.first, current.level + 1 });
+        }
+        nodes[current.nodeIndex] = node;
+    }
+
+    triangleIds.swap(context.order);
+    corners.resize(count * 3);
+    scheduler.ParallelFor(0, count, BoundsGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const glm::uvec3& tri = triangles[triangleIds[i]];
+            for (int corner = 0; corner < 3; ++corner) corners[i * 3 + corner] = vertices[tri[corner]];
+        }
+    });
+}
+
+void TriangleBVH3D::BuildRange(BuildContext& context, uint32_t nodeIndex, uint32_t begin, uint32_t end, int level) {
+    uint32_t count = end - begin;
+    bool parallel = count > ParallelThreshold;
+    auto boundsOf = [&](size_t first, size_t last) {
+        RangeBounds bounds;
+        for (size_t i = first; i < last; ++i) {
+            uint32_t primitive = context.order[i];
+            bounds.boundsMin = glm::min(bounds.boundsMin, context.primitiveMin[primitive]);
+            bounds.boundsMax = glm::max(bounds.boundsMax, context.primitiveMax[primitive]);
+            bounds.centroidMin = glm::min(bounds.centroidMin, context.centroids[primitive]);
+            bounds.centroidMax = glm::max(bounds.centroidMax, context.centroids[primitive]);
+        }
+        return bounds;
+    };
+    RangeBounds bounds = parallel
+        ? context.scheduler.ParallelReduce(size_t(begin), size_t(end), BoundsGrain, RangeBounds(), boundsOf, CombineBounds)
+        : boundsOf(begin, end);
+
+    BuildNode& node = context.buildNodes[nodeIndex];
+    node.boundsMin = bounds.boundsMin;
+    node.boundsMax = bounds.boundsMax;
+    node.first = begin;
+    node.count = count;
+    node.left = node.right = 0;
+    if (count == 1) return;
+
+    glm::vec3 centroidExtent = bounds.centroidMax - bounds.centroidMin;
+    int splitAxis = -1;
+    int splitBin = 0;
+    if (level < MaxSplitDepth && glm::any(glm::greaterThan(centroidExtent, glm::vec3(0.0f)))) {
+        auto binsOf = [&](size_t first, size_t last) {
+            Bins bins;
+            for (size_t i = first; i < last; ++i) {
+                uint32_t primitive = context.order[i];
+                for (int axis = 0; axis < 3; ++axis) {
+                    if (centroidExtent[axis] <= 0.0f) continue;
+                    Bin& bin = bins.axes[axis][context.BinIndex(primitive, axis, bounds)];
+                    bin.boundsMin = glm::min(bin.boundsMin, context.primitiveMin[primitive]);
+                    bin.boundsMax = glm::max(bin.boundsMax, context.primitiveMax[primitive]);
+                    ++bin.count;
+                }
+            }
+            return bins;
+        };
+        Bins bins = parallel
+            ? context.scheduler.ParallelReduce(size_t(begin), size_t(end), BoundsGrain, Bins(), binsOf, CombineBins)
+            : binsOf(begin, end);
+
+        // Sweep from the right for the suffix areas, then from the left evaluating each plane
+        float bestCost = std::numeric_limits<float>::max();
+        for (int axis = 0; axis < 3; ++axis) {
+            if (centroidExtent[axis] <= 0.0f) continue;
+            const Bin* axisBins = bins.axes[axis];
+            float rightCost[BinCount];
+            Bin right;
+            for (int i = BinCount - 1; i > 0; --i) {
+                right.boundsMin = glm::min(right.boundsMin, axisBins[i].boundsMin);
+                right.boundsMax = glm::max(right.boundsMax, axisBins[i].boundsMax);
+                right.count += axisBins[i].count;
+                rightCost[i] = right.count > 0 ? SurfaceArea(right.boundsMin, right.boundsMax) * right.count : 0.0f;
+            }
+            Bin left;
+            for (int i = 0; i < BinCount - 1; ++i) {
+                left.boundsMin = glm::min(left.boundsMin, axisBins[i].boundsMin);
+                left.boundsMax = glm::max(left.boundsMax, axisBins[i].boundsMax);
+                left.count += axisBins[i].count;
+                if (left.count == 0 || left.count == count) continue;
+                float cost = SurfaceArea(left.boundsMin, left.boundsMax) * left.count + rightCost[i + 1];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    splitAxis = axis;
+                    splitBin = i;
+                }
+            }
+        }
+
+        float area = SurfaceArea(bounds.boundsMin, bounds.boundsMax);
+        float splitCost = area > 0.0f ? TraversalCost + bestCost / area : 0.0f;
+        if (count <= MaxLeafSize && (splitAxis < 0 || static_cast<float>(count) <= splitCost)) return;
+    }
+    else if (count <= MaxLeafSize) {
+        return;
+    }
+
+    uint32_t* first = context.order.data() + begin;
+    uint32_t* last = context.order.data() + end;
+    uint32_t* middle = first;
+    if (splitAxis >= 0) {
+        middle = std::partition(first, last, [&](uint32_t primitive) {
+            return context.BinIndex(primitive, splitAxis, bounds) <= splitBin;
+        });
+    }
+    if (middle == first || middle == last) {
+        // Too deep or no usable plane: halve along the widest centroid axis
+        int axis = 0;
+        if (centroidExtent.y > centroidExtent[axis]) axis = 1;
+        if (centroidExtent.z > centroidExtent[axis]) axis = 2;
+        middle = first + count / 2;
+        std::nth_element(first, middle, last, [&](uint32_t a, uint32_t b) {
+            return context.centroids[a][axis] < context.centroids[b][axis] || (context.centroids[a][axis] == context.centroids[b][axis] && a < b);
+        });
+    }
+
+    uint32_t mid = begin + static_cast<uint32_t>(middle - first);
+    uint32_t leftIndex = nodeIndex + 1;
+    uint32_t rightIndex = nodeIndex + 2 * (mid - begin);
+    node.count = 0;
+    node.left = leftIndex;
+    node.right = rightIndex;
+    if (parallel) {
+        std::vector<TaskScheduler::Task> tasks;
+        tasks.push_back([&, leftIndex, begin, mid, level]() { BuildRange(context, leftIndex, begin, mid, level + 1); });
+        tasks.push_back([&, rightIndex, mid, end, level]() { BuildRange(context, rightIndex, mid, end, level + 1); });
+        context.scheduler.RunAll(tasks);
+    }
+    else {
+        BuildRange(context, leftIndex, begin, mid, level + 1);
+        BuildRange(context, rightIndex, mid, end, level + 1);
+    }
+}
+
+float TriangleBVH3D::SqrDistanceToBox(const glm::vec3& point, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    glm::vec3 outside = glm::max(glm::max(boundsMin - point, point - boundsMax), glm::vec3(0.0f));
+    return glm::dot(outside, outside);
+}
+
+bool TriangleBVH3D::FindClosest(const glm::vec3& point, float bestSqrDistance, Hit& hit) const {
+    if (nodes.empty()) return false;
+    struct Entry {
+        uint32_t node;
+        float sqrDistance;
+    };
+    Entry stack[TraversalStackSize];
+    int stackSize = 0;
+    bool found = false;
+
+    uint32_t index = 0;
+    if (SqrDistanceToBox(point, nodes[0].boundsMin, nodes[0].boundsMax) >= bestSqrDistance) return false;
+    while (true) {
+        const Node& node = nodes[index];
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                int feature = 0;
+                glm::vec3 closest = MeshDistance3D::ClosestPointOnTriangle(point, corners[i * 3], corners[i * 3 + 1], corners[i * 3 + 2], feature);
+                glm::vec3 delta = point - closest;
+                float sqrDistance = glm::dot(delta, delta);
+                if (sqrDistance < bestSqrDistance) {
+                    bestSqrDistance = sqrDistance;
+                    hit.triangle = triangleIds[i];
+                    hit.feature = feature;
+                    hit.point = closest;
+                    hit.sqrDistance = sqrDistance;
+                    found = true;
+                }
+            }
+        }
+        else {
+            // Nearer child first; the other waits on the stack with its distance
+            uint32_t nearChild = node.first;
+            uint32_t farChild = node.first + 1;
+            float nearDistance = SqrDistanceToBox(point, nodes[nearChild].boundsMin, nodes[nearChild].boundsMax);
+            float farDistance = SqrDistanceToBox(point, nodes[farChild].boundsMin, nodes[farChild].boundsMax);
+            if (farDistance < nearDistance) {
+                std::swap(nearChild, farChild);
+                std::swap(nearDistance, farDistance);
+            }
+            if (nearDistance < bestSqrDistance) {
+                if (farDistance < bestSqrDistance && stackSize < TraversalStackSize) stack[stackSize++] = { farChild, farDistance };
+                index = nearChild;
+                continue;
+            }
+        }
+
+        // Next waiting node that can still hold something closer
+        bool next = false;
+        while (stackSize > 0) {
+            Entry entry = stack[--stackSize];
+            if (entry.sqrDistance < bestSqrDistance) {
+                index = entry.node;
+                next = true;
+                break;
+            }
+        }
+        if (!next) return found;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef TRIANGLE_BVH_3D_H
+#define TRIANGLE_BVH_3D_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "TaskScheduler.h"
+
+// Bounding volume hierarchy over a triangle soup for closest-point queries.
+// Built top-down with a binned surface area heuristic; ranges above ParallelThreshold are binned
+// with ParallelReduce and their two halves built as separate tasks. The node layout only depends
+// on the input, never on the thread count. Leaves keep copies of their corners, so a query only
+// touches the nodes and corners it visits.
+class TriangleBVH3D {
+public:
+    struct Node {
+        glm::vec3 boundsMin;
+        // Leaf: first triangle in leaf order. Inner node: the left child; the right one follows it
+        uint32_t first;
+        glm::vec3 boundsMax;
+        // Triangles in a leaf, 0 for inner nodes
+        uint32_t count;
+    };
+
+    // Closest point found by a query, with the triangle in input order and its feature code
+    // (see MeshDistance3D::ClosestPointOnTriangle).
+    struct Hit {
+        uint32_t triangle = 0;
+        int feature = 0;
+        glm::vec3 point = glm::vec3(0.0f);
+        float sqrDistance = 0.0f;
+    };
+
+    TriangleBVH3D();
+
+    void Build(const std::vector<glm::vec3>& vertices, const std::vector<glm::uvec3>& triangles, TaskScheduler& scheduler = TaskScheduler::Instance());
+    void Clear();
+
+    // Searches for a triangle closer than sqrt(bestSqrDistance). On success fills hit and returns
+    // true; pass a known distance, e.g. to a neighbour's closest triangle, to prune the search.
+    bool FindClosest(const glm::vec3& point, float bestSqrDistance, Hit& hit) const;
+
+    bool IsEmpty() const { return nodes.empty(); }
+    const std::vector<Node>& GetNodes() const { return nodes; }
+    size_t GetTriangleCount() const { return triangleIds.size(); }
+    int GetDepth() const { return depth; }
+
+    static const int BinCount = 16;
+    static const int MaxLeafSize = 8;
+    // Deeper ranges are split at their median, which bounds the traversal stack
+    static const int MaxSplitDepth = 48;
+    static const size_t ParallelThreshold = 16384;
+
+private:
+    struct BuildNode {
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        uint32_t first;
+        uint32_t count;
+        uint32_t left;
+        uint32_t right;
+    };
+
+    struct BuildContext;
+
+    void BuildRange(BuildContext& context, uint32_t nodeIndex, uint32_t begin, uint32_t end, int level);
+    static float SqrDistanceToBox(const glm::vec3& point, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+    std::vector<Node> nodes;
+    // Three corners per triangle, in leaf order
+    std::vector<glm::vec3> corners;
+    std::vector<uint32_t> triangleIds;
+    int depth;
+};
+
+#endif // TRIANGLE_BVH_3D_H
@@ -0,0 +1,309 @@
+#include "TriangleMesh3D.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#include "MemoryMappedFile.h"
+#include "RadixSort.h"
+
+namespace {
+    const size_t TriangleGrain = 4096;
+
+    // Cursor over one line of an OBJ file; tokens are separated by blanks
+    struct ObjLine {
+        const char* current;
+        const char* end;
+
+        void SkipBlanks() {
+            while (current < end && (*current == ' ' || *current == '\t' || *current == '\r')) ++current;
+        }
+
+        bool NextToken(const char*& tokenBegin, const char*& tokenEnd) {
+            SkipBlanks();
+            tokenBegin = current;
+            while (current < end && *current != ' ' && *current != '\t' && *current != '\r') ++current;
+            tokenEnd = current;
+            return tokenEnd > tokenBegin;
+        }
+
+        bool NextFloat(float& value) {
+            const char* tokenBegin;
+            const char* tokenEnd;
+            if (!NextToken(tokenBegin, tokenEnd)) return false;
+            // strtof needs a terminated string and the mapped file has none
+            char buffer[64];
+            size_t length = std::min(static_cast<size_t>(tokenEnd - tokenBegin), sizeof(buffer) - 1);
+            std::copy(tokenBegin, tokenBegin + length, buffer);
+            buffer[length] = '\0';
+            char* parsedEnd = nullptr;
+            value = std::strtof(buffer, &parsedEnd);
+            return parsedEnd == buffer + length && std::isfinite(value);
+        }
+    };
+
+    // Vertex of a face corner ("v", "v/vt", "v//vn" or "v/vt/vn"); negative indices count back from the last vertex
+    bool ParseCorner(const char* tokenBegin, const char* tokenEnd, size_t vertexCount, uint32_t& index) {
+        bool negative = tokenBegin < tokenEnd && *tokenBegin == '-';
+        if (negative) ++tokenBegin;
+        long long value = 0;
+        const char* digit = tokenBegin;
+        while (digit < tokenEnd && *digit >= '0' && *digit <= '9' && value < (1ll << 40)) value = value * 10 + (*digit++ - '0');
+        if (digit == tokenBegin || (digit < tokenEnd && *digit != '/') || value == 0) return false;
+        long long resolved = negative ? static_cast<long long>(vertexCount) - value : value - 1;
+        if (resolved < 0 || resolved > 0xFFFFFFFEll) return false;
+        index = static_cast<uint32_t>(resolved);
+        return true;
+    }
+}
+
+TriangleMesh3D::TriangleMesh3D(std::vector<glm::vec3> vertices, std::vector<glm::uvec3> triangles)
+    : vertices(std::move(vertices)), triangles(std::move(triangles)), boundsMin(0.0f), boundsMax(0.0f) {
+    if (this->vertices.empty()) return;
+    boundsMin = boundsMax = this->vertices[0];
+    for (const glm::vec3& vertex : this->vertices) {
+        boundsMin = glm::min(boundsMin, vertex);
+        boundsMax = glm::max(boundsMax, vertex);
+    }
+}
+
+std::shared_ptr<TriangleMesh3D> TriangleMesh3D::LoadObj(const std::string& path, std::string& error) {
+    MemoryMappedFile file;
+    if (!file.Open(path)) {
+        error = "cannot open " + path;
+        return nullptr;
+    }
+
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::uvec3> triangles;
+    std::vector<uint32_t> polygon;
+    const char* data = reinterpret_cast<const char*>(file.GetData());
+    const char* fileEnd = data + file.GetSize();
+    size_t lineNumber = 0;
+    for (const char* lineBegin = data; lineBegin < fileEnd; ) {
+        const char* lineEnd = std::find(lineBegin, fileEnd, '\n');
+        ++lineNumber;
+        ObjLine line = { lineBegin, lineEnd };
+        lineBegin = lineEnd < fileEnd ? lineEnd + 1 : fileEnd;
+
+        const char* keyBegin;
+        const char* keyEnd;
+        if (!line.NextToken(keyBegin, keyEnd) || *keyBegin == '#') continue;
+        std::string key(keyBegin, keyEnd);
+        if (key == "v") {
+            glm::vec3 vertex;
+            if (!line.NextFloat(vertex.x) || !line.NextFloat(vertex.y) || !line.NextFloat(vertex.z)) {
+                error = path + ":" + std::to_string(lineNumber) + ": a vertex needs three numbers";
+                return nullptr;
+            }
+            vertices.push_back(vertex);
+        }
+        else if (key == "f") {
+            polygon.clear();
+            const char* tokenBegin;
+            const char* tokenEnd;
+            while (line.NextToken(tokenBegin, tokenEnd)) {
+                uint32_t index = 0;
+                if (!ParseCorner(tokenBegin, tokenEnd, vertices.size(), index)) {
+                    error = path + ":" + std::to_string(lineNumber) + ": invalid face corner '" + std::string(tokenBegin, tokenEnd) + "'";
+                    return nullptr;
+                }
+                polygon.push_back(index);
+            }
+            if (polygon.size() < 3) {
+                error = path + ":" + std::to_string(lineNumber) + ": a face needs at least three corners";
+                return nullptr;
+            }
+            for (size_t corner = 2; corner < polygon.size(); ++corner) {
+                triangles.push_back(glm::uvec3(polygon[0], polygon[corner - 1], polygon[corner]));
+            }
+        }
+    }
+
+    std::shared_ptr<TriangleMesh3D> mesh = std::make_shared<TriangleMesh3D>(std::move(vertices), std::move(triangles));
+    if (!mesh->Validate(error)) {
+        error = path + ": " + error;
+        return nullptr;
+    }
+    return mesh;
+}
+
+std::vector<glm::vec3> TriangleMesh3D::Place(const glm::vec3& centre, const glm::vec3& size) const {
+    // Uniform scale, so the shape keeps its proportions; flat axes do not limit it
+    glm::vec3 extent = boundsMax - boundsMin;
+    float scale = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; ++axis) {
+        if (extent[axis] > 0.0f) scale = std::min(scale, size[axis] / extent[axis]);
+    }
+    if (scale == std::numeric_limits<float>::max()) scale = 1.0f;
+    glm::vec3 meshCentre = (boundsMin + boundsMax) * 0.5f;
+
+    std::vector<glm::vec3> placed(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) placed[i] = centre + (vertices[i] - meshCentre) * scale;
+    return placed;
+}
+
+bool TriangleMesh3D::Validate(std::string& error) const {
+    if (triangles.empty()) {
+        error = "the mesh has no triangles";
+        return false;
+    }
+    for (size_t t = 0; t < triangles.size(); ++t) {
+        for (int corner = 0; corner < 3; ++corner) {
+            if (triangles[t][corner] >= vertices.size()) {
+                error = "triangle " + std::to_string(t) + " uses vertex " + std::to_string(triangles[t][corner]) + " of " + std::to_string(vertices.size());
+                return false;
+            }
+        }
+    }
+    error.clear();
+    return true;
+}
+
+MeshDistance3D::MeshDistance3D(const TriangleMesh3D& mesh, const glm::vec3& centre, const glm::vec3& size, TaskScheduler& scheduler)
+    : vertices(mesh.Place(centre, size)), triangles(mesh.GetTriangles()), boundsMin(centre), boundsMax(centre) {
+    for (const glm::vec3& vertex : vertices) {
+        boundsMin = glm::min(boundsMin, vertex);
+        boundsMax = glm::max(boundsMax, vertex);
+    }
+
+    ComputePseudonormals(scheduler);
+    bvh.Build(vertices, triangles, scheduler);
+}
+
+void MeshDistance3D::ComputePseudonormals(TaskScheduler& scheduler) {
+    size_t count = triangles.size();
+    faceNormals.resize(count);
+    edgeNormals.assign(count * 3, glm::vec3(0.0f));
+    vertexNormals.assign(vertices.size(), glm::vec3(0.0f));
+
+    // Face normals and each corner's angle-weighted share of its vertex normal
+    std::vector<glm::vec3> cornerShares(count * 3);
+    scheduler.ParallelFor(0, count, TriangleGrain, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            const glm::uvec3& tri = triangles[t];
+            glm::vec3 normal = glm::cross(vertices[tri.y] - vertices[tri.x], vertices[tri.z] - vertices[tri.x]);
+            float length = glm::length(normal);
+            faceNormals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+            for (int corner = 0; corner < 3; ++corner) {
+                glm::vec3 toNext = vertices[tri[(corner + 1) % 3]] - vertices[tri[corner]];
+                glm::vec3 toPrevious = vertices[tri[(corner + 2) % 3]] - vertices[tri[corner]];
+                float lengths = glm::length(toNext) * glm::length(toPrevious);
+                float angle = lengths > 0.0f ? std::acos(glm::clamp(glm::dot(toNext, toPrevious) / lengths, -1.0f, 1.0f)) : 0.0f;
+                cornerShares[t * 3 + corner] = angle * faceNormals[t];
+            }
+        }
+    });
+    for (size_t t = 0; t < count; ++t) {
+        for (int corner = 0; corner < 3; ++corner) vertexNormals[triangles[t][corner]] += cornerShares[t * 3 + corner];
+    }
+
+    // Edge normals: the half edges are sorted by their lower vertex, so the ones of an edge land in
+    // the same short run, where they are matched by their upper vertex
+    std::vector<uint32_t> lowerVertices(count * 3);
+    std::vector<uint32_t> halfEdges(count * 3);
+    auto upperVertex = [&](uint32_t halfEdge) {
+        const glm::uvec3& tri = triangles[halfEdge / 3];
+        return std::max(tri[halfEdge % 3], tri[(halfEdge % 3 + 1) % 3]);
+    };
+    scheduler.ParallelFor(0, count, TriangleGrain, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            for (int corner = 0; corner < 3; ++corner) {
+                lowerVertices[t * 3 + corner] = std::min(triangles[t][corner], triangles[t][(corner + 1) % 3]);
+                halfEdges[t * 3 + corner] = static_cast<uint32_t>(t * 3 + corner);
+            }
+        }
+    });
+    RadixSort(scheduler).Sort(lowerVertices, halfEdges);
+    for (size_t runBegin = 0; runBegin < halfEdges.size(); ) {
+        size_t runEnd = runBegin + 1;
+        while (runEnd < halfEdges.size() && lowerVertices[runEnd] == lowerVertices[runBegin]) ++runEnd;
+        for (size_t i = runBegin; i < runEnd; ++i) {
+            uint32_t upper = upperVertex(halfEdges[i]);
+            glm::vec3 sum(0.0f);
+            for (size_t j = runBegin; j < runEnd; ++j) {
+                if (upperVertex(halfEdges[j]) == upper) sum += faceNormals[halfEdges[j] / 3];
+            }
+            edgeNormals[halfEdges[i]] = sum;
+        }
+        runBegin = runEnd;
+    }
+}
+
+glm::vec3 MeshDistance3D::ClosestPointOnTriangle(const glm::vec3& point, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, int& feature) {
+    // Voronoi regions of the triangle, after Ericson, Real-Time Collision Detection 5.1.5
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 ap = point - a;
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) { feature = 4; return a; }
+
+    glm::vec3 bp = point - b;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) { feature = 5; return b; }
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) { feature = 1; return a + ab * (d1 / (d1 - d3)); }
+
+    glm::vec3 cp = point - c;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) { feature = 6; return c; }
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) { feature = 3; return a + ac * (d2 / (d2 - d6)); }
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) { feature = 2; return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))); }
+
+    float denominator = va + vb + vc;
+    if (denominator <= 0.0f) { feature = 4; return a; }
+    feature = 0;
+    return a + ab * (vb / denominator) + ac * (vc / denominator);
+}
+
+glm::vec3 MeshDistance3D::Pseudonormal(size_t triangle, int feature) const {
+    if (feature == 0) return faceNormals[triangle];
+    if (feature <= 3) return edgeNormals[triangle * 3 + (feature - 1)];
+    return vertexNormals[triangles[triangle][feature - 4]];
+}
+
+float MeshDistance3D::DistanceToTriangle(const glm::vec3& point, uint32_t triangle) const {
+    const glm::uvec3& tri = triangles[triangle];
+    int feature = 0;
+    return glm::length(point - ClosestPointOnTriangle(point, vertices[tri.x], vertices[tri.y], vertices[tri.z], feature));
+}
+
+float MeshDistance3D::SignedDistance(const glm::vec3& point) const {
+    uint32_t hint = NoHint;
+    float distance = std::numeric_limits<float>::max();
+    SignedDistanceWithin(point, std::numeric_limits<float>::max(), hint, distance);
+    return distance;
+}
+
+bool MeshDistance3D::SignedDistanceWithin(const glm::vec3& point, float maxDistance, uint32_t& hint, float& distance) const {
+    TriangleBVH3D::Hit hit;
+    float bestSqrDistance = maxDistance < std::sqrt(std::numeric_limits<float>::max()) ? maxDistance * maxDistance : std::numeric_limits<float>::max();
+    bool found = false;
+    if (hint < triangles.size()) {
+        const glm::uvec3& tri = triangles[hint];
+        glm::vec3 closest = ClosestPointOnTriangle(point, vertices[tri.x], vertices[tri.y], vertices[tri.z], hit.feature);
+        float sqrDistance = glm::dot(point - closest, point - closest);
+        if (sqrDistance < bestSqrDistance) {
+            hit.triangle = hint;
+            hit.point = closest;
+            hit.sqrDistance = bestSqrDistance = sqrDistance;
+            found = true;
+        }
+    }
+    // Only a strictly closer triangle replaces the hint
+    found = bvh.FindClosest(point, bestSqrDistance, hit) || found;
+    if (!found) return false;
+    hint = hit.triangle;
+
+    distance = std::sqrt(hit.sqrDistance);
+    if (glm::dot(point - hit.point, Pseudonormal(hit.triangle, hit.feature)) < 0.0f) distance = -distance;
+    return true;
+}
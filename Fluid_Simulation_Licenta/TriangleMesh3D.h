@@ -0,0 +1,83 @@
+#ifndef TRIANGLE_MESH_3D_H
+#define TRIANGLE_MESH_3D_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "TaskScheduler.h"
+#include "TriangleBVH3D.h"
+
+// Indexed triangle mesh used as obstacle geometry, in its own model space.
+// Triangles wind counter-clockwise seen from outside the solid.
+class TriangleMesh3D {
+public:
+    TriangleMesh3D(std::vector<glm::vec3> vertices, std::vector<glm::uvec3> triangles);
+
+    // Reads the vertices and faces of a Wavefront OBJ file; polygons are split into fans and
+    // texture coordinates, normals and groups are ignored. Returns null with the reason in error.
+    static std::shared_ptr<TriangleMesh3D> LoadObj(const std::string& path, std::string& error);
+
+    // False (with the reason in error) for meshes without triangles or with indices past the vertices.
+    bool Validate(std::string& error) const;
+
+    // Vertices scaled uniformly to fit size and centred on centre, the way obstacles are placed.
+    std::vector<glm::vec3> Place(const glm::vec3& centre, const glm::vec3& size) const;
+
+    const std::vector<glm::vec3>& GetVertices() const { return vertices; }
+    const std::vector<glm::uvec3>& GetTriangles() const { return triangles; }
+    const glm::vec3& GetBoundsMin() const { return boundsMin; }
+    const glm::vec3& GetBoundsMax() const { return boundsMax; }
+
+private:
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::uvec3> triangles;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
+
+// Signed distance to a mesh placed like an obstacle: scaled uniformly to fit size and centred
+// on centre. Negative inside. The sign comes from the angle-weighted pseudonormal of the closest
+// face, edge or vertex, which is exact for closed, consistently wound meshes. The closest triangle
+// is found through a TriangleBVH3D built over the placed mesh.
+class MeshDistance3D {
+public:
+    MeshDistance3D(const TriangleMesh3D& mesh, const glm::vec3& centre, const glm::vec3& size, TaskScheduler& scheduler = TaskScheduler::Instance());
+
+    float SignedDistance(const glm::vec3& point) const;
+    // Signed distance if a triangle is closer than maxDistance. The search starts from the distance
+    // to triangle hint and stores the closest triangle back in it: neighbouring points usually
+    // share it, so walking a grid with one hint prunes most of the hierarchy.
+    bool SignedDistanceWithin(const glm::vec3& point, float maxDistance, uint32_t& hint, float& distance) const;
+    // Unsigned distance to one triangle.
+    float DistanceToTriangle(const glm::vec3& point, uint32_t triangle) const;
+    const glm::vec3& GetBoundsMin() const { return boundsMin; }
+    const glm::vec3& GetBoundsMax() const { return boundsMax; }
+
+    // Closest point of triangle abc to point. feature is 0 for the face, 1-3 for the edges ab, bc
+    // and ca, and 4-6 for the vertices a, b and c.
+    static glm::vec3 ClosestPointOnTriangle(const glm::vec3& point, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, int& feature);
+
+    const TriangleBVH3D& GetBVH() const { return bvh; }
+    size_t GetTriangleCount() const { return triangles.size(); }
+
+    static const uint32_t NoHint = 0xFFFFFFFFu;
+
+private:
+    glm::vec3 Pseudonormal(size_t triangle, int feature) const;
+    void ComputePseudonormals(TaskScheduler& scheduler);
+
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::uvec3> triangles;
+    std::vector<glm::vec3> faceNormals;
+    // Three per triangle, for its edges ab, bc and ca
+    std::vector<glm::vec3> edgeNormals;
+    std::vector<glm::vec3> vertexNormals;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    TriangleBVH3D bvh;
+};
+
+#endif // TRIANGLE_MESH_3D_H
@@ -0,0 +1,30 @@
+// boundarySdf_3D.glsl
+// Baked signed distance to the walls and obstacles (BoundarySDF3D), bound by BoundaryTexture3D.
+// Texels hold the unit normal into the fluid in xyz and the distance, positive in the fluid, in w.
+uniform sampler3D boundarySdf;
+uniform vec3 boundarySdfOrigin;
+uniform vec3 boundarySdfExtent;
+uniform float boundarySdfSpacing;
+
+// One filtered fetch; past the edge of the grid the distance keeps falling, as in BoundarySDF3D::Sample
+vec4 SampleBoundary(vec3 position) {
+    vec3 first = boundarySdfOrigin + 0.5 * boundarySdfSpacing;
+    vec3 last = boundarySdfOrigin + boundarySdfExtent - 0.5 * boundarySdfSpacing;
+    vec3 clamped = clamp(position, first, last);
+    vec4 boundary = texture(boundarySdf, (clamped - boundarySdfOrigin) / boundarySdfExtent);
+    boundary.w -= length(position - clamped);
+    return boundary;
+}
+
+// Same rule as BoundarySDF3D::ResolveContact
+void ResolveBoundaryContact(inout vec3 position, inout vec3 velocity, float damping) {
+    vec4 boundary = SampleBoundary(position);
+    if (boundary.w >= 0.0) return;
+    float normalLength = length(boundary.xyz);
+    if (normalLength <= 0.0) return;
+    vec3 normal = boundary.xyz / normalLength;
+
+    position -= normal * boundary.w;
+    float normalSpeed = dot(velocity, normal);
+    if (normalSpeed < 0.0) velocity -= (1.0 + damping) * normalSpeed * normal;
+}
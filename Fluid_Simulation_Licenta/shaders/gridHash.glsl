@@ -29,6 +29,7 @@ uint HashCell2D(vec2 cell) {
     return a + b;
 }
 
+// The table uses the largest power of two that fits in tableSize, so the key is a mask instead of a division
 uint KeyFromHash(uint hash, uint tableSize) {
-    return hash % tableSize;
+    return hash & ((1u << findMSB(tableSize)) - 1u);
 }
\ No newline at end of file
@@ -31,6 +31,11 @@ uint HashCell3D(ivec3 cell) {
     return a + b + c;
 }
 
+// Key of the spatial entries in slots past the live particles: it sorts after every real key and
+// gets no offset, so the sort can run over the whole capacity without knowing the count
+const uint EmptyKey = 0xFFFFFFFFu;
+
+// The table uses the largest power of two that fits in tableSize, so the key is a mask instead of a division
 uint KeyFromHash(uint hash, uint tableSize) {
-    return hash % tableSize;
+    return hash & ((1u << findMSB(tableSize)) - 1u);
 }
@@ -0,0 +1,14 @@
+// particleCount_3D.glsl
+// Live particle count, kept on the GPU so emitters and sinks can change it without a readback.
+// The first three words are the glDispatchComputeIndirect arguments for the simulation kernels
+// and the last four a glDrawArraysIndirect command; ParticleBuffers3D owns the buffer.
+layout(std430, binding = 7) buffer ParticleCountBuffer {
+    uint dispatchGroupsX;
+    uint dispatchGroupsY;
+    uint dispatchGroupsZ;
+    uint numParticles;
+    uint drawCount;
+    uint drawInstanceCount;
+    uint drawFirst;
+    uint drawBaseInstance;
+};
@@ -0,0 +1,22 @@
+// philox.glsl
+// Philox4x32-10, the GLSL twin of Philox.h. Same counter and key give the same four words on both sides.
+uvec4 Philox4x32(uvec4 counter, uvec2 key) {
+    const uint M0 = 0xD2511F53u;
+    const uint M1 = 0xCD9E8D57u;
+    const uint W0 = 0x9E3779B9u;
+    const uint W1 = 0xBB67AE85u;
+
+    for (int round = 0; round < 10; ++round) {
+        uint hi0, lo0, hi1, lo1;
+        umulExtended(M0, counter.x, hi0, lo0);
+        umulExtended(M1, counter.z, hi1, lo1);
+        counter = uvec4(hi1 ^ counter.y ^ key.x, lo1, hi0 ^ counter.w ^ key.y, lo0);
+        key += uvec2(W0, W1);
+    }
+    return counter;
+}
+
+// Uniform float in [0, 1) from the top 24 bits
+float ToUnitFloat(uint value) {
+    return float(value >> 8) * (1.0 / 16777216.0);
+}